@@ -0,0 +1,270 @@
+/* ┌──────────────────────────────────┐
+   │ Host benchmark: color kernels    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <app/color_kernels.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Benchmark config                       │
+   └────────────────────────────────────────┘ */
+
+#define BENCH_NB_FIXTURES  128  /* Color fixtures converted per batch */
+#define BENCH_NB_BATCHES   100000
+
+#define BENCH_HSV_TOLERANCE 2   /* Against the floating point formula */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Bench_Fixture {
+	uint16_t hue;
+	uint8_t  sat;
+	uint8_t  val;
+	uint8_t  rgb[3];
+	uint8_t  amber;
+	uint8_t  white;
+};
+
+static struct Bench_Fixture       fixtures[BENCH_NB_FIXTURES];
+static const struct Color_Matrix  mat   = {{ {240, 16, 0}, {8, 232, 16}, {0, 12, 244} }};
+static const struct Color_Emitter white = COLOR_EMITTER(255, 255, 255);
+static const struct Color_Emitter amber = COLOR_EMITTER(255, 191, 0  );
+static volatile uint32_t          sink;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint64_t __bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void __bench_fixtures_init(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < BENCH_NB_FIXTURES; i++) {
+		fixtures[i].hue = (uint16_t)((i * 97) % COLOR_HUE_MAX);
+		fixtures[i].sat = (uint8_t)(128 + (i * 13) % 128);
+		fixtures[i].val = (uint8_t)(64 + (i * 29) % 192);
+	}
+}
+
+/* The batch is rerun with a different hue each time, so that it is not hoisted */
+
+static uint64_t __bench_hsv(void)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t batch;
+	uint32_t i;
+
+	for(batch = 0; batch < BENCH_NB_BATCHES; batch++) {
+		for(i = 0; i < BENCH_NB_FIXTURES; i++) {
+			struct Bench_Fixture *fx = &fixtures[i];
+			color_hsv_to_rgb((fx->hue + batch) % COLOR_HUE_MAX, fx->sat, fx->val, fx->rgb);
+		}
+		sink = fixtures[batch % BENCH_NB_FIXTURES].rgb[0];
+	}
+
+	return __bench_now_ns() - start;
+}
+
+static uint64_t __bench_calibrate(void)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t batch;
+	uint32_t i;
+
+	for(batch = 0; batch < BENCH_NB_BATCHES; batch++) {
+		for(i = 0; i < BENCH_NB_FIXTURES; i++) {
+			uint8_t in[3] = { fixtures[i].rgb[0], fixtures[i].rgb[1], (uint8_t)(fixtures[i].rgb[2] ^ batch) };
+			color_calibrate(&mat, in, fixtures[i].rgb);
+		}
+		sink = fixtures[batch % BENCH_NB_FIXTURES].rgb[1];
+	}
+
+	return __bench_now_ns() - start;
+}
+
+static uint64_t __bench_extract(void)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t batch;
+	uint32_t i;
+
+	for(batch = 0; batch < BENCH_NB_BATCHES; batch++) {
+		for(i = 0; i < BENCH_NB_FIXTURES; i++) {
+			uint8_t rgb[3] = { (uint8_t)(i + batch), (uint8_t)(i * 3 + batch), (uint8_t)(i * 7 + batch) };
+			fixtures[i].white = color_extract(&white, rgb);
+		}
+		sink = fixtures[batch % BENCH_NB_FIXTURES].white;
+	}
+
+	return __bench_now_ns() - start;
+}
+
+/* As app/color.c: HSV, calibration, amber then white */
+
+static uint64_t __bench_pipeline(void)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t batch;
+	uint32_t i;
+
+	for(batch = 0; batch < BENCH_NB_BATCHES; batch++) {
+		for(i = 0; i < BENCH_NB_FIXTURES; i++) {
+			struct Bench_Fixture *fx = &fixtures[i];
+			uint8_t               in[3];
+
+			color_hsv_to_rgb((fx->hue + batch) % COLOR_HUE_MAX, fx->sat, fx->val, in);
+			color_calibrate(&mat, in, fx->rgb);
+			fx->amber = color_extract(&amber, fx->rgb);
+			fx->white = color_extract(&white, fx->rgb);
+		}
+		sink = fixtures[batch % BENCH_NB_FIXTURES].white;
+	}
+
+	return __bench_now_ns() - start;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Checks                                 │
+   └────────────────────────────────────────┘ */
+
+static int __bench_check_div255(void)
+{
+	uint32_t x;
+
+	for(x = 0; x <= 0xFFFF; x++) {
+		if(color_div255(x) != (2 * x + 255) / 510) {
+			printf("check div255 x=%u got=%u FAILED\n", x, color_div255(x));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int __bench_check_hsv(void)
+{
+	uint32_t hue, sat, val, c;
+	int      worst = 0;
+
+	for(hue = 0; hue < COLOR_HUE_MAX; hue++) {
+		for(sat = 0; sat < 256; sat += 5) {
+			for(val = 0; val < 256; val += 5) {
+				double  h = hue / (double)COLOR_HUE_SECTOR;
+				double  s = sat / 255.0;
+				double  v = val / 255.0;
+				int     sector = (int)h;
+				double  f = h - sector;
+				double  p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+				double  ref[6][3] = { {v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q} };
+				uint8_t rgb[3];
+
+				color_hsv_to_rgb(hue, sat, val, rgb);
+
+				for(c = 0; c < 3; c++) {
+					int err = abs((int)rgb[c] - (int)(ref[sector][c] * 255.0 + 0.5));
+					if(err > worst) worst = err;
+				}
+			}
+		}
+	}
+
+	if(worst > BENCH_HSV_TOLERANCE) {
+		printf("check hsv worst=%d FAILED\n", worst);
+		return 0;
+	}
+
+	printf("check hsv worst=%d ok\n", worst);
+	return 1;
+}
+
+/* The emitter and what is left add up to the input, and the emitter
+   takes all it can: one channel it is part of is left (nearly) empty. */
+
+static int __bench_check_extract(const struct Color_Emitter *em, const char *name)
+{
+	uint32_t r, g, b, c;
+
+	for(r = 0; r < 256; r += 3) {
+		for(g = 0; g < 256; g += 3) {
+			for(b = 0; b < 256; b += 3) {
+				uint8_t in [3] = { (uint8_t)r, (uint8_t)g, (uint8_t)b };
+				uint8_t out[3] = { (uint8_t)r, (uint8_t)g, (uint8_t)b };
+				uint8_t level  = color_extract(em, out);
+				int     empty  = 0;
+
+				for(c = 0; c < 3; c++) {
+					int sum = out[c] + (int)color_div255(level * em->rgb[c]);
+					if(abs(sum - in[c]) > 1) {
+						printf("check extract %s rgb=%u,%u,%u FAILED\n", name, r, g, b);
+						return 0;
+					}
+					if(em->rgb[c] && (out[c] <= 2)) empty = 1;
+				}
+
+				if(!empty && (level < 255)) {
+					printf("check extract %s rgb=%u,%u,%u not maximal FAILED\n", name, r, g, b);
+					return 0;
+				}
+			}
+		}
+	}
+
+	printf("check extract %s ok\n", name);
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+int main(void)
+{
+	uint64_t hsv_ns;
+	uint64_t calibrate_ns;
+	uint64_t extract_ns;
+	uint64_t pipeline_ns;
+	double   per_fixture = (double)BENCH_NB_BATCHES * BENCH_NB_FIXTURES;
+
+	if(!__bench_check_div255()) return EXIT_FAILURE;
+	printf("check div255 ok\n");
+
+	if(!__bench_check_hsv    ()              ) return EXIT_FAILURE;
+	if(!__bench_check_extract(&white, "white")) return EXIT_FAILURE;
+	if(!__bench_check_extract(&amber, "amber")) return EXIT_FAILURE;
+
+	__bench_fixtures_init();
+	hsv_ns       = __bench_hsv      ();
+	calibrate_ns = __bench_calibrate();
+	extract_ns   = __bench_extract  ();
+	pipeline_ns  = __bench_pipeline ();
+
+	printf("bench color fixtures=%u batches=%u hsv_ns=%.2f calibrate_ns=%.2f extract_ns=%.2f pipeline_ns=%.2f (per fixture)\n",
+		BENCH_NB_FIXTURES, BENCH_NB_BATCHES,
+		hsv_ns / per_fixture, calibrate_ns / per_fixture, extract_ns / per_fixture, pipeline_ns / per_fixture
+	);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/* ┌──────────────────────────────────┐
+   │ Host benchmark: CRC-32 kernel    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <io/crc_kernels.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Benchmark config                       │
+   └────────────────────────────────────────┘ */
+
+#define BENCH_BUFFER_SIZE  2048 /* A flash page, as checked by the loader     */
+#define BENCH_NB_BUFFERS   20000
+#define BENCH_NB_CHECKS    1000 /* Random buffers checked against the reference */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+static uint8_t           buffer[BENCH_BUFFER_SIZE];
+static volatile uint32_t sink;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint64_t __bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Bit by bit, straight from the definition */
+
+static uint32_t __bench_crc_reference(const uint8_t *data, uint32_t length)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	uint32_t i_bit;
+
+	while(length--) {
+		crc ^= *data++;
+		for(i_bit = 0; i_bit < 8; i_bit++) crc = (crc >> 1) ^ ((crc & 1) ? CRC32_REFLECTED : 0);
+	}
+
+	return ~crc;
+}
+
+/* As the hardware unit computes it: unreflected state, bits of each
+   byte fed from the lowest one (input reversal) */
+
+static uint32_t __bench_crc_unit(uint32_t crc, const uint8_t *data, uint32_t length)
+{
+	uint32_t state = crc32_reflect(~crc);
+	uint32_t i_bit;
+
+	while(length--) {
+		state ^= crc32_reflect(*data++);
+		for(i_bit = 0; i_bit < 8; i_bit++) state = (state << 1) ^ ((state & 0x80000000UL) ? CRC32_POLYNOMIAL : 0);
+	}
+
+	return ~crc32_reflect(state);
+}
+
+static uint64_t __bench_run(uint32_t (*crc)(const uint8_t*, uint32_t), uint32_t nb_buffers)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t i;
+
+	for(i = 0; i < nb_buffers; i++) {
+		buffer[0] = (uint8_t)i;
+		sink      = crc(buffer, BENCH_BUFFER_SIZE);
+	}
+
+	return __bench_now_ns() - start;
+}
+
+static uint32_t __bench_crc_kernel(const uint8_t *data, uint32_t length)
+{
+	return crc32_kernel(0, data, length);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Checks                                 │
+   └────────────────────────────────────────┘ */
+
+static int __bench_check_vector(void)
+{
+	const uint8_t check[] = "123456789";
+
+	if((crc32_kernel(0, check, 9) != CRC32_CHECK) || (__bench_crc_unit(0, check, 9) != CRC32_CHECK)) {
+		printf("check vector FAILED\n");
+		return 0;
+	}
+
+	printf("check vector ok\n");
+	return 1;
+}
+
+/* Random lengths and splits: a continued CRC is the CRC of the whole */
+
+static int __bench_check_random(void)
+{
+	uint32_t i, j, length, split, crc;
+
+	srand(1);
+
+	for(i = 0; i < BENCH_NB_CHECKS; i++) {
+		length = (uint32_t)rand() % BENCH_BUFFER_SIZE;
+		split  = length ? (uint32_t)rand() % length : 0;
+		for(j = 0; j < length; j++) buffer[j] = (uint8_t)rand();
+
+		crc = __bench_crc_reference(buffer, length);
+
+		if((crc32_kernel(crc32_kernel(0, buffer, split), buffer + split, length - split) != crc)
+			|| (__bench_crc_unit(__bench_crc_unit(0, buffer, split), buffer + split, length - split) != crc)) {
+			printf("check random length=%u split=%u FAILED\n", length, split);
+			return 0;
+		}
+	}
+
+	printf("check random buffers=%u ok\n", BENCH_NB_CHECKS);
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+int main(void)
+{
+	const double bytes = (double)BENCH_NB_BUFFERS * BENCH_BUFFER_SIZE;
+	uint64_t     kernel_ns;
+	uint64_t     reference_ns;
+
+	if(!__bench_check_vector()) return EXIT_FAILURE;
+	if(!__bench_check_random()) return EXIT_FAILURE;
+
+	kernel_ns    = __bench_run(__bench_crc_kernel   , BENCH_NB_BUFFERS     );
+	reference_ns = __bench_run(__bench_crc_reference, BENCH_NB_BUFFERS / 10);
+
+	/* Host times: the hardware unit is timed by the crc line of the CONFIG_BENCH report */
+	printf("bench crc bytes=%u kernel_ns_per_byte=%.3f kernel_mb_s=%.1f bitwise_ns_per_byte=%.3f\n",
+		BENCH_BUFFER_SIZE, kernel_ns / bytes, bytes / (kernel_ns / 1000.0),
+		reference_ns / (bytes / 10)
+	);
+
+	return EXIT_SUCCESS;
+}
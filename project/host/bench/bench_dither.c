@@ -0,0 +1,137 @@
+/* ┌──────────────────────────────────┐
+   │ Host benchmark: slot dithering   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <io/dither.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Benchmark config                       │
+   └────────────────────────────────────────┘ */
+
+#define BENCH_NB_SLOTS    512
+#define BENCH_NB_FRAMES   100000
+#define BENCH_CHECK_FRAMES 256  /* Full error cycle for a q8 value */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+static uint16_t          slots[BENCH_NB_SLOTS];
+static uint8_t           err  [BENCH_NB_SLOTS];
+static volatile uint32_t sink;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint64_t __bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Slow fade at low intensity: every slot has a fractional part */
+
+static void __bench_slots_init(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < BENCH_NB_SLOTS; i++) {
+		slots[i] = (uint16_t)(0x0100 + i * 7);
+		err  [i] = 0;
+	}
+}
+
+static uint64_t __bench_plain(void)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t acc   = 0;
+	uint32_t frame;
+	uint32_t i;
+
+	for(frame = 0; frame < BENCH_NB_FRAMES; frame++) {
+		for(i = 0; i < BENCH_NB_SLOTS; i++) acc += slots[i] >> 8;
+		sink = acc;
+	}
+
+	return __bench_now_ns() - start;
+}
+
+static uint64_t __bench_dither(void)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t acc   = 0;
+	uint32_t frame;
+	uint32_t i;
+
+	for(frame = 0; frame < BENCH_NB_FRAMES; frame++) {
+		for(i = 0; i < BENCH_NB_SLOTS; i++) acc += dither_q8(slots[i], &err[i]);
+		sink = acc;
+	}
+
+	return __bench_now_ns() - start;
+}
+
+/* Over 256 frames, the output sum must equal the q8 value */
+
+static int __bench_check(void)
+{
+	uint32_t value;
+	uint32_t frame;
+	uint32_t sum;
+	uint8_t  e;
+
+	for(value = 0; value <= 0xFF00; value++) {
+		e   = 0;
+		sum = 0;
+
+		for(frame = 0; frame < BENCH_CHECK_FRAMES; frame++) sum += dither_q8((uint16_t)value, &e);
+
+		if(sum != value) {
+			printf("check dither value=%u sum=%u FAILED\n", value, sum);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+int main(void)
+{
+	uint64_t plain_ns;
+	uint64_t dither_ns;
+
+	if(!__bench_check()) return EXIT_FAILURE;
+	printf("check dither ok\n");
+
+	__bench_slots_init();
+	plain_ns  = __bench_plain ();
+	dither_ns = __bench_dither();
+
+	printf("bench dither slots=%u frames=%u plain_ns_per_frame=%llu dither_ns_per_frame=%llu\n",
+		BENCH_NB_SLOTS, BENCH_NB_FRAMES,
+		(unsigned long long)(plain_ns  / BENCH_NB_FRAMES),
+		(unsigned long long)(dither_ns / BENCH_NB_FRAMES)
+	);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+/* ┌──────────────────────────────────┐
+   │ Host benchmark: effect kernels   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <app/effect_kernels.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Benchmark config                       │
+   └────────────────────────────────────────┘ */
+
+#define BENCH_NB_CHANNELS  512  /* A full universe, more than the firmware holds */
+#define BENCH_NB_EFFECTS   8
+#define BENCH_NB_FRAMES    100000
+#define BENCH_DELTA_MS     23   /* 44 Hz frames                                  */
+
+#define BENCH_RATE_MHZ     1000 /* Rate checked over a long run                  */
+#define BENCH_RATE_RUN_MS  3600000UL
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* As app/effect.c */
+
+struct Bench_Effect {
+	uint32_t phase;
+	uint32_t step;
+	uint8_t  wave;
+	uint8_t  low;
+	uint8_t  high;
+};
+
+struct Bench_Channel {
+	uint16_t slot;
+	uint8_t  offset;
+	uint8_t  effect;
+};
+
+static struct Bench_Effect  effects [BENCH_NB_EFFECTS];
+static struct Bench_Channel channels[BENCH_NB_CHANNELS];
+static uint16_t             slots   [BENCH_NB_CHANNELS];
+static volatile uint32_t    sink;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint64_t __bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Every wave in use, the channels of an effect spread over one turn */
+
+static void __bench_init(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < BENCH_NB_EFFECTS; i++) {
+		effects[i].phase = 0;
+		effects[i].step  = EFFECT_STEP(250 + i * 500);
+		effects[i].wave  = (uint8_t)(i % EFFECT_NB_WAVES);
+		effects[i].low   = (uint8_t)(i * 16);
+		effects[i].high  = (uint8_t)(255 - i * 8);
+	}
+
+	for(i = 0; i < BENCH_NB_CHANNELS; i++) {
+		channels[i].slot   = (uint16_t)i;
+		channels[i].effect = (uint8_t)(i % BENCH_NB_EFFECTS);
+		channels[i].offset = (uint8_t)((i / BENCH_NB_EFFECTS) * 256 / (BENCH_NB_CHANNELS / BENCH_NB_EFFECTS));
+	}
+}
+
+static uint64_t __bench_frames(void)
+{
+	uint64_t start = __bench_now_ns();
+	uint32_t frame;
+	uint32_t i;
+
+	for(frame = 0; frame < BENCH_NB_FRAMES; frame++) {
+		for(i = 0; i < BENCH_NB_EFFECTS; i++) effects[i].phase += effects[i].step * BENCH_DELTA_MS;
+
+		for(i = 0; i < BENCH_NB_CHANNELS; i++) {
+			const struct Bench_Channel *ch  = &channels[i];
+			const struct Bench_Effect  *eff = &effects[ch->effect];
+
+			slots[ch->slot] = effect_scale(effect_sample(effect_waves[eff->wave], eff->phase + ((uint32_t)ch->offset << 24)), eff->low, eff->high);
+		}
+
+		sink = slots[frame % BENCH_NB_CHANNELS];
+	}
+
+	return __bench_now_ns() - start;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Checks                                 │
+   └────────────────────────────────────────┘ */
+
+/* On table entries, the sample is the entry */
+
+static int __bench_check_sample(void)
+{
+	uint32_t wave, i;
+
+	for(wave = 0; wave < EFFECT_NB_WAVES; wave++) {
+		for(i = 0; i < EFFECT_WAVE_SIZE; i++) {
+			if(effect_sample(effect_waves[wave], i << 24) != ((uint32_t)effect_waves[wave][i] << 8)) {
+				printf("check sample wave=%u i=%u FAILED\n", wave, i);
+				return 0;
+			}
+		}
+	}
+
+	printf("check sample ok\n");
+	return 1;
+}
+
+/* Ends of the range are reached exactly, in between is within one q8 step */
+
+static int __bench_check_scale(void)
+{
+	uint32_t low, high, level;
+
+	for(low = 0; low < 256; low++) {
+		for(high = 0; high < 256; high++) {
+			if((effect_scale(0, low, high) != (low << 8)) || (effect_scale(255 << 8, low, high) != (high << 8))) {
+				printf("check scale low=%u high=%u FAILED\n", low, high);
+				return 0;
+			}
+
+			for(level = 0; level <= (255 << 8); level += 257) {
+				double ref = low * 256.0 + level * ((double)high - low) / 255.0;
+				if(abs((int)effect_scale(level, low, high) - (int)(ref + 0.5)) > 1) {
+					printf("check scale low=%u high=%u level=%u FAILED\n", low, high, level);
+					return 0;
+				}
+			}
+		}
+	}
+
+	printf("check scale ok\n");
+	return 1;
+}
+
+/* Phase drift of a 1 Hz effect after an hour of 23 ms frames */
+
+static int __bench_check_rate(void)
+{
+	uint64_t turns = (uint64_t)EFFECT_STEP(BENCH_RATE_MHZ) * BENCH_RATE_RUN_MS;
+	double   error = (double)turns / 4294967296.0 - (double)BENCH_RATE_RUN_MS * BENCH_RATE_MHZ / 1000000.0;
+
+	if((error > 0.0) || (error < -1.0)) {
+		printf("check rate error=%.3f turns FAILED\n", error);
+		return 0;
+	}
+
+	printf("check rate error=%.3f turns per hour ok\n", error);
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+int main(void)
+{
+	uint64_t frames_ns;
+	double   per_channel;
+	double   per_frame;
+
+	if(!__bench_check_sample()) return EXIT_FAILURE;
+	if(!__bench_check_scale ()) return EXIT_FAILURE;
+	if(!__bench_check_rate  ()) return EXIT_FAILURE;
+
+	__bench_init();
+	frames_ns   = __bench_frames();
+	per_channel = frames_ns / ((double)BENCH_NB_FRAMES * BENCH_NB_CHANNELS);
+	per_frame   = frames_ns / (double)BENCH_NB_FRAMES;
+
+	/* Host times: the on-target cycle counts are in the CONFIG_BENCH report */
+	printf("bench effect channels=%u frames=%u channel_ns=%.2f frame_us=%.2f (of %u ms at 44 Hz)\n",
+		BENCH_NB_CHANNELS, BENCH_NB_FRAMES, per_channel, per_frame / 1000.0, BENCH_DELTA_MS
+	);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,353 @@
+/* ┌──────────────────────────────────────┐
+   │ Serial loader over a pseudo-terminal │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+/* Runs the firmware loader (loader/loader.c) on the host: the host link
+   is a pseudo-terminal, whose name is printed at start, and the flash
+   is a file mapped in memory, so that it keeps its state if the process
+   is killed. scripts/loader.py can then update it as it would a board.
+   Starting slot A prints its descriptor and exits. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <loader/loader.h>
+#include <loader/loader_port.h>
+#include <io/crc.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Host config                            │
+   └────────────────────────────────────────┘ */
+
+#define LOADER_PTY_FLASH_SIZE      (64 * 1024)                      /* STM32G031K8                 */
+#define LOADER_PTY_POLL_MS         1                                /* Wait when nothing came      */
+
+struct Loader_PTY_Config {
+	const char *flash_path;
+	uint8_t     requested;                                      /* As after LOADER_ENTER       */
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Loader_PTY_State {
+	struct Loader_PTY_Config config;
+
+	int       master;
+	int       slave;                                            /* Kept open, see main         */
+	uint8_t  *flash;
+
+	uint8_t  *rx_buffer;
+	uint32_t  rx_length;
+	uint32_t  rx_received;
+	uint32_t  baudrate;
+
+	uint32_t  erased;                                           /* Statistics                  */
+	uint32_t  programmed;
+};
+
+static struct Loader_PTY_State __loader_pty;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __loader_pty_wait(void)
+{
+	struct pollfd pfd = { .fd = __loader_pty.master, .events = POLLIN };
+
+	poll(&pfd, 1, LOADER_PTY_POLL_MS);
+}
+
+static uint8_t* __loader_pty_flash(uint32_t address, uint32_t length)
+{
+	if((address < LOADER_FLASH_BASE) || ((address - LOADER_FLASH_BASE + length) > LOADER_PTY_FLASH_SIZE)) return NULL;
+
+	return __loader_pty.flash + (address - LOADER_FLASH_BASE);
+}
+
+/* Only slots are written: the loader and the look store are not */
+
+static uint8_t __loader_pty_writable(uint32_t address, uint32_t length)
+{
+	return (address >= LOADER_SLOT_A) && ((address + length) <= (LOADER_SLOT_B + LOADER_SLOT_SIZE));
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Port interface                         │
+   └────────────────────────────────────────┘ */
+
+void loader_port_init(void)
+{
+	__loader_pty.baudrate = LOADER_BAUDRATE;
+}
+
+uint32_t loader_port_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void loader_port_baudrate(uint32_t baudrate)
+{
+	if(baudrate != __loader_pty.baudrate) printf("baud rate %u\n", baudrate);
+
+	__loader_pty.baudrate = baudrate;
+}
+
+uint8_t loader_port_read(uint8_t *data)
+{
+	if(read(__loader_pty.master, data, 1) == 1) return 1;
+
+	__loader_pty_wait();
+	return 0;
+}
+
+void loader_port_write(const uint8_t *data, uint32_t length)
+{
+	ssize_t written;
+
+	while(length) {
+		written = write(__loader_pty.master, data, length);
+
+		if(written < 0) {
+			if(errno != EAGAIN) return;
+
+			__loader_pty_wait();
+			continue;
+		}
+
+		data   += written;
+		length -= (uint32_t)written;
+	}
+}
+
+void loader_port_rx_block(uint8_t *buffer, uint32_t length)
+{
+	__loader_pty.rx_buffer   = buffer;
+	__loader_pty.rx_length   = length;
+	__loader_pty.rx_received = 0;
+}
+
+uint32_t loader_port_rx_left(void)
+{
+	uint32_t left = __loader_pty.rx_length - __loader_pty.rx_received;
+	ssize_t  nb;
+
+	if(!left) return 0;
+
+	nb = read(__loader_pty.master, __loader_pty.rx_buffer + __loader_pty.rx_received, left);
+
+	if(nb > 0) __loader_pty.rx_received += (uint32_t)nb;
+	else       __loader_pty_wait();
+
+	return __loader_pty.rx_length - __loader_pty.rx_received;
+}
+
+void loader_port_rx_stop(void)
+{
+	__loader_pty.rx_length   = 0;
+	__loader_pty.rx_received = 0;
+}
+
+const uint8_t* loader_port_flash(uint32_t address)
+{
+	return __loader_pty_flash(address, 0);
+}
+
+uint8_t loader_port_erase(uint32_t address)
+{
+	uint8_t *page = __loader_pty_flash(address, LOADER_PAGE_SIZE);
+
+	if(!page || (address % LOADER_PAGE_SIZE) || !__loader_pty_writable(address, LOADER_PAGE_SIZE)) return 0;
+
+	memset(page, 0xFF, LOADER_PAGE_SIZE);
+	__loader_pty.erased++;
+
+	return 1;
+}
+
+uint8_t loader_port_program(uint32_t address, const uint8_t *data, uint32_t length)
+{
+	uint8_t  *dst = __loader_pty_flash(address, length);
+	uint32_t  offset;
+	uint32_t  i;
+
+	if(!dst || (address % 8) || (length % 8) || !__loader_pty_writable(address, length)) return 0;
+
+	/* As the hardware: only erased double-words can be programmed */
+	for(offset = 0; offset < length; offset += 8) {
+		for(i = 0; i < 8; i++) {
+			if(dst[offset + i] != 0xFF) return 0;
+		}
+
+		memcpy(dst + offset, data + offset, 8);
+	}
+
+	__loader_pty.programmed += length;
+	return 1;
+}
+
+void loader_port_boot(uint32_t address)
+{
+	const struct Loader_Image *image = (const struct Loader_Image*)loader_port_flash(address + LOADER_SLOT_SIZE - sizeof(*image));
+
+	printf("boot 0x%08X length %u crc 0x%08X version %u\n", address, image->length, image->crc, image->version);
+	printf("flash %u pages erased, %u bytes programmed\n", __loader_pty.erased, __loader_pty.programmed);
+
+	exit(0);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Setup                                  │
+   └────────────────────────────────────────┘ */
+
+static void __loader_pty_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --flash FILE       flash contents, created erased if missing (flash.bin)\n"
+		"  --request 0|1      start as asked by the firmware, in the loader (0)\n",
+		name);
+}
+
+static uint8_t __loader_pty_args(struct Loader_PTY_Config *config, int argc, char **argv)
+{
+	const char *opt;
+	const char *val;
+	int         i_arg;
+
+	config->flash_path = "flash.bin";
+	config->requested  = 0;
+
+	for(i_arg = 1; i_arg < argc; i_arg += 2) {
+		opt = argv[i_arg];
+		val = (i_arg + 1 < argc) ? argv[i_arg + 1] : NULL;
+		if(!val) return 0;
+
+		if     (!strcmp(opt, "--flash"  )) config->flash_path = val;
+		else if(!strcmp(opt, "--request")) config->requested  = (uint8_t)strtoul(val, NULL, 0);
+		else return 0;
+	}
+
+	return 1;
+}
+
+static uint8_t __loader_pty_flash_open(const char *path)
+{
+	struct stat st;
+	int         fd;
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if(fd < 0) return 0;
+
+	/* New file: erased flash */
+	if(!fstat(fd, &st) && (st.st_size == 0)) {
+		uint8_t erased[LOADER_PAGE_SIZE];
+		uint32_t i_page;
+
+		memset(erased, 0xFF, sizeof(erased));
+		for(i_page = 0; i_page < LOADER_PTY_FLASH_SIZE / LOADER_PAGE_SIZE; i_page++) {
+			if(write(fd, erased, sizeof(erased)) != sizeof(erased)) return 0;
+		}
+	}
+
+	__loader_pty.flash = mmap(NULL, LOADER_PTY_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	return __loader_pty.flash != MAP_FAILED;
+}
+
+static uint8_t __loader_pty_open(void)
+{
+	struct termios tio;
+	const char    *name;
+
+	__loader_pty.master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(__loader_pty.master < 0) return 0;
+
+	if(grantpt(__loader_pty.master) || unlockpt(__loader_pty.master)) return 0;
+	name = ptsname(__loader_pty.master);
+
+	/* Holding the slave side avoids hangups between clients */
+	__loader_pty.slave = open(name, O_RDWR | O_NOCTTY);
+	if(__loader_pty.slave < 0) return 0;
+
+	/* Bytes as they are, both ways */
+	tcgetattr(__loader_pty.slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(__loader_pty.slave, TCSANOW, &tio);
+
+	printf("pty %s\n", name);
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+/* Same sequence as loader/loader_main.c */
+
+int main(int argc, char **argv)
+{
+	struct Loader_PTY_Config *config = &__loader_pty.config;
+	uint8_t                   requested;
+	uint8_t                   valid;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if(!__loader_pty_args(config, argc, argv)) {
+		__loader_pty_usage(argv[0]);
+		return 1;
+	}
+
+	if(!__loader_pty_flash_open(config->flash_path)) {
+		fprintf(stderr, "can't map %s\n", config->flash_path);
+		return 1;
+	}
+
+	if(!__loader_pty_open()) {
+		fprintf(stderr, "can't open a pseudo-terminal\n");
+		return 1;
+	}
+
+	requested = config->requested;
+	loader_port_init();
+	crc_init();
+
+	while(1) {
+		valid = loader_check();
+		if(valid && !requested) loader_port_boot(LOADER_SLOT_A);
+
+		printf("loader %s\n", valid ? "requested" : "waiting, slot A not valid");
+
+		requested = 0;
+		loader_serve(valid ? LOADER_IDLE_TIMEOUT_MS : 0);
+	}
+}
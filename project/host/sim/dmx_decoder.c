@@ -0,0 +1,337 @@
+/* ┌──────────────────────────────────────┐
+   │ DMX line decoder and timing checks   │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "dmx_decoder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+#define DMX_DECODER_BIT_PS     ((uint64_t)DMX_DECODER_BIT_NS * 1000)
+#define DMX_DECODER_CHAR_BITS  11 /* Start, 8 data, 2 stop bits */
+
+const struct DMX_Decoder_Limits dmx_decoder_limits_default = {
+	.break_min_ns      = 92000,
+	.mab_min_ns        = 12000,
+	.b2b_min_ns        = 1204000,
+	.b2b_max_ns        = 1000000000,
+	.bit_tolerance_pct = 2
+};
+
+static const char *__dmx_decoder_violation_names[DMX_NB_VIOLATIONS] = {
+	[DMX_VIOLATION_BREAK     ] = "break",
+	[DMX_VIOLATION_MAB       ] = "mab",
+	[DMX_VIOLATION_B2B       ] = "break_to_break",
+	[DMX_VIOLATION_BIT_TIMING] = "bit_timing",
+	[DMX_VIOLATION_FRAMING   ] = "framing",
+	[DMX_VIOLATION_LENGTH    ] = "length",
+	[DMX_VIOLATION_FLOATING  ] = "floating"
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint32_t __dmx_decoder_ns(uint64_t ps)
+{
+	return (uint32_t)(ps / 1000);
+}
+
+static void __dmx_decoder_violation(struct DMX_Decoder *dec, uint64_t time_ps,
+	enum DMX_Decoder_Violation violation, uint32_t value_ns)
+{
+	dec->stats.violations[violation]++;
+
+	if(dec->nb_messages) {
+		dec->nb_messages--;
+		fprintf(stderr, "violation %s at %.3fus: %.3fus\n", __dmx_decoder_violation_names[violation],
+			time_ps / 1e6, value_ns / 1e3);
+	}
+}
+
+static void __dmx_decoder_range_init(struct DMX_Decoder_Range *range)
+{
+	range->min_ns = UINT32_MAX;
+	range->max_ns = 0;
+	range->sum_ns = 0;
+	range->count  = 0;
+}
+
+static void __dmx_decoder_range_add(struct DMX_Decoder_Range *range, uint32_t value_ns)
+{
+	if(value_ns < range->min_ns) range->min_ns = value_ns;
+	if(value_ns > range->max_ns) range->max_ns = value_ns;
+
+	range->sum_ns += value_ns;
+	range->count++;
+}
+
+static void __dmx_decoder_char_start(struct DMX_Decoder *dec, uint64_t time_ps)
+{
+	dec->state    = DMX_DECODER_CHAR;
+	dec->char_ps  = time_ps;
+	dec->i_sample = 0;
+	dec->data     = 0;
+	dec->all_low  = 1;
+}
+
+static void __dmx_decoder_lost(struct DMX_Decoder *dec, uint64_t time_ps, enum DMX_Decoder_Violation violation)
+{
+	__dmx_decoder_violation(dec, time_ps, violation, 0);
+
+	/* The frame is dropped, resync on the next break */
+	dec->state    = DMX_DECODER_UNSYNCED;
+	dec->in_frame = 0;
+}
+
+/* ─────────────── Frames ──────────────── */
+
+static void __dmx_decoder_break(struct DMX_Decoder *dec, uint64_t start_ps, uint64_t end_ps)
+{
+	struct DMX_Decoder_Frame *frame    = &dec->frame;
+	const uint32_t            break_ns = __dmx_decoder_ns(end_ps - start_ps);
+
+	/* Previous frame is complete */
+	if(dec->in_frame) {
+		frame->b2b_ns = __dmx_decoder_ns(start_ps - frame->break_ps);
+		frame->mbb_ns = __dmx_decoder_ns(start_ps - dec->char_end_ps);
+
+		if((frame->b2b_ns < dec->limits.b2b_min_ns) || (frame->b2b_ns > dec->limits.b2b_max_ns)) {
+			__dmx_decoder_violation(dec, start_ps, DMX_VIOLATION_B2B, frame->b2b_ns);
+		}
+
+		__dmx_decoder_range_add(&dec->stats.b2b, frame->b2b_ns);
+		__dmx_decoder_range_add(&dec->stats.mbb, frame->mbb_ns);
+
+		if(frame->mark_min_ns == UINT32_MAX) frame->mark_min_ns = 0;
+
+		dec->stats.frames++;
+		if(dec->cbk) dec->cbk(frame, dec->usrdata);
+	}
+
+	if(break_ns < dec->limits.break_min_ns) __dmx_decoder_violation(dec, start_ps, DMX_VIOLATION_BREAK, break_ns);
+	__dmx_decoder_range_add(&dec->stats.brk, break_ns);
+
+	/* New frame */
+	memset(frame, 0, sizeof(*frame));
+	frame->break_ps    = start_ps;
+	frame->break_ns    = break_ns;
+	frame->mark_min_ns = UINT32_MAX;
+
+	dec->in_frame    = 1;
+	dec->i_char      = 0;
+	dec->char_end_ps = end_ps;
+	dec->rise_ps     = end_ps;
+	dec->state       = DMX_DECODER_MAB;
+}
+
+static void __dmx_decoder_char_done(struct DMX_Decoder *dec)
+{
+	struct DMX_Decoder_Frame *frame = &dec->frame;
+
+	dec->char_end_ps = dec->char_ps + DMX_DECODER_CHAR_BITS * DMX_DECODER_BIT_PS;
+	dec->state       = DMX_DECODER_MARK;
+
+	if(!dec->in_frame) return;
+
+	/* The mark before a character is known once it is not a break */
+	if(dec->i_char) {
+		if(dec->mark_ns < frame->mark_min_ns) frame->mark_min_ns = dec->mark_ns;
+		if(dec->mark_ns > frame->mark_max_ns) frame->mark_max_ns = dec->mark_ns;
+		__dmx_decoder_range_add(&dec->stats.mark, dec->mark_ns);
+	}
+
+	if(dec->i_char == 0) {
+		frame->start_code = (uint8_t)dec->data;
+	}
+
+	else if(dec->i_char <= DMX_DECODER_NB_SLOTS) {
+		frame->slots[dec->i_char - 1] = (uint8_t)dec->data;
+		frame->nb_slots               = (uint16_t)dec->i_char;
+	}
+
+	else {
+		__dmx_decoder_lost(dec, dec->char_ps, DMX_VIOLATION_LENGTH);
+		return;
+	}
+
+	dec->i_char++;
+}
+
+/* ────────────── Sampling ─────────────── */
+
+/* Bits are sampled at their center, with the level held since the last edge */
+
+static void __dmx_decoder_sample(struct DMX_Decoder *dec, uint64_t time_ps)
+{
+	const uint32_t i_bit = dec->i_sample++;
+	const uint8_t  bit   = dec->level;
+
+	if(bit) dec->all_low = 0;
+
+	/* Start bit, shorter than half a bit otherwise */
+	if(i_bit == 0) {
+		if(bit) __dmx_decoder_lost(dec, time_ps, DMX_VIOLATION_FRAMING);
+	}
+
+	else if(i_bit <= 8) {
+		dec->data |= (uint32_t)bit << (i_bit - 1);
+	}
+
+	/* Stop bits. A low line from the start bit may be a break. */
+	else if(!bit) {
+		if(dec->all_low) dec->state = DMX_DECODER_LOW;
+		else             __dmx_decoder_lost(dec, time_ps, DMX_VIOLATION_FRAMING);
+	}
+
+	else if(i_bit == DMX_DECODER_CHAR_BITS - 1) {
+		__dmx_decoder_char_done(dec);
+	}
+}
+
+static void __dmx_decoder_sample_until(struct DMX_Decoder *dec, uint64_t time_ps)
+{
+	uint64_t sample_ps;
+
+	while(dec->state == DMX_DECODER_CHAR) {
+		sample_ps = dec->char_ps + ((2 * dec->i_sample + 1) * DMX_DECODER_BIT_PS) / 2;
+		if(sample_ps >= time_ps) break;
+
+		__dmx_decoder_sample(dec, sample_ps);
+	}
+}
+
+/* Edges inside a character are on the bit grid */
+
+static void __dmx_decoder_bit_check(struct DMX_Decoder *dec, uint64_t time_ps)
+{
+	const uint64_t offset = time_ps - dec->char_ps;
+	const uint64_t i_bit  = (offset + DMX_DECODER_BIT_PS / 2) / DMX_DECODER_BIT_PS;
+	const uint64_t ideal  = i_bit * DMX_DECODER_BIT_PS;
+	const uint64_t error  = (offset > ideal) ? (offset - ideal) : (ideal - offset);
+
+	if(error * 100 > ideal * dec->limits.bit_tolerance_pct) {
+		__dmx_decoder_violation(dec, time_ps, DMX_VIOLATION_BIT_TIMING, __dmx_decoder_ns(error));
+	}
+}
+
+/* ──────────────── Edges ──────────────── */
+
+static void __dmx_decoder_fall(struct DMX_Decoder *dec, uint64_t time_ps)
+{
+	struct DMX_Decoder_Frame *frame = &dec->frame;
+
+	dec->fall_ps = time_ps;
+
+	switch(dec->state) {
+		case DMX_DECODER_MAB:
+			frame->mab_ns = __dmx_decoder_ns(time_ps - dec->rise_ps);
+			if(frame->mab_ns < dec->limits.mab_min_ns) {
+				__dmx_decoder_violation(dec, time_ps, DMX_VIOLATION_MAB, frame->mab_ns);
+			}
+
+			__dmx_decoder_range_add(&dec->stats.mab, frame->mab_ns);
+			__dmx_decoder_char_start(dec, time_ps);
+			break;
+
+		case DMX_DECODER_MARK:
+			/* Mark time between slots, or the start of a break */
+			dec->mark_ns = __dmx_decoder_ns(time_ps - dec->char_end_ps);
+			__dmx_decoder_char_start(dec, time_ps);
+			break;
+
+		case DMX_DECODER_CHAR:
+			__dmx_decoder_bit_check(dec, time_ps);
+			break;
+
+		default:break;
+	}
+}
+
+static void __dmx_decoder_rise(struct DMX_Decoder *dec, uint64_t time_ps)
+{
+	switch(dec->state) {
+		case DMX_DECODER_UNSYNCED:
+			if((dec->fall_ps != UINT64_MAX) && (time_ps - dec->fall_ps) >= (uint64_t)DMX_DECODER_BREAK_DETECT_NS * 1000) {
+				__dmx_decoder_break(dec, dec->fall_ps, time_ps);
+			}
+			break;
+
+		case DMX_DECODER_LOW:
+			if((time_ps - dec->char_ps) >= (uint64_t)DMX_DECODER_BREAK_DETECT_NS * 1000) {
+				__dmx_decoder_break(dec, dec->char_ps, time_ps);
+			}
+
+			else __dmx_decoder_lost(dec, time_ps, DMX_VIOLATION_FRAMING);
+			break;
+
+		case DMX_DECODER_CHAR:
+			__dmx_decoder_bit_check(dec, time_ps);
+			break;
+
+		default:break;
+	}
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void dmx_decoder_init(struct DMX_Decoder *dec, const struct DMX_Decoder_Limits *limits,
+	DMX_Decoder_Callback cbk, void *usrdata)
+{
+	memset(dec, 0, sizeof(*dec));
+
+	dec->limits      = *limits;
+	dec->cbk         = cbk;
+	dec->usrdata     = usrdata;
+	dec->nb_messages = 10;
+
+	dec->state       = DMX_DECODER_UNSYNCED;
+	dec->level       = 1;
+	dec->fall_ps     = UINT64_MAX;
+
+	__dmx_decoder_range_init(&dec->stats.brk );
+	__dmx_decoder_range_init(&dec->stats.mab );
+	__dmx_decoder_range_init(&dec->stats.mark);
+	__dmx_decoder_range_init(&dec->stats.mbb );
+	__dmx_decoder_range_init(&dec->stats.b2b );
+}
+
+void dmx_decoder_edge(struct DMX_Decoder *dec, uint64_t time_ps, uint8_t level)
+{
+	__dmx_decoder_sample_until(dec, time_ps);
+
+	if(level == dec->level) return;
+	dec->level = level;
+
+	if(level > 1) {
+		__dmx_decoder_lost(dec, time_ps, DMX_VIOLATION_FLOATING);
+		dec->fall_ps = UINT64_MAX;
+		return;
+	}
+
+	if(level) __dmx_decoder_rise(dec, time_ps);
+	else      __dmx_decoder_fall(dec, time_ps);
+}
+
+void dmx_decoder_flush(struct DMX_Decoder *dec, uint64_t time_ps)
+{
+	__dmx_decoder_sample_until(dec, time_ps);
+}
+
+const char* dmx_decoder_violation_name(enum DMX_Decoder_Violation violation)
+{
+	return __dmx_decoder_violation_names[violation];
+}
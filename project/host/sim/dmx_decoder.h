@@ -0,0 +1,133 @@
+/* ┌──────────────────────────────────────┐
+   │ DMX line decoder and timing checks   │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Constants                              │
+   └────────────────────────────────────────┘ */
+
+#define DMX_DECODER_NB_SLOTS       512
+#define DMX_DECODER_BIT_NS         4000       /* 250kbps                          */
+#define DMX_DECODER_BREAK_DETECT_NS 88000     /* Receivers take shorter lows as data */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Decoder data                           │
+   └────────────────────────────────────────┘ */
+
+/* Limits of the checks, in ns. Defaults are the transmitter values. */
+
+struct DMX_Decoder_Limits {
+	uint32_t break_min_ns;                                      /* 92us                        */
+	uint32_t mab_min_ns;                                        /* 12us                        */
+	uint32_t b2b_min_ns;                                        /* Break to break: 1204us      */
+	uint32_t b2b_max_ns;                                        /* 1s                          */
+	uint32_t bit_tolerance_pct;                                 /* Bit edges, 2%               */
+};
+
+enum DMX_Decoder_Violation {
+	DMX_VIOLATION_BREAK,                                        /* Break too short             */
+	DMX_VIOLATION_MAB,                                          /* MAB too short               */
+	DMX_VIOLATION_B2B,                                          /* Refresh out of limits       */
+	DMX_VIOLATION_BIT_TIMING,                                   /* Edge off the bit grid       */
+	DMX_VIOLATION_FRAMING,                                      /* Bad start or stop bit       */
+	DMX_VIOLATION_LENGTH,                                       /* More than 512 slots         */
+	DMX_VIOLATION_FLOATING,                                     /* Line not driven             */
+
+	DMX_NB_VIOLATIONS
+};
+
+/* A decoded frame, reported when the next break is seen */
+
+struct DMX_Decoder_Frame {
+	uint64_t break_ps;                                          /* Break start                 */
+	uint32_t break_ns;
+	uint32_t mab_ns;
+	uint32_t mark_min_ns;                                       /* Between slots               */
+	uint32_t mark_max_ns;
+	uint32_t mbb_ns;                                            /* Mark before the next break  */
+	uint32_t b2b_ns;                                            /* To the next break           */
+
+	uint16_t nb_slots;                                          /* Data slots received         */
+	uint8_t  start_code;
+	uint8_t  slots[DMX_DECODER_NB_SLOTS];
+};
+
+typedef void (*DMX_Decoder_Callback)(const struct DMX_Decoder_Frame *frame, void *usrdata);
+
+struct DMX_Decoder_Range {
+	uint32_t min_ns;
+	uint32_t max_ns;
+	uint64_t sum_ns;
+	uint32_t count;
+};
+
+struct DMX_Decoder_Stats {
+	uint32_t                   frames;
+	struct DMX_Decoder_Range   brk;
+	struct DMX_Decoder_Range   mab;
+	struct DMX_Decoder_Range   mark;
+	struct DMX_Decoder_Range   mbb;
+	struct DMX_Decoder_Range   b2b;
+	uint32_t                   violations[DMX_NB_VIOLATIONS];
+};
+
+enum DMX_Decoder_State {
+	DMX_DECODER_UNSYNCED,                                       /* Waiting for a break         */
+	DMX_DECODER_MAB,
+	DMX_DECODER_CHAR,                                           /* Sampling a character        */
+	DMX_DECODER_LOW,                                            /* Low stop bit: break or error*/
+	DMX_DECODER_MARK                                            /* Between characters          */
+};
+
+struct DMX_Decoder {
+	struct DMX_Decoder_Limits  limits;
+	DMX_Decoder_Callback       cbk;
+	void                      *usrdata;
+	uint32_t                   nb_messages;                     /* Violations left to print    */
+
+	enum DMX_Decoder_State     state;
+	uint8_t                    level;
+	uint64_t                   fall_ps;                         /* Last falling edge           */
+	uint64_t                   rise_ps;                         /* Break end                   */
+
+	uint64_t                   char_ps;                         /* Start bit of the character  */
+	uint32_t                   i_sample;
+	uint32_t                   data;
+	uint8_t                    all_low;
+	uint64_t                   char_end_ps;                     /* End of the last character   */
+	uint32_t                   mark_ns;                         /* Mark before this character  */
+
+	uint8_t                    in_frame;
+	uint32_t                   i_char;                          /* 0 is the start code         */
+	struct DMX_Decoder_Frame   frame;
+
+	struct DMX_Decoder_Stats   stats;
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+extern const struct DMX_Decoder_Limits dmx_decoder_limits_default;
+
+void dmx_decoder_init (struct DMX_Decoder *dec, const struct DMX_Decoder_Limits *limits,
+                       DMX_Decoder_Callback cbk, void *usrdata);
+
+/* Level changes in time order. level 2 is an undriven line. */
+void dmx_decoder_edge (struct DMX_Decoder *dec, uint64_t time_ps, uint8_t level);
+
+/* Decodes up to time_ps, e.g. at the end of a run */
+void dmx_decoder_flush(struct DMX_Decoder *dec, uint64_t time_ps);
+
+const char* dmx_decoder_violation_name(enum DMX_Decoder_Violation violation);
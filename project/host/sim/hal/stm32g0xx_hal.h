@@ -0,0 +1,301 @@
+/* ┌──────────────────────────────────────┐
+   │ Host HAL subset for the simulator    │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+/* Stands in for the Cube HAL and CMSIS headers when firmware sources
+   are built natively. Only what the simulated modules use is defined.
+   Peripheral instances are plain structures modelled by sim/sim.c:
+   registers with side effects (TDR, ICR, RQR, BSRR, BRR, EGR, and the
+   EXTI RPR1/FPR1) are applied after each piece of firmware code ran,
+   from the last value written. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Core                                   │
+   └────────────────────────────────────────┘ */
+
+#define __IO volatile
+#define __I  volatile const
+
+typedef enum {
+	HAL_OK      = 0x00,
+	HAL_ERROR   = 0x01,
+	HAL_BUSY    = 0x02,
+	HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+typedef enum {
+	WWDG_IRQn     = 0,
+	EXTI0_1_IRQn  = 5,
+	EXTI2_3_IRQn  = 6,
+	EXTI4_15_IRQn = 7,
+	TIM1_BRK_UP_TRG_COM_IRQn = 13,
+	TIM14_IRQn    = 19,
+	TIM16_IRQn    = 21,
+	TIM17_IRQn    = 22,
+	USART1_IRQn   = 27,
+	USART2_IRQn   = 28,
+	LPUART1_IRQn  = 29,
+
+	SIM_NB_IRQn   = 32
+} IRQn_Type;
+
+/* PRIMASK only guards firmware code against the simulated ISRs, which
+   never preempt it: sim.c checks that it is restored. */
+
+extern uint32_t sim_primask;
+
+static inline uint32_t __get_PRIMASK(void)            { return sim_primask; }
+static inline void     __set_PRIMASK(uint32_t primask) { sim_primask = primask; }
+static inline void     __disable_irq(void)             { sim_primask = 1; }
+static inline void     __enable_irq (void)             { sim_primask = 0; }
+
+/* Main stack pointer, set by the simulation. Pointer sized on the host. */
+
+extern uintptr_t sim_msp;
+
+static inline uintptr_t __get_MSP(void)               { return sim_msp; }
+
+#define READ_REG(reg)                 ((reg))
+#define WRITE_REG(reg, val)           ((reg) = (val))
+#define SET_BIT(reg, bit)             ((reg) |= (bit))
+#define CLEAR_BIT(reg, bit)           ((reg) &= ~(bit))
+#define ATOMIC_SET_BIT(reg, bit)      SET_BIT(reg, bit)
+#define ATOMIC_CLEAR_BIT(reg, bit)    CLEAR_BIT(reg, bit)
+#define MODIFY_REG(reg, clear, set)   ((reg) = (((reg) & ~(clear)) | (set)))
+
+void     HAL_NVIC_SetPriority    (IRQn_Type irqn, uint32_t preempt, uint32_t sub);
+void     HAL_NVIC_EnableIRQ      (IRQn_Type irqn);
+void     HAL_NVIC_DisableIRQ     (IRQn_Type irqn);
+void     HAL_NVIC_ClearPendingIRQ(IRQn_Type irqn);
+
+uint32_t HAL_GetTick(void);
+
+
+/* ┌────────────────────────────────────────┐
+   │ Peripheral registers                   │
+   └────────────────────────────────────────┘ */
+
+typedef struct {
+	__IO uint32_t CR1, CR2, CR3, BRR, GTPR, RTOR, RQR, ISR, ICR, RDR, TDR, PRESC;
+} USART_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR;
+} TIM_TypeDef;
+
+typedef struct {
+	__IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2], BRR;
+} GPIO_TypeDef;
+
+typedef struct {
+	__IO uint32_t IOPENR, AHBENR, APBENR1, APBENR2, CCIPR;
+} RCC_TypeDef;
+
+typedef struct {
+	__IO uint32_t RTSR1, FTSR1, RPR1, FPR1, EXTICR[4], IMR1;
+} EXTI_TypeDef;
+
+extern USART_TypeDef sim_usart1, sim_usart2, sim_lpuart1;
+extern TIM_TypeDef   sim_tim1, sim_tim2, sim_tim14, sim_tim16, sim_tim17;
+extern GPIO_TypeDef  sim_gpioa, sim_gpiob, sim_gpioc, sim_gpiod, sim_gpiof;
+extern RCC_TypeDef   sim_rcc;
+extern EXTI_TypeDef  sim_exti;
+
+#define USART1   (&sim_usart1)
+#define USART2   (&sim_usart2)
+#define LPUART1  (&sim_lpuart1)
+#define TIM1     (&sim_tim1)
+#define TIM2     (&sim_tim2)
+#define TIM14    (&sim_tim14)
+#define TIM16    (&sim_tim16)
+#define TIM17    (&sim_tim17)
+#define GPIOA    (&sim_gpioa)
+#define GPIOB    (&sim_gpiob)
+#define GPIOC    (&sim_gpioc)
+#define GPIOD    (&sim_gpiod)
+#define GPIOF    (&sim_gpiof)
+#define RCC      (&sim_rcc)
+#define EXTI     (&sim_exti)
+
+#define USART_CR1_UE     (1UL << 0)
+#define USART_CR1_RE     (1UL << 2)
+#define USART_CR1_TE     (1UL << 3)
+#define USART_CR1_IDLEIE (1UL << 4)
+#define USART_CR1_TCIE   (1UL << 6)
+#define USART_CR2_STOP_1 (1UL << 13)
+#define USART_RQR_SBKRQ  (1UL << 1)
+#define USART_RQR_RXFRQ  (1UL << 3)
+#define USART_ISR_FE     (1UL << 1)
+#define USART_ISR_NE     (1UL << 2)
+#define USART_ISR_ORE    (1UL << 3)
+#define USART_ISR_IDLE   (1UL << 4)
+#define USART_ISR_TC     (1UL << 6)
+#define USART_ISR_TXE    (1UL << 7)
+#define USART_ICR_FECF   (1UL << 1)
+#define USART_ICR_NECF   (1UL << 2)
+#define USART_ICR_ORECF  (1UL << 3)
+#define USART_ICR_IDLECF (1UL << 4)
+#define USART_ICR_TCCF   (1UL << 6)
+
+#define USART_CR1_RXNEIE_RXFNEIE (1UL << 5)
+#define USART_ISR_RXNE_RXFNE     (1UL << 5)
+
+#define TIM_CR1_CEN      (1UL << 0)
+#define TIM_CR1_URS      (1UL << 2)
+#define TIM_CR1_OPM      (1UL << 3)
+#define TIM_DIER_UIE     (1UL << 0)
+#define TIM_SR_UIF       (1UL << 0)
+#define TIM_EGR_UG       (1UL << 0)
+
+
+/* ┌────────────────────────────────────────┐
+   │ RCC                                    │
+   └────────────────────────────────────────┘ */
+
+typedef struct {
+	uint32_t PeriphClockSelection;
+	uint32_t Usart1ClockSelection;
+	uint32_t Lpuart1ClockSelection;
+} RCC_PeriphCLKInitTypeDef;
+
+#define RCC_PERIPHCLK_USART1        0x01U
+#define RCC_PERIPHCLK_LPUART1       0x04U
+#define RCC_USART1CLKSOURCE_PCLK1   0x00U
+#define RCC_CCIPR_USART1SEL         (3UL << 0)
+#define RCC_CCIPR_LPUART1SEL        (3UL << 10)
+#define RCC_LPUART1CLKSOURCE_PCLK1  0x00U
+
+#define __HAL_RCC_TIM1_CLK_ENABLE()    do {} while(0)
+#define __HAL_RCC_TIM2_CLK_ENABLE()    do {} while(0)
+#define __HAL_RCC_TIM14_CLK_ENABLE()   do {} while(0)
+#define __HAL_RCC_TIM16_CLK_ENABLE()   do {} while(0)
+#define __HAL_RCC_TIM17_CLK_ENABLE()   do {} while(0)
+#define __HAL_RCC_USART1_CLK_ENABLE()  do {} while(0)
+#define __HAL_RCC_USART2_CLK_ENABLE()  do {} while(0)
+#define __HAL_RCC_LPUART1_CLK_ENABLE() do {} while(0)
+
+/* APB is never divided: PCLK is HCLK */
+uint32_t          HAL_RCC_GetHCLKFreq      (void);
+uint32_t          HAL_RCC_GetPCLK1Freq     (void);
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *init);
+
+
+/* ┌────────────────────────────────────────┐
+   │ UART                                   │
+   └────────────────────────────────────────┘ */
+
+typedef enum {
+	HAL_UART_STATE_RESET = 0x00U,
+	HAL_UART_STATE_READY = 0x20U
+} HAL_UART_StateTypeDef;
+
+typedef struct {
+	uint32_t BaudRate;
+	uint32_t WordLength;
+	uint32_t StopBits;
+	uint32_t Parity;
+	uint32_t Mode;
+	uint32_t HwFlowCtl;
+	uint32_t OverSampling;
+	uint32_t OneBitSampling;
+	uint32_t ClockPrescaler;
+} UART_InitTypeDef;
+
+typedef struct {
+	uint32_t AdvFeatureInit;
+} UART_AdvFeatureInitTypeDef;
+
+typedef struct {
+	USART_TypeDef                  *Instance;
+	UART_InitTypeDef                Init;
+	UART_AdvFeatureInitTypeDef      AdvancedInit;
+	__IO HAL_UART_StateTypeDef      gState;
+	__IO HAL_UART_StateTypeDef      RxState;
+} UART_HandleTypeDef;
+
+#define UART_WORDLENGTH_8B          0x00U
+#define UART_STOPBITS_1             0x00U
+#define UART_STOPBITS_2             USART_CR2_STOP_1
+#define UART_PARITY_NONE            0x00U
+#define UART_MODE_TX                USART_CR1_TE
+#define UART_HWCONTROL_NONE         0x00U
+#define UART_OVERSAMPLING_16        0x00U
+#define UART_ONE_BIT_SAMPLE_DISABLE 0x00U
+#define UART_PRESCALER_DIV1         0x00U
+#define UART_ADVFEATURE_NO_INIT     0x00U
+#define UART_TXFIFO_THRESHOLD_1_8   0x00U
+#define UART_SENDBREAK_REQUEST      USART_RQR_SBKRQ
+
+#define IS_LPUART_INSTANCE(instance)        ((instance) == LPUART1)
+#define UART_DIV_SAMPLING16(pclk, baud, p)  (((pclk) + ((baud)/2U)) / (baud))
+#define UART_DIV_LPUART(pclk, baud, p)      ((uint32_t)((((uint64_t)(pclk)) * 256U + ((baud)/2U)) / (baud)))
+
+#define __HAL_UART_ENABLE(h)                ((h)->Instance->CR1 |=  USART_CR1_UE)
+#define __HAL_UART_DISABLE(h)               ((h)->Instance->CR1 &= ~USART_CR1_UE)
+#define __HAL_UART_SEND_REQ(h, req)         ((h)->Instance->RQR |= (uint16_t)(req))
+
+HAL_StatusTypeDef HAL_UART_Init                (UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_DeInit              (UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UARTEx_SetTxFifoThreshold(UART_HandleTypeDef *huart, uint32_t threshold);
+HAL_StatusTypeDef HAL_UARTEx_DisableFifoMode   (UART_HandleTypeDef *huart);
+
+
+/* ┌────────────────────────────────────────┐
+   │ Timers                                 │
+   └────────────────────────────────────────┘ */
+
+typedef struct {
+	uint32_t Prescaler;
+	uint32_t CounterMode;
+	uint32_t Period;
+	uint32_t ClockDivision;
+	uint32_t RepetitionCounter;
+	uint32_t AutoReloadPreload;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+	TIM_TypeDef          *Instance;
+	TIM_Base_InitTypeDef  Init;
+} TIM_HandleTypeDef;
+
+typedef struct {
+	uint32_t ClockSource;
+	uint32_t ClockPolarity;
+	uint32_t ClockPrescaler;
+	uint32_t ClockFilter;
+} TIM_ClockConfigTypeDef;
+
+typedef struct {
+	uint32_t MasterOutputTrigger;
+	uint32_t MasterSlaveMode;
+} TIM_MasterConfigTypeDef;
+
+#define TIM_COUNTERMODE_UP             0x00U
+#define TIM_CLOCKDIVISION_DIV1         0x00U
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0x00U
+#define TIM_CLOCKSOURCE_INTERNAL       0x00U
+#define TIM_TRGO_RESET                 0x00U
+#define TIM_MASTERSLAVEMODE_DISABLE    0x00U
+#define TIM_FLAG_UPDATE                TIM_SR_UIF
+
+/* Status flags are rc_w0: writing 1 has no effect */
+#define __HAL_TIM_GET_FLAG(h, flag)    (((h)->Instance->SR & (flag)) == (flag))
+#define __HAL_TIM_CLEAR_FLAG(h, flag)  ((h)->Instance->SR &= ~(flag))
+
+HAL_StatusTypeDef HAL_TIM_Base_Init                    (TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_DeInit                  (TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT                (TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT                 (TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource            (TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef  *config);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, TIM_MasterConfigTypeDef *config);
+void              HAL_TIM_IRQHandler                   (TIM_HandleTypeDef *htim);
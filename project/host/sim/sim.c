@@ -0,0 +1,1018 @@
+/* ┌──────────────────────────────────────┐
+   │ Virtual-time peripheral simulator    │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "sim.h"
+
+#include <io/timebase.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Peripheral instances                   │
+   └────────────────────────────────────────┘ */
+
+USART_TypeDef sim_usart1, sim_usart2, sim_lpuart1;
+TIM_TypeDef   sim_tim1, sim_tim2, sim_tim14, sim_tim16, sim_tim17;
+GPIO_TypeDef  sim_gpioa, sim_gpiob, sim_gpioc, sim_gpiod, sim_gpiof;
+RCC_TypeDef   sim_rcc;
+EXTI_TypeDef  sim_exti;
+
+uint32_t      sim_primask;
+uintptr_t     sim_msp;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private datatypes                      │
+   └────────────────────────────────────────┘ */
+
+#define SIM_TDR_EMPTY     0xFFFFFFFFUL     /* TDR value when nothing was written */
+#define SIM_MODE_OUTPUT   1U               /* MODER field values                 */
+#define SIM_MODE_AF       2U
+#define SIM_BREAK_BITS    10U              /* Low bits of a break character      */
+#define SIM_RX_BITS       10U              /* Samples: start, data, stop bits    */
+#define SIM_W1C_UNTOUCHED (1UL << 31)      /* Write-1-to-clear not written       */
+
+/* A character is shifted out as a bit string, LSB first: start bit,
+   data bits, stop bits. Only the bit boundaries where the level
+   changes are events. */
+
+struct Sim_Uart {
+	USART_TypeDef     *inst;
+	IRQn_Type          irqn;
+
+	uint8_t            busy;
+	uint16_t           frame;                                   /* Bits of the character       */
+	uint8_t            nb_bits;
+	uint8_t            i_bit;                                   /* Next bit boundary           */
+	uint64_t           start;                                   /* Start bit time              */
+	uint32_t           bit_q8;                                  /* Bit time as q8 cycles       */
+
+	uint8_t            buffered;                                /* Written while busy          */
+	uint16_t           buffer;
+
+	uint8_t            level;                                   /* TX output level             */
+
+	/* Receiver: bits are sampled at their middle */
+	uint8_t            rx_busy;
+	uint64_t           rx_start;                                /* Start bit falling edge      */
+	uint32_t           rx_bit_q8;
+	uint8_t            rx_i_bit;                                /* Next sample                 */
+	uint16_t           rx_frame;                                /* Sampled bits                */
+	uint8_t            rx_idle_armed;                           /* Received since the IDLE     */
+	uint64_t           rx_idle_due;                             /* 0: line not idle            */
+};
+
+struct Sim_Timer {
+	TIM_TypeDef       *inst;
+	IRQn_Type          irqn;
+	uint64_t           due;                                     /* Next update event           */
+};
+
+struct Sim_Nvic {
+	uint32_t           enabled;
+	uint32_t           pending;
+	uint8_t            priority[SIM_NB_IRQn];
+	uint64_t           due     [SIM_NB_IRQn];                   /* Handler start when pending  */
+	Sim_Irq_Handler    handler [SIM_NB_IRQn];
+};
+
+struct Sim_Line {
+	GPIO_TypeDef      *port;
+	uint32_t           num;
+	uint32_t           af;
+	struct Sim_Uart   *uart;
+
+	uint8_t            level;
+	Sim_Line_Callback  cbk;
+	void              *usrdata;
+};
+
+struct Sim_Input {
+	GPIO_TypeDef      *port;
+	uint32_t           num;
+	struct Sim_Uart   *uart;
+	Sim_Input_Source   src;
+	void              *usrdata;
+
+	uint8_t            level;
+	uint8_t            pending;                                 /* A change is due             */
+	uint64_t           due;
+	uint8_t            next_level;
+};
+
+struct Sim_Exti {
+	uint32_t           rising;                                  /* Pending lines, RPR1         */
+	uint32_t           falling;                                 /* Pending lines, FPR1         */
+};
+
+enum Sim_Event {
+	SIM_EVENT_NONE,
+	SIM_EVENT_UART_TX,
+	SIM_EVENT_UART_RX,
+	SIM_EVENT_TIMER,
+	SIM_EVENT_INPUT,
+	SIM_EVENT_IRQ
+};
+
+struct Sim_State {
+	uint64_t           now;                                     /* In HCLK cycles              */
+	uint32_t           hclk_hz;
+	uint32_t           ps_per_cycle;
+	uint32_t           irq_latency;
+
+	struct Sim_Uart    uarts [3];
+	struct Sim_Timer   timers[3];
+	struct Sim_Nvic    nvic;
+	struct Sim_Line    line;
+	struct Sim_Input   input;
+	struct Sim_Exti    exti;
+
+	Sim_Fw_Callback    fw_cbk;
+	void              *fw_usrdata;
+};
+
+static struct Sim_State __sim;
+
+static GPIO_TypeDef * const __sim_ports[] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOF};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __sim_fatal(const char *msg)
+{
+	fprintf(stderr, "sim: %s at cycle %llu\n", msg, (unsigned long long)__sim.now);
+	exit(EXIT_FAILURE);
+}
+
+static struct Sim_Uart* __sim_uart(USART_TypeDef *inst)
+{
+	uint32_t i;
+
+	for(i = 0; i < sizeof(__sim.uarts)/sizeof(__sim.uarts[0]); i++) {
+		if(__sim.uarts[i].inst == inst) return &__sim.uarts[i];
+	}
+
+	__sim_fatal("unknown UART instance");
+	return NULL;
+}
+
+static struct Sim_Timer* __sim_timer(TIM_TypeDef *inst)
+{
+	uint32_t i;
+
+	for(i = 0; i < sizeof(__sim.timers)/sizeof(__sim.timers[0]); i++) {
+		if(__sim.timers[i].inst == inst) return &__sim.timers[i];
+	}
+
+	__sim_fatal("unknown timer instance");
+	return NULL;
+}
+
+
+/* ────────────────── UART ──────────────── */
+
+static uint64_t __sim_uart_point(struct Sim_Uart *uart)
+{
+	return uart->start + (((uint64_t)uart->i_bit * uart->bit_q8) >> 8);
+}
+
+/* Skips the bit boundaries without level change */
+
+static void __sim_uart_next(struct Sim_Uart *uart)
+{
+	while((uart->i_bit < uart->nb_bits) && (((uart->frame >> uart->i_bit) & 1U) == uart->level)) {
+		uart->i_bit++;
+	}
+}
+
+static void __sim_uart_shift(struct Sim_Uart *uart, uint16_t data, uint8_t brk)
+{
+	const uint32_t nb_stop = (uart->inst->CR2 & USART_CR2_STOP_1) ? 2 : 1;
+	const uint32_t nb_low  = brk ? SIM_BREAK_BITS : 1 + 8;
+
+	/* BRR is the bit time in kernel clock cycles, times 256 for the LPUART */
+	uart->bit_q8  = (uart->inst == LPUART1) ? uart->inst->BRR : (uart->inst->BRR << 8);
+	if(!uart->bit_q8) __sim_fatal("UART enabled with BRR = 0");
+
+	uart->frame   = brk ? 0 : (uint16_t)((data & 0xFF) << 1);
+	uart->frame  |= (uint16_t)(((1U << nb_stop) - 1) << nb_low);
+	uart->nb_bits = (uint8_t)(nb_low + nb_stop);
+	uart->start   = __sim.now;
+	uart->busy    = 1;
+
+	/* Start bit begins now */
+	uart->level   = 0;
+	uart->i_bit   = 1;
+	__sim_uart_next(uart);
+}
+
+static void __sim_uart_point_process(struct Sim_Uart *uart)
+{
+	/* Level change inside the character */
+	if(uart->i_bit < uart->nb_bits) {
+		uart->level = (uart->frame >> uart->i_bit) & 1U;
+		uart->i_bit++;
+		__sim_uart_next(uart);
+		return;
+	}
+
+	/* End of the last stop bit */
+	uart->busy = 0;
+
+	if(uart->buffered) {
+		uart->buffered = 0;
+		__sim_uart_shift(uart, uart->buffer, 0);
+	}
+
+	else {
+		uart->inst->ISR |= USART_ISR_TC;
+	}
+}
+
+static uint8_t __sim_uart_rx_enabled(struct Sim_Uart *uart)
+{
+	const uint32_t en = USART_CR1_UE | USART_CR1_RE;
+
+	return (uart->inst->CR1 & en) == en;
+}
+
+/* The driven input when its pin is in AF mode, an idle line otherwise */
+
+static uint8_t __sim_uart_rx_level(struct Sim_Uart *uart)
+{
+	const struct Sim_Input *input = &__sim.input;
+
+	if((input->uart != uart) || (((input->port->MODER >> (2*input->num)) & 3U) != SIM_MODE_AF)) return 1;
+
+	return input->level;
+}
+
+static uint64_t __sim_uart_rx_bits(struct Sim_Uart *uart, uint32_t nb_bits)
+{
+	return ((uint64_t)nb_bits * uart->rx_bit_q8) >> 8;
+}
+
+static uint64_t __sim_uart_rx_point(struct Sim_Uart *uart)
+{
+	return uart->rx_start + (((uint64_t)(2*uart->rx_i_bit + 1) * uart->rx_bit_q8) >> 9);
+}
+
+static uint64_t __sim_uart_rx_due(struct Sim_Uart *uart)
+{
+	uint64_t due = uart->rx_idle_due ? uart->rx_idle_due : UINT64_MAX;
+
+	if(uart->rx_busy && (__sim_uart_rx_point(uart) < due)) due = __sim_uart_rx_point(uart);
+
+	return due;
+}
+
+/* Falling edges start a character, a line high for a character time
+   after a reception is IDLE */
+
+static void __sim_uart_rx_edge(struct Sim_Uart *uart, uint8_t level)
+{
+	if(!__sim_uart_rx_enabled(uart) || (__sim_uart_rx_level(uart) != level)) return;
+
+	if(level) {
+		if(!uart->rx_busy && uart->rx_idle_armed) uart->rx_idle_due = __sim.now + __sim_uart_rx_bits(uart, SIM_RX_BITS);
+		return;
+	}
+
+	uart->rx_idle_due = 0;
+	if(uart->rx_busy) return;
+
+	uart->rx_bit_q8 = (uart->inst == LPUART1) ? uart->inst->BRR : (uart->inst->BRR << 8);
+	if(!uart->rx_bit_q8) __sim_fatal("UART enabled with BRR = 0");
+
+	uart->rx_busy   = 1;
+	uart->rx_start  = __sim.now;
+	uart->rx_i_bit  = 0;
+	uart->rx_frame  = 0;
+}
+
+static void __sim_uart_rx_sample(struct Sim_Uart *uart)
+{
+	USART_TypeDef *inst  = uart->inst;
+	const uint8_t  level = __sim_uart_rx_level(uart);
+
+	/* Start bit checked again: a glitch otherwise */
+	if((uart->rx_i_bit == 0) && level) {
+		uart->rx_busy = 0;
+		return;
+	}
+
+	uart->rx_frame |= (uint16_t)(level << uart->rx_i_bit);
+	if(++uart->rx_i_bit < SIM_RX_BITS) return;
+
+	/* Stop bit: IDLE a character time after its end */
+	uart->rx_busy       = 0;
+	uart->rx_idle_armed = 1;
+	uart->rx_idle_due   = level ? uart->rx_start + __sim_uart_rx_bits(uart, 2*SIM_RX_BITS) : 0;
+
+	/* RDR is kept while RXNE is set */
+	if(inst->ISR & USART_ISR_RXNE_RXFNE) {
+		inst->ISR |= USART_ISR_ORE;
+		return;
+	}
+
+	inst->RDR  = (uart->rx_frame >> 1) & 0xFFU;
+	inst->ISR |= USART_ISR_RXNE_RXFNE | (level ? 0 : USART_ISR_FE);
+}
+
+static void __sim_uart_rx_process(struct Sim_Uart *uart)
+{
+	if(uart->rx_busy && (__sim_uart_rx_point(uart) == __sim.now)) {
+		__sim_uart_rx_sample(uart);
+		return;
+	}
+
+	uart->rx_idle_due    = 0;
+	uart->rx_idle_armed  = 0;
+	uart->inst->ISR     |= USART_ISR_IDLE;
+}
+
+/* RDR reads can't be seen: the ISR of a receiving UART is taken as
+   reading it */
+
+static void __sim_uart_rx_read(IRQn_Type irqn)
+{
+	uint32_t i;
+
+	for(i = 0; i < sizeof(__sim.uarts)/sizeof(__sim.uarts[0]); i++) {
+		if((__sim.uarts[i].irqn != irqn) || !(__sim.uarts[i].inst->CR1 & USART_CR1_RXNEIE_RXFNEIE)) continue;
+		__sim.uarts[i].inst->ISR &= ~USART_ISR_RXNE_RXFNE;
+	}
+}
+
+
+/* Applies the register writes done by firmware code */
+
+static void __sim_uart_writes(struct Sim_Uart *uart)
+{
+	USART_TypeDef *inst    = uart->inst;
+	const uint8_t  enabled = (inst->CR1 & (USART_CR1_UE | USART_CR1_TE)) == (USART_CR1_UE | USART_CR1_TE);
+	uint32_t       data;
+
+	/* Disabling the UART aborts the transfer and resets the flags */
+	if(!(inst->CR1 & USART_CR1_UE)) {
+		uart->busy     = 0;
+		uart->buffered = 0;
+		inst->ISR      = USART_ISR_TC | USART_ISR_TXE;
+	}
+
+	if(!__sim_uart_rx_enabled(uart)) {
+		uart->rx_busy       = 0;
+		uart->rx_idle_armed = 0;
+		uart->rx_idle_due   = 0;
+	}
+
+	/* Clear flags, then transmit: writing TDR clears TC as well */
+	if(inst->ICR) {
+		inst->ISR &= ~inst->ICR;
+		inst->ICR  = 0;
+	}
+
+	if(inst->RQR & USART_RQR_RXFRQ) inst->ISR &= ~USART_ISR_RXNE_RXFNE;
+
+	if(inst->RQR & USART_RQR_SBKRQ) {
+		if(enabled && !uart->busy) __sim_uart_shift(uart, 0, 1);
+	}
+
+	inst->RQR = 0;
+
+	if(inst->TDR != SIM_TDR_EMPTY) {
+		data      = inst->TDR;
+		inst->TDR = SIM_TDR_EMPTY;
+
+		if(!enabled) return;
+
+		inst->ISR &= ~USART_ISR_TC;
+
+		if(!uart->busy) {
+			__sim_uart_shift(uart, (uint16_t)data, 0);
+		}
+
+		else if(!uart->buffered) {
+			uart->buffered = 1;
+			uart->buffer   = (uint16_t)data;
+		}
+
+		else __sim_fatal("TDR written while full");
+	}
+}
+
+
+/* ───────────────── Timers ─────────────── */
+
+static uint64_t __sim_timer_period(TIM_TypeDef *inst)
+{
+	/* Update event when the counter wraps after ARR */
+	return (uint64_t)(inst->PSC + 1) * (inst->ARR + 1);
+}
+
+/* Update generation: restarts the counter with the new prescaler */
+
+static void __sim_timer_writes(struct Sim_Timer *timer)
+{
+	TIM_TypeDef *inst = timer->inst;
+
+	if(!(inst->EGR & TIM_EGR_UG)) return;
+
+	inst->EGR  = 0;
+	inst->CNT  = 0;
+	timer->due = __sim.now + __sim_timer_period(inst);
+
+	if(!(inst->CR1 & TIM_CR1_URS)) inst->SR |= TIM_SR_UIF;
+}
+
+
+/* ────────────────── GPIO ──────────────── */
+
+/* Output data, but on the driven input */
+
+static void __sim_gpio_idr(GPIO_TypeDef *port)
+{
+	const struct Sim_Input *input = &__sim.input;
+	uint32_t                idr   = port->ODR;
+
+	if(input->src && (input->port == port)) {
+		idr = (idr & ~(1UL << input->num)) | ((uint32_t)input->level << input->num);
+	}
+
+	port->IDR = idr;
+}
+
+static void __sim_gpio_writes(GPIO_TypeDef *port)
+{
+	if(port->BSRR) {
+		port->ODR  = (port->ODR | (port->BSRR & 0xFFFF)) & ~(port->BSRR >> 16);
+		port->BSRR = 0;
+	}
+
+	if(port->BRR) {
+		port->ODR &= ~port->BRR;
+		port->BRR  = 0;
+	}
+
+	__sim_gpio_idr(port);
+}
+
+static uint8_t __sim_line_level(void)
+{
+	const struct Sim_Line *line = &__sim.line;
+	const uint32_t         mode = (line->port->MODER >> (2*line->num)) & 3U;
+	const uint32_t         af   = (line->port->AFR[line->num >> 3] >> (4*(line->num & 7))) & 0xFU;
+	const uint32_t         pull = (line->port->PUPDR >> (2*line->num)) & 3U;
+	const uint32_t         en   = USART_CR1_UE | USART_CR1_TE;
+
+	if(mode == SIM_MODE_OUTPUT) return (line->port->ODR >> line->num) & 1U;
+
+	if((mode == SIM_MODE_AF) && (af == line->af) && line->uart && ((line->uart->inst->CR1 & en) == en)) {
+		return line->uart->busy ? line->uart->level : 1;
+	}
+
+	/* Not driven */
+	if(pull == 1) return 1;
+	if(pull == 2) return 0;
+	return 2;
+}
+
+static void __sim_line_update(void)
+{
+	uint8_t level;
+
+	if(!__sim.line.cbk) return;
+
+	level = __sim_line_level();
+	if(level == __sim.line.level) return;
+
+	__sim.line.level = level;
+	__sim.line.cbk(sim_time_ps(__sim.now), level, __sim.line.usrdata);
+}
+
+
+/* ────────────────── EXTI ──────────────── */
+
+/* EXTICR value of a port, see bsp/pin.h */
+
+static uint32_t __sim_exti_port(GPIO_TypeDef *port)
+{
+	uint32_t i;
+
+	for(i = 0; __sim_ports[i] != port; i++);
+
+	return (port == GPIOF) ? 5 : i;
+}
+
+static void __sim_exti_edge(GPIO_TypeDef *port, uint32_t num, uint8_t level)
+{
+	const uint32_t line = 1UL << num;
+	const uint32_t sel  = (EXTI->EXTICR[num >> 2] >> (8*(num & 3))) & 0xFFU;
+
+	if(sel != __sim_exti_port(port)) return;
+
+	if( level && (EXTI->RTSR1 & line)) __sim.exti.rising  |= line;
+	if(!level && (EXTI->FTSR1 & line)) __sim.exti.falling |= line;
+}
+
+/* Pending registers are write-1-to-clear: they hold SIM_W1C_UNTOUCHED
+   until written */
+
+static void __sim_exti_writes(void)
+{
+	if(!(EXTI->RPR1 & SIM_W1C_UNTOUCHED)) __sim.exti.rising  &= ~EXTI->RPR1;
+	if(!(EXTI->FPR1 & SIM_W1C_UNTOUCHED)) __sim.exti.falling &= ~EXTI->FPR1;
+
+	EXTI->RPR1 = __sim.exti.rising;
+	EXTI->FPR1 = __sim.exti.falling;
+}
+
+
+/* ───────────────── Input ──────────────── */
+
+static void __sim_input_fetch(struct Sim_Input *input)
+{
+	input->pending = input->src(&input->due, &input->next_level, input->usrdata);
+
+	if(input->pending && (input->due < __sim.now)) __sim_fatal("input change in the past");
+}
+
+static void __sim_input_change(struct Sim_Input *input)
+{
+	const uint8_t level = input->next_level ? 1 : 0;
+
+	__sim_input_fetch(input);
+	if(level == input->level) return;
+
+	input->level = level;
+	__sim_gpio_idr(input->port);
+	__sim_exti_edge(input->port, input->num, level);
+
+	if(input->uart) __sim_uart_rx_edge(input->uart, level);
+}
+
+
+/* ────────────────── NVIC ──────────────── */
+
+static void __sim_irq_raise(IRQn_Type irqn, uint8_t asserted)
+{
+	const uint32_t bit = 1UL << irqn;
+
+	/* Level sensitive: stays pending until the handler starts */
+	if(asserted && !(__sim.nvic.pending & bit)) {
+		__sim.nvic.pending   |= bit;
+		__sim.nvic.due[irqn]  = __sim.now + __sim.irq_latency;
+	}
+}
+
+static void __sim_irq_update(void)
+{
+	const uint32_t    exti = (__sim.exti.rising | __sim.exti.falling) & EXTI->IMR1;
+	struct Sim_Uart  *uart;
+	struct Sim_Timer *timer;
+	uint32_t          isr;
+	uint32_t          cr1;
+	uint32_t          i;
+
+	for(i = 0; i < sizeof(__sim.uarts)/sizeof(__sim.uarts[0]); i++) {
+		uart = &__sim.uarts[i];
+		isr  = uart->inst->ISR;
+		cr1  = uart->inst->CR1;
+
+		__sim_irq_raise(uart->irqn, ((isr & USART_ISR_TC) && (cr1 & USART_CR1_TCIE))
+			|| ((isr & (USART_ISR_RXNE_RXFNE | USART_ISR_ORE)) && (cr1 & USART_CR1_RXNEIE_RXFNEIE))
+			|| ((isr & USART_ISR_IDLE) && (cr1 & USART_CR1_IDLEIE)));
+	}
+
+	__sim_irq_raise(EXTI0_1_IRQn , (exti & 0x0003U) != 0);
+	__sim_irq_raise(EXTI2_3_IRQn , (exti & 0x000CU) != 0);
+	__sim_irq_raise(EXTI4_15_IRQn, (exti & 0xFFF0U) != 0);
+
+	for(i = 0; i < sizeof(__sim.timers)/sizeof(__sim.timers[0]); i++) {
+		timer = &__sim.timers[i];
+		__sim_irq_raise(timer->irqn, (timer->inst->SR & TIM_SR_UIF) && (timer->inst->DIER & TIM_DIER_UIE));
+	}
+}
+
+static void __sim_irq_take(IRQn_Type irqn)
+{
+	__sim.nvic.pending &= ~(1UL << irqn);
+
+	if(!__sim.nvic.handler[irqn]) __sim_fatal("IRQ without handler");
+
+	sim_fw_enter();
+	__sim.nvic.handler[irqn]();
+	__sim_uart_rx_read(irqn);
+	sim_fw_exit();
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void sim_init(uint32_t hclk_hz, uint32_t irq_latency_cycles)
+{
+	uint32_t i;
+
+	memset(&__sim, 0, sizeof(__sim));
+
+	if(!hclk_hz || (1000000000000ULL % hclk_hz)) __sim_fatal("HCLK must divide 10^12");
+
+	__sim.hclk_hz      = hclk_hz;
+	__sim.ps_per_cycle = (uint32_t)(1000000000000ULL / hclk_hz);
+	__sim.irq_latency  = irq_latency_cycles;
+
+	__sim.uarts [0] = (struct Sim_Uart ){.inst = USART1, .irqn = USART1_IRQn };
+	__sim.uarts [1] = (struct Sim_Uart ){.inst = USART2, .irqn = USART2_IRQn };
+	__sim.uarts [2] = (struct Sim_Uart ){.inst = LPUART1, .irqn = LPUART1_IRQn};
+	__sim.timers[0] = (struct Sim_Timer){.inst = TIM14 , .irqn = TIM14_IRQn  };
+	__sim.timers[1] = (struct Sim_Timer){.inst = TIM16 , .irqn = TIM16_IRQn  };
+	__sim.timers[2] = (struct Sim_Timer){.inst = TIM17 , .irqn = TIM17_IRQn  };
+
+	/* Reset values */
+	for(i = 0; i < sizeof(__sim.uarts)/sizeof(__sim.uarts[0]); i++) {
+		memset((void*)__sim.uarts[i].inst, 0, sizeof(USART_TypeDef));
+		__sim.uarts[i].inst->ISR = USART_ISR_TC | USART_ISR_TXE;
+		__sim.uarts[i].inst->TDR = SIM_TDR_EMPTY;
+	}
+
+	for(i = 0; i < sizeof(__sim_ports)/sizeof(__sim_ports[0]); i++) {
+		memset((void*)__sim_ports[i], 0, sizeof(GPIO_TypeDef));
+		__sim_ports[i]->MODER = 0xFFFFFFFF;                     /* Analog                      */
+	}
+
+	GPIOA->MODER = 0xEBFFFFFF;                                  /* SWD pins                    */
+
+	memset(&sim_tim2 , 0, sizeof(sim_tim2 ));
+	memset(&sim_tim14, 0, sizeof(sim_tim14));
+	memset(&sim_tim16, 0, sizeof(sim_tim16));
+	memset(&sim_tim17, 0, sizeof(sim_tim17));
+	memset(&sim_rcc  , 0, sizeof(sim_rcc  ));
+	memset(&sim_exti , 0, sizeof(sim_exti ));
+
+	sim_primask = 0;
+}
+
+void sim_irq_handler_set(IRQn_Type irqn, Sim_Irq_Handler handler)
+{
+	__sim.nvic.handler[irqn] = handler;
+}
+
+void sim_fw_callback_set(Sim_Fw_Callback cbk, void *usrdata)
+{
+	__sim.fw_cbk     = cbk;
+	__sim.fw_usrdata = usrdata;
+}
+
+void sim_line_watch(GPIO_TypeDef *port, uint32_t num, uint32_t af, USART_TypeDef *uart,
+	Sim_Line_Callback cbk, void *usrdata)
+{
+	__sim.line.port    = port;
+	__sim.line.num     = num;
+	__sim.line.af      = af;
+	__sim.line.uart    = uart ? __sim_uart(uart) : NULL;
+	__sim.line.cbk     = cbk;
+	__sim.line.usrdata = usrdata;
+
+	/* Report the initial level */
+	__sim.line.level   = __sim_line_level();
+	cbk(sim_time_ps(__sim.now), __sim.line.level, usrdata);
+}
+
+void sim_input_drive(GPIO_TypeDef *port, uint32_t num, USART_TypeDef *uart,
+	Sim_Input_Source src, void *usrdata)
+{
+	struct Sim_Input *input = &__sim.input;
+
+	input->port    = port;
+	input->num     = num;
+	input->uart    = uart ? __sim_uart(uart) : NULL;
+	input->src     = src;
+	input->usrdata = usrdata;
+	input->level   = 1;
+
+	__sim_gpio_idr(port);
+	__sim_input_fetch(input);
+}
+
+void sim_fw_enter(void)
+{
+	/* Free-running cycle counter, see io/cycles.h */
+	TIM2->CNT = (uint32_t)__sim.now;
+
+	EXTI->RPR1 = __sim.exti.rising  | SIM_W1C_UNTOUCHED;
+	EXTI->FPR1 = __sim.exti.falling | SIM_W1C_UNTOUCHED;
+}
+
+void sim_fw_exit(void)
+{
+	uint32_t i;
+
+	if(sim_primask) __sim_fatal("firmware code left IRQs disabled");
+
+	for(i = 0; i < sizeof(__sim_ports)/sizeof(__sim_ports[0]); i++) __sim_gpio_writes(__sim_ports[i]);
+	for(i = 0; i < sizeof(__sim.uarts)/sizeof(__sim.uarts[0]); i++) __sim_uart_writes(&__sim.uarts[i]);
+	for(i = 0; i < sizeof(__sim.timers)/sizeof(__sim.timers[0]); i++) __sim_timer_writes(&__sim.timers[i]);
+	__sim_exti_writes();
+
+	__sim_line_update();
+	__sim_irq_update();
+
+	if(__sim.fw_cbk) __sim.fw_cbk(__sim.fw_usrdata);
+}
+
+uint8_t sim_step(uint64_t until)
+{
+	enum Sim_Event    event = SIM_EVENT_NONE;
+	struct Sim_Uart  *uart  = NULL;
+	struct Sim_Timer *timer = NULL;
+	int32_t           irqn  = -1;
+	uint64_t          next  = UINT64_MAX;
+	uint64_t          t;
+	uint32_t          i;
+
+	/* Peripheral events first, then IRQs by priority */
+	for(i = 0; i < sizeof(__sim.uarts)/sizeof(__sim.uarts[0]); i++) {
+		t = __sim.uarts[i].busy ? __sim_uart_point(&__sim.uarts[i]) : UINT64_MAX;
+		if(t < next) { next = t; event = SIM_EVENT_UART_TX; uart = &__sim.uarts[i]; }
+
+		t = __sim_uart_rx_due(&__sim.uarts[i]);
+		if(t < next) { next = t; event = SIM_EVENT_UART_RX; uart = &__sim.uarts[i]; }
+	}
+
+	for(i = 0; i < sizeof(__sim.timers)/sizeof(__sim.timers[0]); i++) {
+		if(!(__sim.timers[i].inst->CR1 & TIM_CR1_CEN)) continue;
+
+		t = __sim.timers[i].due;
+		if(t < next) { next = t; event = SIM_EVENT_TIMER; timer = &__sim.timers[i]; }
+	}
+
+	if(__sim.input.pending && (__sim.input.due < next)) {
+		next  = __sim.input.due;
+		event = SIM_EVENT_INPUT;
+	}
+
+	for(i = 0; i < SIM_NB_IRQn; i++) {
+		if(!(__sim.nvic.pending & __sim.nvic.enabled & (1UL << i))) continue;
+
+		t = (__sim.nvic.due[i] > __sim.now) ? __sim.nvic.due[i] : __sim.now;
+		if((t < next) || ((t == next) && (event == SIM_EVENT_IRQ) && (__sim.nvic.priority[i] < __sim.nvic.priority[irqn]))) {
+			next  = t;
+			event = SIM_EVENT_IRQ;
+			irqn  = (int32_t)i;
+		}
+	}
+
+	if((event == SIM_EVENT_NONE) || (next > until)) return 0;
+
+	__sim.now = next;
+
+	switch(event) {
+		case SIM_EVENT_UART_TX:
+			__sim_uart_point_process(uart);
+			__sim_line_update();
+			__sim_irq_update();
+			break;
+
+		case SIM_EVENT_UART_RX:
+			__sim_uart_rx_process(uart);
+			__sim_irq_update();
+			break;
+
+		case SIM_EVENT_TIMER:
+			/* Keeps counting until stopped, but in one-pulse mode */
+			timer->inst->SR |= TIM_SR_UIF;
+			timer->due      += __sim_timer_period(timer->inst);
+
+			if(timer->inst->CR1 & TIM_CR1_OPM) timer->inst->CR1 &= ~TIM_CR1_CEN;
+			__sim_irq_update();
+			break;
+
+		case SIM_EVENT_INPUT:
+			__sim_input_change(&__sim.input);
+			__sim_irq_update();
+			break;
+
+		default:
+			__sim_irq_take((IRQn_Type)irqn);
+			break;
+	}
+
+	return 1;
+}
+
+void sim_run_until(uint64_t until)
+{
+	while(sim_step(until));
+	if(__sim.now < until) __sim.now = until;
+}
+
+uint64_t sim_now(void)
+{
+	return __sim.now;
+}
+
+uint64_t sim_time_ps(uint64_t cycles)
+{
+	return cycles * __sim.ps_per_cycle;
+}
+
+uint64_t sim_us_to_cycles(uint32_t us)
+{
+	return (uint64_t)us * (__sim.hclk_hz / 1000000);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ HAL: core and RCC                      │
+   └────────────────────────────────────────┘ */
+
+void HAL_NVIC_SetPriority(IRQn_Type irqn, uint32_t preempt, uint32_t sub)
+{
+	(void)sub;
+	__sim.nvic.priority[irqn] = (uint8_t)preempt;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irqn)
+{
+	__sim.nvic.enabled |= 1UL << irqn;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type irqn)
+{
+	__sim.nvic.enabled &= ~(1UL << irqn);
+}
+
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type irqn)
+{
+	__sim.nvic.pending &= ~(1UL << irqn);
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(__sim.now / (__sim.hclk_hz / 1000));
+}
+
+/* Stands for io/timebase.c */
+
+uint32_t timebase_us(void)
+{
+	return (uint32_t)timebase_us64();
+}
+
+uint64_t timebase_us64(void)
+{
+	return __sim.now / (__sim.hclk_hz / 1000000);
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void)
+{
+	return __sim.hclk_hz;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return __sim.hclk_hz;
+}
+
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *init)
+{
+	(void)init;
+	return HAL_OK;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ HAL: UART                              │
+   └────────────────────────────────────────┘ */
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+	USART_TypeDef   *inst = huart->Instance;
+	struct Sim_Uart *uart = __sim_uart(inst);
+	const uint32_t   pclk = HAL_RCC_GetPCLK1Freq();
+
+	uart->busy     = 0;
+	uart->buffered = 0;
+
+	inst->CR1 = 0;
+	inst->CR2 = huart->Init.StopBits;
+	inst->BRR = IS_LPUART_INSTANCE(inst) ? UART_DIV_LPUART    (pclk, huart->Init.BaudRate, 0)
+	                                     : UART_DIV_SAMPLING16(pclk, huart->Init.BaudRate, 0);
+	inst->ISR = USART_ISR_TC | USART_ISR_TXE;
+	inst->TDR = SIM_TDR_EMPTY;
+	inst->CR1 = USART_CR1_UE | huart->Init.Mode;
+
+	huart->gState  = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart)
+{
+	struct Sim_Uart *uart = __sim_uart(huart->Instance);
+
+	uart->busy     = 0;
+	uart->buffered = 0;
+
+	huart->Instance->CR1 = 0;
+	huart->Instance->CR2 = 0;
+	huart->Instance->BRR = 0;
+
+	huart->gState  = HAL_UART_STATE_RESET;
+	huart->RxState = HAL_UART_STATE_RESET;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_SetTxFifoThreshold(UART_HandleTypeDef *huart, uint32_t threshold)
+{
+	(void)huart;
+	(void)threshold;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_DisableFifoMode(UART_HandleTypeDef *huart)
+{
+	(void)huart;
+	return HAL_OK;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ HAL: timers                            │
+   └────────────────────────────────────────┘ */
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim)
+{
+	TIM_TypeDef      *inst  = htim->Instance;
+	struct Sim_Timer *timer = __sim_timer(inst);
+
+	inst->PSC = htim->Init.Prescaler;
+	inst->ARR = htim->Init.Period;
+
+	/* Update generation restarts the counter, the HAL clears the flag it sets */
+	inst->CNT  = 0;
+	inst->SR  &= ~TIM_SR_UIF;
+	timer->due = __sim.now + __sim_timer_period(inst);
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_DeInit(TIM_HandleTypeDef *htim)
+{
+	htim->Instance->CR1  = 0;
+	htim->Instance->DIER = 0;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim)
+{
+	htim->Instance->DIER |= TIM_DIER_UIE;
+	htim->Instance->CR1  |= TIM_CR1_CEN;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim)
+{
+	htim->Instance->DIER &= ~TIM_DIER_UIE;
+	htim->Instance->CR1  &= ~TIM_CR1_CEN;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *config)
+{
+	(void)htim;
+	(void)config;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, TIM_MasterConfigTypeDef *config)
+{
+	(void)htim;
+	(void)config;
+	return HAL_OK;
+}
+
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef *htim)
+{
+	/* Only the update interrupt is used */
+	if((htim->Instance->SR & TIM_SR_UIF) && (htim->Instance->DIER & TIM_DIER_UIE)) {
+		htim->Instance->SR &= ~TIM_SR_UIF;
+	}
+}
@@ -0,0 +1,71 @@
+/* ┌──────────────────────────────────────┐
+   │ Virtual-time peripheral simulator    │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "stm32g0xx_hal.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Model                                  │
+   └────────────────────────────────────────┘ */
+
+/* Time is counted in HCLK cycles. Peripherals are cycle-exact: UART
+ * bits last BRR cycles, timers expire after (PSC+1)*(ARR+1) cycles,
+ * TIM2 counts HCLK cycles. Firmware code itself runs in zero time,
+ * ISRs start a fixed latency after their flag is raised.
+ *
+ * Firmware code called outside of the ISRs must be enclosed between
+ * sim_fw_enter and sim_fw_exit, so that register writes take effect. */
+
+typedef void (*Sim_Irq_Handler)(void);
+
+/* Level of the watched pin changed, time is in ps. level is 0, 1, or
+ * 2 when the pin is not driven and has no pull resistor. */
+typedef void (*Sim_Line_Callback)(uint64_t time_ps, uint8_t level, void *usrdata);
+
+/* Called after each piece of firmware code, e.g. to trace its state */
+typedef void (*Sim_Fw_Callback)(void *usrdata);
+
+/* Next level change of a driven input, at cycle. Returns 0 when there
+ * is none left. */
+typedef uint8_t (*Sim_Input_Source)(uint64_t *cycle, uint8_t *level, void *usrdata);
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* hclk_hz must divide 10^12 for exact ps timestamps */
+void     sim_init           (uint32_t hclk_hz, uint32_t irq_latency_cycles);
+
+void     sim_irq_handler_set(IRQn_Type irqn, Sim_Irq_Handler handler);
+void     sim_fw_callback_set(Sim_Fw_Callback cbk, void *usrdata);
+
+/* Watches a pin. In AF mode with alternate function af, it follows the TX output of uart */
+void     sim_line_watch     (GPIO_TypeDef *port, uint32_t num, uint32_t af, USART_TypeDef *uart,
+                             Sim_Line_Callback cbk, void *usrdata);
+
+/* Drives an input pin from src, high until its first change. Its EXTI
+ * line sees the edges, and uart receives from it in AF mode. RDR is
+ * taken as read by each ISR of uart while RXNEIE is set. */
+void     sim_input_drive    (GPIO_TypeDef *port, uint32_t num, USART_TypeDef *uart,
+                             Sim_Input_Source src, void *usrdata);
+
+void     sim_fw_enter       (void);
+void     sim_fw_exit        (void);
+
+/* Runs the next event if it is due before until. Returns 0 if there is none. */
+uint8_t  sim_step           (uint64_t until);
+void     sim_run_until      (uint64_t until);
+
+uint64_t sim_now            (void);
+uint64_t sim_time_ps        (uint64_t cycles);
+uint64_t sim_us_to_cycles   (uint32_t us);
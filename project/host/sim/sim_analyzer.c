@@ -0,0 +1,649 @@
+/* ┌──────────────────────────────────────┐
+   │ DMX line analyzer simulation         │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+/* Runs the firmware DMX receiver (io/dmx_rx.c) on the simulated USART1
+   and EXTI, fed by a console generator on the dmx_in pin, and checks
+   each frame record against the generated line. Records are read from
+   a main loop polled every --poll-us, as app/analyzer.c sends them.
+   Exits with an error on any mismatch or lost record. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <bsp/pin.h>
+#include <io/cycles.h>
+#include <io/dmx.h>
+#include <io/dmx_rx.h>
+
+#include "sim.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Simulation config                      │
+   └────────────────────────────────────────┘ */
+
+#define SIM_ANALYZER_IRQ_LATENCY   16     /* Cortex-M0+ exception entry, in cycles           */
+#define SIM_ANALYZER_IDLE_US       200    /* Line idle before the first break                */
+#define SIM_ANALYZER_HOLD_US       50000  /* Longest frame of the controller, with margin    */
+#define SIM_ANALYZER_SHORT_US      60     /* Break of the glitched frames                    */
+#define SIM_ANALYZER_GLITCH_SLOT   2      /* Slot with a low stop bit in the glitched frames */
+#define SIM_ANALYZER_GLITCH_VALUE  0xA5
+#define SIM_ANALYZER_CAPTURE_AT    10     /* Frames received before the capture              */
+#define SIM_ANALYZER_RECORD_BYTES  33     /* ANALYZER_FRAME command frame, app/command.h     */
+#define SIM_ANALYZER_NB_REPORTED   5      /* Mismatches printed                              */
+
+#define SIM_ANALYZER_SLOT_BITS     11     /* Start, 8 data and 2 stop bits                   */
+#define SIM_ANALYZER_STOP_SAMPLE   38     /* Middle of the first stop bit, in us             */
+#define SIM_ANALYZER_IDLE_AFTER    80     /* IDLE from a start bit: 10 bits, 10 idle ones    */
+
+struct Sim_Analyzer_Config {
+	uint32_t clock_mhz;
+	uint32_t nb_frames;
+	uint32_t irq_latency;
+	uint32_t break_us;
+	uint32_t mab_us;
+	uint32_t nb_slots;
+	uint32_t mark_us;                                           /* Between slots               */
+	uint32_t mbb_us;
+	uint32_t start_code;
+	uint32_t glitch_every;                                      /* 0: no glitched frame        */
+	uint32_t poll_us;                                           /* Main loop period            */
+	uint32_t baudrate;                                          /* Host link, for the load     */
+	uint32_t capture_first;
+	uint32_t capture_count;                                     /* 0: up to the window size    */
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* Same wiring as universe 0 and the receiver in main.c */
+
+static struct DMX_Controller __sim_dmx = {
+	.uart       = USART1,
+	.timer      = TIM17,
+	.pin_output = &pin_dmx_out
+};
+
+static struct DMX_RX __sim_rx = {
+	.uart       = USART1,
+	.pin_input  = &pin_dmx_in,
+	.input_port = BSP_PORT_A
+};
+
+/* Generated frame, times in cycles */
+
+struct Sim_Analyzer_Truth {
+	uint64_t break_start;
+	uint32_t break_len;
+	uint32_t mab_len;
+	uint64_t last_slot;                                         /* Start bit of the last byte  */
+	uint8_t  flags;                                             /* Expected, but ESTIMATED     */
+};
+
+/* Line segments of the frame in progress, one per bit */
+
+#define SIM_ANALYZER_NB_SEGMENTS   (4 + SIM_ANALYZER_SLOT_BITS * 2 * (DMX_NB_DATA_SLOTS + 1))
+
+struct Sim_Analyzer_Generator {
+	uint32_t                    i_frame;                        /* Next frame to build         */
+	uint32_t                    nb_segments;
+	uint32_t                    i_segment;
+	uint8_t                     levels [SIM_ANALYZER_NB_SEGMENTS];
+	uint32_t                    lengths[SIM_ANALYZER_NB_SEGMENTS];
+	uint64_t                    cursor;                         /* Next segment start          */
+	uint8_t                     level;
+};
+
+struct Sim_Analyzer_State {
+	struct Sim_Analyzer_Config     config;
+	uint32_t                       cycles_per_us;
+	uint32_t                       tolerance;                   /* Cycles, ISR entry jitter    */
+
+	struct Sim_Analyzer_Generator  gen;
+	struct Sim_Analyzer_Truth     *truth;                       /* One more frame than checked */
+
+	uint32_t                       next;                        /* Next record to read         */
+	uint32_t                       checked;
+	uint32_t                       mismatches;
+	uint32_t                       lost;
+
+	uint8_t                        capture_armed;
+	uint8_t                        capture_done;
+	uint32_t                       capture_sequence;
+	uint32_t                       capture_errors;
+};
+
+static struct Sim_Analyzer_State __sim_state;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Firmware glue                          │
+   └────────────────────────────────────────┘ */
+
+void Error_Handler(void)
+{
+	fprintf(stderr, "sim: firmware called Error_Handler\n");
+	exit(EXIT_FAILURE);
+}
+
+static void USART1_IRQHandler(void)
+{
+	if(dmx_rx_is_running(&__sim_rx)) dmx_rx_irq_handler(&__sim_rx);
+	else                             dmx_controller_irq_handler(&__sim_dmx);
+}
+
+static void TIM17_IRQHandler(void)
+{
+	dmx_controller_timer_irq_handler(&__sim_dmx);
+}
+
+static void EXTI4_15_IRQHandler(void)
+{
+	dmx_rx_exti_irq_handler(&__sim_rx);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Console generator                      │
+   └────────────────────────────────────────┘ */
+
+static uint8_t __sim_analyzer_glitched(const struct Sim_Analyzer_Config *config, uint32_t i_frame)
+{
+	return config->glitch_every && ((i_frame % config->glitch_every) == (config->glitch_every - 1));
+}
+
+/* Glitched frames alternate a short break and a low stop bit */
+
+static uint8_t __sim_analyzer_short_break(const struct Sim_Analyzer_Config *config, uint32_t i_frame)
+{
+	return __sim_analyzer_glitched(config, i_frame) && !((i_frame / config->glitch_every) & 1);
+}
+
+static uint8_t __sim_analyzer_framing(const struct Sim_Analyzer_Config *config, uint32_t i_frame)
+{
+	return __sim_analyzer_glitched(config, i_frame) && ((i_frame / config->glitch_every) & 1)
+		&& (config->nb_slots > SIM_ANALYZER_GLITCH_SLOT);
+}
+
+/* Value of a data slot, changes from frame to frame */
+
+static uint8_t __sim_analyzer_slot(const struct Sim_Analyzer_Config *config, uint32_t i_frame, uint32_t i_slot)
+{
+	if((i_slot == SIM_ANALYZER_GLITCH_SLOT) && __sim_analyzer_framing(config, i_frame)) return SIM_ANALYZER_GLITCH_VALUE;
+
+	return (uint8_t)(i_slot * 7 + i_frame * 13 + 3);
+}
+
+static void __sim_analyzer_segment(struct Sim_Analyzer_Generator *gen, uint8_t level, uint32_t length)
+{
+	gen->levels [gen->nb_segments] = level;
+	gen->lengths[gen->nb_segments] = length;
+	gen->nb_segments++;
+}
+
+static void __sim_analyzer_frame_build(struct Sim_Analyzer_State *st)
+{
+	const struct Sim_Analyzer_Config *config  = &st->config;
+	struct Sim_Analyzer_Generator    *gen     = &st->gen;
+	struct Sim_Analyzer_Truth        *truth   = &st->truth[gen->i_frame];
+	const uint32_t                    us      = st->cycles_per_us;
+	const uint32_t                    bit     = 4 * us;
+	const uint32_t                    brk     = __sim_analyzer_short_break(config, gen->i_frame) ? SIM_ANALYZER_SHORT_US : config->break_us;
+	uint64_t                          t       = gen->cursor;
+	uint32_t                          i_byte;
+	uint32_t                          i_bit;
+	uint32_t                          data;
+
+	gen->nb_segments = 0;
+	gen->i_segment   = 0;
+
+	truth->break_start = t;
+	truth->break_len   = brk * us;
+	truth->mab_len     = config->mab_us * us;
+	truth->flags       = 0;
+
+	if(brk            < DMX_RX_BREAK_MIN_US) truth->flags |= DMX_RX_FLAG_SHORT_BREAK;
+	if(config->mab_us < DMX_RX_MAB_MIN_US  ) truth->flags |= DMX_RX_FLAG_SHORT_MAB;
+	if(config->nb_slots > DMX_NB_DATA_SLOTS) truth->flags |= DMX_RX_FLAG_OVERSIZE;
+	if(__sim_analyzer_framing(config, gen->i_frame)) truth->flags |= DMX_RX_FLAG_FRAMING;
+
+	__sim_analyzer_segment(gen, 0, brk            * us);
+	__sim_analyzer_segment(gen, 1, config->mab_us * us);
+	t += (brk + config->mab_us) * us;
+
+	for(i_byte = 0; i_byte <= config->nb_slots; i_byte++) {
+		data = i_byte ? __sim_analyzer_slot(config, gen->i_frame, i_byte - 1) : config->start_code;
+
+		truth->last_slot = t;
+
+		__sim_analyzer_segment(gen, 0, bit);
+		for(i_bit = 0; i_bit < 8; i_bit++) __sim_analyzer_segment(gen, (data >> i_bit) & 1, bit);
+
+		/* Low first stop bit: framing error */
+		__sim_analyzer_segment(gen, !((i_byte == SIM_ANALYZER_GLITCH_SLOT + 1) && (truth->flags & DMX_RX_FLAG_FRAMING)), bit);
+		__sim_analyzer_segment(gen, 1, bit);
+		t += SIM_ANALYZER_SLOT_BITS * bit;
+
+		if(i_byte < config->nb_slots) {
+			__sim_analyzer_segment(gen, 1, config->mark_us * us);
+			t += config->mark_us * us;
+		}
+	}
+
+	__sim_analyzer_segment(gen, 1, config->mbb_us * us);
+}
+
+/* Sim_Input_Source: level changes only */
+
+static uint8_t __sim_analyzer_source(uint64_t *cycle, uint8_t *level, void *usrdata)
+{
+	struct Sim_Analyzer_State     *st  = (struct Sim_Analyzer_State*)usrdata;
+	struct Sim_Analyzer_Generator *gen = &st->gen;
+	uint64_t                       start;
+	uint8_t                        seg_level;
+
+	for(;;) {
+		if(gen->i_segment == gen->nb_segments) {
+			/* No break after the last frame: closed by the UART IDLE event */
+			if(gen->i_frame >= st->config.nb_frames) return 0;
+
+			__sim_analyzer_frame_build(st);
+			gen->i_frame++;
+		}
+
+		start         = gen->cursor;
+		seg_level     = gen->levels [gen->i_segment];
+		gen->cursor  += gen->lengths[gen->i_segment];
+		gen->i_segment++;
+
+		if(seg_level != gen->level) {
+			gen->level = seg_level;
+			*cycle     = start;
+			*level     = seg_level;
+			return 1;
+		}
+	}
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Checks                                 │
+   └────────────────────────────────────────┘ */
+
+static uint8_t __sim_analyzer_near(uint32_t value, uint64_t expected, uint32_t tolerance)
+{
+	return (value + (uint64_t)tolerance >= expected) && (value <= expected + tolerance);
+}
+
+static void __sim_analyzer_mismatch(struct Sim_Analyzer_State *st, const struct DMX_RX_Frame *frame, const char *what,
+	uint64_t expected, uint32_t value)
+{
+	if(st->mismatches++ >= SIM_ANALYZER_NB_REPORTED) return;
+
+	printf("frame %u: %s %u, expected %llu (flags 0x%02x)\n", frame->sequence, what, value,
+		(unsigned long long)expected, frame->flags);
+}
+
+/* The break start edge is only caught after an IDLE, a character time
+   after the last slot: otherwise the frame is ESTIMATED */
+
+static int __sim_analyzer_estimated(struct Sim_Analyzer_State *st, uint32_t sequence)
+{
+	const uint64_t us   = st->cycles_per_us;
+	const uint64_t fall = (SIM_ANALYZER_SLOT_BITS * 4 + st->config.mbb_us) * us;
+	const uint64_t idle = SIM_ANALYZER_IDLE_AFTER * us + st->config.irq_latency;
+
+	/* No reception before the first one */
+	if(!sequence) return 1;
+
+	/* Too close to tell */
+	if(fall + st->tolerance < idle) return 1;
+	if(fall > idle + st->tolerance) return 0;
+	return -1;
+}
+
+static void __sim_analyzer_check(struct Sim_Analyzer_State *st, const struct DMX_RX_Frame *frame)
+{
+	const struct Sim_Analyzer_Config *config = &st->config;
+	const struct Sim_Analyzer_Truth  *truth  = &st->truth[frame->sequence];
+	const uint32_t                    tol    = st->tolerance;
+	const uint32_t                    us     = st->cycles_per_us;
+	const uint8_t                     mask   = (uint8_t)~DMX_RX_FLAG_ESTIMATED;
+	const int                         est    = __sim_analyzer_estimated(st, frame->sequence);
+	uint32_t                          nb_slots;
+
+	st->checked++;
+
+	if(frame->sequence > config->nb_frames) {
+		__sim_analyzer_mismatch(st, frame, "sequence", config->nb_frames, frame->sequence);
+		return;
+	}
+
+	nb_slots = (config->nb_slots > 0xFFFF) ? 0xFFFF : config->nb_slots;
+
+	if(!__sim_analyzer_near(frame->break_len, truth->break_len, tol)) __sim_analyzer_mismatch(st, frame, "break_len", truth->break_len, frame->break_len);
+	if(!__sim_analyzer_near(frame->mab_len  , truth->mab_len  , tol)) __sim_analyzer_mismatch(st, frame, "mab_len"  , truth->mab_len  , frame->mab_len  );
+
+	if(frame->sequence && !__sim_analyzer_near(frame->interval, truth->break_start - truth[-1].break_start, tol)) {
+		__sim_analyzer_mismatch(st, frame, "interval", truth->break_start - truth[-1].break_start, frame->interval);
+	}
+
+	if(!__sim_analyzer_near(frame->length, truth->last_slot + SIM_ANALYZER_STOP_SAMPLE * us - truth->break_start, tol)) {
+		__sim_analyzer_mismatch(st, frame, "length", truth->last_slot + SIM_ANALYZER_STOP_SAMPLE * us - truth->break_start, frame->length);
+	}
+
+	if((nb_slots > 1) && !__sim_analyzer_near(frame->gap_max, (SIM_ANALYZER_SLOT_BITS * 4 + config->mark_us) * us, tol)) {
+		__sim_analyzer_mismatch(st, frame, "gap_max", (SIM_ANALYZER_SLOT_BITS * 4 + config->mark_us) * us, frame->gap_max);
+	}
+
+	if(frame->nb_slots   != nb_slots          ) __sim_analyzer_mismatch(st, frame, "nb_slots"  , nb_slots          , frame->nb_slots  );
+	if(frame->start_code != config->start_code) __sim_analyzer_mismatch(st, frame, "start_code", config->start_code, frame->start_code);
+
+	if((frame->flags & mask) != truth->flags) __sim_analyzer_mismatch(st, frame, "flags", truth->flags, frame->flags);
+
+	if((est >= 0) && (((frame->flags & DMX_RX_FLAG_ESTIMATED) != 0) != est)) {
+		__sim_analyzer_mismatch(st, frame, "estimated", (uint64_t)est, (frame->flags & DMX_RX_FLAG_ESTIMATED) != 0);
+	}
+}
+
+static void __sim_analyzer_capture(struct Sim_Analyzer_State *st)
+{
+	const struct Sim_Analyzer_Config *config = &st->config;
+	struct DMX_RX_Frame               frame;
+	uint32_t                          i;
+
+	if(!st->capture_armed) {
+		if(dmx_rx_head(&__sim_rx) < SIM_ANALYZER_CAPTURE_AT) return;
+
+		if(!dmx_rx_capture(&__sim_rx, config->capture_first, config->capture_count)) {
+			fprintf(stderr, "invalid capture window\n");
+			exit(EXIT_FAILURE);
+		}
+
+		st->capture_armed = 1;
+		return;
+	}
+
+	if(st->capture_done || !dmx_rx_capture_get(&__sim_rx, &frame)) return;
+
+	st->capture_done     = 1;
+	st->capture_sequence = frame.sequence;
+
+	for(i = 0; i < config->capture_count; i++) {
+		if(__sim_rx.slots[i] != __sim_analyzer_slot(config, frame.sequence, config->capture_first + i)) st->capture_errors++;
+	}
+}
+
+/* Main loop: records from the oldest one still in the ring, as
+   app/analyzer.c */
+
+static void __sim_analyzer_poll(struct Sim_Analyzer_State *st)
+{
+	const uint32_t      head = dmx_rx_head(&__sim_rx);
+	struct DMX_RX_Frame frame;
+
+	if((head - st->next) > DMX_RX_NB_FRAMES) {
+		st->lost += head - st->next - DMX_RX_NB_FRAMES;
+		st->next  = head - DMX_RX_NB_FRAMES;
+	}
+
+	while(st->next != head) {
+		if(dmx_rx_read(&__sim_rx, st->next, &frame)) __sim_analyzer_check(st, &frame);
+		else                                         st->lost++;
+
+		st->next++;
+	}
+
+	__sim_analyzer_capture(st);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __sim_analyzer_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --frames N         frames to simulate (1000)\n"
+		"  --clock MHZ        HCLK: 16, 32 or 64 (32)\n"
+		"  --latency CYCLES   ISR entry latency (%u)\n"
+		"  --break-us US      break (88)\n"
+		"  --mab-us US        mark after break (8)\n"
+		"  --slots N          data slots per frame (24)\n"
+		"  --mark-us US       mark between slots (0)\n"
+		"  --mbb-us US        mark before break (8)\n"
+		"  --start-code N     start code (0)\n"
+		"  --glitch-every N   short break or framing error every N frames, 0: none (0)\n"
+		"  --poll-us US       main loop period (1000)\n"
+		"  --baud N           host link baud rate, for its load (1000000)\n"
+		"  --capture-first N  first captured slot (0)\n"
+		"  --capture-count N  captured slots, 0: as many as possible (0)\n",
+		name, SIM_ANALYZER_IRQ_LATENCY);
+}
+
+static uint8_t __sim_analyzer_args(struct Sim_Analyzer_Config *config, int argc, char **argv)
+{
+	const char *opt;
+	const char *val;
+	int         i_arg;
+
+	/* Highest legal refresh rate: 1204us break to break */
+	config->clock_mhz     = 32;
+	config->nb_frames     = 1000;
+	config->irq_latency   = SIM_ANALYZER_IRQ_LATENCY;
+	config->break_us      = 88;
+	config->mab_us        = 8;
+	config->nb_slots      = 24;
+	config->mark_us       = 0;
+	config->mbb_us        = 8;
+	config->start_code    = DMX_START_CODE;
+	config->glitch_every  = 0;
+	config->poll_us       = 1000;
+	config->baudrate      = 1000000;
+	config->capture_first = 0;
+	config->capture_count = 0;
+
+	for(i_arg = 1; i_arg < argc; i_arg += 2) {
+		opt = argv[i_arg];
+		val = (i_arg + 1 < argc) ? argv[i_arg + 1] : NULL;
+		if(!val) return 0;
+
+		if     (!strcmp(opt, "--frames"       )) config->nb_frames     = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--clock"        )) config->clock_mhz     = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--latency"      )) config->irq_latency   = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--break-us"     )) config->break_us      = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--mab-us"       )) config->mab_us        = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--slots"        )) config->nb_slots      = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--mark-us"      )) config->mark_us       = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--mbb-us"       )) config->mbb_us        = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--start-code"   )) config->start_code    = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--glitch-every" )) config->glitch_every  = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--poll-us"      )) config->poll_us       = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--baud"         )) config->baudrate      = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--capture-first")) config->capture_first = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--capture-count")) config->capture_count = strtoul(val, NULL, 0);
+		else return 0;
+	}
+
+	/* Clock profiles, see io/clock.h */
+	if((config->clock_mhz != 16) && (config->clock_mhz != 32) && (config->clock_mhz != 64)) return 0;
+
+	/* Breaks are low at the stop sample, marks can be seen */
+	if((config->break_us * 1000 <= DMX_RX_STOP_SAMPLE_NS) || !config->mab_us || !config->mbb_us) return 0;
+	if((config->nb_slots > DMX_NB_DATA_SLOTS) || (config->start_code > 0xFF)) return 0;
+
+	if(!config->capture_count) {
+		config->capture_count = (config->nb_slots > config->capture_first) ? config->nb_slots - config->capture_first : 0;
+		if(config->capture_count > DMX_RX_CAPTURE_SLOTS) config->capture_count = DMX_RX_CAPTURE_SLOTS;
+	}
+
+	return (config->nb_frames > SIM_ANALYZER_CAPTURE_AT) && (config->poll_us > 0) && (config->baudrate > 0);
+}
+
+static void __sim_analyzer_range(const char *name, uint32_t min, uint32_t max, double cyc_us)
+{
+	if(min > max) {
+		printf("%-15s: -\n", name);
+		return;
+	}
+
+	printf("%-15s: min %10.3fus  max %10.3fus\n", name, min / cyc_us, max / cyc_us);
+}
+
+static uint32_t __sim_analyzer_report(struct Sim_Analyzer_State *st, double wall_s)
+{
+	const struct Sim_Analyzer_Config *config  = &st->config;
+	const double                      cyc_us  = config->clock_mhz;
+	struct DMX_RX_Stats               stats;
+	uint32_t                          nb_errs = st->mismatches + st->lost + st->capture_errors;
+	double                            load;
+
+	sim_fw_enter();
+	dmx_rx_get_stats(&__sim_rx, &stats, 0);
+	sim_fw_exit();
+
+	printf("sim analyzer clock=%uMHz break=%uus mab=%uus slots=%u mark=%uus mbb=%uus latency=%u glitch_every=%u\n",
+		config->clock_mhz, config->break_us, config->mab_us, config->nb_slots, config->mark_us, config->mbb_us,
+		config->irq_latency, config->glitch_every);
+
+	printf("%-15s: %u\n", "frames", stats.frames);
+	__sim_analyzer_range("break"   , stats.break_min   , stats.break_max   , cyc_us);
+	__sim_analyzer_range("mab"     , stats.mab_min     , stats.mab_max     , cyc_us);
+	__sim_analyzer_range("interval", stats.interval_min, stats.interval_max, cyc_us);
+
+	if(stats.slots_min <= stats.slots_max) printf("%-15s: min %u  max %u\n", "slots", stats.slots_min, stats.slots_max);
+	if(stats.interval_max) printf("%-15s: %.2fHz at the shortest interval\n", "refresh", 1e6 * cyc_us / stats.interval_min);
+
+	printf("%-15s: short_breaks=%u short_mabs=%u framing=%u noise=%u overruns=%u estimated=%u\n", "flags",
+		stats.short_breaks, stats.short_mabs, stats.framing, stats.noise, stats.overruns, stats.estimated);
+
+	if(stats.frames) {
+		printf("%-15s: uart=%u exti=%u, %.1f per frame\n", "irqs", stats.uart_irqs, stats.exti_irqs,
+			(double)(stats.uart_irqs + stats.exti_irqs) / stats.frames);
+	}
+
+	printf("%-15s: checked=%u mismatches=%u lost=%u\n", "records", st->checked, st->mismatches, st->lost);
+
+	if(st->capture_done) {
+		printf("%-15s: slots %u to %u of frame %u, errors=%u\n", "capture", config->capture_first + 1,
+			config->capture_first + config->capture_count, st->capture_sequence, st->capture_errors);
+	}
+
+	else {
+		printf("%-15s: not held\n", "capture");
+		nb_errs++;
+	}
+
+	/* Records must be sent faster than frames come */
+	if(stats.interval_max) {
+		load = (SIM_ANALYZER_RECORD_BYTES * 10.0 * 1e6 / config->baudrate) / (stats.interval_min / cyc_us);
+		printf("%-15s: %.1f%% at %u baud\n", "link_load", 100.0 * load, config->baudrate);
+		if(load >= 1.0) nb_errs++;
+	}
+
+	printf("%-15s: %.3fs, %.0f frames/s\n", "wall", wall_s, wall_s > 0 ? stats.frames / wall_s : 0.0);
+
+	if(st->checked + st->lost < config->nb_frames) {
+		printf("FAILED: %u records out of %u\n", st->checked + st->lost, config->nb_frames);
+		return nb_errs + 1;
+	}
+
+	printf("%s\n", nb_errs ? "FAILED" : "OK");
+	return nb_errs;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+int main(int argc, char **argv)
+{
+	struct Sim_Analyzer_State *st = &__sim_state;
+	struct timespec            wall_start;
+	struct timespec            wall_end;
+	uint64_t                   limit;
+	uint64_t                   poll;
+	uint8_t                    started;
+
+	if(!__sim_analyzer_args(&st->config, argc, argv)) {
+		__sim_analyzer_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	st->truth = calloc(st->config.nb_frames + 2, sizeof(*st->truth));
+	if(!st->truth) return EXIT_FAILURE;
+
+	sim_init(st->config.clock_mhz * 1000000, st->config.irq_latency);
+	sim_irq_handler_set(USART1_IRQn  , USART1_IRQHandler  );
+	sim_irq_handler_set(TIM17_IRQn   , TIM17_IRQHandler   );
+	sim_irq_handler_set(EXTI4_15_IRQn, EXTI4_15_IRQHandler);
+
+	st->cycles_per_us = st->config.clock_mhz;
+	st->tolerance     = 2 * st->config.irq_latency + 2;
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+	/* Boot sequence from the startup code and main.c */
+	sim_fw_enter();
+	cycles_init();
+	bsp_pins_init();
+	dmx_controller_init(&__sim_dmx);
+	dmx_rx_init(&__sim_rx);
+	dmx_controller_start(&__sim_dmx);
+	sim_fw_exit();
+
+	/* Start sequence of app/analyzer.c */
+	sim_fw_enter();
+	dmx_controller_hold(&__sim_dmx);
+	sim_fw_exit();
+
+	limit = sim_now() + sim_us_to_cycles(SIM_ANALYZER_HOLD_US);
+	while(!dmx_controller_is_held(&__sim_dmx) && sim_step(limit));
+
+	sim_fw_enter();
+	started = dmx_controller_is_held(&__sim_dmx) && dmx_rx_start(&__sim_rx);
+	sim_fw_exit();
+
+	if(!started) {
+		fprintf(stderr, "receiver not started\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Console on the RX pin, USART1_RX is AF1, see bsp/pin_table.h */
+	st->gen.cursor = sim_now() + sim_us_to_cycles(SIM_ANALYZER_IDLE_US);
+	st->gen.level  = 1;
+	sim_input_drive(pin_dmx_in.port, __builtin_ctz(pin_dmx_in.pin), USART1, __sim_analyzer_source, st);
+
+	/* Generated frames plus the main loop, with margin */
+	limit = st->gen.cursor + (uint64_t)(st->config.nb_frames + 2) * 2
+		* sim_us_to_cycles(st->config.break_us + st->config.mab_us + st->config.mbb_us
+			+ (SIM_ANALYZER_SLOT_BITS * 4 + st->config.mark_us) * (st->config.nb_slots + 1));
+	poll  = sim_now();
+
+	while((st->next < st->config.nb_frames) && (poll < limit)) {
+		poll += sim_us_to_cycles(st->config.poll_us);
+		sim_run_until(poll);
+
+		sim_fw_enter();
+		__sim_analyzer_poll(st);
+		sim_fw_exit();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+	return __sim_analyzer_report(st, (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9)
+		? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,451 @@
+/* ┌──────────────────────────────────────┐
+   │ DMX output waveform simulation       │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+/* Runs the firmware DMX controller (io/dmx.c, io/oneshot_timer.c) on
+   the simulated USART1 and TIM17, decodes the output pin and checks
+   its timing against the DMX512 limits. Exits with an error on any
+   violation or data mismatch. The line can be dumped as a VCD file. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <bsp/pin.h>
+#include <io/cycles.h>
+#include <io/dmx.h>
+#include <app/boot.h>
+
+#include "sim.h"
+#include "vcd.h"
+#include "dmx_decoder.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Simulation config                      │
+   └────────────────────────────────────────┘ */
+
+#define SIM_DMX_INIT_US        100    /* From init to start, as main.c restores the look */
+#define SIM_DMX_IRQ_LATENCY    16     /* Cortex-M0+ exception entry, in cycles           */
+#define SIM_DMX_FRAME_MAX_US   1000000
+#define SIM_DMX_BOOT_TOL_US    2      /* boot_stats rounding and IRQ latency             */
+
+struct Sim_DMX_Config {
+	uint32_t                   clock_mhz;
+	uint32_t                   nb_frames;
+	uint32_t                   irq_latency;
+	enum DMX_Timing_Preset     preset;
+	int32_t                    nb_slots;                        /* -1: from the preset         */
+	int32_t                    mark_us;                         /* -1: from the preset         */
+	uint32_t                   period_us;                       /* Fixed schedule if not 0     */
+	uint32_t                   sync_us;                         /* Sync events period, or 0    */
+	const char                *vcd_path;
+	uint32_t                   vcd_frames;
+	struct DMX_Decoder_Limits  limits;
+};
+
+static const char *__sim_dmx_preset_names[DMX_TIMING_NB_PRESETS] = {
+	[DMX_TIMING_PRESET_BOOT        ] = "boot",
+	[DMX_TIMING_PRESET_MAX_REFRESH ] = "max_refresh",
+	[DMX_TIMING_PRESET_CONSERVATIVE] = "conservative"
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* Same wiring as universe 0 in main.c */
+
+static struct DMX_Controller __sim_dmx = {
+	.uart       = USART1,
+	.timer      = TIM17,
+	.pin_output = &pin_dmx_out
+};
+
+struct Sim_DMX_State {
+	struct Sim_DMX_Config      config;
+	struct DMX_Timing          timing;
+
+	struct DMX_Decoder         decoder;
+	uint32_t                   data_errors;
+	uint32_t                   cut_frames;                      /* Ended early by a sync       */
+	uint64_t                   next_sync_ps;
+	uint64_t                   boot_ps;                         /* cycles_init, as in main.c   */
+	uint64_t                   start_ps;
+	uint64_t                   first_break_ps;
+
+	struct VCD_Writer          vcd;
+	uint8_t                    vcd_tx;
+	uint8_t                    vcd_state;
+	uint8_t                    vcd_slot;
+	uint32_t                   last_state;
+	uint32_t                   last_slot;
+};
+
+static struct Sim_DMX_State __sim_state;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Firmware glue                          │
+   └────────────────────────────────────────┘ */
+
+void Error_Handler(void)
+{
+	fprintf(stderr, "sim: firmware called Error_Handler\n");
+	exit(EXIT_FAILURE);
+}
+
+static void USART1_IRQHandler(void)
+{
+	dmx_controller_irq_handler(&__sim_dmx);
+}
+
+static void TIM17_IRQHandler(void)
+{
+	dmx_controller_timer_irq_handler(&__sim_dmx);
+}
+
+/* Expected value of a slot */
+
+static uint8_t __sim_dmx_pattern(uint32_t i_slot)
+{
+	return (uint8_t)(i_slot * 7 + 3);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Callbacks                              │
+   └────────────────────────────────────────┘ */
+
+static void __sim_dmx_line(uint64_t time_ps, uint8_t level, void *usrdata)
+{
+	struct Sim_DMX_State *st = (struct Sim_DMX_State*)usrdata;
+
+	dmx_decoder_edge(&st->decoder, time_ps, level);
+
+	if(st->vcd.file) vcd_change(&st->vcd, time_ps, st->vcd_tx, level);
+}
+
+static void __sim_dmx_fw(void *usrdata)
+{
+	struct Sim_DMX_State *st = (struct Sim_DMX_State*)usrdata;
+	const uint64_t        now = sim_time_ps(sim_now());
+
+	/* Main loop of main.c */
+	boot_poll(&__sim_dmx);
+
+	/* Trigger input or FRAME_SYNC command */
+	if(st->config.sync_us && st->start_ps && (now >= st->next_sync_ps)) {
+		st->next_sync_ps = now + (uint64_t)st->config.sync_us * 1000000;
+		dmx_controller_sync(&__sim_dmx);
+	}
+
+	if(!st->vcd.file) return;
+
+	if(__sim_dmx.state != st->last_state) {
+		st->last_state = __sim_dmx.state;
+		vcd_change(&st->vcd, now, st->vcd_state, st->last_state);
+	}
+
+	if(__sim_dmx.i_slot != st->last_slot) {
+		st->last_slot = __sim_dmx.i_slot;
+		vcd_change(&st->vcd, now, st->vcd_slot, st->last_slot);
+	}
+}
+
+static void __sim_dmx_frame(const struct DMX_Decoder_Frame *frame, void *usrdata)
+{
+	struct Sim_DMX_State *st = (struct Sim_DMX_State*)usrdata;
+	uint8_t               cut;
+	uint32_t              i_slot;
+
+	if(!st->first_break_ps) st->first_break_ps = frame->break_ps;
+
+	/* Free running frames are cut by sync events, the first one also
+	   with a fixed period: the schedule applies from its end */
+	cut = st->config.sync_us && frame->nb_slots && (frame->nb_slots < st->timing.nb_slots);
+	if(cut) st->cut_frames++;
+
+	/* Start code, slot count and values */
+	if((frame->start_code != DMX_START_CODE) || (!cut && (frame->nb_slots != st->timing.nb_slots))) {
+		st->data_errors++;
+	}
+
+	else {
+		for(i_slot = 0; i_slot < frame->nb_slots; i_slot++) {
+			if(frame->slots[i_slot] != __sim_dmx_pattern(i_slot)) {
+				st->data_errors++;
+				break;
+			}
+		}
+	}
+
+	/* Trace the first frames only */
+	if(st->vcd.file && (st->decoder.stats.frames >= st->config.vcd_frames)) {
+		vcd_close(&st->vcd, frame->break_ps + (uint64_t)frame->b2b_ns * 1000);
+	}
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __sim_dmx_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --frames N         frames to simulate (1000)\n"
+		"  --clock MHZ        HCLK: 16, 32 or 64 (32)\n"
+		"  --preset NAME      boot, max_refresh or conservative (boot)\n"
+		"  --slots N          data slots per frame\n"
+		"  --mark US          mark between slots\n"
+		"  --period US        fixed schedule period, free running if 0 (0)\n"
+		"  --sync-us US       sync event period, none if 0 (0)\n"
+		"  --latency CYCLES   ISR entry latency (%u)\n"
+		"  --vcd FILE         dump the line and FSM state\n"
+		"  --vcd-frames N     frames in the dump (4)\n"
+		"  --break-min-us US  break limit (92)\n"
+		"  --mab-min-us US    MAB limit (12)\n"
+		"  --b2b-min-us US    break to break limit (1204)\n",
+		name, SIM_DMX_IRQ_LATENCY);
+}
+
+static uint8_t __sim_dmx_args(struct Sim_DMX_Config *config, int argc, char **argv)
+{
+	const char *opt;
+	const char *val;
+	uint32_t    i;
+	int         i_arg;
+
+	config->clock_mhz   = 32;
+	config->nb_frames   = 1000;
+	config->irq_latency = SIM_DMX_IRQ_LATENCY;
+	config->preset      = DMX_TIMING_PRESET_BOOT;
+	config->nb_slots    = -1;
+	config->mark_us     = -1;
+	config->period_us   = 0;
+	config->sync_us     = 0;
+	config->vcd_path    = NULL;
+	config->vcd_frames  = 4;
+	config->limits      = dmx_decoder_limits_default;
+
+	for(i_arg = 1; i_arg < argc; i_arg += 2) {
+		opt = argv[i_arg];
+		val = (i_arg + 1 < argc) ? argv[i_arg + 1] : NULL;
+		if(!val) return 0;
+
+		if     (!strcmp(opt, "--frames"      )) config->nb_frames           = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--clock"       )) config->clock_mhz           = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--slots"       )) config->nb_slots            = strtol (val, NULL, 0);
+		else if(!strcmp(opt, "--mark"        )) config->mark_us             = strtol (val, NULL, 0);
+		else if(!strcmp(opt, "--period"      )) config->period_us           = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--sync-us"     )) config->sync_us             = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--latency"     )) config->irq_latency         = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--vcd"         )) config->vcd_path            = val;
+		else if(!strcmp(opt, "--vcd-frames"  )) config->vcd_frames          = strtoul(val, NULL, 0);
+		else if(!strcmp(opt, "--break-min-us")) config->limits.break_min_ns = strtoul(val, NULL, 0) * 1000;
+		else if(!strcmp(opt, "--mab-min-us"  )) config->limits.mab_min_ns   = strtoul(val, NULL, 0) * 1000;
+		else if(!strcmp(opt, "--b2b-min-us"  )) config->limits.b2b_min_ns   = strtoul(val, NULL, 0) * 1000;
+
+		else if(!strcmp(opt, "--preset")) {
+			for(i = 0; i < DMX_TIMING_NB_PRESETS; i++) {
+				if(!strcmp(val, __sim_dmx_preset_names[i])) break;
+			}
+
+			if(i == DMX_TIMING_NB_PRESETS) return 0;
+			config->preset = (enum DMX_Timing_Preset)i;
+		}
+
+		else return 0;
+	}
+
+	/* Clock profiles, see io/clock.h */
+	if((config->clock_mhz != 16) && (config->clock_mhz != 32) && (config->clock_mhz != 64)) return 0;
+
+	return config->nb_frames > 0;
+}
+
+static uint8_t __sim_dmx_vcd_open(struct Sim_DMX_State *st)
+{
+	if(!vcd_open(&st->vcd, st->config.vcd_path, "dmx")) return 0;
+
+	st->vcd_tx    = vcd_var_add(&st->vcd, "tx"   , 1 );
+	st->vcd_state = vcd_var_add(&st->vcd, "state", 4 );
+	st->vcd_slot  = vcd_var_add(&st->vcd, "slot" , 10);
+	vcd_header_end(&st->vcd);
+
+	st->last_state = UINT32_MAX;
+	st->last_slot  = UINT32_MAX;
+
+	return 1;
+}
+
+static void __sim_dmx_range(const char *name, const struct DMX_Decoder_Range *range)
+{
+	if(!range->count) {
+		printf("%-15s: -\n", name);
+		return;
+	}
+
+	printf("%-15s: min %10.3fus  avg %10.3fus  max %10.3fus\n", name,
+		range->min_ns / 1e3, (double)range->sum_ns / range->count / 1e3, range->max_ns / 1e3);
+}
+
+static uint32_t __sim_dmx_report(struct Sim_DMX_State *st, double wall_s)
+{
+	const struct DMX_Decoder_Stats    *stats   = &st->decoder.stats;
+	const struct DMX_Controller_Stats *fw      = &__sim_dmx.stats;
+	const double                       cyc_us  = st->config.clock_mhz;
+	uint32_t                           nb_errs = st->data_errors;
+	double                             boot_us;
+	uint32_t                           i;
+
+	printf("sim dmx clock=%uMHz preset=%s slots=%u mark=%uus period=%uus latency=%u\n",
+		st->config.clock_mhz, __sim_dmx_preset_names[st->config.preset],
+		st->timing.nb_slots, st->timing.mark_us, st->config.period_us, st->config.irq_latency);
+
+	printf("%-15s: %u\n", "frames", stats->frames);
+	__sim_dmx_range("break"         , &stats->brk );
+	__sim_dmx_range("mab"           , &stats->mab );
+	__sim_dmx_range("mark"          , &stats->mark);
+	__sim_dmx_range("mbb"           , &stats->mbb );
+	__sim_dmx_range("break_to_break", &stats->b2b );
+
+	if(stats->b2b.count) {
+		printf("%-15s: %.2fHz, nominal period %uus\n", "refresh",
+			1e9 * stats->b2b.count / stats->b2b.sum_ns, dmx_timing_frame_period_us(&st->timing));
+	}
+
+	if(st->first_break_ps) {
+		printf("%-15s: %.3fus after start\n", "first_break", (st->first_break_ps - st->start_ps) / 1e6);
+
+		/* Firmware code runs in zero time: from cycles_init, only the
+		   look restore (SIM_DMX_INIT_US) and the line are counted */
+		boot_us = (st->first_break_ps - st->boot_ps) / 1e6;
+		printf("%-15s: %.3fus after cycles_init, boot_stats %uus\n", "first_frame", boot_us, boot_stats.first_frame_us);
+
+		if((boot_us > boot_stats.first_frame_us + SIM_DMX_BOOT_TOL_US) || (boot_us + SIM_DMX_BOOT_TOL_US < boot_stats.first_frame_us)) {
+			nb_errs++;
+		}
+	}
+
+	if(fw->intervals) {
+		printf("%-15s: min %10.3fus  max %10.3fus  jitter max %.3fus  late %u\n", "fw_intervals",
+			fw->interval_min / cyc_us, fw->interval_max / cyc_us, fw->jitter_max / cyc_us, fw->late);
+	}
+
+	printf("%-15s:", "violations");
+	for(i = 0; i < DMX_NB_VIOLATIONS; i++) {
+		printf(" %s=%u", dmx_decoder_violation_name((enum DMX_Decoder_Violation)i), stats->violations[i]);
+		nb_errs += stats->violations[i];
+	}
+	printf("\n");
+
+	printf("%-15s: %u\n", "data_errors", st->data_errors);
+	if(st->config.sync_us) printf("%-15s: %u\n", "cut_frames", st->cut_frames);
+	printf("%-15s: %.3fs, %.0f frames/s\n", "wall", wall_s, wall_s > 0 ? stats->frames / wall_s : 0.0);
+
+	if(stats->frames < st->config.nb_frames) {
+		printf("FAILED: %u frames out of %u\n", stats->frames, st->config.nb_frames);
+		return nb_errs + 1;
+	}
+
+	printf("%s\n", nb_errs ? "FAILED" : "OK");
+	return nb_errs;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+int main(int argc, char **argv)
+{
+	struct Sim_DMX_State *st = &__sim_state;
+	struct DMX_Schedule   schedule;
+	struct timespec       wall_start;
+	struct timespec       wall_end;
+	uint64_t              limit;
+	uint32_t              i_slot;
+
+	if(!__sim_dmx_args(&st->config, argc, argv)) {
+		__sim_dmx_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	st->timing = dmx_timing_presets[st->config.preset];
+	if(st->config.nb_slots >= 0) st->timing.nb_slots = (uint16_t)st->config.nb_slots;
+	if(st->config.mark_us  >= 0) st->timing.mark_us  = (uint16_t)st->config.mark_us;
+
+	dmx_decoder_init(&st->decoder, &st->config.limits, __sim_dmx_frame, st);
+
+	sim_init(st->config.clock_mhz * 1000000, st->config.irq_latency);
+	sim_irq_handler_set(USART1_IRQn, USART1_IRQHandler);
+	sim_irq_handler_set(TIM17_IRQn , TIM17_IRQHandler );
+	sim_fw_callback_set(__sim_dmx_fw, st);
+
+	if(st->config.vcd_path && !__sim_dmx_vcd_open(st)) {
+		fprintf(stderr, "can't create %s\n", st->config.vcd_path);
+		return EXIT_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+	/* Boot sequence from main.c, the clock is already set */
+	st->boot_ps = sim_time_ps(sim_now());
+
+	sim_fw_enter();
+	cycles_init();
+	boot_clock_ready();
+	bsp_pins_init();
+	dmx_controller_init(&__sim_dmx);
+
+	for(i_slot = 0; i_slot < DMX_NB_DATA_SLOTS; i_slot++) {
+		dmx_controller_set(&__sim_dmx, i_slot, __sim_dmx_pattern(i_slot), 0);
+	}
+
+	if(!dmx_controller_set_timing(&__sim_dmx, &st->timing)) {
+		fprintf(stderr, "invalid timing\n");
+		return EXIT_FAILURE;
+	}
+
+	schedule.mode      = st->config.period_us ? DMX_SCHEDULE_FIXED : DMX_SCHEDULE_FREE;
+	schedule.period_us = st->config.period_us;
+	if(!dmx_controller_set_schedule(&__sim_dmx, &schedule)) {
+		fprintf(stderr, "invalid schedule\n");
+		return EXIT_FAILURE;
+	}
+	sim_fw_exit();
+
+	/* Line is configured from here. USART1_TX is AF1, see bsp/pin_table.h */
+	sim_line_watch(pin_dmx_out.port, __builtin_ctz(pin_dmx_out.pin), 1, USART1, __sim_dmx_line, st);
+	sim_run_until(sim_now() + sim_us_to_cycles(SIM_DMX_INIT_US));
+
+	sim_fw_enter();
+	dmx_controller_start(&__sim_dmx);
+	boot_dmx_started();
+	sim_fw_exit();
+	st->start_ps = sim_time_ps(sim_now());
+
+	/* One more break to complete the last frame */
+	limit = sim_now() + sim_us_to_cycles(SIM_DMX_FRAME_MAX_US) * (st->config.nb_frames + 2);
+	while(st->decoder.stats.frames < st->config.nb_frames) {
+		if(!sim_step(limit)) break;
+	}
+
+	dmx_decoder_flush(&st->decoder, sim_time_ps(sim_now()));
+	vcd_close(&st->vcd, sim_time_ps(sim_now()));
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+	return __sim_dmx_report(st, (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9)
+		? EXIT_FAILURE : EXIT_SUCCESS;
+}
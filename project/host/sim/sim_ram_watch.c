@@ -0,0 +1,164 @@
+/* ┌──────────────────────────────────────┐
+   │ RAM watch check on the boot path     │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+/* Runs app/ram_watch.c over a simulated heap and stack area, as main.c
+   boots: the startup code leaves the area as it was at power-up, main's
+   frame sits at its top, ram_watch_fill is called with the stack pointer
+   there, then ram_watch_init. Stack and heap use then grow, with stacked
+   values equal to the pattern, and each poll is checked against the
+   depths actually written. Exits with an error on any mismatch. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <app/ram_watch.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Simulation config                      │
+   └────────────────────────────────────────┘ */
+
+#define SIM_RAM_WATCH_AREA         4096   /* _end to _estack, in bytes                       */
+#define SIM_RAM_WATCH_MAIN_FRAME   48     /* Stacked by the startup code and main's prologue */
+#define SIM_RAM_WATCH_STEP         100    /* Stack and heap growth per step, in bytes        */
+#define SIM_RAM_WATCH_SEED         0x2545F491UL
+
+#define __SIM_RAM_WATCH_XSTR(x)    #x
+#define __SIM_RAM_WATCH_STR(x)     __SIM_RAM_WATCH_XSTR(x)
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* _end and _estack of the linker script alias the area. The host
+   linker defines _end itself: the firmware gets it as sim_ram_watch_end,
+   see CMakeLists.txt. */
+
+uint32_t sim_ram_watch_area[SIM_RAM_WATCH_AREA / 4] __attribute__((aligned(8)));
+
+__asm__(
+	".globl sim_ram_watch_end\n"
+	".set   sim_ram_watch_end, sim_ram_watch_area\n"
+	".globl _estack\n"
+	".set   _estack, sim_ram_watch_area + " __SIM_RAM_WATCH_STR(SIM_RAM_WATCH_AREA) "\n"
+);
+
+static uint32_t __sim_ram_watch_rand_state = SIM_RAM_WATCH_SEED;
+static uint32_t __sim_ram_watch_errors;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+/* Never the pattern: power-up content, and the deepest word written */
+
+static uint32_t __sim_ram_watch_garbage(void)
+{
+	uint32_t x = __sim_ram_watch_rand_state;
+
+	do {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	} while(x == RAM_WATCH_PATTERN);
+
+	__sim_ram_watch_rand_state = x;
+	return x;
+}
+
+/* Pushed values: some are the pattern, in runs shorter than RAM_WATCH_RUN */
+
+static uint32_t __sim_ram_watch_stacked(uint32_t i_word)
+{
+	if((i_word % 16) <  (RAM_WATCH_RUN - 1)) return RAM_WATCH_PATTERN;
+	if((i_word % 16) == 8)                   return RAM_WATCH_PATTERN;
+
+	return __sim_ram_watch_garbage();
+}
+
+static void __sim_ram_watch_expect(const char *what, uint32_t got, uint32_t expected)
+{
+	if(got == expected) return;
+
+	fprintf(stderr, "%s: %u, expected %u\n", what, got, expected);
+	__sim_ram_watch_errors++;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Main                                   │
+   └────────────────────────────────────────┘ */
+
+int main(void)
+{
+	const uint32_t nb_words  = SIM_RAM_WATCH_AREA / 4;
+	const uint32_t boot_used = SIM_RAM_WATCH_MAIN_FRAME + RAM_WATCH_FILL_GUARD;
+
+	uint32_t stack = boot_used;                                 /* Deepest stack use, bytes    */
+	uint32_t heap  = 0;
+	uint32_t i_word;
+	uint32_t alarm_at = 0;
+
+	/* Power-up content, main's frame at the top */
+	for(i_word = 0; i_word < nb_words; i_word++) {
+		sim_ram_watch_area[i_word] = __sim_ram_watch_garbage();
+	}
+
+	sim_msp = (uintptr_t)&sim_ram_watch_area[nb_words] - SIM_RAM_WATCH_MAIN_FRAME;
+
+	/* Start of main.c */
+	ram_watch_fill();
+	ram_watch_init();
+
+	printf("boot: area %u stack %u heap %u free %u alarm %u\n", ram_watch_stats.area,
+		ram_watch_stats.stack_peak, ram_watch_stats.heap_peak, ram_watch_stats.free_min, ram_watch_stats.alarm);
+
+	__sim_ram_watch_expect("boot area"      , ram_watch_stats.area      , SIM_RAM_WATCH_AREA);
+	__sim_ram_watch_expect("boot stack peak", ram_watch_stats.stack_peak, boot_used);
+	__sim_ram_watch_expect("boot heap peak" , ram_watch_stats.heap_peak , 0);
+	__sim_ram_watch_expect("boot alarm"     , ram_watch_stats.alarm     , 0);
+
+	/* Both grow until they meet, the stack pops back after each step */
+	while((stack + heap + 2 * SIM_RAM_WATCH_STEP) <= SIM_RAM_WATCH_AREA) {
+		for(i_word = (SIM_RAM_WATCH_AREA - stack) / 4; i_word > (SIM_RAM_WATCH_AREA - stack - SIM_RAM_WATCH_STEP) / 4; i_word--) {
+			sim_ram_watch_area[i_word - 1] = __sim_ram_watch_stacked(i_word);
+		}
+		sim_ram_watch_area[i_word] = __sim_ram_watch_garbage();
+
+		for(i_word = heap / 4; i_word < (heap + SIM_RAM_WATCH_STEP) / 4; i_word++) {
+			sim_ram_watch_area[i_word] = __sim_ram_watch_garbage();
+		}
+
+		stack += SIM_RAM_WATCH_STEP;
+		heap  += SIM_RAM_WATCH_STEP;
+
+		ram_watch_poll();
+
+		__sim_ram_watch_expect("stack peak", ram_watch_stats.stack_peak, stack);
+		__sim_ram_watch_expect("heap peak" , ram_watch_stats.heap_peak , heap );
+		__sim_ram_watch_expect("free min"  , ram_watch_stats.free_min  , SIM_RAM_WATCH_AREA - stack - heap);
+
+		if(!alarm_at && ram_watch_stats.alarm) alarm_at = ram_watch_stats.free_min;
+		__sim_ram_watch_expect("alarm", ram_watch_stats.alarm, (SIM_RAM_WATCH_AREA - stack - heap) < RAM_WATCH_ALARM_FREE);
+	}
+
+	printf("end : area %u stack %u heap %u free %u alarm %u (raised at %u free)\n", ram_watch_stats.area,
+		ram_watch_stats.stack_peak, ram_watch_stats.heap_peak, ram_watch_stats.free_min, ram_watch_stats.alarm, alarm_at);
+
+	if(!ram_watch_stats.alarm) {
+		fprintf(stderr, "alarm never raised\n");
+		__sim_ram_watch_errors++;
+	}
+
+	printf("%u errors\n", __sim_ram_watch_errors);
+
+	return __sim_ram_watch_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+/* ┌──────────────────────────────────────┐
+   │ Value change dump writer             │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "vcd.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+/* Identifier codes are printable characters from '!' */
+
+static char __vcd_id(uint8_t i_var)
+{
+	return (char)('!' + i_var);
+}
+
+static void __vcd_time(struct VCD_Writer *vcd, uint64_t time_ps)
+{
+	if(time_ps == vcd->time_ps) return;
+
+	fprintf(vcd->file, "#%llu\n", (unsigned long long)time_ps);
+	vcd->time_ps = time_ps;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+uint8_t vcd_open(struct VCD_Writer *vcd, const char *path, const char *scope)
+{
+	vcd->file = fopen(path, "w");
+	if(!vcd->file) return 0;
+
+	vcd->time_ps = UINT64_MAX;
+	vcd->nb_vars = 0;
+
+	fprintf(vcd->file, "$timescale 1ps $end\n");
+	fprintf(vcd->file, "$scope module %s $end\n", scope);
+
+	return 1;
+}
+
+uint8_t vcd_var_add(struct VCD_Writer *vcd, const char *name, uint8_t width)
+{
+	const uint8_t i_var = vcd->nb_vars;
+
+	if(i_var >= VCD_MAX_VARS) return i_var - 1;
+
+	fprintf(vcd->file, "$var %s %u %c %s $end\n", (width == 1) ? "wire" : "reg", width, __vcd_id(i_var), name);
+
+	vcd->widths[i_var] = width;
+	vcd->nb_vars++;
+
+	return i_var;
+}
+
+void vcd_header_end(struct VCD_Writer *vcd)
+{
+	fprintf(vcd->file, "$upscope $end\n");
+	fprintf(vcd->file, "$enddefinitions $end\n");
+}
+
+void vcd_change(struct VCD_Writer *vcd, uint64_t time_ps, uint8_t i_var, uint32_t value)
+{
+	int32_t i_bit;
+
+	__vcd_time(vcd, time_ps);
+
+	if(vcd->widths[i_var] == 1) {
+		fprintf(vcd->file, "%c%c\n", (value > 1) ? 'x' : (char)('0' + value), __vcd_id(i_var));
+		return;
+	}
+
+	fputc('b', vcd->file);
+	for(i_bit = vcd->widths[i_var] - 1; i_bit >= 0; i_bit--) fputc('0' + ((value >> i_bit) & 1), vcd->file);
+	fprintf(vcd->file, " %c\n", __vcd_id(i_var));
+}
+
+void vcd_close(struct VCD_Writer *vcd, uint64_t time_ps)
+{
+	if(!vcd->file) return;
+
+	__vcd_time(vcd, time_ps);
+	fclose(vcd->file);
+	vcd->file = NULL;
+}
@@ -0,0 +1,45 @@
+/* ┌──────────────────────────────────────┐
+   │ Value change dump writer             │
+   └──────────────────────────────────────┘
+
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ VCD data                               │
+   └────────────────────────────────────────┘ */
+
+/* Timestamps are in ps. Variables are declared between vcd_open and
+ * vcd_header_end, then changes are written in time order. */
+
+#define VCD_MAX_VARS 16
+
+struct VCD_Writer {
+	FILE                      *file;
+	uint64_t                   time_ps;                         /* Last written timestamp      */
+	uint8_t                    nb_vars;
+	uint8_t                    widths[VCD_MAX_VARS];
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Returns 0 if the file can't be created */
+uint8_t vcd_open      (struct VCD_Writer *vcd, const char *path, const char *scope);
+
+/* Returns the variable index, width is 1 for a wire */
+uint8_t vcd_var_add   (struct VCD_Writer *vcd, const char *name, uint8_t width);
+void    vcd_header_end(struct VCD_Writer *vcd);
+
+/* value 2 is written as x for wires */
+void    vcd_change    (struct VCD_Writer *vcd, uint64_t time_ps, uint8_t i_var, uint32_t value);
+void    vcd_close     (struct VCD_Writer *vcd, uint64_t time_ps);
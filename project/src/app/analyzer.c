@@ -0,0 +1,264 @@
+/* ┌──────────────────────────────────┐
+   │ DMX line analyzer mode           │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "analyzer.h"
+
+#include <string.h>
+
+#include <io/host_link.h>
+#include <app/command.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* Record payload after the status byte, see COMMAND_ANALYZER_FRAME */
+
+#define ANALYZER_RECORD_SIZE       28
+
+struct Analyzer_State {
+	struct DMX_Controller *dmx;
+	struct DMX_RX         *rx;
+
+	uint8_t                running;
+	uint32_t               request_baudrate;                    /* 0: no start requested       */
+	uint8_t                request_stop;
+
+	uint32_t               cycles_per_us;                       /* Clock of the records        */
+	uint32_t               next;                                /* Next record to send         */
+
+	uint32_t               command_frames;                      /* Keepalive, see the timeout  */
+	uint32_t               command_tick;
+
+	uint32_t               window_tick;
+	uint32_t               window_frames;
+};
+
+static struct Analyzer_State __analyzer;
+
+struct Analyzer_Stats analyzer_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint32_t __analyzer_ns(uint32_t cycles)
+{
+	return (uint32_t)(((uint64_t)cycles * 1000) / __analyzer.cycles_per_us);
+}
+
+/* Minimums start at the maximum value */
+
+static uint32_t __analyzer_ns_min(uint32_t cycles)
+{
+	return (cycles == 0xFFFFFFFF) ? 0 : __analyzer_ns(cycles);
+}
+
+static uint8_t* __analyzer_put_u32(uint8_t *ptr, uint32_t value)
+{
+	ptr[0] = (uint8_t)(value      );
+	ptr[1] = (uint8_t)(value >> 8 );
+	ptr[2] = (uint8_t)(value >> 16);
+	ptr[3] = (uint8_t)(value >> 24);
+
+	return ptr + 4;
+}
+
+static void __analyzer_send(const struct DMX_RX_Frame *frame)
+{
+	uint8_t  record[ANALYZER_RECORD_SIZE];
+	uint8_t *ptr = record;
+
+	ptr    = __analyzer_put_u32(ptr, frame->sequence                );
+	ptr    = __analyzer_put_u32(ptr, __analyzer_ns(frame->interval ));
+	ptr    = __analyzer_put_u32(ptr, __analyzer_ns(frame->break_len));
+	ptr    = __analyzer_put_u32(ptr, __analyzer_ns(frame->mab_len  ));
+	ptr    = __analyzer_put_u32(ptr, __analyzer_ns(frame->gap_max  ));
+	ptr    = __analyzer_put_u32(ptr, __analyzer_ns(frame->length   ));
+	*ptr++ = (uint8_t)(frame->nb_slots     );
+	*ptr++ = (uint8_t)(frame->nb_slots >> 8);
+	*ptr++ = frame->start_code;
+	*ptr++ = frame->flags;
+
+	command_notify(COMMAND_ANALYZER_FRAME, record, ANALYZER_RECORD_SIZE);
+	analyzer_stats.records++;
+}
+
+/* Sent from the oldest record still in the ring */
+
+static void __analyzer_records(void)
+{
+	const uint32_t      head = dmx_rx_head(__analyzer.rx);
+	struct DMX_RX_Frame frame;
+
+	if((head - __analyzer.next) > DMX_RX_NB_FRAMES) {
+		analyzer_stats.lost += head - __analyzer.next - DMX_RX_NB_FRAMES;
+		__analyzer.next      = head - DMX_RX_NB_FRAMES;
+	}
+
+	while(__analyzer.next != head) {
+		if(dmx_rx_read(__analyzer.rx, __analyzer.next, &frame)) __analyzer_send(&frame);
+		else                                                    analyzer_stats.lost++;
+
+		__analyzer.next++;
+	}
+}
+
+static void __analyzer_window(uint32_t now)
+{
+	const uint32_t elapsed = now - __analyzer.window_tick;
+	const uint32_t head    = dmx_rx_head(__analyzer.rx);
+
+	if(elapsed < ANALYZER_WINDOW_MS) return;
+
+	analyzer_stats.refresh_mhz = (uint32_t)(((uint64_t)(head - __analyzer.window_frames) * 1000000) / elapsed);
+	__analyzer.window_tick     = now;
+	__analyzer.window_frames   = head;
+}
+
+static void __analyzer_start(void)
+{
+	struct DMX_Controller *dmx      = __analyzer.dmx;
+	const uint32_t         baudrate = __analyzer.request_baudrate;
+	uint32_t               start;
+
+	__analyzer.request_baudrate = 0;
+
+	/* Line idle (mark) before the UART receives */
+	dmx_controller_hold(dmx);
+
+	start = HAL_GetTick();
+	while(!dmx_controller_is_held(dmx) && ((HAL_GetTick() - start) < ANALYZER_HOLD_TIMEOUT_MS));
+
+	if(!dmx_controller_is_held(dmx) || !dmx_rx_start(__analyzer.rx)) {
+		dmx_controller_resume(dmx);
+		return;
+	}
+
+	memset(&analyzer_stats, 0, sizeof(analyzer_stats));
+
+	__analyzer.cycles_per_us  = HAL_RCC_GetHCLKFreq() / 1000000;
+	__analyzer.next           = 0;
+	__analyzer.command_frames = command_stats.frames;
+	__analyzer.command_tick   = HAL_GetTick();
+	__analyzer.window_tick    = __analyzer.command_tick;
+	__analyzer.window_frames  = 0;
+	__analyzer.running        = 1;
+
+	host_link_set_baudrate(baudrate);
+}
+
+static void __analyzer_stop(void)
+{
+	dmx_rx_stop(__analyzer.rx);
+	__analyzer.running = 0;
+
+	host_link_set_baudrate(HOST_LINK_BAUDRATE);
+
+	/* Output starts over with a mark before break */
+	dmx_controller_resume(__analyzer.dmx);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void analyzer_init(struct DMX_Controller *dmx, struct DMX_RX *rx)
+{
+	__analyzer.dmx              = dmx;
+	__analyzer.rx               = rx;
+	__analyzer.running          = 0;
+	__analyzer.request_baudrate = 0;
+	__analyzer.request_stop     = 0;
+	__analyzer.cycles_per_us    = HAL_RCC_GetHCLKFreq() / 1000000;
+
+	dmx_rx_init(rx);
+}
+
+uint8_t analyzer_request(uint32_t baudrate)
+{
+	/* Oversampling by 8, see io/host_link.c */
+	if((baudrate < ANALYZER_BAUDRATE_MIN) || (baudrate > (HAL_RCC_GetPCLK1Freq() / 8))) return 0;
+
+	__analyzer.request_baudrate = baudrate;
+
+	return 1;
+}
+
+void analyzer_request_stop(void)
+{
+	__analyzer.request_stop = 1;
+}
+
+uint8_t analyzer_is_active(void)
+{
+	return __analyzer.running || (__analyzer.request_baudrate != 0);
+}
+
+void analyzer_get_stats(struct DMX_RX_Stats *stats, uint8_t reset)
+{
+	dmx_rx_get_stats(__analyzer.rx, stats, reset);
+
+	stats->interval_min = __analyzer_ns_min(stats->interval_min);
+	stats->interval_max = __analyzer_ns    (stats->interval_max);
+	stats->break_min    = __analyzer_ns_min(stats->break_min   );
+	stats->break_max    = __analyzer_ns    (stats->break_max   );
+	stats->mab_min      = __analyzer_ns_min(stats->mab_min     );
+	stats->mab_max      = __analyzer_ns    (stats->mab_max     );
+
+	if(stats->slots_min == 0xFFFFFFFF) stats->slots_min = 0;
+}
+
+uint8_t analyzer_capture(uint32_t first, uint32_t count)
+{
+	return dmx_rx_capture(__analyzer.rx, first, count);
+}
+
+uint8_t analyzer_capture_get(struct DMX_RX_Frame *frame, const uint8_t **slots, uint32_t *first, uint32_t *count)
+{
+	*slots = __analyzer.rx->slots;
+	*first = __analyzer.rx->capture_first;
+	*count = __analyzer.rx->capture_count;
+
+	return dmx_rx_capture_get(__analyzer.rx, frame);
+}
+
+void analyzer_poll(void)
+{
+	uint32_t now;
+
+	if(__analyzer.request_baudrate) {
+		if(!__analyzer.running) __analyzer_start();
+		else                    __analyzer.request_baudrate = 0;
+	}
+
+	if(!__analyzer.running) {
+		__analyzer.request_stop = 0;
+		return;
+	}
+
+	/* After the start, which waits for the frame end */
+	now = HAL_GetTick();
+
+	if(command_stats.frames != __analyzer.command_frames) {
+		__analyzer.command_frames = command_stats.frames;
+		__analyzer.command_tick   = now;
+	}
+
+	if(__analyzer.request_stop || ((now - __analyzer.command_tick) >= ANALYZER_TIMEOUT_MS)) {
+		__analyzer.request_stop = 0;
+		__analyzer_stop();
+		return;
+	}
+
+	__analyzer_window(now);
+	__analyzer_records();
+}
@@ -0,0 +1,86 @@
+/* ┌──────────────────────────────────┐
+   │ DMX line analyzer mode           │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+#include <io/dmx_rx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Analyzer config                        │
+   └────────────────────────────────────────┘ */
+
+/* Started by the ANALYZER_START command (see app/command.h): universe 0
+ * is held at the end of its frame, its UART receives the line of a
+ * third-party console on the dmx_in pin (see io/dmx_rx.h), and the host
+ * link switches to the requested baud rate once the response is sent.
+ * Commands keep working meanwhile.
+ *
+ * Each received frame is sent as an ANALYZER_FRAME record, without
+ * request. A record frame is 33 bytes: at the highest refresh rate
+ * (E1.11 minimum break to break of 1204us, 830 frames/s) they need
+ * 274kbaud, hence ANALYZER_BAUDRATE_MIN. Records are kept in a ring of
+ * DMX_RX_NB_FRAMES (19ms at that rate) while the main loop is busy: the
+ * ones overwritten meanwhile are counted as lost, the statistics still
+ * cover every frame.
+ *
+ * The analyzer stops without a valid command frame for
+ * ANALYZER_TIMEOUT_MS: the link goes back to HOST_LINK_BAUDRATE and
+ * universe 0 resumes its output. */
+
+#define ANALYZER_BAUDRATE_MIN      500000
+#define ANALYZER_TIMEOUT_MS        3000
+#define ANALYZER_HOLD_TIMEOUT_MS   50                               /* Longest frame is ~23ms      */
+#define ANALYZER_WINDOW_MS         1000                             /* Refresh rate measurement    */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Analyzer data                          │
+   └────────────────────────────────────────┘ */
+
+struct Analyzer_Stats {
+	uint32_t records;                                           /* Sent to the host            */
+	uint32_t lost;                                              /* Overwritten before sending  */
+	uint32_t refresh_mhz;                                       /* Over the last window        */
+};
+
+extern struct Analyzer_Stats analyzer_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* rx receives on the UART of dmx */
+void    analyzer_init        (struct DMX_Controller *dmx, struct DMX_RX *rx);
+
+/* Started and stopped by the next analyzer_poll, so that the command
+   response is sent first. Returns 0 if the baud rate is not supported. */
+uint8_t analyzer_request     (uint32_t baudrate);
+void    analyzer_request_stop(void);
+
+/* Running or about to: the universe and the host link are taken */
+uint8_t analyzer_is_active   (void);
+
+/* Copies then restarts the line statistics, times in ns. Minimums are
+   0 until measured. */
+void    analyzer_get_stats   (struct DMX_RX_Stats *stats, uint8_t reset);
+
+/* Captures count slots from first of the next frame, see dmx_rx_capture */
+uint8_t analyzer_capture     (uint32_t first, uint32_t count);
+
+/* Returns 0 until the capture is complete. slots starts at the first
+   captured slot. */
+uint8_t analyzer_capture_get (struct DMX_RX_Frame *frame, const uint8_t **slots, uint32_t *first, uint32_t *count);
+
+/* Starts, stops and sends the records, to call from the main loop */
+void    analyzer_poll        (void);
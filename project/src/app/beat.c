@@ -0,0 +1,124 @@
+/* ┌──────────────────────────────────┐
+   │ Beat input                       │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "beat.h"
+
+#include <io/timebase.h>
+#include <io/trigger.h>
+#include <app/effect.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Beat_State {
+	struct DMX_Controller *universes;
+	uint32_t               nb_universes;
+
+	uint32_t               sync_mask;
+	uint32_t               tempo_mask;
+
+	uint32_t               last;                                /* Previous edge, in us        */
+	uint32_t               intervals[BEAT_NB_INTERVALS];        /* In us                       */
+	uint32_t               nb_intervals;                        /* -1 before the first edge    */
+	uint32_t               i_interval;
+};
+
+struct Beat_Stats        beat_stats;
+static struct Beat_State __beat;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __beat_tempo(uint32_t edge)
+{
+	uint32_t interval = edge - __beat.last;
+	uint32_t sum      = 0;
+	uint32_t i;
+
+	__beat.last = edge;
+
+	if(__beat.nb_intervals == UINT32_MAX) {
+		__beat.nb_intervals = 0;
+		return;
+	}
+
+	/* Too fast or too slow for a tap: first beat of a new measurement */
+	if((interval < BEAT_INTERVAL_MIN_US) || (interval > BEAT_INTERVAL_MAX_US)) {
+		__beat.nb_intervals = 0;
+		return;
+	}
+
+	__beat.intervals[__beat.i_interval] = interval;
+	__beat.i_interval                   = (__beat.i_interval + 1) % BEAT_NB_INTERVALS;
+	if(__beat.nb_intervals < BEAT_NB_INTERVALS) __beat.nb_intervals++;
+
+	for(i = 0; i < __beat.nb_intervals; i++) {
+		sum += __beat.intervals[(__beat.i_interval + BEAT_NB_INTERVALS - 1 - i) % BEAT_NB_INTERVALS];
+	}
+
+	beat_stats.period_us = sum / __beat.nb_intervals;
+
+	/* One turn per beat */
+	effect_set_rate(__beat.tempo_mask, 1000000000UL / beat_stats.period_us);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void beat_init(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	__beat.universes    = universes;
+	__beat.nb_universes = nb_universes;
+	__beat.sync_mask    = 0;
+	__beat.tempo_mask   = 0;
+	__beat.nb_intervals = UINT32_MAX;
+	__beat.i_interval   = 0;
+
+	trigger_init();
+}
+
+void beat_configure(uint32_t sync_mask, uint32_t tempo_mask)
+{
+	__beat.sync_mask  = sync_mask;
+	__beat.tempo_mask = tempo_mask;
+
+	/* Applied at once if the tempo is known */
+	if(beat_stats.period_us) effect_set_rate(tempo_mask, 1000000000UL / beat_stats.period_us);
+}
+
+void beat_poll(void)
+{
+	uint32_t edge;
+	uint32_t latency;
+	uint32_t i_universe;
+
+	while(trigger_pop(&edge)) {
+		beat_stats.beats++;
+
+		__beat_tempo(edge);
+		effect_sync (__beat.sync_mask);
+
+		for(i_universe = 0; i_universe < __beat.nb_universes; i_universe++) {
+			dmx_controller_sync(&__beat.universes[i_universe]);
+		}
+
+		latency = timebase_us() - edge;
+		if(latency > beat_stats.latency_max_us) beat_stats.latency_max_us = latency;
+	}
+}
+
+void beat_reset(void)
+{
+	beat_stats.latency_max_us = 0;
+}
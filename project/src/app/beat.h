@@ -0,0 +1,66 @@
+/* ┌──────────────────────────────────┐
+   │ Beat input                       │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Beat config                            │
+   └────────────────────────────────────────┘ */
+
+/* Each edge of the trigger input (see io/trigger.h) is a beat, or a GO:
+ *
+ *  - the effects of the sync mask restart at phase 0,
+ *  - the interval to the previous beats gives the tempo, applied as the
+ *    rate of the effects of the tempo mask (one turn per beat),
+ *  - the channels are written and every universe is synced at once
+ *    (see dmx_controller_sync): with the EXTERNAL schedule the frame
+ *    starts right away, with the FREE one the frame in progress is cut
+ *    short, with the FIXED one the next frame carries the change.
+ *
+ * The tempo is the mean of the last BEAT_NB_INTERVALS intervals. An
+ * interval out of the tap range starts a new measurement. */
+
+#define BEAT_NB_INTERVALS          4
+#define BEAT_INTERVAL_MIN_US       200000                           /* 300 BPM                     */
+#define BEAT_INTERVAL_MAX_US       2000000                          /* 30 BPM                      */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Beat data                              │
+   └────────────────────────────────────────┘ */
+
+struct Beat_Stats {
+	uint32_t beats;
+	uint32_t period_us;                                         /* Tempo, 0 if not known       */
+	uint32_t latency_max_us;                                    /* Edge to universes synced    */
+};
+
+extern struct Beat_Stats beat_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Also starts the trigger input */
+void beat_init     (struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* Effects restarted on beats, and following the tempo */
+void beat_configure(uint32_t sync_mask, uint32_t tempo_mask);
+
+/* Handles the queued edges, to call from the main loop */
+void beat_poll     (void);
+
+/* Clears the latency maximum */
+void beat_reset    (void);
@@ -0,0 +1,61 @@
+/* ┌──────────────────────────────────┐
+   │ Boot sequence instrumentation    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "boot.h"
+
+#include <io/cycles.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Boot_Stats boot_stats;
+
+static uint32_t __boot_clock_cycles;                           /* Cycle count when clock is ready */
+static uint8_t  __boot_clock_set;                              /* boot_clock_ready was called     */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+uint32_t boot_cycles_to_us(uint32_t cycles)
+{
+	/* Before clock_init, the counter runs at the reset clock */
+	if(!__boot_clock_set || (cycles < __boot_clock_cycles)) {
+		return cycles / BOOT_RESET_CLOCK_MHZ;
+	}
+
+	return boot_stats.clock_ready_us + (cycles - __boot_clock_cycles) / (HAL_RCC_GetHCLKFreq() / 1000000);
+}
+
+void boot_clock_ready(void)
+{
+	uint32_t cycles = cycles_now();
+
+	/* Cycles spent on the PLL clock while in clock_init are
+	   counted as reset clock ones: error is a few us. */
+	boot_stats.clock_ready_us = cycles / BOOT_RESET_CLOCK_MHZ;
+	__boot_clock_cycles       = cycles;
+	__boot_clock_set          = 1;
+}
+
+void boot_dmx_started(void)
+{
+	boot_stats.dmx_start_us = boot_cycles_to_us(cycles_now());
+}
+
+uint8_t boot_poll(struct DMX_Controller *dmx)
+{
+	if(boot_stats.first_frame_us) return 1;
+	if(!dmx->stats.frames)        return 0;
+
+	boot_stats.first_frame_us = boot_cycles_to_us(dmx->stats.first_break_cycles);
+	return 1;
+}
@@ -0,0 +1,54 @@
+/* ┌──────────────────────────────────┐
+   │ Boot sequence instrumentation    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Boot config                            │
+   └────────────────────────────────────────┘ */
+
+/* The cycle counter is started by main right after HAL_Init, while the
+   core still runs on HSI16. Timestamps are given since then: the startup
+   code (data copy, bss clear) is not counted. */
+
+#define BOOT_RESET_CLOCK_MHZ   16
+
+
+/* ┌────────────────────────────────────────┐
+   │ Boot data                              │
+   └────────────────────────────────────────┘ */
+
+struct Boot_Stats {
+	uint32_t clock_ready_us;                                    /* End of clock_init           */
+	uint32_t dmx_start_us;                                      /* All universes started       */
+	uint32_t first_frame_us;                                    /* First break of universe 0   */
+	uint8_t  look_restored;                                     /* Look reloaded from flash    */
+	uint8_t  warm_restart;                                      /* Output restored after fault */
+};
+
+extern struct Boot_Stats boot_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Converts a cycle count taken during boot to us since the counter start */
+uint32_t boot_cycles_to_us (uint32_t cycles);
+
+void     boot_clock_ready  (void);
+void     boot_dmx_started  (void);
+
+/* Fills first_frame_us once the first frame is started. Returns 1 when done. */
+uint8_t  boot_poll         (struct DMX_Controller *dmx);
@@ -0,0 +1,73 @@
+/* ┌──────────────────────────────────┐
+   │ Runtime clock profile switching  │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "clock_switch.h"
+
+#include <io/trigger.h>
+#include <io/host_link.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint8_t __clock_switch_all_held(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	uint32_t i_universe;
+
+	for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+		if(!dmx_controller_is_held(&universes[i_universe])) return 0;
+	}
+
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+uint8_t clock_switch(struct DMX_Controller *universes, uint32_t nb_universes, enum Clock_Profile profile)
+{
+	uint32_t i_universe;
+	uint32_t start;
+	uint8_t  held;
+
+	if(profile == clock_get_profile()) return 1;
+
+	/* Wait for the end of the current frames */
+	for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+		dmx_controller_hold(&universes[i_universe]);
+	}
+
+	start = HAL_GetTick();
+	while(!(held = __clock_switch_all_held(universes, nb_universes))
+		&& ((HAL_GetTick() - start) < CLOCK_SWITCH_TIMEOUT_MS));
+
+	/* Lines are idle (mark): switch */
+	if(held) {
+		clock_set_profile(profile);
+
+		for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+			dmx_controller_clock_update(&universes[i_universe]);
+		}
+
+#if DMX_HAS_HOST_LINK
+		/* Recomputes the host link baud rate, also in stream block mode */
+		host_link_clock_update();
+
+		trigger_clock_update();
+#endif
+	}
+
+	for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+		dmx_controller_resume(&universes[i_universe]);
+	}
+
+	return held;
+}
@@ -0,0 +1,34 @@
+/* ┌──────────────────────────────────┐
+   │ Runtime clock profile switching  │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/clock.h>
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Clock switch config                    │
+   └────────────────────────────────────────┘ */
+
+/* A full frame of 512 slots lasts about 23ms */
+
+#define CLOCK_SWITCH_TIMEOUT_MS   50
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Switches the clock profile between two frames of every universe,
+   then recomputes the timer and UART prescalers. Returns 0 if the
+   universes could not be held in time: the clock is left unchanged. */
+uint8_t clock_switch(struct DMX_Controller *universes, uint32_t nb_universes, enum Clock_Profile profile);
@@ -0,0 +1,169 @@
+/* ┌──────────────────────────────────┐
+   │ Color fixtures                   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "color.h"
+
+#include <string.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+enum Color_Space {
+	COLOR_SPACE_RGB,
+	COLOR_SPACE_HSV
+};
+
+struct Color_Fixture {
+	uint8_t             changed;                                /* Not converted yet           */
+	uint8_t             space;                                  /* enum Color_Space            */
+	uint8_t             rgb[3];
+	uint8_t             sat;
+	uint8_t             val;
+	uint16_t            hue;
+	uint16_t            fadetime_ms;
+
+	struct Color_Matrix mat;
+};
+
+struct Color_State {
+	struct DMX_Controller *universes;
+	uint8_t                changed;                             /* Any fixture changed         */
+	uint32_t               frame;                               /* Last converted frame        */
+
+	struct Color_Fixture   fixtures[PATCH_NB_FIXTURES];
+};
+
+static struct Color_State __color;
+
+static const struct Color_Emitter __color_white = COLOR_WHITE;
+static const struct Color_Emitter __color_amber = COLOR_AMBER;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static inline uint8_t __attribute__ ((always_inline)) __color_is_color(uint32_t fixture)
+{
+	return patch_coarse[PATCH_ATTR_RED][fixture] && patch_coarse[PATCH_ATTR_GREEN][fixture] && patch_coarse[PATCH_ATTR_BLUE][fixture];
+}
+
+static void __color_output(uint32_t fixture)
+{
+	struct Color_Fixture *fx = &__color.fixtures[fixture];
+	uint8_t               in [3];
+	uint8_t               out[3];
+	uint8_t               amber = 0;
+	uint8_t               white = 0;
+
+	if(fx->space == COLOR_SPACE_HSV) color_hsv_to_rgb(fx->hue, fx->sat, fx->val, in);
+	else                             memcpy(in, fx->rgb, sizeof(in));
+
+	color_calibrate(&fx->mat, in, out);
+
+	if(patch_coarse[PATCH_ATTR_AMBER][fixture]) amber = color_extract(&__color_amber, out);
+	if(patch_coarse[PATCH_ATTR_WHITE][fixture]) white = color_extract(&__color_white, out);
+
+	patch_set(__color.universes, fixture, PATCH_ATTR_RED  , (uint16_t)out[0] << 8, fx->fadetime_ms);
+	patch_set(__color.universes, fixture, PATCH_ATTR_GREEN, (uint16_t)out[1] << 8, fx->fadetime_ms);
+	patch_set(__color.universes, fixture, PATCH_ATTR_BLUE , (uint16_t)out[2] << 8, fx->fadetime_ms);
+	patch_set(__color.universes, fixture, PATCH_ATTR_AMBER, (uint16_t)amber  << 8, fx->fadetime_ms);
+	patch_set(__color.universes, fixture, PATCH_ATTR_WHITE, (uint16_t)white  << 8, fx->fadetime_ms);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void color_init(struct DMX_Controller *universes)
+{
+	static const struct Color_Matrix identity = COLOR_MATRIX_IDENTITY;
+	uint32_t                         fixture;
+
+	__color.universes = universes;
+	__color.changed   = 0;
+
+	for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+		memset(&__color.fixtures[fixture], 0, sizeof(struct Color_Fixture));
+		__color.fixtures[fixture].mat = identity;
+	}
+}
+
+void color_set_rgb(uint32_t groups, const uint8_t rgb[3], uint16_t fadetime_ms)
+{
+	struct Color_Fixture *fx;
+	uint32_t              fixture;
+
+	for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+		if(!__color_is_color(fixture) || !(patch_groups[fixture] & groups)) continue;
+
+		fx              = &__color.fixtures[fixture];
+		fx->space       = COLOR_SPACE_RGB;
+		fx->fadetime_ms = fadetime_ms;
+		fx->changed     = 1;
+		memcpy(fx->rgb, rgb, sizeof(fx->rgb));
+
+		__color.changed = 1;
+	}
+}
+
+void color_set_hsv(uint32_t groups, uint16_t hue, uint8_t sat, uint8_t val, uint16_t fadetime_ms)
+{
+	struct Color_Fixture *fx;
+	uint32_t              fixture;
+
+	for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+		if(!__color_is_color(fixture) || !(patch_groups[fixture] & groups)) continue;
+
+		fx              = &__color.fixtures[fixture];
+		fx->space       = COLOR_SPACE_HSV;
+		fx->hue         = hue;
+		fx->sat         = sat;
+		fx->val         = val;
+		fx->fadetime_ms = fadetime_ms;
+		fx->changed     = 1;
+
+		__color.changed = 1;
+	}
+}
+
+uint8_t color_calibrate_set(enum Patch_Fixture fixture, const struct Color_Matrix *mat)
+{
+	if((fixture >= PATCH_NB_FIXTURES) || !__color_is_color(fixture)) return 0;
+
+	__color.fixtures[fixture].mat     = *mat;
+	__color.fixtures[fixture].changed = 1;
+	__color.changed                   = 1;
+
+	return 1;
+}
+
+void color_poll(void)
+{
+	uint32_t frame;
+	uint32_t fixture;
+
+	if(!__color.changed) return;
+
+	/* Once per frame: changes in between are merged */
+	frame = __color.universes[0].stats.frames;
+	if(frame == __color.frame) return;
+
+	__color.frame   = frame;
+	__color.changed = 0;
+
+	for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+		if(!__color.fixtures[fixture].changed) continue;
+
+		__color.fixtures[fixture].changed = 0;
+		__color_output(fixture);
+	}
+}
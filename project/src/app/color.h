@@ -0,0 +1,51 @@
+/* ┌──────────────────────────────────┐
+   │ Color fixtures                   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+#include "patch.h"
+#include "color_kernels.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Color config                           │
+   └────────────────────────────────────────┘ */
+
+/* Color fixtures are the patched fixtures with RED, GREEN and BLUE
+ * attributes. They are given an RGB or HSV color, and their slots are
+ * computed on the controller: HSV to RGB, per fixture calibration
+ * matrix, then the AMBER and WHITE emitters take the part of the color
+ * they can render, if the fixture has them.
+ *
+ * Changed fixtures are converted in one batch, at most once per frame
+ * of the first universe. The emitters are given as the RGB they replace. */
+
+#define COLOR_WHITE                COLOR_EMITTER(255, 255, 255)
+#define COLOR_AMBER                COLOR_EMITTER(255, 191, 0  )
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void    color_init         (struct DMX_Controller *universes);
+
+/* Color of every color fixture in one of groups, reached after fadetime_ms */
+void    color_set_rgb      (uint32_t groups, const uint8_t rgb[3], uint16_t fadetime_ms);
+void    color_set_hsv      (uint32_t groups, uint16_t hue, uint8_t sat, uint8_t val, uint16_t fadetime_ms);
+
+/* Returns 0 if fixture is not a color fixture */
+uint8_t color_calibrate_set(enum Patch_Fixture fixture, const struct Color_Matrix *mat);
+
+/* Converts the changed fixtures, to call from the main loop */
+void    color_poll         (void);
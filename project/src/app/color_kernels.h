@@ -0,0 +1,118 @@
+/* ┌──────────────────────────────────┐
+   │ Integer color kernels            │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/* 8 bits color conversions for the Cortex-M0+: no divide instruction,
+ * but a single cycle 32 bits multiply. Divisions by 255 are done with
+ * color_div255, divisions by a calibration constant with a reciprocal
+ * computed at compile time. No dependency on the HAL: also used by the
+ * host build. */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Color kernels data                     │
+   └────────────────────────────────────────┘ */
+
+/* Hue covers the 6 sectors of the color wheel with 256 steps each */
+#define COLOR_HUE_SECTOR           256
+#define COLOR_HUE_MAX              (6 * COLOR_HUE_SECTOR)    /* Excluded                    */
+
+/* Calibration matrix, applied to RGB: out = M * in, in q8 (256 is 1.0).
+   Negative coefficients remove crosstalk between emitters. */
+
+struct Color_Matrix {
+	int16_t m[3][3];
+};
+
+#define COLOR_MATRIX_IDENTITY      {{ {256, 0, 0}, {0, 256, 0}, {0, 0, 256} }}
+
+/* An extra emitter (white, amber...), as the RGB it replaces at full
+   level. inv holds 255 / rgb in q8, 0 for the channels it has no part in. */
+
+struct Color_Emitter {
+	uint8_t  rgb[3];
+	uint16_t inv[3];
+};
+
+#define __COLOR_INV(c)             ((c) ? (uint16_t)((255UL << 8) / (c)) : 0U)
+#define COLOR_EMITTER(r, g, b)     { {(r), (g), (b)}, {__COLOR_INV(r), __COLOR_INV(g), __COLOR_INV(b)} }
+
+
+/* ┌────────────────────────────────────────┐
+   │ Kernels                                │
+   └────────────────────────────────────────┘ */
+
+/* x / 255, rounded, exact for x up to 65535 */
+
+static inline uint32_t __attribute__ ((always_inline)) color_div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+static inline uint8_t __attribute__ ((always_inline)) color_clamp(int32_t x)
+{
+	return (x < 0) ? 0 : ((x > 255) ? 255 : (uint8_t)x);
+}
+
+/* hue from 0 to COLOR_HUE_MAX - 1, red at 0, green at 2 sectors, blue at 4 */
+
+static inline void __attribute__ ((always_inline)) color_hsv_to_rgb(uint32_t hue, uint32_t sat, uint32_t val, uint8_t rgb[3])
+{
+	uint32_t sector = hue >> 8;
+	uint32_t frac   = hue & 0xFF;
+
+	uint8_t  p      = (uint8_t)color_div255(val * (255 - sat));
+	uint8_t  q      = (uint8_t)color_div255(val * (255 - color_div255(sat * frac)));
+	uint8_t  t      = (uint8_t)color_div255(val * (255 - color_div255(sat * (255 - frac))));
+	uint8_t  v      = (uint8_t)val;
+
+	switch(sector) {
+		case 0 : rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+		case 1 : rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+		case 2 : rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+		case 3 : rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+		case 4 : rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+		default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break;
+	}
+}
+
+static inline void __attribute__ ((always_inline)) color_calibrate(const struct Color_Matrix *mat, const uint8_t in[3], uint8_t out[3])
+{
+	uint32_t i;
+
+	for(i = 0; i < 3; i++) {
+		int32_t acc = mat->m[i][0] * in[0] + mat->m[i][1] * in[1] + mat->m[i][2] * in[2];
+		out[i]      = color_clamp((acc + 128) >> 8);
+	}
+}
+
+/* Moves the largest possible part of rgb to the emitter: rgb keeps what
+   the emitter cannot render. Returns the emitter level. */
+
+static inline uint8_t __attribute__ ((always_inline)) color_extract(const struct Color_Emitter *em, uint8_t rgb[3])
+{
+	uint32_t level = 255;
+	uint32_t i;
+
+	for(i = 0; i < 3; i++) {
+		if(em->inv[i]) {
+			uint32_t max = (rgb[i] * em->inv[i]) >> 8;
+			if(max < level) level = max;
+		}
+	}
+
+	for(i = 0; i < 3; i++) {
+		rgb[i] = color_clamp((int32_t)rgb[i] - (int32_t)color_div255(level * em->rgb[i]));
+	}
+
+	return (uint8_t)level;
+}
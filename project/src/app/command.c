@@ -0,0 +1,803 @@
+/* ┌──────────────────────────────────┐
+   │ Host command protocol            │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "command.h"
+
+#include <string.h>
+
+#include <bsp/pin.h>
+#include <io/host_link.h>
+#include <io/trigger.h>
+#include <app/clock_switch.h>
+#include <app/patch.h>
+#include <app/color.h>
+#include <app/effect.h>
+#include <app/beat.h>
+#include <app/recovery.h>
+#include <app/boot.h>
+#include <app/stream.h>
+#include <app/latency.h>
+#include <app/ram_watch.h>
+#include <app/telemetry.h>
+
+#if defined(CONFIG_LOADER)
+#include <loader/loader_handover.h>
+#endif
+
+#if BSP_USE_DMX_IN
+#include <app/analyzer.h>
+#endif
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private datatypes                      │
+   └────────────────────────────────────────┘ */
+
+enum Command_Parser_State {
+	COMMAND_WAIT_SYNC,
+	COMMAND_WAIT_ID,
+	COMMAND_WAIT_LENGTH,
+	COMMAND_WAIT_PAYLOAD,
+	COMMAND_WAIT_CHECKSUM
+};
+
+struct Command_Frame {
+	uint8_t  id;
+	uint8_t  length;
+	uint8_t  payload[COMMAND_MAX_PAYLOAD];
+};
+
+/* Handlers fill the response payload after the status byte, and return the status */
+
+typedef enum Command_Status (*Command_Handler)(const struct Command_Frame *req, struct Command_Frame *resp);
+
+struct Command_Def {
+	uint8_t         id;
+	uint8_t         min_length;                                 /* Minimum payload length      */
+	Command_Handler handler;
+};
+
+struct Command_Parser {
+	enum Command_Parser_State state;
+	struct Command_Frame      frame;
+	uint32_t                  i_payload;
+	uint8_t                   sum;
+	uint8_t                   rx_stamped;                       /* rx_cycles is known          */
+	uint32_t                  rx_cycles;                        /* Arrival of the frame        */
+
+	uint8_t                   loader_request;                   /* Restart once answered       */
+
+	struct DMX_Controller    *universes;
+	uint32_t                  nb_universes;
+};
+
+static struct Command_Parser __command;
+
+struct Command_Stats command_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Payload helpers                        │
+   └────────────────────────────────────────┘ */
+
+static uint16_t __command_get_u16(const uint8_t *ptr)
+{
+	return (uint16_t)ptr[0] | ((uint16_t)ptr[1] << 8);
+}
+
+static uint32_t __command_get_u32(const uint8_t *ptr)
+{
+	return (uint32_t)__command_get_u16(ptr) | ((uint32_t)__command_get_u16(ptr + 2) << 16);
+}
+
+static void __command_put_u8(struct Command_Frame *resp, uint8_t value)
+{
+	resp->payload[resp->length++] = value;
+}
+
+static void __command_put_u16(struct Command_Frame *resp, uint16_t value)
+{
+	__command_put_u8(resp, value & 0xFF);
+	__command_put_u8(resp, value >> 8  );
+}
+
+static void __command_put_u32(struct Command_Frame *resp, uint32_t value)
+{
+	__command_put_u16(resp, value & 0xFFFF);
+	__command_put_u16(resp, value >> 16   );
+}
+
+static void __command_put_count(struct Command_Frame *resp, uint32_t value)
+{
+	__command_put_u16(resp, (value > 0xFFFF) ? 0xFFFF : value);
+}
+
+static struct DMX_Controller* __command_universe(uint8_t i_universe)
+{
+	return (i_universe < __command.nb_universes) ? &__command.universes[i_universe] : NULL;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Command handlers                       │
+   └────────────────────────────────────────┘ */
+
+static enum Command_Status __command_ping(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)req;
+	(void)resp;
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_fault_get(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)req;
+
+	__command_put_u8 (resp, boot_stats.warm_restart);
+	__command_put_u8 (resp, (uint8_t)recovery_record.cause);
+	__command_put_u32(resp, recovery_record.restarts);
+	__command_put_u32(resp, recovery_record.pc);
+	__command_put_u32(resp, recovery_record.lr);
+	__command_put_u32(resp, recovery_record.fault_us);
+	__command_put_u32(resp, recovery_record.restart_us);
+
+	return COMMAND_STATUS_OK;
+}
+
+#if defined(CONFIG_LOADER)
+static enum Command_Status __command_loader_enter(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)req;
+	(void)resp;
+
+	__command.loader_request = 1;
+
+	return COMMAND_STATUS_OK;
+}
+#endif
+
+/* Common response for timing commands */
+
+static enum Command_Status __command_timing_report(uint8_t i_universe, struct Command_Frame *resp)
+{
+	struct DMX_Controller *dmx = __command_universe(i_universe);
+	struct DMX_Timing      timing;
+	uint32_t               period_us;
+
+	if(!dmx) return COMMAND_STATUS_INVALID;
+
+	dmx_controller_get_timing(dmx, &timing);
+	period_us = dmx_timing_frame_period_us(&timing);
+
+	__command_put_u8 (resp, i_universe);
+	__command_put_u16(resp, timing.mbb_us);
+	__command_put_u16(resp, timing.break_us);
+	__command_put_u16(resp, timing.mab_us);
+	__command_put_u16(resp, timing.mark_us);
+	__command_put_u16(resp, timing.nb_slots);
+	__command_put_u32(resp, period_us);
+	__command_put_u32(resp, 1000000000UL / period_us);
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_timing_get(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	return __command_timing_report(req->payload[0], resp);
+}
+
+static enum Command_Status __command_timing_set(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_Controller *dmx = __command_universe(req->payload[0]);
+	struct DMX_Timing      timing;
+
+	if(!dmx) return COMMAND_STATUS_INVALID;
+
+	timing.mbb_us   = __command_get_u16(&req->payload[1]);
+	timing.break_us = __command_get_u16(&req->payload[3]);
+	timing.mab_us   = __command_get_u16(&req->payload[5]);
+	timing.mark_us  = __command_get_u16(&req->payload[7]);
+	timing.nb_slots = __command_get_u16(&req->payload[9]);
+
+	if(!dmx_controller_set_timing(dmx, &timing)) return COMMAND_STATUS_INVALID;
+
+	return __command_timing_report(req->payload[0], resp);
+}
+
+static enum Command_Status __command_timing_preset(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_Controller *dmx = __command_universe(req->payload[0]);
+
+	if(!dmx                                       ) return COMMAND_STATUS_INVALID;
+	if(req->payload[1] >= DMX_TIMING_NB_PRESETS   ) return COMMAND_STATUS_INVALID;
+
+	dmx_controller_set_timing(dmx, &dmx_timing_presets[req->payload[1]]);
+
+	return __command_timing_report(req->payload[0], resp);
+}
+
+static enum Command_Status __command_schedule_set(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_Controller *dmx = __command_universe(req->payload[0]);
+	struct DMX_Schedule    schedule;
+
+	(void)resp;
+
+	if(!dmx) return COMMAND_STATUS_INVALID;
+
+	schedule.mode      = (enum DMX_Schedule_Mode)req->payload[1];
+	schedule.period_us = __command_get_u32(&req->payload[2]);
+
+	if(!dmx_controller_set_schedule(dmx, &schedule)) return COMMAND_STATUS_INVALID;
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_frame_stats(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_Controller       *dmx = __command_universe(req->payload[0]);
+	struct DMX_Controller_Stats  stats;
+	uint32_t                     cycles_per_us;
+
+	if(!dmx) return COMMAND_STATUS_INVALID;
+
+	dmx_controller_get_stats(dmx, &stats, req->payload[1]);
+	cycles_per_us = dmx->cycles_per_us;
+
+	__command_put_u8 (resp, req->payload[0]);
+	__command_put_u32(resp, stats.frames);
+	__command_put_u32(resp, stats.intervals);
+	__command_put_u32(resp, stats.interval_last / cycles_per_us);
+	__command_put_u32(resp, stats.intervals ? stats.interval_min / cycles_per_us : 0);
+	__command_put_u32(resp, stats.interval_max / cycles_per_us);
+	__command_put_u32(resp, stats.jitter_max / cycles_per_us);
+	__command_put_u32(resp, stats.intervals ? (uint32_t)(stats.jitter_sum / stats.intervals) / cycles_per_us : 0);
+	__command_put_u32(resp, stats.late);
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_frame_sync(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	uint32_t i_universe;
+
+	(void)resp;
+
+	for(i_universe = 0; i_universe < __command.nb_universes; i_universe++) {
+		if(req->payload[0] & (1U << i_universe)) dmx_controller_sync(&__command.universes[i_universe]);
+	}
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_latency_stats(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	latency_poll();
+
+	__command_put_u32(resp, latency_stats.samples      );
+	__command_put_u32(resp, latency_stats.replaced     );
+	__command_put_u32(resp, latency_stats.unstamped    );
+	__command_put_u32(resp, latency_percentile(500)    );
+	__command_put_u32(resp, latency_percentile(990)    );
+	__command_put_u32(resp, latency_stats.max_us       );
+	__command_put_u32(resp, latency_stats.queue_mean_us);
+	__command_put_u32(resp, latency_stats.queue_max_us );
+
+	if(req->payload[0]) latency_reset();
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_ram_stats(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)req;
+
+	ram_watch_poll();
+
+	__command_put_u32(resp, ram_watch_stats.area      );
+	__command_put_u32(resp, ram_watch_stats.stack_peak);
+	__command_put_u32(resp, ram_watch_stats.heap_peak );
+	__command_put_u32(resp, ram_watch_stats.free_min  );
+	__command_put_u8 (resp, ram_watch_stats.alarm     );
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_telemetry(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	__command_put_u8 (resp, __command.nb_universes          );
+	__command_put_u32(resp, HAL_GetTick()                   );
+	__command_put_u32(resp, telemetry_stats.frames          );
+	__command_put_u32(resp, telemetry_stats.frame_rate_mhz  );
+	__command_put_u32(resp, telemetry_stats.uart_irqs       );
+	__command_put_u32(resp, telemetry_stats.timer_irqs      );
+	__command_put_u32(resp, telemetry_stats.uart_errors     );
+	__command_put_u32(resp, host_link_stats.overruns        );
+	__command_put_u32(resp, host_link_stats.errors          );
+	__command_put_u32(resp, host_link_stats.dropped         );
+	__command_put_u32(resp, telemetry_stats.isr_max_ns      );
+	__command_put_u32(resp, telemetry_stats.loop_max_us     );
+	__command_put_u32(resp, telemetry_stats.load_permille   );
+	__command_put_u32(resp, ram_watch_stats.free_min        );
+	__command_put_u8 (resp, ram_watch_stats.alarm           );
+
+	if(req->payload[0]) telemetry_reset();
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_beat_stats(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	__command_put_u32(resp, beat_stats.beats         );
+	__command_put_u32(resp, beat_stats.period_us     );
+	__command_put_u32(resp, beat_stats.latency_max_us);
+	__command_put_u32(resp, trigger_stats.edges      );
+	__command_put_u32(resp, trigger_stats.bounces    );
+	__command_put_u32(resp, trigger_stats.overruns   );
+
+	if(req->payload[0]) beat_reset();
+
+	return COMMAND_STATUS_OK;
+}
+
+#if BSP_USE_DMX_IN
+static enum Command_Status __command_analyzer_stats(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_RX_Stats stats;
+
+	analyzer_get_stats(&stats, req->payload[0]);
+
+	__command_put_u32  (resp, stats.frames              );
+	__command_put_u32  (resp, analyzer_stats.refresh_mhz);
+	__command_put_u32  (resp, stats.interval_min        );
+	__command_put_u32  (resp, stats.interval_max        );
+	__command_put_u32  (resp, stats.break_min           );
+	__command_put_u32  (resp, stats.break_max           );
+	__command_put_u32  (resp, stats.mab_min             );
+	__command_put_u32  (resp, stats.mab_max             );
+	__command_put_u16  (resp, stats.slots_min           );
+	__command_put_u16  (resp, stats.slots_max           );
+	__command_put_u32  (resp, stats.null_frames         );
+	__command_put_u32  (resp, stats.alternate_frames    );
+	__command_put_u8   (resp, stats.alternate_last      );
+	__command_put_count(resp, stats.short_breaks        );
+	__command_put_count(resp, stats.short_mabs          );
+	__command_put_count(resp, stats.framing             );
+	__command_put_count(resp, stats.noise               );
+	__command_put_count(resp, stats.overruns            );
+	__command_put_count(resp, stats.oversize            );
+	__command_put_count(resp, stats.estimated           );
+	__command_put_count(resp, analyzer_stats.lost       );
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_analyzer_slots(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	const uint32_t       first = __command_get_u16(&req->payload[1]);
+	const uint32_t       count = req->payload[3];
+	struct DMX_RX_Frame  frame;
+	const uint8_t       *slots;
+	uint32_t             captured_first;
+	uint32_t             captured_count;
+
+	/* Answered from the next frame on */
+	if(req->payload[0]) {
+		if(!analyzer_capture(first, count)) return COMMAND_STATUS_INVALID;
+		return COMMAND_STATUS_BUSY;
+	}
+
+	if(!analyzer_capture_get(&frame, &slots, &captured_first, &captured_count)) return COMMAND_STATUS_BUSY;
+
+	if((first < captured_first) || ((first + count) > (captured_first + captured_count))) {
+		return COMMAND_STATUS_INVALID;
+	}
+
+	__command_put_u32(resp, frame.sequence  );
+	__command_put_u8 (resp, frame.start_code);
+	__command_put_u16(resp, frame.nb_slots  );
+
+	memcpy(&resp->payload[resp->length], slots + (first - captured_first), count);
+	resp->length += count;
+
+	return COMMAND_STATUS_OK;
+}
+#endif
+
+static enum Command_Status __command_slots_set(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_Controller *dmx     = __command_universe(req->payload[0]);
+	uint32_t               i_first = __command_get_u16(&req->payload[1]);
+	uint16_t               fade_ms = __command_get_u16(&req->payload[3]);
+	uint32_t               nb      = req->length - 5;
+	uint32_t               i;
+
+	(void)resp;
+
+	if(!dmx                                  ) return COMMAND_STATUS_INVALID;
+	if((i_first + nb) > DMX_NB_DATA_SLOTS    ) return COMMAND_STATUS_INVALID;
+
+	for(i = 0; i < nb; i++) {
+		dmx_controller_set(dmx, i_first + i, req->payload[5 + i], fade_ms);
+	}
+
+	/* Fades start at the next frame */
+	if(nb) {
+		if(__command.rx_stamped) latency_event(dmx, i_first, __command.rx_cycles, fade_ms != 0);
+		else                     latency_stats.unstamped++;
+	}
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_dither_set(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_Controller *dmx     = __command_universe(req->payload[0]);
+	uint32_t               i_first = __command_get_u16(&req->payload[1]);
+	uint32_t               nb      = __command_get_u16(&req->payload[3]);
+	uint32_t               i;
+
+	(void)resp;
+
+	if(!dmx                                  ) return COMMAND_STATUS_INVALID;
+	if((i_first + nb) > DMX_NB_DATA_SLOTS    ) return COMMAND_STATUS_INVALID;
+
+	for(i = 0; i < nb; i++) {
+		dmx_controller_set_dither(dmx, i_first + i, req->payload[5]);
+	}
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_patch_set(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+	if(!patch_set(__command.universes, (enum Patch_Fixture)req->payload[0], (enum Patch_Attr)req->payload[1],
+		__command_get_u16(&req->payload[2]), __command_get_u16(&req->payload[4]))) return COMMAND_STATUS_INVALID;
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_patch_group_set(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+	if(req->payload[4] >= PATCH_NB_ATTRS) return COMMAND_STATUS_INVALID;
+
+	patch_set_group(__command.universes, __command_get_u32(&req->payload[0]), (enum Patch_Attr)req->payload[4],
+		__command_get_u16(&req->payload[5]), __command_get_u16(&req->payload[7]));
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_color_rgb(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+	color_set_rgb(__command_get_u32(&req->payload[0]), &req->payload[4], __command_get_u16(&req->payload[7]));
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_color_hsv(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	uint16_t hue = __command_get_u16(&req->payload[4]);
+
+	(void)resp;
+
+	if(hue >= COLOR_HUE_MAX) return COMMAND_STATUS_INVALID;
+
+	color_set_hsv(__command_get_u32(&req->payload[0]), hue, req->payload[6], req->payload[7], __command_get_u16(&req->payload[8]));
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_color_calibrate(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct Color_Matrix mat;
+	uint32_t            i;
+
+	(void)resp;
+
+	for(i = 0; i < 9; i++) {
+		mat.m[i / 3][i % 3] = (int16_t)__command_get_u16(&req->payload[1 + 2 * i]);
+	}
+
+	if(!color_calibrate_set((enum Patch_Fixture)req->payload[0], &mat)) return COMMAND_STATUS_INVALID;
+
+	return COMMAND_STATUS_OK;
+}
+
+#if defined(CONFIG_STREAM)
+static enum Command_Status __command_stream_start(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	struct DMX_Controller *dmx = __command_universe(req->payload[0]);
+
+	(void)resp;
+
+#if BSP_USE_DMX_IN
+	if(analyzer_is_active()                                     ) return COMMAND_STATUS_BUSY;
+#endif
+	if(!dmx                                                     ) return COMMAND_STATUS_INVALID;
+	if(!stream_request(dmx, __command_get_u32(&req->payload[1]))) return COMMAND_STATUS_INVALID;
+
+	return COMMAND_STATUS_OK;
+}
+#endif
+
+static enum Command_Status __command_effect_start(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+	if(!effect_start(req->payload[0], (enum Effect_Wave)req->payload[1], __command_get_u32(&req->payload[2]),
+		req->payload[6], req->payload[7])) return COMMAND_STATUS_INVALID;
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_effect_group(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	uint32_t nb = effect_add_group(req->payload[0], __command_get_u32(&req->payload[1]), (enum Patch_Attr)req->payload[5],
+		req->payload[6], __command_get_u16(&req->payload[7]));
+
+	__command_put_u16(resp, nb           );
+	__command_put_u16(resp, effect_free());
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_effect_slots(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	uint32_t nb = effect_add_slots(req->payload[0], req->payload[1], __command_get_u16(&req->payload[2]),
+		__command_get_u16(&req->payload[4]), req->payload[6], __command_get_u16(&req->payload[7]));
+
+	__command_put_u16(resp, nb           );
+	__command_put_u16(resp, effect_free());
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_effect_stop(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+	effect_stop(req->payload[0]);
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_beat_config(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+	beat_configure(req->payload[0], req->payload[1]);
+
+	return COMMAND_STATUS_OK;
+}
+
+#if BSP_USE_DMX_IN
+static enum Command_Status __command_analyzer_start(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+#if defined(CONFIG_STREAM)
+	if(stream_is_active()                                  ) return COMMAND_STATUS_BUSY;
+#endif
+	if(!analyzer_request(__command_get_u32(&req->payload[0]))) return COMMAND_STATUS_INVALID;
+
+	return COMMAND_STATUS_OK;
+}
+
+static enum Command_Status __command_analyzer_stop(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)req;
+	(void)resp;
+
+	analyzer_request_stop();
+
+	return COMMAND_STATUS_OK;
+}
+#endif
+
+static enum Command_Status __command_clock_profile(const struct Command_Frame *req, struct Command_Frame *resp)
+{
+	(void)resp;
+
+	if(req->payload[0] >= CLOCK_NB_PROFILES) return COMMAND_STATUS_INVALID;
+
+#if BSP_USE_DMX_IN
+	/* The analyzed universe is held, and timestamps are in cycles */
+	if(analyzer_is_active()) return COMMAND_STATUS_BUSY;
+#endif
+
+	if(!clock_switch(__command.universes, __command.nb_universes, (enum Clock_Profile)req->payload[0])) {
+		return COMMAND_STATUS_BUSY;
+	}
+
+	return COMMAND_STATUS_OK;
+}
+
+static const struct Command_Def __command_defs[] = {
+	{ COMMAND_PING           , 0 , __command_ping            },
+	{ COMMAND_FAULT_GET      , 0 , __command_fault_get       },
+#if defined(CONFIG_LOADER)
+	{ COMMAND_LOADER_ENTER   , 0 , __command_loader_enter    },
+#endif
+	{ COMMAND_TIMING_GET     , 1 , __command_timing_get      },
+	{ COMMAND_TIMING_SET     , 11, __command_timing_set      },
+	{ COMMAND_TIMING_PRESET  , 2 , __command_timing_preset   },
+	{ COMMAND_SCHEDULE_SET   , 6 , __command_schedule_set    },
+	{ COMMAND_FRAME_STATS    , 2 , __command_frame_stats     },
+	{ COMMAND_FRAME_SYNC     , 1 , __command_frame_sync      },
+	{ COMMAND_LATENCY_STATS  , 1 , __command_latency_stats   },
+	{ COMMAND_RAM_STATS      , 0 , __command_ram_stats       },
+	{ COMMAND_TELEMETRY      , 1 , __command_telemetry       },
+	{ COMMAND_BEAT_STATS     , 1 , __command_beat_stats      },
+#if BSP_USE_DMX_IN
+	{ COMMAND_ANALYZER_STATS , 1 , __command_analyzer_stats  },
+	{ COMMAND_ANALYZER_SLOTS , 4 , __command_analyzer_slots  },
+#endif
+	{ COMMAND_SLOTS_SET      , 5 , __command_slots_set       },
+	{ COMMAND_DITHER_SET     , 6 , __command_dither_set      },
+	{ COMMAND_PATCH_SET      , 6 , __command_patch_set       },
+	{ COMMAND_PATCH_GROUP    , 9 , __command_patch_group_set },
+#if defined(CONFIG_STREAM)
+	{ COMMAND_STREAM_START   , 5 , __command_stream_start    },
+#endif
+	{ COMMAND_COLOR_RGB      , 9 , __command_color_rgb       },
+	{ COMMAND_COLOR_HSV      , 10, __command_color_hsv       },
+	{ COMMAND_COLOR_CALIB    , 19, __command_color_calibrate },
+	{ COMMAND_EFFECT_START   , 8 , __command_effect_start    },
+	{ COMMAND_EFFECT_GROUP   , 9 , __command_effect_group    },
+	{ COMMAND_EFFECT_SLOTS   , 9 , __command_effect_slots    },
+	{ COMMAND_EFFECT_STOP    , 1 , __command_effect_stop     },
+	{ COMMAND_BEAT_CONFIG    , 2 , __command_beat_config     },
+#if BSP_USE_DMX_IN
+	{ COMMAND_ANALYZER_START , 4 , __command_analyzer_start  },
+	{ COMMAND_ANALYZER_STOP  , 0 , __command_analyzer_stop   },
+#endif
+	{ COMMAND_CLOCK_PROFILE  , 1 , __command_clock_profile   },
+};
+
+#define COMMAND_NB_DEFS (sizeof(__command_defs) / sizeof(__command_defs[0]))
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __command_send(const struct Command_Frame *resp)
+{
+	uint8_t  header[3] = { COMMAND_SYNC, resp->id, resp->length };
+	uint8_t  sum       = resp->id + resp->length;
+	uint32_t i;
+
+	for(i = 0; i < resp->length; i++) sum += resp->payload[i];
+	sum = -sum;
+
+	host_link_write(header       , sizeof(header));
+	host_link_write(resp->payload, resp->length  );
+	host_link_write(&sum         , 1             );
+}
+
+static void __command_execute(const struct Command_Frame *req)
+{
+	static struct Command_Frame resp;
+	const struct Command_Def   *def = NULL;
+	uint32_t                    i;
+
+	for(i = 0; i < COMMAND_NB_DEFS; i++) {
+		if(__command_defs[i].id == req->id) {
+			def = &__command_defs[i];
+			break;
+		}
+	}
+
+	/* Status byte first, then handler data */
+	resp.id         = req->id | COMMAND_RESPONSE;
+	resp.length     = 1;
+	resp.payload[0] = COMMAND_STATUS_OK;
+
+	if     (!def                          ) resp.payload[0] = COMMAND_STATUS_UNKNOWN;
+	else if(req->length < def->min_length ) resp.payload[0] = COMMAND_STATUS_INVALID;
+	else                                    resp.payload[0] = def->handler(req, &resp);
+
+	/* No partial data with an error */
+	if(resp.payload[0] != COMMAND_STATUS_OK) resp.length = 1;
+
+	__command_send(&resp);
+
+#if defined(CONFIG_LOADER)
+	/* Sending is blocking: the answer is out */
+	if(__command.loader_request) loader_handover_request();
+#endif
+}
+
+static void __command_parse(uint8_t data)
+{
+	switch(__command.state) {
+		case COMMAND_WAIT_SYNC:
+			if(data == COMMAND_SYNC) __command.state = COMMAND_WAIT_ID;
+			break;
+
+		case COMMAND_WAIT_ID:
+			__command.frame.id = data;
+			__command.sum      = data;
+			__command.state    = COMMAND_WAIT_LENGTH;
+			break;
+
+		case COMMAND_WAIT_LENGTH:
+			__command.frame.length = data;
+			__command.sum         += data;
+			__command.i_payload    = 0;
+
+			if     (data > COMMAND_MAX_PAYLOAD) __command.state = COMMAND_WAIT_SYNC;
+			else if(data == 0                 ) __command.state = COMMAND_WAIT_CHECKSUM;
+			else                                __command.state = COMMAND_WAIT_PAYLOAD;
+			break;
+
+		case COMMAND_WAIT_PAYLOAD:
+			__command.frame.payload[__command.i_payload++] = data;
+			__command.sum += data;
+
+			if(__command.i_payload >= __command.frame.length) __command.state = COMMAND_WAIT_CHECKSUM;
+			break;
+
+		case COMMAND_WAIT_CHECKSUM:
+			__command.state = COMMAND_WAIT_SYNC;
+
+			if((uint8_t)(__command.sum + data) != 0) {
+				command_stats.checksum_errors++;
+				break;
+			}
+
+			command_stats.frames++;
+			__command.rx_stamped = host_link_rx_cycles(&__command.rx_cycles);
+			__command_execute(&__command.frame);
+			break;
+
+		default:break;
+	}
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void command_init(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	__command.state        = COMMAND_WAIT_SYNC;
+	__command.universes    = universes;
+	__command.nb_universes = nb_universes;
+}
+
+void command_poll(void)
+{
+	uint8_t data;
+
+	while(host_link_read(&data)) {
+		__command_parse(data);
+	}
+}
+
+void command_notify(enum Command_Id id, const uint8_t *payload, uint32_t length)
+{
+	uint8_t  header[4] = { COMMAND_SYNC, id | COMMAND_RESPONSE, length + 1, COMMAND_STATUS_OK };
+	uint8_t  sum       = header[1] + header[2] + header[3];
+	uint32_t i;
+
+	for(i = 0; i < length; i++) sum += payload[i];
+	sum = -sum;
+
+	host_link_write(header , sizeof(header));
+	host_link_write(payload, length        );
+	host_link_write(&sum   , 1             );
+}
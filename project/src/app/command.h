@@ -0,0 +1,171 @@
+/* ┌──────────────────────────────────┐
+   │ Host command protocol            │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Protocol                               │
+   └────────────────────────────────────────┘ */
+
+/* Binary frames over the host link, both ways:
+ *
+ *   ┌──────┬─────┬─────┬──────────────┬──────────┐
+ *   │ SYNC │ cmd │ len │ payload[len] │ checksum │
+ *   └──────┴─────┴─────┴──────────────┴──────────┘
+ *
+ * checksum is chosen so that the byte sum of cmd to checksum is 0.
+ * Multi-byte fields are little endian. Every valid frame gets a
+ * response with cmd | COMMAND_RESPONSE, starting with a status
+ * byte. Frames with a bad checksum are dropped. */
+
+#define COMMAND_SYNC               0xA5
+#define COMMAND_RESPONSE           0x80
+#define COMMAND_MAX_PAYLOAD        64
+
+enum Command_Id {
+	COMMAND_PING           = 0x01, /* -                                          */
+	COMMAND_FAULT_GET      = 0x02, /* -                                          */
+	COMMAND_LOADER_ENTER   = 0x03, /* -, see loader/loader.h (CONFIG_LOADER)     */
+
+	COMMAND_TIMING_GET     = 0x10, /* u8 universe                                */
+	COMMAND_TIMING_SET     = 0x11, /* u8 universe, u16 mbb, break, mab, mark,
+	                                  u16 nb_slots                               */
+	COMMAND_TIMING_PRESET  = 0x12, /* u8 universe, u8 preset                     */
+	COMMAND_SCHEDULE_SET   = 0x13, /* u8 universe, u8 mode, u32 period (us)      */
+	COMMAND_FRAME_STATS    = 0x14, /* u8 universe, u8 reset                      */
+	COMMAND_FRAME_SYNC     = 0x15, /* u8 universe mask. Starts the next frame now
+	                                  (EXTERNAL), cuts the current one (FREE),
+	                                  ignored (FIXED), see io/dmx.h              */
+	COMMAND_LATENCY_STATS  = 0x16, /* u8 reset                                   */
+	COMMAND_RAM_STATS      = 0x17, /* -                                          */
+	COMMAND_TELEMETRY      = 0x18, /* u8 reset                                   */
+	COMMAND_BEAT_STATS     = 0x19, /* u8 reset                                   */
+	COMMAND_ANALYZER_STATS = 0x1A, /* u8 reset, see app/analyzer.h               */
+	COMMAND_ANALYZER_SLOTS = 0x1B, /* u8 rearm, u16 first slot, u8 count         */
+	COMMAND_ANALYZER_FRAME = 0x1C, /* Sent by the analyzer only, see below       */
+
+	COMMAND_SLOTS_SET      = 0x20, /* u8 universe, u16 first slot, u16 fade ms,
+	                                  u8 values[]                                */
+	COMMAND_DITHER_SET     = 0x21, /* u8 universe, u16 first slot, u16 count,
+	                                  u8 enable                                  */
+
+	COMMAND_PATCH_SET      = 0x22, /* u8 fixture, u8 attribute, u16 value,
+	                                  u16 fade ms                                */
+	COMMAND_PATCH_GROUP    = 0x23, /* u32 groups, u8 attribute, u16 value,
+	                                  u16 fade ms                                */
+	COMMAND_STREAM_START   = 0x24, /* u8 universe, u32 baudrate, see app/stream.h
+	                                  (CONFIG_STREAM builds)                     */
+	COMMAND_COLOR_RGB      = 0x25, /* u32 groups, u8 red, green, blue,
+	                                  u16 fade ms, see app/color.h               */
+	COMMAND_COLOR_HSV      = 0x26, /* u32 groups, u16 hue, u8 sat, val,
+	                                  u16 fade ms                                */
+	COMMAND_COLOR_CALIB    = 0x27, /* u8 fixture, i16 matrix[3][3] (q8)          */
+	COMMAND_EFFECT_START   = 0x28, /* u8 effect, u8 wave, u32 rate (mHz),
+	                                  u8 low, high, see app/effect.h             */
+	COMMAND_EFFECT_GROUP   = 0x29, /* u8 effect, u32 groups, u8 attribute,
+	                                  u8 offset, u16 spread                      */
+	COMMAND_EFFECT_SLOTS   = 0x2A, /* u8 effect, u8 universe, u16 first slot,
+	                                  u16 count, u8 offset, u16 spread           */
+	COMMAND_EFFECT_STOP    = 0x2B, /* u8 effect mask                             */
+	COMMAND_BEAT_CONFIG    = 0x2C, /* u8 sync mask, u8 tempo mask, see app/beat.h */
+	COMMAND_ANALYZER_START = 0x2D, /* u32 baudrate, see app/analyzer.h           */
+	COMMAND_ANALYZER_STOP  = 0x2E, /* -                                          */
+
+	COMMAND_CLOCK_PROFILE  = 0x30, /* u8 profile                                 */
+};
+
+/* Timing commands answer with the resulting timing:
+ * u8 universe, u16 mbb, break, mab, mark, nb_slots,
+ * u32 frame period (us), u32 refresh rate (mHz) */
+
+/* Fault answer, see app/recovery.h: u8 warm restart (this boot),
+ * u8 last cause, u32 restarts, pc, lr, u32 fault us, restart us */
+
+/* Frame statistics answer, times in us:
+ * u8 universe, u32 frames, intervals, last, min, max interval,
+ * u32 max jitter, mean jitter, u32 late frames */
+
+/* Latency answer, see app/latency.h: u32 samples, replaced, unstamped,
+ * u32 p50, p99, max (us), u32 mean, max arrival to execution (us).
+ * The first slot of SLOTS_SET and streamed frames are measured. */
+
+/* RAM answer, see app/ram_watch.h, in bytes: u32 heap and stack area,
+ * u32 stack peak, heap peak, free min, u8 alarm */
+
+/* Telemetry answer, see app/telemetry.h: u8 universes, u32 uptime (ms),
+ * u32 frames, frame rate (mHz), u32 DMX UART TC, timer interrupts,
+ * UART error flags, u32 host link overruns, framing and noise errors, dropped bytes,
+ * u32 longest ISR (ns), main loop turn (us), CPU load (per mille),
+ * u32 RAM free min, u8 RAM alarm. Maxima are cleared after the answer
+ * with reset. */
+
+/* Beat answer, see app/beat.h: u32 beats, u32 tempo period (us, 0 if
+ * unknown), u32 max edge to sync latency (us), u32 trigger edges,
+ * bounces, overruns. The maximum is cleared after the answer with reset. */
+
+/* Effect channel answer: u16 channels added, u16 channels left */
+
+/* Analyzer answer, see io/dmx_rx.h, times in ns: u32 frames, refresh
+ * rate over the last second (mHz), u32 min, max interval, break, MAB,
+ * u16 min, max slots, u32 null start code frames, alternate start code
+ * frames, u8 last alternate start code, u16 short breaks, short MABs,
+ * framing errors, noise errors, overruns, oversize frames, estimated
+ * edges, lost records. Counters saturate at 0xFFFF. Minimums are 0
+ * until measured. */
+
+/* Analyzer slots: with rearm, count slots from first of the next frame
+ * are captured, answering BUSY. Without, the captured slots in that
+ * range are answered once complete (BUSY before): u32 frame sequence,
+ * u8 start code, u16 slots received, u8 values[count]. At most
+ * DMX_RX_CAPTURE_SLOTS per capture. */
+
+/* Analyzer records, sent once per received frame as cmd
+ * ANALYZER_FRAME | COMMAND_RESPONSE with the OK status, times in ns:
+ * u32 sequence, interval from the previous break, break, MAB, longest
+ * slot to slot time, break start to last slot, u16 slots, u8 start
+ * code, u8 flags (DMX_RX_FLAG_x) */
+
+enum Command_Status {
+	COMMAND_STATUS_OK,
+	COMMAND_STATUS_UNKNOWN,                                     /* Unknown command             */
+	COMMAND_STATUS_INVALID,                                     /* Bad length or argument      */
+	COMMAND_STATUS_BUSY                                         /* Could not be done now       */
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Command data                           │
+   └────────────────────────────────────────┘ */
+
+struct Command_Stats {
+	uint32_t frames;                                            /* Valid frames                */
+	uint32_t checksum_errors;
+};
+
+extern struct Command_Stats command_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* The host link must be initialized */
+void command_init(struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* Parses received bytes and runs commands, to call from the main loop */
+void command_poll(void);
+
+/* Sends a frame without request: cmd | COMMAND_RESPONSE, the OK status
+   then payload. From the main loop only. */
+void command_notify(enum Command_Id id, const uint8_t *payload, uint32_t length);
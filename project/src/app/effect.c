@@ -0,0 +1,242 @@
+/* ┌──────────────────────────────────┐
+   │ Effect engine                    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "effect.h"
+
+#include <string.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Effect {
+	uint32_t phase;                                             /* Phase accumulator           */
+	uint32_t step;                                              /* Phase increment per ms      */
+	uint8_t  active;
+	uint8_t  wave;                                              /* enum Effect_Wave            */
+	uint8_t  low;
+	uint8_t  high;
+};
+
+/* Channels are packed: the patch code in the low bits, the effect
+   above, and the phase offsets apart to avoid padding: 3 bytes each */
+
+#define EFFECT_CODE_BITS           11
+
+#define EFFECT_CHANNEL(code, effect) ((uint16_t)((code) | ((effect) << EFFECT_CODE_BITS)))
+#define EFFECT_CHANNEL_CODE(ch)      ((ch) & ((1U << EFFECT_CODE_BITS) - 1))
+#define EFFECT_CHANNEL_EFFECT(ch)    ((ch) >> EFFECT_CODE_BITS)
+
+_Static_assert(PATCH_ENCODE(DMX_NB_UNIVERSES - 1, DMX_NB_DATA_SLOTS, 1) < (1U << EFFECT_CODE_BITS), "patch codes do not fit the channels");
+_Static_assert(EFFECT_NB_EFFECTS <= (1U << (16 - EFFECT_CODE_BITS)), "effects do not fit the channels");
+
+struct Effect_State {
+	struct DMX_Controller *universes;
+	uint32_t               nb_universes;
+	uint32_t               frame;                               /* Last written frame          */
+	uint32_t               tick;                                /* Time of the last move       */
+
+	struct Effect          effects [EFFECT_NB_EFFECTS];
+
+	uint32_t               nb_channels;                         /* In use, packed first        */
+	uint16_t               channels[EFFECT_NB_CHANNELS];        /* As EFFECT_CHANNEL           */
+	uint8_t                offsets [EFFECT_NB_CHANNELS];        /* Phase offsets               */
+};
+
+static struct Effect_State __effect;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __effect_write(void)
+{
+	const struct Effect *eff;
+	uint32_t             code;
+	uint32_t             i;
+
+	for(i = 0; i < __effect.nb_channels; i++) {
+		eff = &__effect.effects[EFFECT_CHANNEL_EFFECT(__effect.channels[i])];
+		if(!eff->active) continue;
+
+		code = EFFECT_CHANNEL_CODE(__effect.channels[i]);
+		dmx_controller_layer_q8(&__effect.universes[PATCH_DECODE_UNIVERSE(code)], PATCH_DECODE_SLOT(code),
+			effect_scale(effect_sample(effect_waves[eff->wave], eff->phase + ((uint32_t)__effect.offsets[i] << 24)), eff->low, eff->high));
+	}
+}
+
+static uint8_t __effect_add(uint32_t effect, uint16_t code, uint8_t offset, uint16_t spread, uint32_t n, uint32_t n_total)
+{
+	if(__effect.nb_channels >= EFFECT_NB_CHANNELS) return 0;
+
+	__effect.channels[__effect.nb_channels] = EFFECT_CHANNEL(code, effect);
+	__effect.offsets [__effect.nb_channels] = (uint8_t)(offset + (spread * n) / n_total);
+	__effect.nb_channels++;
+
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void effect_init(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	memset(&__effect, 0, sizeof(__effect));
+
+	__effect.universes    = universes;
+	__effect.nb_universes = nb_universes;
+	__effect.tick         = HAL_GetTick();
+}
+
+uint8_t effect_start(uint32_t effect, enum Effect_Wave wave, uint32_t rate_mhz, uint8_t low, uint8_t high)
+{
+	struct Effect *eff;
+
+	if((effect >= EFFECT_NB_EFFECTS) || (wave >= EFFECT_NB_WAVES) || (rate_mhz > EFFECT_RATE_MAX_MHZ)) return 0;
+
+	eff         = &__effect.effects[effect];
+	eff->phase  = 0;
+	eff->step   = EFFECT_STEP(rate_mhz);
+	eff->wave   = (uint8_t)wave;
+	eff->low    = low;
+	eff->high   = high;
+	eff->active = 1;
+
+	return 1;
+}
+
+void effect_stop(uint32_t mask)
+{
+	uint32_t i_from;
+	uint32_t i_to = 0;
+	uint32_t effect;
+	uint32_t code;
+
+	for(effect = 0; effect < EFFECT_NB_EFFECTS; effect++) {
+		if(mask & (1UL << effect)) __effect.effects[effect].active = 0;
+	}
+
+	/* Channels of the other effects are packed back first, the slots
+	   of the stopped ones go back to their level */
+	for(i_from = 0; i_from < __effect.nb_channels; i_from++) {
+		if(mask & (1UL << EFFECT_CHANNEL_EFFECT(__effect.channels[i_from]))) {
+			code = EFFECT_CHANNEL_CODE(__effect.channels[i_from]);
+			dmx_controller_layer_q8(&__effect.universes[PATCH_DECODE_UNIVERSE(code)], PATCH_DECODE_SLOT(code), 0);
+			continue;
+		}
+
+		__effect.channels[i_to] = __effect.channels[i_from];
+		__effect.offsets [i_to] = __effect.offsets [i_from];
+		i_to++;
+	}
+
+	__effect.nb_channels = i_to;
+}
+
+uint32_t effect_add_group(uint32_t effect, uint32_t groups, enum Patch_Attr attr, uint8_t offset, uint16_t spread)
+{
+	const uint16_t *coarse;
+	uint32_t        fixture;
+	uint32_t        n_total = 0;
+	uint32_t        n       = 0;
+
+	if((effect >= EFFECT_NB_EFFECTS) || (attr >= PATCH_NB_ATTRS)) return 0;
+
+	/* Coarse slots only: q8 values are smoothed by dithering */
+	coarse = patch_coarse[attr];
+
+	for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+		if(coarse[fixture] && (patch_groups[fixture] & groups)) n_total++;
+	}
+
+	for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+		if(!coarse[fixture] || !(patch_groups[fixture] & groups)) continue;
+		if(!__effect_add(effect, coarse[fixture], offset, spread, n, n_total)) break;
+		n++;
+	}
+
+	return n;
+}
+
+uint32_t effect_add_slots(uint32_t effect, uint32_t i_universe, uint32_t i_first, uint32_t count, uint8_t offset, uint16_t spread)
+{
+	uint32_t n;
+
+	if((effect >= EFFECT_NB_EFFECTS) || (i_universe >= __effect.nb_universes)) return 0;
+	if((i_first + count) > DMX_NB_DATA_SLOTS                                  ) return 0;
+
+	for(n = 0; n < count; n++) {
+		if(!__effect_add(effect, PATCH_ENCODE(i_universe, i_first + n + 1, 1), offset, spread, n, count)) break;
+	}
+
+	return n;
+}
+
+uint32_t effect_free(void)
+{
+	return EFFECT_NB_CHANNELS - __effect.nb_channels;
+}
+
+uint8_t effect_set_rate(uint32_t mask, uint32_t rate_mhz)
+{
+	uint32_t effect;
+
+	if(rate_mhz > EFFECT_RATE_MAX_MHZ) return 0;
+
+	for(effect = 0; effect < EFFECT_NB_EFFECTS; effect++) {
+		if(mask & (1UL << effect)) __effect.effects[effect].step = EFFECT_STEP(rate_mhz);
+	}
+
+	return 1;
+}
+
+void effect_sync(uint32_t mask)
+{
+	uint32_t now = HAL_GetTick();
+	uint32_t effect;
+
+	/* The others move up to now, as they would at the next frame */
+	for(effect = 0; effect < EFFECT_NB_EFFECTS; effect++) {
+		if(mask & (1UL << effect)) __effect.effects[effect].phase  = 0;
+		else                       __effect.effects[effect].phase += __effect.effects[effect].step * (now - __effect.tick);
+	}
+
+	__effect.tick = now;
+	__effect_write();
+}
+
+void effect_update(uint32_t delta_ms)
+{
+	uint32_t i;
+
+	for(i = 0; i < EFFECT_NB_EFFECTS; i++) {
+		__effect.effects[i].phase += __effect.effects[i].step * delta_ms;
+	}
+
+	__effect_write();
+}
+
+void effect_poll(void)
+{
+	uint32_t frame;
+	uint32_t now;
+
+	/* Once per frame: the first universe is always running */
+	frame = __effect.universes[0].stats.frames;
+	if(frame == __effect.frame) return;
+
+	now            = HAL_GetTick();
+	__effect.frame = frame;
+
+	effect_update(now - __effect.tick);
+	__effect.tick  = now;
+}
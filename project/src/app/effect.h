@@ -0,0 +1,83 @@
+/* ┌──────────────────────────────────┐
+   │ Effect engine                    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+#include "patch.h"
+#include "effect_kernels.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Effect config                          │
+   └────────────────────────────────────────┘ */
+
+/* An effect is a wave, a rate and a low .. high range. Its channels
+ * are slots (or patched attributes) that follow the wave, each with
+ * its own phase offset: the offsets of the channels added in one call
+ * are spread over a fraction of a turn, which makes chases and
+ * rainbow waves across a group.
+ *
+ * Every effect has one phase accumulator, a channel phase is the
+ * effect phase plus its offset: 3 bytes of RAM per channel. Once per
+ * frame of the first universe, the accumulators move by the elapsed
+ * time and the channel values are layered on the slots, highest takes
+ * precedence (see dmx_controller_layer_q8): the level set by commands
+ * or color fixtures stays underneath, a fade on the slot is output
+ * until it completes.
+ *
+ * 128 channels are about 400 bytes: the streaming build
+ * (CONFIG_STREAM) still fits the 8KB of RAM with them. */
+
+#define EFFECT_NB_EFFECTS          8
+#define EFFECT_NB_CHANNELS         128                              /* Shared by all effects       */
+
+/* Offsets and spreads are in 1/256 of a turn */
+#define EFFECT_TURN                256
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void     effect_init      (struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* (Re)starts effect at phase 0, keeping its channels.
+ * Returns 0 on a bad effect, wave or rate. */
+uint8_t  effect_start     (uint32_t effect, enum Effect_Wave wave, uint32_t rate_mhz, uint8_t low, uint8_t high);
+
+/* Frees the channels of every effect in mask, slots go back to their level */
+void     effect_stop      (uint32_t mask);
+
+/* Adds the attribute of every fixture in one of groups, or count slots
+ * from i_first. The n-th channel of n_total gets
+ * offset + spread * n / n_total. Returns the number of channels added,
+ * fewer if the channels ran out. */
+uint32_t effect_add_group (uint32_t effect, uint32_t groups, enum Patch_Attr attr, uint8_t offset, uint16_t spread);
+uint32_t effect_add_slots (uint32_t effect, uint32_t i_universe, uint32_t i_first, uint32_t count, uint8_t offset, uint16_t spread);
+
+/* Free channels left */
+uint32_t effect_free      (void);
+
+/* Rate of every effect in mask, e.g. from a tap tempo.
+ * Returns 0 if rate_mhz is too high. */
+uint8_t  effect_set_rate  (uint32_t mask, uint32_t rate_mhz);
+
+/* Restarts every effect in mask at phase 0 and writes all the channels
+ * now, e.g. on a beat. Their slots change at the next frame. */
+void     effect_sync      (uint32_t mask);
+
+/* Moves the effects by delta_ms and writes their channels */
+void     effect_update    (uint32_t delta_ms);
+
+/* effect_update once per frame, to call from the main loop */
+void     effect_poll      (void);
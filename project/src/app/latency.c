@@ -0,0 +1,210 @@
+/* ┌──────────────────────────────────┐
+   │ Host to wire latency             │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "latency.h"
+
+#include <string.h>
+
+#include <io/cycles.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Latency_Probe {
+	uint32_t armed;                                             /* A change is in flight       */
+	uint32_t arrival_cycles;
+	uint32_t exec_cycles;
+
+	uint32_t ready;                                             /* Measured, not accounted yet */
+	uint32_t total_cycles;                                      /* Arrival to TDR write        */
+	uint32_t queue_cycles;                                      /* Arrival to execution        */
+};
+
+struct Latency_State {
+	struct DMX_Controller *universes;
+	uint32_t               nb_universes;
+	struct Latency_Probe   probes[DMX_NB_UNIVERSES];
+
+	uint16_t               buckets[LATENCY_NB_BUCKETS];
+	uint32_t               count;                               /* Sum of the buckets          */
+};
+
+static struct Latency_State __latency;
+
+struct Latency_Stats latency_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint32_t __latency_bucket(uint32_t us)
+{
+	uint32_t exponent;
+	uint32_t i_bucket;
+
+	if(us < LATENCY_LINEAR_US) return us;
+
+	exponent = 31 - __builtin_clz(us);
+	i_bucket = LATENCY_LINEAR_US + ((exponent - LATENCY_SUB_BITS - 1) << LATENCY_SUB_BITS)
+	         + ((us >> (exponent - LATENCY_SUB_BITS)) & ((1U << LATENCY_SUB_BITS) - 1));
+
+	return (i_bucket < LATENCY_NB_BUCKETS) ? i_bucket : (LATENCY_NB_BUCKETS - 1);
+}
+
+/* Largest value of a bucket, but the overflow one */
+
+static uint32_t __latency_bucket_max(uint32_t i_bucket)
+{
+	uint32_t exponent;
+	uint32_t i_sub;
+
+	if(i_bucket < LATENCY_LINEAR_US) return i_bucket;
+
+	exponent = ((i_bucket - LATENCY_LINEAR_US) >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS + 1;
+	i_sub    =  (i_bucket - LATENCY_LINEAR_US) & ((1U << LATENCY_SUB_BITS) - 1);
+
+	return (1UL << exponent) + ((i_sub + 1) << (exponent - LATENCY_SUB_BITS)) - 1;
+}
+
+/* Interrupts must be disabled */
+
+static void __latency_collect(struct Latency_Probe *probe, struct DMX_Controller *dmx)
+{
+	uint32_t wire_cycles;
+
+	if(!probe->armed || !dmx_controller_probe_get(dmx, &wire_cycles)) return;
+
+	probe->total_cycles = wire_cycles        - probe->arrival_cycles;
+	probe->queue_cycles = probe->exec_cycles - probe->arrival_cycles;
+	probe->armed        = 0;
+	probe->ready        = 1;
+}
+
+static void __latency_account(uint32_t total_us, uint32_t queue_us)
+{
+	uint32_t i;
+
+	/* Older samples weigh half */
+	if(__latency.count >= LATENCY_WINDOW) {
+		__latency.count = 0;
+		for(i = 0; i < LATENCY_NB_BUCKETS; i++) {
+			__latency.buckets[i] >>= 1;
+			__latency.count       += __latency.buckets[i];
+		}
+	}
+
+	__latency.buckets[__latency_bucket(total_us)]++;
+	__latency.count++;
+
+	if(!latency_stats.samples) latency_stats.queue_mean_us = queue_us;
+	else                       latency_stats.queue_mean_us = (latency_stats.queue_mean_us * 7 + queue_us) >> 3;
+
+	if(total_us > latency_stats.max_us      ) latency_stats.max_us       = total_us;
+	if(queue_us > latency_stats.queue_max_us) latency_stats.queue_max_us = queue_us;
+
+	latency_stats.samples++;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void latency_init(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	memset(__latency.probes, 0, sizeof(__latency.probes));
+
+	__latency.universes    = universes;
+	__latency.nb_universes = nb_universes;
+
+	latency_reset();
+}
+
+void latency_event(struct DMX_Controller *dmx, uint32_t i_slot, uint32_t arrival_cycles, uint8_t next_frame)
+{
+	struct Latency_Probe *probe = &__latency.probes[dmx - __latency.universes];
+	uint32_t              primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* The previous change may be output already */
+	__latency_collect(probe, dmx);
+	if(probe->armed) latency_stats.replaced++;
+
+	probe->armed          = 1;
+	probe->arrival_cycles = arrival_cycles;
+	probe->exec_cycles    = cycles_now();
+
+	dmx_controller_probe(dmx, i_slot, next_frame);
+
+	__set_PRIMASK(primask);
+}
+
+void latency_poll(void)
+{
+	const uint32_t        cycles_per_us = HAL_RCC_GetHCLKFreq() / 1000000;
+	struct Latency_Probe *probe;
+	uint32_t              total_cycles;
+	uint32_t              queue_cycles;
+	uint32_t              ready;
+	uint32_t              primask;
+	uint32_t              i;
+
+	for(i = 0; i < __latency.nb_universes; i++) {
+		probe = &__latency.probes[i];
+
+		primask = __get_PRIMASK();
+		__disable_irq();
+
+		__latency_collect(probe, &__latency.universes[i]);
+
+		ready        = probe->ready;
+		total_cycles = probe->total_cycles;
+		queue_cycles = probe->queue_cycles;
+		probe->ready = 0;
+
+		__set_PRIMASK(primask);
+
+		if(ready) __latency_account(total_cycles / cycles_per_us, queue_cycles / cycles_per_us);
+	}
+}
+
+uint32_t latency_percentile(uint32_t per_mille)
+{
+	uint32_t target;
+	uint32_t sum = 0;
+	uint32_t i;
+
+	if(!__latency.count) return 0;
+
+	/* Smallest bucket reaching per_mille of the samples */
+	target = (__latency.count * per_mille + 999) / 1000;
+	if(!target) target = 1;
+
+	for(i = 0; i < (LATENCY_NB_BUCKETS - 1); i++) {
+		sum += __latency.buckets[i];
+		if(sum >= target) {
+			uint32_t max_us = __latency_bucket_max(i);
+			return (max_us < latency_stats.max_us) ? max_us : latency_stats.max_us;
+		}
+	}
+
+	return latency_stats.max_us;
+}
+
+void latency_reset(void)
+{
+	memset(__latency.buckets, 0, sizeof(__latency.buckets));
+	__latency.count = 0;
+
+	memset(&latency_stats, 0, sizeof(latency_stats));
+}
@@ -0,0 +1,73 @@
+/* ┌──────────────────────────────────┐
+   │ Host to wire latency             │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Latency config                         │
+   └────────────────────────────────────────┘ */
+
+/* A slot change is measured from the arrival of its last byte on the
+ * host link to the TDR write of the slot, with one probe per universe
+ * (see dmx_controller_probe): a newer change replaces the one in flight.
+ * Arrival to execution is the main loop share, the rest is frame timing
+ * and fades.
+ *
+ * Latencies are counted in a log-linear histogram: 1us buckets below
+ * LATENCY_LINEAR_US, then 2^LATENCY_SUB_BITS buckets per octave (~6%
+ * wide) up to 2^(LATENCY_MAX_EXPONENT+1) us, then an overflow bucket.
+ * Counts are halved once LATENCY_WINDOW samples are reached, so that
+ * percentiles follow the recent behaviour. */
+
+#define LATENCY_SUB_BITS           3
+#define LATENCY_LINEAR_US          (2U << LATENCY_SUB_BITS)
+#define LATENCY_MAX_EXPONENT       17 /* 262ms */
+#define LATENCY_NB_BUCKETS         (LATENCY_LINEAR_US + ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BITS) << LATENCY_SUB_BITS) + 1)
+
+#define LATENCY_WINDOW             1024
+
+
+/* ┌────────────────────────────────────────┐
+   │ Latency data                           │
+   └────────────────────────────────────────┘ */
+
+struct Latency_Stats {
+	uint32_t samples;                                           /* Measured changes            */
+	uint32_t replaced;                                          /* Newer change before output  */
+	uint32_t unstamped;                                         /* Arrival time unknown        */
+	uint32_t max_us;                                            /* Arrival to wire             */
+	uint32_t queue_max_us;                                      /* Arrival to execution        */
+	uint32_t queue_mean_us;                                     /* Moving average, 1/8 weight  */
+};
+
+extern struct Latency_Stats latency_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void     latency_init      (struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* A change of i_slot executed now, output from now or from the next
+   frame. Can be called from any context. */
+void     latency_event     (struct DMX_Controller *dmx, uint32_t i_slot, uint32_t arrival_cycles, uint8_t next_frame);
+
+/* Accounts the measured changes, to call from the main loop */
+void     latency_poll      (void);
+
+/* Upper bound of the per_mille percentile, in us. 0 without samples. */
+uint32_t latency_percentile(uint32_t per_mille);
+
+void     latency_reset     (void);
@@ -0,0 +1,277 @@
+/* ┌──────────────────────────────────┐
+   │ Last look storage in flash       │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "look_store.h"
+
+#include <string.h>
+
+#include <io/crc.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private datatypes                      │
+   └────────────────────────────────────────┘ */
+
+/* Header is written last: a torn write leaves an invalid record */
+
+struct Look_Store_Header {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t length;                                            /* Data length in bytes        */
+	uint32_t checksum;                                          /* CRC-32 of the data          */
+};
+
+#define LOOK_STORE_RECORD_SIZE(length) \
+	((sizeof(struct Look_Store_Header) + (length) + 7) & ~7UL) /* Double-word programming */
+
+struct Look_Store_State {
+	uint32_t checksum;                                          /* Checksum of the saved look  */
+
+	uint32_t pending_checksum;                                  /* Last seen look checksum     */
+	uint32_t pending_tick;                                      /* Time it was first seen      */
+	uint32_t poll_tick;                                         /* Last checksum of the look   */
+};
+
+extern uint8_t _look_store_start[];                             /* From linker script          */
+
+static struct Look_Store_State __look_store;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+/* Checksum of all universe targets */
+
+static uint32_t __look_store_checksum(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	uint32_t crc = 0;
+	uint32_t i_universe;
+
+	for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+		crc = crc_update(crc, universes[i_universe].targets, DMX_NB_DATA_SLOTS);
+	}
+
+	return crc;
+}
+
+/* Records per page */
+
+static uint32_t __look_store_nb_records(uint32_t length)
+{
+	return FLASH_PAGE_SIZE / LOOK_STORE_RECORD_SIZE(length);
+}
+
+static const struct Look_Store_Header* __look_store_record(uint32_t length, uint32_t i_page, uint32_t i_record)
+{
+	return (const struct Look_Store_Header*)(_look_store_start + i_page * FLASH_PAGE_SIZE
+		+ i_record * LOOK_STORE_RECORD_SIZE(length));
+}
+
+static uint8_t __look_store_is_blank(const void *start, uint32_t size)
+{
+	const uint32_t *ptr = (const uint32_t*)start;
+	const uint32_t *end = (const uint32_t*)((const uint8_t*)start + size);
+
+	while(ptr < end) {
+		if(*ptr++ != 0xFFFFFFFF) return 0;
+	}
+
+	return 1;
+}
+
+/* Sealed record with the highest sequence number under seq_below, NULL
+   if none. Torn slots (data without header) are skipped, the scan is
+   bounded by the store size. */
+
+static const struct Look_Store_Header* __look_store_newest(uint32_t length, uint32_t seq_below)
+{
+	const struct Look_Store_Header *newest = NULL;
+	const struct Look_Store_Header *hdr;
+
+	uint32_t i_page;
+	uint32_t i_record;
+
+	for(i_page = 0; i_page < LOOK_STORE_NB_PAGES; i_page++) {
+		for(i_record = 0; i_record < __look_store_nb_records(length); i_record++) {
+			hdr = __look_store_record(length, i_page, i_record);
+
+			if((hdr->magic != LOOK_STORE_MAGIC) || (hdr->length != length)) continue;
+			if((hdr->seq >= seq_below) || (newest && (hdr->seq <= newest->seq))) continue;
+
+			newest = hdr;
+		}
+	}
+
+	return newest;
+}
+
+static HAL_StatusTypeDef __look_store_erase(uint32_t i_page)
+{
+	FLASH_EraseInitTypeDef erase = {
+		.TypeErase = FLASH_TYPEERASE_PAGES,
+		.Banks     = FLASH_BANK_1,
+		.Page      = (uint32_t)(_look_store_start - (uint8_t*)FLASH_BASE) / FLASH_PAGE_SIZE + i_page,
+		.NbPages   = 1
+	};
+	uint32_t page_error;
+
+	return HAL_FLASHEx_Erase(&erase, &page_error);
+}
+
+static HAL_StatusTypeDef __look_store_program(uint32_t address, const uint8_t *data, uint32_t length)
+{
+	uint64_t dword;
+	uint32_t offset;
+
+	for(offset = 0; offset < length; offset += 8) {
+		/* Pad the last double-word with erased flash value */
+		dword = UINT64_MAX;
+		memcpy(&dword, data + offset, (length - offset) < 8 ? (length - offset) : 8);
+
+		if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + offset, dword) != HAL_OK) {
+			return HAL_ERROR;
+		}
+	}
+
+	return HAL_OK;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+uint8_t look_store_restore(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	const uint32_t                  length = nb_universes * DMX_NB_DATA_SLOTS;
+	const struct Look_Store_Header *hdr    = __look_store_newest(length, UINT32_MAX);
+	const uint8_t                  *data;
+
+	uint32_t i_universe;
+	uint32_t i_slot;
+
+	/* A record failing its checksum (cut while sealed, flash fault) is
+	   skipped for the previous one. It stays the newest for the log. */
+	while(hdr && (crc_compute(hdr + 1, length) != hdr->checksum)) {
+		hdr = __look_store_newest(length, hdr->seq);
+	}
+
+	if(!hdr) return 0;
+
+	data = (const uint8_t*)(hdr + 1);
+
+	/* Apply without fading */
+	for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+		for(i_slot = 0; i_slot < DMX_NB_DATA_SLOTS; i_slot++) {
+			dmx_controller_set(&universes[i_universe], i_slot, data[i_universe * DMX_NB_DATA_SLOTS + i_slot], 0);
+		}
+	}
+
+	__look_store.checksum         = hdr->checksum;
+	__look_store.pending_checksum = hdr->checksum;
+
+	return 1;
+}
+
+void look_store_poll(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	uint32_t now = HAL_GetTick();
+	uint32_t checksum;
+
+	/* The checksum covers all universes and holds the CRC unit: the
+	   stream frame check meanwhile falls back to the software kernel,
+	   in its interrupt */
+	if((now - __look_store.poll_tick) < LOOK_STORE_POLL_MS) return;
+	__look_store.poll_tick = now;
+
+	checksum = __look_store_checksum(universes, nb_universes);
+
+	/* Look is changing: restart the delay */
+	if(checksum != __look_store.pending_checksum) {
+		__look_store.pending_checksum = checksum;
+		__look_store.pending_tick     = now;
+		return;
+	}
+
+	/* Stable and not saved yet */
+	if((checksum != __look_store.checksum) && ((now - __look_store.pending_tick) >= LOOK_STORE_SAVE_DELAY_MS)) {
+		look_store_save(universes, nb_universes);
+	}
+}
+
+uint8_t look_store_save(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	const uint32_t                  length  = nb_universes * DMX_NB_DATA_SLOTS;
+	const uint32_t                  nb_recs = __look_store_nb_records(length);
+	const struct Look_Store_Header *newest  = __look_store_newest(length, UINT32_MAX);
+	struct Look_Store_Header        hdr;
+
+	uint32_t i_page   = 0;
+	uint32_t i_record = 0;
+	uint32_t address;
+	uint32_t i_universe;
+	uint8_t  ok = 0;
+
+	if(!nb_recs) return 0;
+
+	hdr.magic    = LOOK_STORE_MAGIC;
+	hdr.seq      = newest ? (newest->seq + 1) : 1;
+	hdr.length   = length;
+
+	/* Append in the first blank slot after the newest record, torn
+	   slots are left as they are. Once its page is full, the log moves
+	   to the other page, which only holds older records: the newest
+	   record stays until this one is sealed. */
+
+	if(newest) {
+		address  = (uint32_t)((const uint8_t*)newest - _look_store_start);
+		i_page   = address / FLASH_PAGE_SIZE;
+		i_record = (address % FLASH_PAGE_SIZE) / LOOK_STORE_RECORD_SIZE(length) + 1;
+
+		while((i_record < nb_recs)
+			&& !__look_store_is_blank(__look_store_record(length, i_page, i_record), LOOK_STORE_RECORD_SIZE(length))) {
+			i_record++;
+		}
+
+		if(i_record >= nb_recs) {
+			i_page   = (i_page + 1) % LOOK_STORE_NB_PAGES;
+			i_record = 0;
+		}
+	}
+
+	/* Flash operations stall the CPU: DMX marks are stretched
+	   meanwhile, which is still a valid signal. */
+
+	HAL_FLASH_Unlock();
+
+	if((i_record == 0) && !__look_store_is_blank(__look_store_record(length, i_page, 0), FLASH_PAGE_SIZE)) {
+		if(__look_store_erase(i_page) != HAL_OK) goto end;
+	}
+
+	/* Data first, header last */
+	address = (uint32_t)__look_store_record(length, i_page, i_record);
+
+	for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+		if(__look_store_program(address + sizeof(hdr) + i_universe * DMX_NB_DATA_SLOTS,
+			universes[i_universe].targets, DMX_NB_DATA_SLOTS) != HAL_OK) goto end;
+	}
+
+	/* Targets keep changing meanwhile (commands, stream): the checksum
+	   is the one of the bytes actually programmed */
+	hdr.checksum = crc_compute((const uint8_t*)address + sizeof(hdr), length);
+
+	if(__look_store_program(address, (const uint8_t*)&hdr, sizeof(hdr)) != HAL_OK) goto end;
+
+	__look_store.checksum = hdr.checksum;
+	ok                    = 1;
+
+end:
+	HAL_FLASH_Lock();
+	return ok;
+}
@@ -0,0 +1,46 @@
+/* ┌──────────────────────────────────┐
+   │ Last look storage in flash       │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Look store config                      │
+   └────────────────────────────────────────┘ */
+
+/* The look (slot targets of all universes) is saved once it has not
+   changed for LOOK_STORE_SAVE_DELAY_MS. Records are appended to a log
+   over the last two flash pages (STORE in the linker scripts), used in
+   turn: a page is only erased when the log moves into it, once the
+   other one is full, so the newest record is never erased. */
+
+#define LOOK_STORE_SAVE_DELAY_MS   2000
+#define LOOK_STORE_POLL_MS         50           /* Look checked at this period   */
+#define LOOK_STORE_NB_PAGES        2            /* Must match the linker scripts */
+#define LOOK_STORE_MAGIC           0x4B4F4F4CUL /* "LOOK" */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Restores the last saved look into slots and targets.
+   Returns 1 if a valid look was found. */
+uint8_t look_store_restore(struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* Saves the look if it changed and is stable, to call from the main loop.
+   The look is only checked every LOOK_STORE_POLL_MS. */
+void    look_store_poll   (struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* Saves the look now. Returns 0 on error. */
+uint8_t look_store_save   (struct DMX_Controller *universes, uint32_t nb_universes);
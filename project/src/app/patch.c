@@ -0,0 +1,125 @@
+/* ┌──────────────────────────────────┐
+   │ Fixture patch                    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "patch.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Compile-time checks                    │
+   └────────────────────────────────────────┘ */
+
+#define __PATCH_GEN_TYPE_CHECK(type, attr, coarse, fine, def)                                          \
+	_Static_assert((coarse) < PATCH_TYPE_##type##_FOOTPRINT, "type " #type ": " #attr " out of footprint"); \
+	_Static_assert((fine)   < PATCH_TYPE_##type##_FOOTPRINT, "type " #type ": " #attr " fine out of footprint"); \
+	_Static_assert(((def) >= 0) && ((def) < 256), "type " #type ": " #attr " default out of range");
+
+#define __PATCH_GEN_CHECK(arg, name, universe, address, type, groups)                                   \
+	_Static_assert((universe) < DMX_NB_UNIVERSES, "fixture " #name ": universe out of range");      \
+	_Static_assert((address) >= 1, "fixture " #name ": addresses start at 1");                      \
+	_Static_assert(((address) + PATCH_TYPE_##type##_FOOTPRINT - 1) <= DMX_NB_DATA_SLOTS,             \
+		"fixture " #name ": does not fit in the universe");                                     \
+	PATCH_TYPE_##type(__PATCH_GEN_TYPE_CHECK, type)
+
+PATCH_FIXTURE_TABLE(__PATCH_GEN_CHECK, 0)
+
+
+/* ┌────────────────────────────────────────┐
+   │ Lookup tables                          │
+   └────────────────────────────────────────┘ */
+
+/* A row per attribute, a column per fixture */
+
+#define __PATCH_GEN_COARSE(A, name, universe, address, type, groups) \
+	PATCH_ENCODE(universe, address, PATCH_TYPE_VALUE(__PATCH_GEN_COARSE1, type, A)),
+
+#define __PATCH_GEN_FINE(A, name, universe, address, type, groups) \
+	PATCH_ENCODE(universe, address, PATCH_TYPE_VALUE(__PATCH_GEN_FINE1, type, A)),
+
+#define __PATCH_GEN_DEFAULTS(A, name, universe, address, type, groups) \
+	PATCH_TYPE_VALUE(__PATCH_GEN_DEFAULT, type, A),
+
+#define __PATCH_GEN_COARSE_ROW(arg, attr)   [PATCH_ATTR_##attr] = { PATCH_FIXTURE_TABLE(__PATCH_GEN_COARSE  , PATCH_ATTR_##attr) },
+#define __PATCH_GEN_FINE_ROW(arg, attr)     [PATCH_ATTR_##attr] = { PATCH_FIXTURE_TABLE(__PATCH_GEN_FINE    , PATCH_ATTR_##attr) },
+#define __PATCH_GEN_DEFAULTS_ROW(arg, attr) [PATCH_ATTR_##attr] = { PATCH_FIXTURE_TABLE(__PATCH_GEN_DEFAULTS, PATCH_ATTR_##attr) },
+
+#define __PATCH_GEN_GROUPS(arg, name, universe, address, type, groups) \
+	[PATCH_FIXTURE_##name] = (groups),
+
+const uint16_t patch_coarse [PATCH_NB_ATTRS][PATCH_NB_FIXTURES] = { PATCH_ATTR_LIST(__PATCH_GEN_COARSE_ROW  , 0) };
+const uint16_t patch_fine   [PATCH_NB_ATTRS][PATCH_NB_FIXTURES] = { PATCH_ATTR_LIST(__PATCH_GEN_FINE_ROW    , 0) };
+const uint8_t  patch_default[PATCH_NB_ATTRS][PATCH_NB_FIXTURES] = { PATCH_ATTR_LIST(__PATCH_GEN_DEFAULTS_ROW, 0) };
+const uint32_t patch_groups [PATCH_NB_FIXTURES]                 = { PATCH_FIXTURE_TABLE(__PATCH_GEN_GROUPS, 0) };
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static inline void __attribute__ ((always_inline)) __patch_write(struct DMX_Controller *universes, uint16_t code, uint8_t value, uint16_t fadetime_ms)
+{
+	dmx_controller_set(&universes[PATCH_DECODE_UNIVERSE(code)], PATCH_DECODE_SLOT(code), value, fadetime_ms);
+}
+
+static inline void __attribute__ ((always_inline)) __patch_write_attr(struct DMX_Controller *universes, uint16_t coarse, uint16_t fine, uint16_t value, uint16_t fadetime_ms)
+{
+	__patch_write(universes, coarse, value >> 8, fadetime_ms);
+	if(fine) __patch_write(universes, fine, value & 0xFF, fadetime_ms);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void patch_apply_defaults(struct DMX_Controller *universes)
+{
+	uint32_t attr;
+	uint32_t fixture;
+
+	for(attr = 0; attr < PATCH_NB_ATTRS; attr++) {
+		for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+			if(!patch_coarse[attr][fixture]) continue;
+
+			__patch_write_attr(universes, patch_coarse[attr][fixture], patch_fine[attr][fixture],
+				(uint16_t)patch_default[attr][fixture] << 8, 0);
+		}
+	}
+}
+
+uint8_t patch_set(struct DMX_Controller *universes, enum Patch_Fixture fixture, enum Patch_Attr attr, uint16_t value, uint16_t fadetime_ms)
+{
+	uint16_t coarse;
+
+	if((fixture >= PATCH_NB_FIXTURES) || (attr >= PATCH_NB_ATTRS)) return 0;
+
+	coarse = patch_coarse[attr][fixture];
+	if(!coarse) return 0;
+
+	__patch_write_attr(universes, coarse, patch_fine[attr][fixture], value, fadetime_ms);
+
+	return 1;
+}
+
+void patch_set_group(struct DMX_Controller *universes, uint32_t groups, enum Patch_Attr attr, uint16_t value, uint16_t fadetime_ms)
+{
+	const uint16_t *coarse;
+	const uint16_t *fine;
+	uint32_t        fixture;
+
+	if(attr >= PATCH_NB_ATTRS) return;
+
+	/* Single pass over the attribute row */
+	coarse = patch_coarse[attr];
+	fine   = patch_fine  [attr];
+
+	for(fixture = 0; fixture < PATCH_NB_FIXTURES; fixture++) {
+		if(!coarse[fixture] || !(patch_groups[fixture] & groups)) continue;
+
+		__patch_write_attr(universes, coarse[fixture], fine[fixture], value, fadetime_ms);
+	}
+}
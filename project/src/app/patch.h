@@ -0,0 +1,86 @@
+/* ┌──────────────────────────────────┐
+   │ Fixture patch                    │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+#include "patch_table.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Identifiers                            │
+   └────────────────────────────────────────┘ */
+
+#define __PATCH_GEN_ATTR_ENUM(arg, attr)                                 PATCH_ATTR_##attr,
+#define __PATCH_GEN_FIXTURE_ENUM(arg, name, universe, address, type, groups) PATCH_FIXTURE_##name,
+
+enum Patch_Attr {
+	PATCH_ATTR_LIST(__PATCH_GEN_ATTR_ENUM, 0)
+
+	PATCH_NB_ATTRS
+};
+
+enum Patch_Fixture {
+	PATCH_FIXTURE_TABLE(__PATCH_GEN_FIXTURE_ENUM, 0)
+
+	PATCH_NB_FIXTURES
+};
+
+#define PATCH_GROUP_ALL    0xFFFFFFFFUL
+
+
+/* ┌────────────────────────────────────────┐
+   │ Lookup tables                          │
+   └────────────────────────────────────────┘ */
+
+/* Slots are encoded as universe * 512 + slot + 1, 0 when the fixture
+ * has no such attribute. Tables are indexed [attribute][fixture]:
+ * a write is one lookup, a group write is one pass over a row. */
+
+#define PATCH_ENCODE(universe, address, offset1) \
+	((offset1) ? (uint16_t)((universe) * DMX_NB_DATA_SLOTS + (address) - 1 + (offset1)) : 0U)
+
+#define PATCH_DECODE_UNIVERSE(code) (((uint32_t)(code) - 1) / DMX_NB_DATA_SLOTS)
+#define PATCH_DECODE_SLOT(code)     (((uint32_t)(code) - 1) % DMX_NB_DATA_SLOTS)
+
+/* Offsets of an attribute in a fixture type, plus one, 0 if absent */
+
+#define __PATCH_GEN_COARSE1(A, attr, coarse, fine, def) \
+	| ((PATCH_ATTR_##attr == (A)) ? (coarse) + 1 : 0)
+
+#define __PATCH_GEN_FINE1(A, attr, coarse, fine, def) \
+	| (((PATCH_ATTR_##attr == (A)) && ((fine) >= 0)) ? (fine) + 1 : 0)
+
+#define __PATCH_GEN_DEFAULT(A, attr, coarse, fine, def) \
+	| ((PATCH_ATTR_##attr == (A)) ? (def) : 0)
+
+#define PATCH_TYPE_VALUE(GEN, type, A) (0 PATCH_TYPE_##type(GEN, A))
+
+extern const uint16_t patch_coarse [PATCH_NB_ATTRS][PATCH_NB_FIXTURES];
+extern const uint16_t patch_fine   [PATCH_NB_ATTRS][PATCH_NB_FIXTURES];
+extern const uint8_t  patch_default[PATCH_NB_ATTRS][PATCH_NB_FIXTURES];
+extern const uint32_t patch_groups [PATCH_NB_FIXTURES];
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Sets the default value of every patched attribute, without fade */
+void    patch_apply_defaults(struct DMX_Controller *universes);
+
+/* Sets a 16 bits attribute value: MSB to the coarse slot, LSB to the
+ * fine one if any. Returns 0 if the fixture has no such attribute. */
+uint8_t patch_set           (struct DMX_Controller *universes, enum Patch_Fixture fixture, enum Patch_Attr attr, uint16_t value, uint16_t fadetime_ms);
+
+/* Same, for every fixture in one of groups */
+void    patch_set_group     (struct DMX_Controller *universes, uint32_t groups, enum Patch_Attr attr, uint16_t value, uint16_t fadetime_ms);
@@ -0,0 +1,99 @@
+/* ┌─────────────────────────────┐
+   │ Fixture patch configuration │
+   └─────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+
+/* ┌────────────────────────────────────────┐
+   │ Attributes                             │
+   └────────────────────────────────────────┘ */
+
+/* ATTR_NAME(arg, attribute) */
+
+#define PATCH_ATTR_LIST(ATTR_NAME, arg)                                               \
+	ATTR_NAME(arg, INTENSITY)                                                     \
+	ATTR_NAME(arg, PAN      )                                                     \
+	ATTR_NAME(arg, TILT     )                                                     \
+	ATTR_NAME(arg, SPEED    )                                                     \
+	ATTR_NAME(arg, COLOR    )                                                     \
+	ATTR_NAME(arg, GOBO     )                                                     \
+	ATTR_NAME(arg, STROBE   )                                                     \
+	ATTR_NAME(arg, RED      )                                                     \
+	ATTR_NAME(arg, GREEN    )                                                     \
+	ATTR_NAME(arg, BLUE     )                                                     \
+	ATTR_NAME(arg, WHITE    )                                                     \
+	ATTR_NAME(arg, MODE     )                                                     \
+	ATTR_NAME(arg, RESET    )                                                     \
+	ATTR_NAME(arg, AMBER    )
+
+
+/* ┌────────────────────────────────────────┐
+   │ Fixture types                          │
+   └────────────────────────────────────────┘ */
+
+/* ATTR(arg, attribute, coarse, fine, default)
+ *
+ *  coarse  : slot offset from the fixture address
+ *  fine    : slot offset of the fine (LSB) channel, -1 if 8 bits
+ *  default : coarse value at boot, fine is set to 0
+ *
+ * PATCH_TYPE_<type>_FOOTPRINT is the number of slots used. */
+
+/* Scanner, the default look of the first controller versions */
+
+#define PATCH_TYPE_SCANNER_FOOTPRINT 11
+#define PATCH_TYPE_SCANNER(ATTR, arg)                                                 \
+	ATTR(arg, PAN      ,  0, 1   , 125) /* Level operation, fine tuning       */ \
+	ATTR(arg, TILT     ,  2, 3   , 28 ) /* Vertical operation, trimming       */ \
+	ATTR(arg, COLOR    ,  4, -1  , 160) /* Automatic color change             */ \
+	ATTR(arg, GOBO     ,  5, -1  , 1  ) /* Fix spot                           */ \
+	ATTR(arg, STROBE   ,  6, -1  , 0  )                                          \
+	ATTR(arg, INTENSITY,  7, -1  , 128) /* Dimming                            */ \
+	ATTR(arg, SPEED    ,  8, -1  , 128) /* Move speed                         */ \
+	ATTR(arg, MODE     ,  9, -1  , 0  ) /* No auto mode                       */ \
+	ATTR(arg, RESET    , 10, -1  , 0  ) /* No reset                           */
+
+/* Generic RGBW par, 16 bits dimmer */
+
+#define PATCH_TYPE_RGBW_PAR_FOOTPRINT 6
+#define PATCH_TYPE_RGBW_PAR(ATTR, arg)                                                \
+	ATTR(arg, INTENSITY,  0, 1   , 0  )                                          \
+	ATTR(arg, RED      ,  2, -1  , 255)                                          \
+	ATTR(arg, GREEN    ,  3, -1  , 255)                                          \
+	ATTR(arg, BLUE     ,  4, -1  , 255)                                          \
+	ATTR(arg, WHITE    ,  5, -1  , 255)
+
+/* Generic RGBA par, colors are computed by app/color.h */
+
+#define PATCH_TYPE_RGBA_PAR_FOOTPRINT 5
+#define PATCH_TYPE_RGBA_PAR(ATTR, arg)                                                \
+	ATTR(arg, INTENSITY,  0, -1  , 0  )                                          \
+	ATTR(arg, RED      ,  1, -1  , 0  )                                          \
+	ATTR(arg, GREEN    ,  2, -1  , 0  )                                          \
+	ATTR(arg, BLUE     ,  3, -1  , 0  )                                          \
+	ATTR(arg, AMBER    ,  4, -1  , 0  )
+
+
+/* ┌────────────────────────────────────────┐
+   │ Patch                                  │
+   └────────────────────────────────────────┘ */
+
+/* FIXTURE(arg, name, universe, address, type, groups)
+ *
+ *  address : DMX start address, from 1
+ *  groups  : bitmask of PATCH_GROUP_* values
+ *
+ * Everything is checked and computed at compile time by app/patch.h */
+
+#define PATCH_GROUP_SPOTS  (1UL << 0)
+#define PATCH_GROUP_WASH   (1UL << 1)
+
+/* e.g. FIXTURE(arg, par1, 0, 33, RGBW_PAR, PATCH_GROUP_WASH) */
+
+#define PATCH_FIXTURE_TABLE(FIXTURE, arg)                                             \
+	FIXTURE(arg, scanner1, 0, 1 , SCANNER , PATCH_GROUP_SPOTS)
@@ -0,0 +1,105 @@
+/* ┌──────────────────────────────────┐
+   │ Stack and heap watermarks        │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "ram_watch.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* From the linker script */
+extern uint32_t _end;
+extern uint32_t _estack;
+
+struct RAM_Watch_State {
+	uint32_t *heap_high;                                        /* First word not used         */
+	uint32_t *stack_low;                                        /* Last word used              */
+};
+
+static struct RAM_Watch_State __ram_watch;
+
+struct RAM_Watch_Stats ram_watch_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __ram_watch_heap_scan(void)
+{
+	uint32_t *high = __ram_watch.heap_high;
+	uint32_t  run  = 0;
+
+	while((run < RAM_WATCH_RUN) && ((high + run) < __ram_watch.stack_low)) {
+		if(high[run] == RAM_WATCH_PATTERN) run++;
+		else {
+			high += run + 1;
+			run   = 0;
+		}
+	}
+
+	__ram_watch.heap_high = high;
+}
+
+/* Words below the stack pointer are written by interrupts at any time,
+   they are only read here. */
+
+static void __ram_watch_stack_scan(void)
+{
+	uint32_t *low = __ram_watch.stack_low;
+	uint32_t  run = 0;
+
+	while((run < RAM_WATCH_RUN) && ((low - run) > __ram_watch.heap_high)) {
+		if(*(low - run - 1) == RAM_WATCH_PATTERN) run++;
+		else {
+			low -= run + 1;
+			run  = 0;
+		}
+	}
+
+	__ram_watch.stack_low = low;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void ram_watch_fill(void)
+{
+	uint32_t *word = &_end;
+	uint32_t *top  = (uint32_t*)(__get_MSP() - RAM_WATCH_FILL_GUARD);
+
+	while(word < top) {
+		*word++ = RAM_WATCH_PATTERN;
+	}
+}
+
+void ram_watch_init(void)
+{
+	__ram_watch.heap_high = &_end;
+	__ram_watch.stack_low = &_estack;
+
+	ram_watch_stats.area  = (uint32_t)((uint8_t*)&_estack - (uint8_t*)&_end);
+	ram_watch_stats.alarm = 0;
+
+	ram_watch_poll();
+}
+
+void ram_watch_poll(void)
+{
+	__ram_watch_heap_scan ();
+	__ram_watch_stack_scan();
+
+	ram_watch_stats.heap_peak  = (uint32_t)((uint8_t*)__ram_watch.heap_high - (uint8_t*)&_end);
+	ram_watch_stats.stack_peak = (uint32_t)((uint8_t*)&_estack - (uint8_t*)__ram_watch.stack_low);
+	ram_watch_stats.free_min   = ram_watch_stats.area - ram_watch_stats.heap_peak - ram_watch_stats.stack_peak;
+
+	if(ram_watch_stats.free_min < RAM_WATCH_ALARM_FREE) ram_watch_stats.alarm = 1;
+}
@@ -0,0 +1,64 @@
+/* ┌──────────────────────────────────┐
+   │ Stack and heap watermarks        │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ RAM watch config                       │
+   └────────────────────────────────────────┘ */
+
+/* ram_watch_fill, called first in main, fills the RAM between the end
+ * of the static data (_end, after .bss and .noinit) and the stack
+ * pointer, less RAM_WATCH_FILL_GUARD, with RAM_WATCH_PATTERN. The heap grows up from _end and the stack down from
+ * _estack: each poll moves both watermarks over the words that were
+ * overwritten since, stopping at RAM_WATCH_RUN untouched words so that a
+ * stacked value equal to the pattern does not end the scan early.
+ *
+ * The alarm is raised, and latched, once the space left between the
+ * watermarks falls under RAM_WATCH_ALARM_FREE. */
+
+#define RAM_WATCH_PATTERN          0xDEADBEEFUL
+#define RAM_WATCH_RUN              4            /* Untouched words ending a scan   */
+#define RAM_WATCH_FILL_GUARD       16           /* Bytes left under the SP, fill   */
+#define RAM_WATCH_ALARM_FREE       128          /* Bytes                           */
+
+
+/* ┌────────────────────────────────────────┐
+   │ RAM watch data                         │
+   └────────────────────────────────────────┘ */
+
+/* Sizes in bytes, peaks since boot */
+
+struct RAM_Watch_Stats {
+	uint32_t area;                                              /* _end to _estack             */
+	uint32_t stack_peak;                                        /* Deepest stack use           */
+	uint32_t heap_peak;                                         /* Highest heap use            */
+	uint32_t free_min;                                          /* Left between both           */
+	uint32_t alarm;                                             /* free_min under the limit    */
+};
+
+extern struct RAM_Watch_Stats ram_watch_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Fills the free RAM with the pattern. To call first in main, before
+   any interrupt is enabled: the stack is then at its shallowest. */
+void ram_watch_fill(void);
+
+void ram_watch_init(void);
+
+/* Moves the watermarks, to call from the main loop. A few words are read per call. */
+void ram_watch_poll(void);
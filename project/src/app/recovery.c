@@ -0,0 +1,201 @@
+/* ┌──────────────────────────────────┐
+   │ Fault recovery                   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "recovery.h"
+
+#include <string.h>
+
+#include <io/cycles.h>
+#include <io/watchdog.h>
+#include <app/boot.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Recovery_State {
+	struct DMX_Controller *universes;
+	uint32_t               nb_universes;
+
+	uint32_t               snapshot_tick;
+	uint32_t               frames    [DMX_NB_UNIVERSES];     /* Frame count at last progress */
+	uint32_t               frames_tick[DMX_NB_UNIVERSES];
+	uint8_t                restart_pending;                  /* restart_us not filled yet    */
+};
+
+struct Recovery_Record recovery_record __attribute__ ((section(".noinit")));
+
+static struct Recovery_State __recovery;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+/* Snapshot is invalid while copied: a reset in between is detected */
+
+static void __recovery_snapshot(void)
+{
+	uint32_t i_universe;
+	uint32_t i_slot;
+
+	recovery_record.snapshot_valid = 0;
+
+	for(i_universe = 0; i_universe < __recovery.nb_universes; i_universe++) {
+		struct DMX_Controller *dmx    = &__recovery.universes[i_universe];
+		const uint8_t         *stream = dmx_controller_stream_get(dmx);
+		uint8_t               *dst    = recovery_record.snapshot[i_universe];
+
+		/* What the line outputs: the streamed buffer replaces the slots */
+		if(stream) {
+			memcpy(dst, stream, DMX_NB_DATA_SLOTS);
+		}
+
+		else {
+			for(i_slot = 0; i_slot < DMX_NB_DATA_SLOTS; i_slot++) dst[i_slot] = dmx->slots[i_slot] >> 8;
+		}
+	}
+
+	if(__recovery.nb_universes) recovery_record.snapshot_valid = RECOVERY_MAGIC;
+}
+
+/* A running universe starts a frame at least every second. Stopped
+   and held universes are not supervised. */
+
+static void __recovery_supervise(uint32_t now)
+{
+	uint32_t i_universe;
+
+	for(i_universe = 0; i_universe < __recovery.nb_universes; i_universe++) {
+		struct DMX_Controller *dmx = &__recovery.universes[i_universe];
+
+		if((dmx->stats.frames != __recovery.frames[i_universe])
+			|| (dmx->state == DMX_INIT) || (dmx->state == DMX_HOLD)) {
+			__recovery.frames     [i_universe] = dmx->stats.frames;
+			__recovery.frames_tick[i_universe] = now;
+		}
+
+		else if((now - __recovery.frames_tick[i_universe]) >= RECOVERY_STALL_MS) {
+			recovery_fault(RECOVERY_CAUSE_STALL, 0, 0);
+		}
+	}
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+uint8_t recovery_restore(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	const uint32_t csr  = RCC->CSR;
+	uint8_t        warm = 0;
+	uint32_t       i_universe;
+	uint32_t       i_slot;
+
+	__HAL_RCC_CLEAR_RESET_FLAGS();
+
+	if(nb_universes > DMX_NB_UNIVERSES) nb_universes = DMX_NB_UNIVERSES;
+
+	__recovery.universes    = universes;
+	__recovery.nb_universes = nb_universes;
+
+	/* Only resets from recovery_fault and the watchdog are warm. The
+	   reset pin, power on and debugger resets are cold, and so are
+	   faults with nothing to restore or too many restarts in a row. */
+	if((recovery_record.magic == RECOVERY_MAGIC)
+		&& (recovery_record.snapshot_valid == RECOVERY_MAGIC)
+		&& (recovery_record.consecutive < RECOVERY_MAX_RESTARTS)) {
+		if((csr & RCC_CSR_SFTRSTF) && recovery_record.fault_pending) {
+			warm = 1;
+		}
+
+		else if(csr & RCC_CSR_IWDGRSTF) {
+			/* A fault handler that could not finish keeps its cause */
+			if(!recovery_record.fault_pending) {
+				recovery_record.cause    = RECOVERY_CAUSE_WATCHDOG;
+				recovery_record.pc       = 0;
+				recovery_record.lr       = 0;
+				recovery_record.fault_us = 0;
+			}
+
+			warm = 1;
+		}
+	}
+
+	if(!warm) {
+		memset(&recovery_record, 0, sizeof(recovery_record));
+		recovery_record.magic = RECOVERY_MAGIC;
+		return 0;
+	}
+
+	recovery_record.restarts++;
+	recovery_record.consecutive++;
+	recovery_record.fault_pending = 0;
+	recovery_record.restart_us    = 0;
+	__recovery.restart_pending    = 1;
+
+	/* Values are applied at once, fades in progress are lost */
+	for(i_universe = 0; i_universe < nb_universes; i_universe++) {
+		for(i_slot = 0; i_slot < DMX_NB_DATA_SLOTS; i_slot++) {
+			dmx_controller_set(&universes[i_universe], i_slot, recovery_record.snapshot[i_universe][i_slot], 0);
+		}
+	}
+
+	return 1;
+}
+
+void recovery_poll(void)
+{
+	const uint32_t now = HAL_GetTick();
+
+	watchdog_refresh();
+
+	if(__recovery.restart_pending && boot_stats.first_frame_us) {
+		recovery_record.restart_us = boot_stats.first_frame_us;
+		__recovery.restart_pending = 0;
+	}
+
+	/* Running fine since the last restart */
+	if(recovery_record.consecutive && (now >= RECOVERY_STABLE_MS)) {
+		recovery_record.consecutive = 0;
+	}
+
+	if((now - __recovery.snapshot_tick) >= RECOVERY_SNAPSHOT_MS) {
+		__recovery.snapshot_tick = now;
+
+		__recovery_snapshot  ();
+		__recovery_supervise (now);
+	}
+}
+
+void recovery_fault(enum Recovery_Cause cause, uint32_t pc, uint32_t lr)
+{
+	const uint32_t start = cycles_now();
+
+	__disable_irq();
+
+	recovery_record.cause         = cause;
+	recovery_record.pc            = pc;
+	recovery_record.lr            = lr;
+	recovery_record.fault_pending = 1;
+
+	__recovery_snapshot();
+
+	recovery_record.fault_us = (cycles_now() - start) / (HAL_RCC_GetHCLKFreq() / 1000000);
+
+	NVIC_SystemReset();
+}
+
+/* Exception frame: r0, r1, r2, r3, r12, lr, pc, xpsr */
+
+void recovery_hardfault(const uint32_t *frame)
+{
+	recovery_fault(RECOVERY_CAUSE_HARDFAULT, frame[6], frame[5]);
+}
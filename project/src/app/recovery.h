@@ -0,0 +1,94 @@
+/* ┌──────────────────────────────────┐
+   │ Fault recovery                   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Recovery config                        │
+   └────────────────────────────────────────┘ */
+
+/* Faults (HardFault, Error_Handler, watchdog, stalled output) end in a
+   reset. The record below is kept in the .noinit RAM section, so that
+   the next boot restarts the output with the values it had, instead of
+   the stored look. A snapshot of the output is taken periodically from
+   the main loop, and again by the fault handlers: the streamed frame
+   while a universe streams (app/stream.h), else the integer part of
+   the slots. Dithered slots thus come back up to one step lower, and
+   streaming restarts only once the host requests it again.
+
+   A fault without a complete snapshot (before recovery_restore, or
+   while copied) leads to a cold boot. So does a fault after
+   RECOVERY_MAX_RESTARTS warm restarts in a row, with less than
+   RECOVERY_STABLE_MS of run in between: the restored output may be
+   what faults. */
+
+#define RECOVERY_MAGIC             0x52564352UL /* "RCVR" */
+#define RECOVERY_SNAPSHOT_MS       100          /* Snapshot period                  */
+#define RECOVERY_STALL_MS          1500         /* No frame started: 1s period max  */
+#define RECOVERY_MAX_RESTARTS      3            /* Warm restarts in a row           */
+#define RECOVERY_STABLE_MS         10000        /* Run ending a row of restarts     */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Recovery data                          │
+   └────────────────────────────────────────┘ */
+
+enum Recovery_Cause {
+	RECOVERY_CAUSE_NONE,
+	RECOVERY_CAUSE_HARDFAULT,
+	RECOVERY_CAUSE_ERROR,                                       /* Error_Handler               */
+	RECOVERY_CAUSE_WATCHDOG,                                    /* Main loop stuck             */
+	RECOVERY_CAUSE_STALL                                        /* A universe stopped output   */
+};
+
+/* Times are in us. The total recovery time is fault_us + restart_us,
+   plus up to WATCHDOG_TIMEOUT_MS for watchdog resets. */
+
+struct Recovery_Record {
+	uint32_t magic;
+	uint32_t restarts;                                          /* Since the last cold boot    */
+	uint32_t consecutive;                                       /* Restarts in a row           */
+	uint32_t fault_pending;                                     /* Set by recovery_fault       */
+
+	uint32_t cause;                                             /* enum Recovery_Cause         */
+	uint32_t pc;                                                /* Faulting instruction        */
+	uint32_t lr;
+	uint32_t fault_us;                                          /* Fault to reset request      */
+	uint32_t restart_us;                                        /* Reset to first frame        */
+
+	uint32_t snapshot_valid;                                    /* RECOVERY_MAGIC if complete  */
+	uint8_t  snapshot[DMX_NB_UNIVERSES][DMX_NB_DATA_SLOTS];     /* Slot values                 */
+};
+
+extern struct Recovery_Record recovery_record;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* To call once the universes are initialized, before they are started.
+   After a fault, restores the snapshot and returns 1 (warm restart).
+   Otherwise clears the record and returns 0. */
+uint8_t recovery_restore(struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* Watchdog refresh, snapshots and output supervision, to call from the main loop */
+void    recovery_poll   (void);
+
+/* Saves the record and the output, then resets. Can be called from any context. */
+void    recovery_fault  (enum Recovery_Cause cause, uint32_t pc, uint32_t lr) __attribute__ ((noreturn));
+
+/* Called by HardFault_Handler with the stacked exception frame. Only referenced
+   from assembly: kept explicitly for link time optimization. */
+void    recovery_hardfault(const uint32_t *frame) __attribute__ ((noreturn, used));
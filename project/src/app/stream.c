@@ -0,0 +1,162 @@
+/* ┌──────────────────────────────────┐
+   │ Full frame streaming from host   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "stream.h"
+
+#include <io/host_link.h>
+#include <io/cycles.h>
+#include <io/crc.h>
+#include <app/latency.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* Frames are received by DMA in place, and output from there: one
+   buffer is output by the controller, the other one receives. Once a
+   frame is received, reception is held until the controller outputs
+   it, from the next DMX frame: frames sent meanwhile are skipped, the
+   following sync pattern is looked for. */
+
+#define STREAM_NB_BUFFERS          2
+
+struct Stream_State {
+	struct DMX_Controller *dmx;                                 /* NULL while not streaming    */
+	uint8_t * __IO         queued;                              /* Given to dmx, not output yet*/
+	__IO uint32_t          frame_tick;                          /* Last valid frame            */
+
+	struct DMX_Controller *request_dmx;
+	uint32_t               request_baudrate;
+};
+
+static const uint8_t       __stream_sync[STREAM_HEADER_SIZE] = {STREAM_SYNC0, STREAM_SYNC1};
+
+static uint8_t             __stream_buffers[STREAM_NB_BUFFERS][STREAM_FRAME_SIZE];
+static struct Stream_State __stream;
+
+struct Stream_Stats stream_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint8_t __stream_frame_valid(const uint8_t *frame)
+{
+	const uint8_t *slots = frame + STREAM_HEADER_SIZE;
+	const uint8_t *crc   = slots + DMX_NB_DATA_SLOTS;
+
+	return crc_compute(slots, DMX_NB_DATA_SLOTS)
+		== ((uint32_t)crc[0] | ((uint32_t)crc[1] << 8) | ((uint32_t)crc[2] << 16) | ((uint32_t)crc[3] << 24));
+}
+
+static uint8_t* __stream_buffer_other(const uint8_t *buffer)
+{
+	return (buffer == __stream_buffers[0]) ? __stream_buffers[1] : __stream_buffers[0];
+}
+
+/* From the DMA interrupt: reception is held first, the UART would
+   overrun while the frame is checked. */
+
+static void __stream_block_done(uint8_t *block)
+{
+	struct DMX_Controller *dmx     = __stream.dmx;
+	const uint32_t         arrival = cycles_now();
+
+	host_link_block_hold();
+
+	if(!__stream_frame_valid(block)) {
+		stream_stats.checksum_errors++;
+		host_link_block_sync(block);
+		return;
+	}
+
+	/* Reception resumes in the other buffer once this one is output, see stream_poll */
+	dmx_controller_stream_set(dmx, block + STREAM_HEADER_SIZE);
+	__stream.queued = block;
+
+	latency_event(dmx, 0, arrival, 1);
+
+	stream_stats.frames++;
+	__stream.frame_tick = HAL_GetTick();
+}
+
+static void __stream_start(void)
+{
+	struct DMX_Controller *dmx = __stream.request_dmx;
+
+	__stream.request_dmx = NULL;
+	__stream.queued      = NULL;
+	__stream.frame_tick  = HAL_GetTick();
+	__stream.dmx         = dmx;
+
+	host_link_block_start(__stream.request_baudrate, __stream_sync, STREAM_HEADER_SIZE, STREAM_FRAME_SIZE,
+		__stream_block_done, __stream_buffers[0]);
+}
+
+/* The last received values are kept as slot values */
+
+static void __stream_stop(void)
+{
+	struct DMX_Controller *dmx = __stream.dmx;
+	const uint8_t         *values;
+	uint32_t               i_slot;
+
+	host_link_block_stop();
+
+	values = __stream.queued ? (__stream.queued + STREAM_HEADER_SIZE) : dmx_controller_stream_get(dmx);
+	if(values) {
+		for(i_slot = 0; i_slot < DMX_NB_DATA_SLOTS; i_slot++) dmx_controller_set(dmx, i_slot, values[i_slot], 0);
+	}
+
+	dmx_controller_stream_set(dmx, NULL);
+	__stream.dmx = NULL;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+uint8_t stream_request(struct DMX_Controller *dmx, uint32_t baudrate)
+{
+	/* Oversampling by 8, see io/host_link.c */
+	if((baudrate < STREAM_BAUDRATE_MIN) || (baudrate > (HAL_RCC_GetPCLK1Freq() / 8))) return 0;
+
+	__stream.request_baudrate = baudrate;
+	__stream.request_dmx      = dmx;
+
+	return 1;
+}
+
+uint8_t stream_is_active(void)
+{
+	return (__stream.dmx != NULL) || (__stream.request_dmx != NULL);
+}
+
+void stream_poll(void)
+{
+	if(__stream.request_dmx) {
+		if(!__stream.dmx) __stream_start();
+		else              __stream.request_dmx = NULL;
+	}
+
+	else if(__stream.dmx && ((HAL_GetTick() - __stream.frame_tick) >= STREAM_TIMEOUT_MS)) {
+		__stream_stop();
+	}
+
+	/* Queued frame output: the other buffer is free. Not queued any
+	   more first, the next frame may be received right away. */
+	else if(__stream.queued && (dmx_controller_stream_get(__stream.dmx) == (__stream.queued + STREAM_HEADER_SIZE))) {
+		uint8_t *output = __stream.queued;
+
+		__stream.queued = NULL;
+		host_link_block_sync(__stream_buffer_other(output));
+	}
+}
@@ -0,0 +1,74 @@
+/* ┌──────────────────────────────────┐
+   │ Full frame streaming from host   │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Protocol                               │
+   └────────────────────────────────────────┘ */
+
+/* Started by the STREAM_START command (see app/command.h): once the
+ * response is sent, the host link switches to the requested baud rate
+ * and only carries stream frames:
+ *
+ *   ┌───────┬───────┬────────────────────┬─────────┐
+ *   │ SYNC0 │ SYNC1 │ slots[512]         │ u32 crc │
+ *   └───────┴───────┴────────────────────┴─────────┘
+ *
+ * crc is the CRC-32 of slots (see io/crc.h), little endian.
+ * A valid frame is output from the next DMX frame start: host to wire
+ * latency is the frame transfer (5.2ms at 1Mbaud) plus at most one DMX
+ * frame period. Frames sent before that are skipped, so the host should
+ * send at most one frame per DMX frame. The link goes back to commands
+ * at HOST_LINK_BAUDRATE once no valid frame was received for
+ * STREAM_TIMEOUT_MS, keeping the last output values.
+ *
+ * Built with CONFIG_STREAM: the two frame buffers take about 1KB of RAM,
+ * which the STM32G031K8 only has left without CONFIG_DMX_DITHER. */
+
+#define STREAM_SYNC0               0x5A
+#define STREAM_SYNC1               0xD3
+#define STREAM_HEADER_SIZE         2
+#define STREAM_FRAME_SIZE          (STREAM_HEADER_SIZE + DMX_NB_DATA_SLOTS + 4)
+
+#define STREAM_BAUDRATE_MIN        250000
+#define STREAM_TIMEOUT_MS          500
+
+
+/* ┌────────────────────────────────────────┐
+   │ Stream data                            │
+   └────────────────────────────────────────┘ */
+
+struct Stream_Stats {
+	uint32_t frames;                                            /* Valid frames                */
+	uint32_t checksum_errors;
+};
+
+extern struct Stream_Stats stream_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Streaming to dmx is started by the next stream_poll, so that the
+   command response is sent first. Returns 0 if the baud rate is not
+   supported. */
+uint8_t stream_request(struct DMX_Controller *dmx, uint32_t baudrate);
+
+/* Streaming or about to: the host link is taken */
+uint8_t stream_is_active(void);
+
+/* Starts and stops streaming, to call from the main loop */
+void    stream_poll   (void);
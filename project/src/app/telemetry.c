@@ -0,0 +1,112 @@
+/* ┌──────────────────────────────────┐
+   │ Health counters and CPU load     │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "telemetry.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Telemetry_State {
+	struct DMX_Controller *universes;
+	uint32_t               nb_universes;
+
+	uint32_t               loop_cycles;                         /* Start of the loop turn      */
+	uint32_t               loop_max_cycles;
+
+	uint32_t               window_tick;                         /* Start of the window         */
+	uint32_t               window_cycles;
+	uint32_t               window_frames;
+	uint32_t               window_isr_cycles;
+};
+
+static struct Telemetry_State __telemetry;
+
+struct Telemetry_Stats telemetry_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __telemetry_window(uint32_t now)
+{
+	struct DMX_Controller_Stats stats;
+	uint32_t                    cycles_per_us = HAL_RCC_GetHCLKFreq() / 1000000;
+	uint32_t                    elapsed       = now - __telemetry.window_cycles;
+	uint32_t                    isr_cycles    = cycles_isr_cycles;
+	uint32_t                    frames        = 0;
+	uint32_t                    uart_irqs     = 0;
+	uint32_t                    timer_irqs    = 0;
+	uint32_t                    uart_errors   = 0;
+
+	for(uint32_t i = 0; i < __telemetry.nb_universes; i++) {
+		dmx_controller_get_stats(&__telemetry.universes[i], &stats, 0);
+
+		frames     += stats.frames;
+		uart_irqs  += stats.uart_irqs;
+		timer_irqs += stats.timer_irqs;
+		uart_errors += stats.uart_errors;
+	}
+
+	telemetry_stats.frames         = frames;
+	telemetry_stats.uart_irqs      = uart_irqs;
+	telemetry_stats.timer_irqs     = timer_irqs;
+	telemetry_stats.uart_errors    = uart_errors;
+	telemetry_stats.frame_rate_mhz = (uint32_t)(((uint64_t)(frames     - __telemetry.window_frames    ) * 1000000000ULL) / (elapsed / cycles_per_us));
+	telemetry_stats.load_permille  = (uint32_t)(((uint64_t)(isr_cycles - __telemetry.window_isr_cycles) * 1000ULL      ) /  elapsed                 );
+
+	/* Maxima are converted here, the clock may have changed since */
+	telemetry_stats.isr_max_ns     = (cycles_isr_max * 1000) / cycles_per_us;
+	telemetry_stats.loop_max_us    = __telemetry.loop_max_cycles / cycles_per_us;
+
+	__telemetry.window_tick       = HAL_GetTick();
+	__telemetry.window_cycles     = now;
+	__telemetry.window_frames     = frames;
+	__telemetry.window_isr_cycles = isr_cycles;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void telemetry_init(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	__telemetry.universes    = universes;
+	__telemetry.nb_universes = nb_universes;
+
+	__telemetry.loop_cycles   = cycles_now();
+	__telemetry.window_tick   = HAL_GetTick();
+	__telemetry.window_cycles = __telemetry.loop_cycles;
+
+	telemetry_reset();
+}
+
+void telemetry_poll(void)
+{
+	uint32_t now  = cycles_now();
+	uint32_t turn = now - __telemetry.loop_cycles;
+
+	__telemetry.loop_cycles = now;
+	if(turn > __telemetry.loop_max_cycles) __telemetry.loop_max_cycles = turn;
+
+	if((HAL_GetTick() - __telemetry.window_tick) >= TELEMETRY_WINDOW_MS) {
+		__telemetry_window(now);
+	}
+}
+
+void telemetry_reset(void)
+{
+	__telemetry.loop_max_cycles = 0;
+	cycles_isr_max              = 0;
+
+	telemetry_stats.isr_max_ns  = 0;
+	telemetry_stats.loop_max_us = 0;
+}
@@ -0,0 +1,61 @@
+/* ┌──────────────────────────────────┐
+   │ Health counters and CPU load     │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/cycles.h>
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Telemetry config                       │
+   └────────────────────────────────────────┘ */
+
+/* The main loop only polls, so it is never idle in the usual sense: the
+ * time left to it is the time not spent in interrupts. The CPU load is
+ * the interrupts share of the last window, from the self time of the
+ * ISRs, nested ones being accounted once (see CYCLES_ISR_ENTER). */
+
+#define TELEMETRY_WINDOW_MS        1000
+
+
+/* ┌────────────────────────────────────────┐
+   │ Telemetry data                         │
+   └────────────────────────────────────────┘ */
+
+/* Counters are totals of all universes, updated at the end of each
+   window. Maxima are kept until reset. */
+
+struct Telemetry_Stats {
+	uint32_t frames;                                            /* Frames started              */
+	uint32_t frame_rate_mhz;                                    /* Last window                 */
+	uint32_t uart_irqs;                                         /* DMX UART TC interrupts      */
+	uint32_t timer_irqs;                                        /* DMX oneshot timer interrupts*/
+	uint32_t uart_errors;                                       /* DMX UART error flags        */
+	uint32_t isr_max_ns;                                        /* Longest ISR self time       */
+	uint32_t loop_max_us;                                       /* Longest main loop turn      */
+	uint32_t load_permille;                                     /* Last window                 */
+};
+
+extern struct Telemetry_Stats telemetry_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void telemetry_init (struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* Once per main loop turn: times the turn, and closes the window when due */
+void telemetry_poll (void);
+
+/* Clears the maxima */
+void telemetry_reset(void);
@@ -0,0 +1,557 @@
+/* ┌────────────────────────────────┐
+   │ On-target benchmark build mode │
+   └────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "bench.h"
+
+#include <string.h>
+
+#include <bsp/pin.h>
+#include <io/clock.h>
+#include <io/crc.h>
+#include <io/gpio.h>
+#include <io/oneshot_timer.h>
+#include <app/effect.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+#define BENCH_MAX_UNIVERSES DMX_NB_UNIVERSES
+#define BENCH_NB_FADES      3
+#define BENCH_NB_CRCS       2
+
+struct Bench_Range {
+	uint32_t min;
+	uint32_t max;
+	uint32_t sum;
+	uint32_t count;
+};
+
+struct Bench_Universes_Result {
+	uint32_t isr_count;
+	uint32_t isr_cycles;
+	uint32_t isr_max;
+	uint32_t window_cycles;
+};
+
+struct Bench_GPIO_Result {
+	uint32_t write_runtime;
+	uint32_t write_inline;
+	uint32_t read_runtime;
+	uint32_t read_inline;
+};
+
+struct Bench_CRC_Result {
+	struct Bench_Range software;
+	struct Bench_Range cpu;
+	struct Bench_Range dma;
+};
+
+/* All results for one clock profile */
+
+struct Bench_Run {
+	uint32_t                      clock_mhz;
+	uint32_t                      overhead;                     /* Two back-to-back readings   */
+
+	struct Bench_Universes_Result universes[BENCH_MAX_UNIVERSES];
+	uint32_t                      nb_universes;
+
+	struct Bench_GPIO_Result      gpio;
+	struct Bench_Range            fade[BENCH_NB_FADES];
+	struct Bench_Range            effect;
+	struct Bench_CRC_Result       crc[BENCH_NB_CRCS];
+
+	struct Bench_Range            timer_arm;                    /* oneshot_timer_start call    */
+	struct Bench_Range            timer_late;                   /* Callback past the delay     */
+
+	struct Bench_Range            irq_entry;                    /* Pending to first ISR read   */
+	struct Bench_Range            irq_exit;                     /* Last ISR read to thread     */
+};
+
+static const enum Clock_Profile __bench_profiles[] = {
+	CLOCK_PROFILE_32MHZ,
+	CLOCK_PROFILE_64MHZ,
+};
+
+#define BENCH_NB_RUNS (sizeof(__bench_profiles) / sizeof(__bench_profiles[0]))
+
+static const uint32_t __bench_fade_active[BENCH_NB_FADES] = {0, 64, DMX_NB_DATA_SLOTS};
+static const uint32_t __bench_crc_bytes  [BENCH_NB_CRCS ] = {64, DMX_NB_DATA_SLOTS};
+
+static struct Bench_Run          __bench_runs[BENCH_NB_RUNS];
+static uint32_t                  __bench_nb_runs;
+
+static volatile uint32_t         __bench_timer_done;
+static volatile uint32_t         __bench_timer_cycles;          /* Cycle count in the callback */
+static volatile uint32_t         __bench_irq_cycles;            /* Cycle count in the ISR      */
+
+/* Not part of the DMX public interface, see io/dmx.c */
+void __dmx_controller_update(struct DMX_Controller *dmx, uint32_t delta_us);
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __bench_range_reset(struct Bench_Range *range)
+{
+	range->min   = UINT32_MAX;
+	range->max   = 0;
+	range->sum   = 0;
+	range->count = 0;
+}
+
+static void __bench_range_add(struct Bench_Range *range, uint32_t value)
+{
+	if(value < range->min) range->min = value;
+	if(value > range->max) range->max = value;
+
+	range->sum += value;
+	range->count++;
+}
+
+static void __bench_measure(struct Bench_Universes_Result *res)
+{
+	uint32_t window = (HAL_RCC_GetHCLKFreq() / 1000) * BENCH_WINDOW_MS;
+	uint32_t start;
+
+	__disable_irq();
+	cycles_isr_cycles = 0;
+	cycles_isr_count  = 0;
+	cycles_isr_max    = 0;
+	start             = cycles_now();
+	__enable_irq();
+
+	while((cycles_now() - start) < window);
+
+	__disable_irq();
+	res->isr_count     = cycles_isr_count;
+	res->isr_cycles    = cycles_isr_cycles;
+	res->isr_max       = cycles_isr_max;
+	res->window_cycles = cycles_now() - start;
+	__enable_irq();
+}
+
+
+/* ─────────────── Workloads ────────────── */
+
+static void __bench_universes(struct Bench_Run *run, struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	uint32_t i;
+
+	if(nb_universes > BENCH_MAX_UNIVERSES) nb_universes = BENCH_MAX_UNIVERSES;
+
+	/* Add one universe at each step */
+	for(i = 0; i < nb_universes; i++) {
+		dmx_controller_init (&universes[i]);
+		dmx_controller_start(&universes[i]);
+
+		__bench_measure(&run->universes[i]);
+	}
+
+	for(i = 0; i < nb_universes; i++) {
+		dmx_controller_stop(&universes[i]);
+	}
+
+	run->nb_universes = nb_universes;
+}
+
+static void __bench_gpio(struct Bench_Run *run)
+{
+	struct Bench_GPIO_Result *res = &run->gpio;
+	volatile uint8_t          sink;
+	uint32_t                  start;
+	uint32_t                  i;
+
+	/* Runtime API: out of line call, pin definition passed by value */
+	start = cycles_now();
+	for(i = 0; i < BENCH_GPIO_ITERATIONS; i++) gpio_pin_write(pin_led, i & 1);
+	res->write_runtime = cycles_now() - start;
+
+	start = cycles_now();
+	for(i = 0; i < BENCH_GPIO_ITERATIONS; i++) sink = gpio_pin_read(pin_led);
+	res->read_runtime  = cycles_now() - start;
+
+	/* Inlined API: single BSRR/BRR store, single IDR load */
+	start = cycles_now();
+	for(i = 0; i < BENCH_GPIO_ITERATIONS; i++) pin_led_write(i & 1);
+	res->write_inline  = cycles_now() - start;
+
+	start = cycles_now();
+	for(i = 0; i < BENCH_GPIO_ITERATIONS; i++) sink = pin_led_read();
+	res->read_inline   = cycles_now() - start;
+
+	(void)sink;
+}
+
+/* Fade update of a stopped universe, as done in the DMX_UPDATE state.
+   Fades are long enough to stay active during all the iterations. */
+
+static void __bench_fade(struct Bench_Range *res, struct DMX_Controller *dmx, uint32_t nb_active)
+{
+	uint32_t start;
+	uint32_t duration;
+	uint32_t i;
+
+	for(i = 0; i < DMX_NB_DATA_SLOTS; i++) dmx_controller_set(dmx, i, 0, 0);
+	for(i = 0; i < nb_active;         i++) dmx_controller_set(dmx, i, 255, 0xFFFF);
+
+	__bench_range_reset(res);
+
+	for(i = 0; i < BENCH_FADE_ITERATIONS; i++) {
+		__disable_irq();
+		start    = cycles_now();
+		__dmx_controller_update(dmx, BENCH_FADE_DELTA_MS * 1000);
+		duration = cycles_now() - start;
+		__enable_irq();
+
+		__bench_range_add(res, duration);
+	}
+
+	for(i = 0; i < DMX_NB_DATA_SLOTS; i++) dmx_controller_set(dmx, i, 0, 0);
+}
+
+/* Effect update with every channel in use, on the slots of a stopped
+   universe. The sine needs the most work: interpolation on every step. */
+
+static void __bench_effect(struct Bench_Range *res, struct DMX_Controller *dmx)
+{
+	uint32_t start;
+	uint32_t duration;
+	uint32_t i;
+
+	effect_init     (dmx, 1);
+	effect_start    (0, EFFECT_WAVE_SINE, 1000, 0, 255);
+	effect_add_slots(0, 0, 0, EFFECT_NB_CHANNELS, 0, EFFECT_TURN);
+
+	__bench_range_reset(res);
+
+	for(i = 0; i < BENCH_EFFECT_ITERATIONS; i++) {
+		__disable_irq();
+		start    = cycles_now();
+		effect_update(BENCH_FADE_DELTA_MS);
+		duration = cycles_now() - start;
+		__enable_irq();
+
+		__bench_range_add(res, duration);
+	}
+
+	effect_stop(1);
+	for(i = 0; i < DMX_NB_DATA_SLOTS; i++) dmx_controller_set(dmx, i, 0, 0);
+}
+
+/* CRC-32 of slot values: as a stream frame, or a universe of a stored look */
+
+static void __bench_crc_feed(struct Bench_Range *res, const uint8_t *data, uint32_t length, enum Crc_Feed feed)
+{
+	uint32_t start;
+	uint32_t duration;
+	uint32_t i;
+
+	__bench_range_reset(res);
+
+	for(i = 0; i < BENCH_CRC_ITERATIONS; i++) {
+		__disable_irq();
+		start    = cycles_now();
+		crc_update_feed(0, data, length, feed);
+		duration = cycles_now() - start;
+		__enable_irq();
+
+		__bench_range_add(res, duration);
+	}
+}
+
+static void __bench_crc(struct Bench_CRC_Result *res, struct DMX_Controller *dmx, uint32_t length)
+{
+	__bench_crc_feed(&res->software, dmx->targets, length, CRC_FEED_SOFTWARE);
+	__bench_crc_feed(&res->cpu     , dmx->targets, length, CRC_FEED_CPU     );
+	__bench_crc_feed(&res->dma     , dmx->targets, length, CRC_FEED_DMA     );
+}
+
+static void __bench_timer_done_cbk(void *usrdata)
+{
+	(void)usrdata;
+
+	__bench_timer_cycles = cycles_now();
+	__bench_timer_done   = 1;
+}
+
+/* Borrows the oneshot timer of a stopped universe: the callback runs
+   from the same ISR as the DMX state machine. */
+
+static void __bench_timer(struct Bench_Run *run, struct DMX_Controller *dmx)
+{
+	const uint32_t delay = BENCH_TIMER_DELAY_US * (HAL_RCC_GetHCLKFreq() / 1000000);
+	uint32_t       start;
+	uint32_t       armed;
+	uint32_t       elapsed;
+	uint32_t       i;
+
+	oneshot_timer_init(&dmx->stimer, dmx->timer, __bench_timer_done_cbk, NULL);
+
+	__bench_range_reset(&run->timer_arm );
+	__bench_range_reset(&run->timer_late);
+
+	for(i = 0; i < BENCH_TIMER_ITERATIONS; i++) {
+		__bench_timer_done = 0;
+
+		start = cycles_now();
+		oneshot_timer_start(&dmx->stimer, BENCH_TIMER_DELAY_US);
+		armed = cycles_now();
+
+		while(!__bench_timer_done);
+
+		elapsed = __bench_timer_cycles - armed;
+
+		__bench_range_add(&run->timer_arm , armed - start);
+		__bench_range_add(&run->timer_late, (elapsed > delay) ? (elapsed - delay) : 0);
+	}
+
+	oneshot_timer_deinit(&dmx->stimer);
+}
+
+/* Interrupts are pended while masked, then taken when unmasked: entry
+   is the exception entry up to the first ISR instruction, exit the
+   exception return back to the thread code. */
+
+static void __bench_irq(struct Bench_Run *run)
+{
+	uint32_t start;
+	uint32_t end;
+	uint32_t i;
+
+	HAL_NVIC_SetPriority(BENCH_IRQ_LINE, 0, 0);
+	HAL_NVIC_EnableIRQ  (BENCH_IRQ_LINE);
+
+	__bench_range_reset(&run->irq_entry);
+	__bench_range_reset(&run->irq_exit );
+
+	for(i = 0; i < BENCH_IRQ_ITERATIONS; i++) {
+		__disable_irq();
+		HAL_NVIC_SetPendingIRQ(BENCH_IRQ_LINE);
+		start = cycles_now();
+		__enable_irq();
+		end   = cycles_now();
+
+		__bench_range_add(&run->irq_entry, __bench_irq_cycles - start);
+		__bench_range_add(&run->irq_exit , end - __bench_irq_cycles  );
+	}
+
+	HAL_NVIC_DisableIRQ(BENCH_IRQ_LINE);
+}
+
+
+/* ───────────── Output format ──────────── */
+
+static void __bench_puts(UART_HandleTypeDef *huart, const char *str)
+{
+	HAL_UART_Transmit(huart, (const uint8_t*)str, strlen(str), HAL_MAX_DELAY);
+}
+
+static void __bench_put_u32(UART_HandleTypeDef *huart, uint32_t value)
+{
+	char  buf[11];
+	char *ptr = buf + sizeof(buf);
+
+	*--ptr = '\0';
+	do {
+		*--ptr = '0' + (value % 10);
+		value /= 10;
+	} while(value);
+
+	__bench_puts(huart, ptr);
+}
+
+static void __bench_put_field(UART_HandleTypeDef *huart, const char *name, uint32_t value)
+{
+	__bench_puts   (huart, " ");
+	__bench_puts   (huart, name);
+	__bench_puts   (huart, "=");
+	__bench_put_u32(huart, value);
+}
+
+/* name_min, name_avg and name_max fields */
+
+static void __bench_put_range(UART_HandleTypeDef *huart, const char *name, const struct Bench_Range *range)
+{
+	const uint32_t avg = range->count ? (range->sum / range->count) : 0;
+
+	__bench_puts   (huart, " ");
+	__bench_puts   (huart, name);
+	__bench_puts   (huart, "_min=");
+	__bench_put_u32(huart, range->count ? range->min : 0);
+
+	__bench_puts   (huart, " ");
+	__bench_puts   (huart, name);
+	__bench_puts   (huart, "_avg=");
+	__bench_put_u32(huart, avg);
+
+	__bench_puts   (huart, " ");
+	__bench_puts   (huart, name);
+	__bench_puts   (huart, "_max=");
+	__bench_put_u32(huart, range->max);
+}
+
+static void __bench_put_name(UART_HandleTypeDef *huart, const struct Bench_Run *run, const char *name)
+{
+	__bench_puts     (huart, "bench ");
+	__bench_puts     (huart, name);
+	__bench_put_field(huart, "clock_mhz", run->clock_mhz);
+}
+
+static void __bench_report_run(UART_HandleTypeDef *huart, const struct Bench_Run *run)
+{
+	uint32_t i;
+
+	/* Cost of reading the cycle counter, included in all the results */
+
+	__bench_put_name (huart, run, "overhead");
+	__bench_put_field(huart, "cycles", run->overhead);
+	__bench_puts     (huart, "\r\n");
+
+	/* One line per step: isr_cycles includes an estimate of the exception
+	   entry/exit cost. Cost of the n-th universe is the difference between
+	   two consecutive lines. isr_max is the longest single ISR, without it. */
+
+	for(i = 0; i < run->nb_universes; i++) {
+		const struct Bench_Universes_Result *res = &run->universes[i];
+		uint64_t cycles = res->isr_cycles + (uint64_t)res->isr_count * BENCH_IRQ_LATENCY_CYCLES;
+
+		__bench_put_name (huart, run, "dmx_universes");
+		__bench_put_field(huart, "universes"    , i + 1                                           );
+		__bench_put_field(huart, "isr_count"    , res->isr_count                                  );
+		__bench_put_field(huart, "isr_cycles"   , (uint32_t)cycles                                );
+		__bench_put_field(huart, "isr_max"      , res->isr_max                                    );
+		__bench_put_field(huart, "load_permille", (uint32_t)((cycles * 1000) / res->window_cycles));
+		__bench_puts     (huart, "\r\n");
+	}
+
+	/* Total cycles for all iterations, loop overhead included */
+
+	__bench_put_name (huart, run, "gpio");
+	__bench_put_field(huart, "iterations"   , BENCH_GPIO_ITERATIONS   );
+	__bench_put_field(huart, "write_runtime", run->gpio.write_runtime);
+	__bench_put_field(huart, "write_inline" , run->gpio.write_inline );
+	__bench_put_field(huart, "read_runtime" , run->gpio.read_runtime );
+	__bench_put_field(huart, "read_inline"  , run->gpio.read_inline  );
+	__bench_puts     (huart, "\r\n");
+
+	/* Cycles per update call */
+
+	for(i = 0; i < BENCH_NB_FADES; i++) {
+		__bench_put_name (huart, run, "fade");
+		__bench_put_field(huart, "active_slots", __bench_fade_active[i]);
+		__bench_put_field(huart, "iterations"  , BENCH_FADE_ITERATIONS );
+		__bench_put_range(huart, "cycles"      , &run->fade[i]         );
+		__bench_puts     (huart, "\r\n");
+	}
+
+	/* Cycles per update call, 44 Hz leaves 22.7 ms per frame */
+
+	__bench_put_name (huart, run, "effect");
+	__bench_put_field(huart, "channels"  , EFFECT_NB_CHANNELS     );
+	__bench_put_field(huart, "iterations", BENCH_EFFECT_ITERATIONS);
+	__bench_put_range(huart, "cycles"    , &run->effect           );
+	__bench_puts     (huart, "\r\n");
+
+	/* Cycles per call, software is the fallback of io/crc_kernels.h */
+
+	for(i = 0; i < BENCH_NB_CRCS; i++) {
+		__bench_put_name (huart, run, "crc");
+		__bench_put_field(huart, "bytes"     , __bench_crc_bytes[i] );
+		__bench_put_field(huart, "iterations", BENCH_CRC_ITERATIONS );
+		__bench_put_range(huart, "software"  , &run->crc[i].software);
+		__bench_put_range(huart, "cpu"       , &run->crc[i].cpu     );
+		__bench_put_range(huart, "dma"       , &run->crc[i].dma     );
+		__bench_puts     (huart, "\r\n");
+	}
+
+	/* arm is the oneshot_timer_start call, late is counted from its
+	   return to the callback, minus the requested delay */
+
+	__bench_put_name (huart, run, "timer");
+	__bench_put_field(huart, "delay_us"  , BENCH_TIMER_DELAY_US  );
+	__bench_put_field(huart, "iterations", BENCH_TIMER_ITERATIONS);
+	__bench_put_range(huart, "arm"       , &run->timer_arm       );
+	__bench_put_range(huart, "late"      , &run->timer_late      );
+	__bench_puts     (huart, "\r\n");
+
+	__bench_put_name (huart, run, "irq");
+	__bench_put_field(huart, "iterations", BENCH_IRQ_ITERATIONS  );
+	__bench_put_range(huart, "entry"     , &run->irq_entry       );
+	__bench_put_range(huart, "exit"      , &run->irq_exit        );
+	__bench_puts     (huart, "\r\n");
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void bench_run(struct DMX_Controller *universes, uint32_t nb_universes)
+{
+	uint32_t start;
+	uint32_t i_run;
+	uint32_t i;
+
+	for(i_run = 0; i_run < BENCH_NB_RUNS; i_run++) {
+		struct Bench_Run *run = &__bench_runs[i_run];
+
+		/* Nothing is running yet: the clock can be changed directly */
+		clock_set_profile(__bench_profiles[i_run]);
+		run->clock_mhz = HAL_RCC_GetHCLKFreq() / 1000000;
+
+		__disable_irq();
+		start         = cycles_now();
+		run->overhead = cycles_now() - start;
+		__enable_irq();
+
+		__bench_universes(run, universes, nb_universes);
+		__bench_gpio     (run);
+
+		for(i = 0; i < BENCH_NB_FADES; i++) {
+			__bench_fade(&run->fade[i], &universes[0], __bench_fade_active[i]);
+		}
+
+		__bench_effect   (&run->effect, &universes[0]);
+
+		for(i = 0; i < BENCH_NB_CRCS; i++) {
+			__bench_crc(&run->crc[i], &universes[0], __bench_crc_bytes[i]);
+		}
+
+		__bench_timer    (run, &universes[0]);
+		__bench_irq      (run);
+
+		__bench_nb_runs = i_run + 1;
+	}
+
+	clock_set_profile(CLOCK_PROFILE_DEFAULT);
+}
+
+void bench_report(UART_HandleTypeDef *huart)
+{
+	uint32_t i;
+
+	/* Framed, to find complete reports in a capture */
+
+	__bench_puts     (huart, "bench begin");
+	__bench_put_field(huart, "runs", __bench_nb_runs);
+	__bench_puts     (huart, "\r\n");
+
+	for(i = 0; i < __bench_nb_runs; i++) {
+		__bench_report_run(huart, &__bench_runs[i]);
+	}
+
+	__bench_puts(huart, "bench end\r\n");
+}
+
+void BENCH_IRQ_HANDLER(void)
+{
+	__bench_irq_cycles = cycles_now();
+}
@@ -0,0 +1,51 @@
+/* ┌────────────────────────────────┐
+   │ On-target benchmark build mode │
+   └────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/cycles.h>
+#include <io/dmx.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Benchmark config                       │
+   └────────────────────────────────────────┘ */
+
+#define BENCH_WINDOW_MS            1000 /* Measurement window for each step                 */
+#define BENCH_IRQ_LATENCY_CYCLES   32   /* M0+ exception entry + exit, not seen by the ISR  */
+#define BENCH_GPIO_ITERATIONS      1024 /* Accesses timed for each GPIO access method       */
+
+#define BENCH_FADE_ITERATIONS      16   /* Fade updates timed for each number of fades      */
+#define BENCH_FADE_DELTA_MS        23   /* About one 512 slots frame between updates        */
+
+#define BENCH_EFFECT_ITERATIONS    16   /* Effect updates timed, all channels in use        */
+
+#define BENCH_TIMER_ITERATIONS     16   /* Oneshot timer delays timed                       */
+#define BENCH_TIMER_DELAY_US       10
+
+#define BENCH_CRC_ITERATIONS       16   /* CRC-32 of slot values timed for each feed        */
+
+#define BENCH_IRQ_ITERATIONS       64   /* Software triggered interrupts timed              */
+#define BENCH_IRQ_LINE             WWDG_IRQn       /* Unused: the WWDG is never started     */
+#define BENCH_IRQ_HANDLER          WWDG_IRQHandler
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Runs all the workloads at each benchmarked clock profile (32 and 64MHz),
+   then switches back to the default profile. Universes are left stopped. */
+void bench_run      (struct DMX_Controller *universes, uint32_t nb_universes);
+
+/* Prints all results over the given UART, one "bench <workload> key=value..."
+   line per result. See scripts/bench_compare.py to compare runs. */
+void bench_report   (UART_HandleTypeDef *huart);
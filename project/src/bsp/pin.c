@@ -8,15 +8,94 @@
 
 #include "pin.h"
 
+/* ┌────────────────────────────────────────┐
+   │ Compile-time checks                    │
+   └────────────────────────────────────────┘ */
+
+#define __BSP_GEN_CHECK(arg, name, port, num, mode, otype, pull, speed, af, exti)                      \
+	_Static_assert((num) < 16, "pin " #name ": pin number out of range");                          \
+	_Static_assert((af)  < 8 , "pin " #name ": alternate function out of range");                  \
+	_Static_assert((BSP_MODE_##mode == BSP_MODE_AF) || ((af) == 0),                                 \
+		"pin " #name ": alternate function set on a non-AF pin");                               \
+	_Static_assert((BSP_EXTI_##exti == BSP_EXTI_NONE) || (BSP_MODE_##mode == BSP_MODE_INPUT),       \
+		"pin " #name ": EXTI set on a non-input pin");
+
+BSP_PIN_TABLE(__BSP_GEN_CHECK, 0)
+
+/* Two pins on the same port/pin, or on the same EXTI line, make the sum differ from the OR */
+
+#define __BSP_CHECK_PORT(P, port)                                                                     \
+	_Static_assert(BSP_PORT_VALUE(__BSP_GEN_SUM1, P) == BSP_PORT_VALUE(__BSP_GEN_MASK1, P),       \
+		"pin table: a pin of port " #port " is used twice")
+
+__BSP_CHECK_PORT(BSP_PORT_A, A);
+__BSP_CHECK_PORT(BSP_PORT_B, B);
+__BSP_CHECK_PORT(BSP_PORT_C, C);
+__BSP_CHECK_PORT(BSP_PORT_D, D);
+__BSP_CHECK_PORT(BSP_PORT_F, F);
+
+_Static_assert(BSP_VALUE(__BSP_GEN_EXTI_SUM, 0) == BSP_VALUE(__BSP_GEN_EXTI_LINES, 0),
+	"pin table: an EXTI line is used twice");
+
+
 /* ┌────────────────────────────────────────┐
    │ Pin list                               │
    └────────────────────────────────────────┘ */
 
-const struct Pin_Def pin_led     = { .port = GPIOC, .pin = GPIO_PIN_6 };
+#define __BSP_GEN_DEF(arg, name, port, num, mode, otype, pull, speed, af, exti) \
+	const struct Pin_Def pin_##name = { GPIO##port, 1UL << (num) };
+
+BSP_PIN_TABLE(__BSP_GEN_DEF, 0)
+
+
+/* ┌────────────────────────────────────────┐
+   │ Batched init                           │
+   └────────────────────────────────────────┘ */
+
+/* All values are constants: unused ports and registers are optimized out.
+   MODER is written last so that pins switch with their final settings. */
+
+#define __BSP_PORT_INIT(P, gpio)                                                                              \
+	if(BSP_PORT_VALUE(__BSP_GEN_MASK1, P)) {                                                                \
+		gpio->OTYPER  = (gpio->OTYPER  & ~BSP_PORT_VALUE(__BSP_GEN_MASK1, P))     | BSP_PORT_VALUE(__BSP_GEN_OTYPER , P); \
+		gpio->OSPEEDR = (gpio->OSPEEDR & ~BSP_PORT_VALUE(__BSP_GEN_MASK2, P))     | BSP_PORT_VALUE(__BSP_GEN_OSPEEDR, P); \
+		gpio->PUPDR   = (gpio->PUPDR   & ~BSP_PORT_VALUE(__BSP_GEN_MASK2, P))     | BSP_PORT_VALUE(__BSP_GEN_PUPDR  , P); \
+		if(BSP_PORT_VALUE(__BSP_GEN_AFRL_MASK, P)) {                                                    \
+			gpio->AFR[0] = (gpio->AFR[0] & ~BSP_PORT_VALUE(__BSP_GEN_AFRL_MASK, P)) | BSP_PORT_VALUE(__BSP_GEN_AFRL, P); \
+		}                                                                                               \
+		if(BSP_PORT_VALUE(__BSP_GEN_AFRH_MASK, P)) {                                                    \
+			gpio->AFR[1] = (gpio->AFR[1] & ~BSP_PORT_VALUE(__BSP_GEN_AFRH_MASK, P)) | BSP_PORT_VALUE(__BSP_GEN_AFRH, P); \
+		}                                                                                               \
+		gpio->MODER   = (gpio->MODER   & ~BSP_PORT_VALUE(__BSP_GEN_MASK2, P))     | BSP_PORT_VALUE(__BSP_GEN_MODER  , P); \
+	}
+
+#define __BSP_EXTICR_INIT(I)                                                                                  \
+	if(BSP_VALUE(__BSP_GEN_EXTICR_MASK, I)) {                                                               \
+		EXTI->EXTICR[I] = (EXTI->EXTICR[I] & ~BSP_VALUE(__BSP_GEN_EXTICR_MASK, I)) | BSP_VALUE(__BSP_GEN_EXTICR, I); \
+	}
+
+void bsp_pins_init(void)
+{
+	/* Port clocks */
+	RCC->IOPENR |= BSP_VALUE(__BSP_GEN_PORTS, 0);
+	(void)RCC->IOPENR; /* Delay after clock enable */
 
-const struct Pin_Def pin_vcp_rx  = { .port = GPIOA, .pin = GPIO_PIN_3 };
-const struct Pin_Def pin_vcp_tx  = { .port = GPIOA, .pin = GPIO_PIN_2 };
+	/* Pins config */
+	__BSP_PORT_INIT(BSP_PORT_A, GPIOA);
+	__BSP_PORT_INIT(BSP_PORT_B, GPIOB);
+	__BSP_PORT_INIT(BSP_PORT_C, GPIOC);
+	__BSP_PORT_INIT(BSP_PORT_D, GPIOD);
+	__BSP_PORT_INIT(BSP_PORT_F, GPIOF);
 
-const struct Pin_Def pin_nrst    = { .port = GPIOF, .pin = GPIO_PIN_2 };
+	/* EXTI lines: port selection, edges, then unmask */
+	if(BSP_VALUE(__BSP_GEN_EXTI_LINES, 0)) {
+		__BSP_EXTICR_INIT(0);
+		__BSP_EXTICR_INIT(1);
+		__BSP_EXTICR_INIT(2);
+		__BSP_EXTICR_INIT(3);
 
-const struct Pin_Def pin_dmx_out = { .port = GPIOA, .pin = GPIO_PIN_9 };
+		EXTI->RTSR1 = (EXTI->RTSR1 & ~BSP_VALUE(__BSP_GEN_EXTI_LINES, 0)) | BSP_VALUE(__BSP_GEN_EXTI_RISING , 0);
+		EXTI->FTSR1 = (EXTI->FTSR1 & ~BSP_VALUE(__BSP_GEN_EXTI_LINES, 0)) | BSP_VALUE(__BSP_GEN_EXTI_FALLING, 0);
+		EXTI->IMR1 |= BSP_VALUE(__BSP_GEN_EXTI_LINES, 0);
+	}
+}
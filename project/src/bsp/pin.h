@@ -11,6 +11,7 @@
 #include <stdint.h>
 
 #include "main.h"
+#include "pin_table.h"
 
 /* ┌────────────────────────────────────────┐
    │ Pin def. structure                     │
@@ -22,13 +23,151 @@ struct Pin_Def {
 };
 
 
+/* ┌────────────────────────────────────────┐
+   │ Pin table encoding                     │
+   └────────────────────────────────────────┘ */
+
+/* Port identifiers match the RCC IOPENR bits and EXTICR values */
+
+#define BSP_PORT_A         0U
+#define BSP_PORT_B         1U
+#define BSP_PORT_C         2U
+#define BSP_PORT_D         3U
+#define BSP_PORT_F         5U
+
+#define BSP_MODE_INPUT     0U /* Register values for MODER   */
+#define BSP_MODE_OUTPUT    1U
+#define BSP_MODE_AF        2U
+#define BSP_MODE_ANALOG    3U
+
+#define BSP_OTYPE_PP       0U /* Register values for OTYPER  */
+#define BSP_OTYPE_OD       1U
+
+#define BSP_PULL_NOPULL    0U /* Register values for PUPDR   */
+#define BSP_PULL_PULLUP    1U
+#define BSP_PULL_PULLDOWN  2U
+
+#define BSP_SPEED_LOW       0U /* Register values for OSPEEDR */
+#define BSP_SPEED_MEDIUM    1U
+#define BSP_SPEED_HIGH      2U
+#define BSP_SPEED_VERY_HIGH 3U
+
+#define BSP_EXTI_NONE      0U
+#define BSP_EXTI_RISING    1U
+#define BSP_EXTI_FALLING   2U
+#define BSP_EXTI_BOTH      3U
+
+
+/* ───────── Per-port register values ────────
+   Each generator ORs the contribution of a pin if it belongs
+   to the port given as arg. */
+
+#define __BSP_ON_PORT(P, port, value) ((BSP_PORT_##port == (P)) ? (uint32_t)(value) : 0U)
+
+#define __BSP_GEN_MASK1(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, 1UL << (num))
+
+#define __BSP_GEN_MASK2(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, 3UL << (2*(num)))
+
+#define __BSP_GEN_MODER(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, BSP_MODE_##mode << (2*(num)))
+
+#define __BSP_GEN_OTYPER(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, BSP_OTYPE_##otype << (num))
+
+#define __BSP_GEN_OSPEEDR(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, BSP_SPEED_##speed << (2*(num)))
+
+#define __BSP_GEN_PUPDR(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, BSP_PULL_##pull << (2*(num)))
+
+#define __BSP_GEN_AFRL_MASK(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, ((num) < 8)  ? (0xFUL << (4*((num) & 7))) : 0U)
+
+#define __BSP_GEN_AFRL(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, ((num) < 8)  ? ((uint32_t)(af) << (4*((num) & 7))) : 0U)
+
+#define __BSP_GEN_AFRH_MASK(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, ((num) >= 8) ? (0xFUL << (4*((num) & 7))) : 0U)
+
+#define __BSP_GEN_AFRH(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	| __BSP_ON_PORT(P, port, ((num) >= 8) ? ((uint32_t)(af) << (4*((num) & 7))) : 0U)
+
+#define __BSP_GEN_SUM1(P, name, port, num, mode, otype, pull, speed, af, exti) \
+	+ __BSP_ON_PORT(P, port, 1UL << (num))
+
+#define BSP_PORT_VALUE(GEN, P) (0U BSP_PIN_TABLE(GEN, P))
+
+
+/* ─────────────── Global values ───────────── */
+
+#define __BSP_GEN_PORTS(arg, name, port, num, mode, otype, pull, speed, af, exti) \
+	| (1UL << BSP_PORT_##port)
+
+#define __BSP_GEN_EXTI_LINES(arg, name, port, num, mode, otype, pull, speed, af, exti) \
+	| ((BSP_EXTI_##exti != BSP_EXTI_NONE) ? (1UL << (num)) : 0U)
+
+#define __BSP_GEN_EXTI_SUM(arg, name, port, num, mode, otype, pull, speed, af, exti) \
+	+ ((BSP_EXTI_##exti != BSP_EXTI_NONE) ? (1UL << (num)) : 0U)
+
+#define __BSP_GEN_EXTI_RISING(arg, name, port, num, mode, otype, pull, speed, af, exti) \
+	| ((BSP_EXTI_##exti & BSP_EXTI_RISING)  ? (1UL << (num)) : 0U)
+
+#define __BSP_GEN_EXTI_FALLING(arg, name, port, num, mode, otype, pull, speed, af, exti) \
+	| ((BSP_EXTI_##exti & BSP_EXTI_FALLING) ? (1UL << (num)) : 0U)
+
+/* arg is the EXTICR register index */
+#define __BSP_GEN_EXTICR_MASK(I, name, port, num, mode, otype, pull, speed, af, exti) \
+	| (((BSP_EXTI_##exti != BSP_EXTI_NONE) && (((num) >> 2) == (I))) ? (0xFFUL << (8*((num) & 3))) : 0U)
+
+#define __BSP_GEN_EXTICR(I, name, port, num, mode, otype, pull, speed, af, exti) \
+	| (((BSP_EXTI_##exti != BSP_EXTI_NONE) && (((num) >> 2) == (I))) ? ((uint32_t)BSP_PORT_##port << (8*((num) & 3))) : 0U)
+
+#define BSP_VALUE(GEN, arg) (0U BSP_PIN_TABLE(GEN, arg))
+
+
 /* ┌────────────────────────────────────────┐
    │ Pin list                               │
    └────────────────────────────────────────┘ */
 
-extern const struct Pin_Def pin_led;
-extern const struct Pin_Def pin_vcp_rx;
-extern const struct Pin_Def pin_vcp_tx;
-extern const struct Pin_Def pin_nrst;
+/* Pin definitions, for pins used through the runtime GPIO API */
+
+#define __BSP_GEN_EXTERN(arg, name, port, num, mode, otype, pull, speed, af, exti) \
+	extern const struct Pin_Def pin_##name;
+
+BSP_PIN_TABLE(__BSP_GEN_EXTERN, 0)
+
+
+/* Inlined accessors: pin_<name>_set/clear/write/read(). A write is
+   a single store to BSRR/BRR, a read a single load from IDR. */
+
+#define __BSP_GEN_ACCESSORS(arg, name, port, num, mode, otype, pull, speed, af, exti)  \
+	static inline void __attribute__ ((always_inline)) pin_##name##_set(void)            \
+	{                                                                                     \
+		GPIO##port->BSRR = 1UL << (num);                                              \
+	}                                                                                     \
+	static inline void __attribute__ ((always_inline)) pin_##name##_clear(void)          \
+	{                                                                                     \
+		GPIO##port->BRR  = 1UL << (num);                                              \
+	}                                                                                     \
+	static inline void __attribute__ ((always_inline)) pin_##name##_write(uint8_t value) \
+	{                                                                                     \
+		if(value) GPIO##port->BSRR = 1UL << (num);                                    \
+		else      GPIO##port->BRR  = 1UL << (num);                                    \
+	}                                                                                     \
+	static inline uint8_t __attribute__ ((always_inline)) pin_##name##_read(void)        \
+	{                                                                                     \
+		return (GPIO##port->IDR >> (num)) & 1U;                                       \
+	}
+
+BSP_PIN_TABLE(__BSP_GEN_ACCESSORS, 0)
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
 
-extern const struct Pin_Def pin_dmx_out;
+/* Configures all the pins from the pin table: one write per
+   register and per port, with port clocks enabled at once. */
+void bsp_pins_init(void);
@@ -0,0 +1,103 @@
+/* ┌─────────────────────────────┐
+   │ Board pin configuration     │
+   └─────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+
+/* ┌────────────────────────────────────────┐
+   │ Board config                           │
+   └────────────────────────────────────────┘ */
+
+/* Each universe needs its own UART and timer. On the G031K8, the second
+   universe takes over the SWCLK pin and USART2, the third the VCP TX pin:
+   the host link is only available with a single universe. */
+
+#ifndef DMX_NB_UNIVERSES
+#define DMX_NB_UNIVERSES 1
+#endif
+
+#define DMX_HAS_HOST_LINK (DMX_NB_UNIVERSES < 2)
+
+/* The benchmark build runs the extra universes unrouted, and always
+   reports over the host link. The analyzer (CONFIG_ANALYZER, see
+   app/analyzer.h) receives on USART1 RX, and reports over the host
+   link. */
+
+#if defined(CONFIG_BENCH)
+#define BSP_USE_HOST_LINK 1
+#define BSP_USE_DMX2_OUT  0
+#define BSP_USE_DMX3_OUT  0
+#define BSP_USE_DMX_IN    0
+#else
+#define BSP_USE_HOST_LINK DMX_HAS_HOST_LINK
+#define BSP_USE_DMX2_OUT  (DMX_NB_UNIVERSES > 1)
+#define BSP_USE_DMX3_OUT  (DMX_NB_UNIVERSES > 2)
+#if defined(CONFIG_ANALYZER)
+#define BSP_USE_DMX_IN    DMX_HAS_HOST_LINK
+#else
+#define BSP_USE_DMX_IN    0
+#endif
+#endif
+
+
+/* ┌────────────────────────────────────────┐
+   │ Pin table                              │
+   └────────────────────────────────────────┘ */
+
+/* PIN(arg, name, port, number, mode, otype, pull, speed, af, exti)
+ *
+ *  mode  : INPUT, OUTPUT, AF, ANALOG
+ *  otype : PP (push-pull), OD (open-drain)
+ *  pull  : NOPULL, PULLUP, PULLDOWN
+ *  speed : LOW, MEDIUM, HIGH, VERY_HIGH
+ *  af    : alternate function number, 0 if mode is not AF
+ *  exti  : NONE, RISING, FALLING, BOTH
+ *
+ * arg is passed as is to PIN, it is used to generate per-port values.
+ * Everything is checked and computed at compile time by bsp/pin.h */
+
+#define BSP_PIN_TABLE(PIN, arg)                                                       \
+	PIN(arg, led     , C,  6, OUTPUT, PP, NOPULL  , LOW , 0, NONE  )              \
+	PIN(arg, nrst    , F,  2, INPUT , PP, NOPULL  , LOW , 0, RISING) /* io/trigger.h */ \
+	PIN(arg, dmx_out , A,  9, AF    , PP, PULLDOWN, HIGH, 1, NONE  ) /* USART1_TX */ \
+	BSP_PIN_TABLE_HOST_LINK(PIN, arg)                                             \
+	BSP_PIN_TABLE_DMX2_OUT (PIN, arg)                                             \
+	BSP_PIN_TABLE_DMX3_OUT (PIN, arg)                                             \
+	BSP_PIN_TABLE_DMX_IN   (PIN, arg)
+
+
+/* ───────────── Optional pins ──────────── */
+
+#if BSP_USE_HOST_LINK
+#define BSP_PIN_TABLE_HOST_LINK(PIN, arg)                                             \
+	PIN(arg, vcp_tx  , A,  2, AF    , PP, PULLUP  , LOW , 1, NONE  ) /* USART2_TX */ \
+	PIN(arg, vcp_rx  , A,  3, AF    , PP, PULLUP  , LOW , 1, NONE  ) /* USART2_RX */
+#else
+#define BSP_PIN_TABLE_HOST_LINK(PIN, arg)
+#endif
+
+#if BSP_USE_DMX2_OUT
+#define BSP_PIN_TABLE_DMX2_OUT(PIN, arg)                                              \
+	PIN(arg, dmx2_out, A, 14, AF    , PP, PULLDOWN, HIGH, 1, NONE  ) /* USART2_TX, shared with SWCLK */
+#else
+#define BSP_PIN_TABLE_DMX2_OUT(PIN, arg)
+#endif
+
+#if BSP_USE_DMX3_OUT
+#define BSP_PIN_TABLE_DMX3_OUT(PIN, arg)                                              \
+	PIN(arg, dmx3_out, A,  2, AF    , PP, PULLDOWN, HIGH, 6, NONE  ) /* LPUART1_TX, shared with VCP TX */
+#else
+#define BSP_PIN_TABLE_DMX3_OUT(PIN, arg)
+#endif
+
+#if BSP_USE_DMX_IN
+#define BSP_PIN_TABLE_DMX_IN(PIN, arg)                                                \
+	PIN(arg, dmx_in  , A, 10, AF    , PP, PULLUP  , HIGH, 1, NONE  ) /* USART1_RX, EXTI from io/dmx_rx.h */
+#else
+#define BSP_PIN_TABLE_DMX_IN(PIN, arg)
+#endif
@@ -8,89 +8,107 @@
 
 #include "clock.h"
 
+
+/* ┌────────────────────────────────────────┐
+   │ Profiles                               │
+   └────────────────────────────────────────┘ */
+
+struct Clock_Profile_Def {
+	uint8_t  pll;                                               /* SYSCLK from PLL, else HSI   */
+	uint32_t ahb_div;                                           /* AHB prescaler               */
+	uint32_t latency;                                           /* Flash wait states           */
+	uint8_t  prefetch;                                          /* Flash prefetch              */
+};
+
+/* Wait states for range 1: 0 up to 24MHz, 1 up to 48MHz, 2 up to 64MHz */
+
+static const struct Clock_Profile_Def __clock_profiles[CLOCK_NB_PROFILES] = {
+	[CLOCK_PROFILE_16MHZ] = { .pll = 0, .ahb_div = RCC_SYSCLK_DIV1, .latency = FLASH_LATENCY_0, .prefetch = 0 },
+	[CLOCK_PROFILE_32MHZ] = { .pll = 1, .ahb_div = RCC_SYSCLK_DIV2, .latency = FLASH_LATENCY_1, .prefetch = 1 },
+	[CLOCK_PROFILE_64MHZ] = { .pll = 1, .ahb_div = RCC_SYSCLK_DIV1, .latency = FLASH_LATENCY_2, .prefetch = 1 },
+};
+
+static enum Clock_Profile __clock_profile;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
 void clock_init(void)
 {
-#if 0
-	RCC_OscInitTypeDef RCC_OscInitStruct = {0};
-	RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
-
 	/** Configure the main internal regulator output voltage
 	*/
 	HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1);
 
-	/** Initializes the RCC Oscillators according to the specified parameters
-	 * in the RCC_OscInitTypeDef structure.
-	 */
-	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
-	RCC_OscInitStruct.HSIState = RCC_HSI_ON;
-	RCC_OscInitStruct.HSIDiv = RCC_HSI_DIV1;
-	RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
-	RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
-	if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
-	{
-		Error_Handler();
-	}
+	clock_set_profile(CLOCK_PROFILE_DEFAULT);
+}
 
-	/** Initializes the CPU, AHB and APB buses clocks
-	*/
-	RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
-		|RCC_CLOCKTYPE_PCLK1;
-	RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
-	RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-	RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+void clock_set_profile(enum Clock_Profile profile)
+{
+	const struct Clock_Profile_Def *def = &__clock_profiles[profile];
 
-	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
-	{
-		Error_Handler();
-	}
-#endif
 	RCC_OscInitTypeDef RCC_OscInitStruct = {0};
 	RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
 
-	/** Configure the main internal regulator output voltage
-	*/
-	HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1);
+	/* The PLL can only be configured while it does not clock the system */
+	if(def->pll && !__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY)) {
+		RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+		RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+		RCC_OscInitStruct.HSIDiv = RCC_HSI_DIV1;
+		RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
 
-	/** Initializes the RCC Oscillators according to the specified parameters
-	 * in the RCC_OscInitTypeDef structure.
-	 */
-	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
-	RCC_OscInitStruct.HSIState = RCC_HSI_ON;
-	RCC_OscInitStruct.HSIDiv = RCC_HSI_DIV1;
-	RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
-
-	RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
-	RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSI;
-	RCC_OscInitStruct.PLL.PLLM = RCC_PLLM_DIV1;
-	RCC_OscInitStruct.PLL.PLLN = 8;
-	RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV2;
-	RCC_OscInitStruct.PLL.PLLQ = RCC_PLLQ_DIV2;
-
-	//RCC_OscInitStruct.PLL.PLLR = RCC_PLLR_DIV2;
-	RCC_OscInitStruct.PLL.PLLR = RCC_PLLR_DIV4;
-
-	if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
-	{
-		Error_Handler();
+		/* HSI16 * 8 / 2 = 64MHz */
+		RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+		RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+		RCC_OscInitStruct.PLL.PLLM = RCC_PLLM_DIV1;
+		RCC_OscInitStruct.PLL.PLLN = 8;
+		RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV2;
+		RCC_OscInitStruct.PLL.PLLQ = RCC_PLLQ_DIV2;
+		RCC_OscInitStruct.PLL.PLLR = RCC_PLLR_DIV2;
+
+		if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+		{
+			Error_Handler();
+		}
 	}
 
-	/** Initializes the CPU, AHB and APB buses clocks
-	*/
+	/** Initializes the CPU, AHB and APB buses clocks.
+	 *  The HAL orders the flash latency change and updates the tick
+	 *  through HAL_InitTick, see io/timebase.c.
+	 */
 	RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
 		|RCC_CLOCKTYPE_PCLK1;
-	RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
-	RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	RCC_ClkInitStruct.SYSCLKSource = def->pll ? RCC_SYSCLKSOURCE_PLLCLK : RCC_SYSCLKSOURCE_HSI;
+	RCC_ClkInitStruct.AHBCLKDivider = def->ahb_div;
 	RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
 
-	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
+	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, def->latency) != HAL_OK)
 	{
 		Error_Handler();
 	}
 
-	/* GPIO clocks */
-	__HAL_RCC_GPIOA_CLK_ENABLE();
-	__HAL_RCC_GPIOB_CLK_ENABLE();
-	__HAL_RCC_GPIOC_CLK_ENABLE();
-	__HAL_RCC_GPIOD_CLK_ENABLE();
-	__HAL_RCC_GPIOF_CLK_ENABLE();
+	/* PLL not needed anymore */
+	if(!def->pll && __HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY)) {
+		RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+		RCC_OscInitStruct.PLL.PLLState = RCC_PLL_OFF;
+
+		if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+		{
+			Error_Handler();
+		}
+	}
+
+	/* Prefetch only helps with wait states */
+	if(def->prefetch) __HAL_FLASH_PREFETCH_BUFFER_ENABLE ();
+	else              __HAL_FLASH_PREFETCH_BUFFER_DISABLE();
+
+	__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+
+	__clock_profile = profile;
+}
+
+enum Clock_Profile clock_get_profile(void)
+{
+	return __clock_profile;
 }
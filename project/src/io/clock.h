@@ -10,4 +10,34 @@
 
 #include "main.h"
 
-void clock_init(void);
+
+/* ┌────────────────────────────────────────┐
+   │ Clock profiles                         │
+   └────────────────────────────────────────┘ */
+
+/* When used, the PLL runs at 64MHz from HSI16. Each profile sets
+   the flash wait states, prefetch and instruction cache to match.
+   APB is never divided: PCLK and timer clocks equal HCLK. */
+
+enum Clock_Profile {
+	CLOCK_PROFILE_16MHZ,                                        /* HSI16, PLL off: idle        */
+	CLOCK_PROFILE_32MHZ,                                        /* PLL / 2                     */
+	CLOCK_PROFILE_64MHZ,                                        /* PLL: busy effects engine    */
+
+	CLOCK_NB_PROFILES
+};
+
+#define CLOCK_PROFILE_DEFAULT CLOCK_PROFILE_32MHZ
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void               clock_init       (void);
+
+/* Switches the system clock. The timebase is updated here (see
+   io/timebase.h); other peripherals must recompute their prescalers
+   from HAL_RCC_GetHCLKFreq. */
+void               clock_set_profile(enum Clock_Profile profile);
+enum Clock_Profile clock_get_profile(void);
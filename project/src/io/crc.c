@@ -0,0 +1,147 @@
+/* ┌──────────────────────────────────────┐
+   │ CRC-32 on the hardware CRC unit      │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "crc.h"
+
+#include <io/crc_kernels.h>
+
+#if !defined(CONFIG_CRC_SOFT)
+#include "stm32g0xx.h"
+#endif
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Crc_State {
+	volatile uint8_t busy;                                      /* Computation on the unit     */
+};
+
+static struct Crc_State __crc;
+
+struct Crc_Stats crc_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+#if !defined(CONFIG_CRC_SOFT)
+
+/* Input reflected by word for word writes, by byte for byte writes:
+   both give the byte order of the reflected CRC. */
+
+#define CRC_CR_WORDS               (CRC_CR_REV_IN_1 | CRC_CR_REV_IN_0 | CRC_CR_REV_OUT)
+#define CRC_CR_BYTES               (CRC_CR_REV_IN_0 | CRC_CR_REV_OUT)
+
+static void __crc_feed_bytes(const uint8_t *data, uint32_t length)
+{
+	CRC->CR = CRC_CR_BYTES;
+	while(length--) *(__IO uint8_t*)&CRC->DR = *data++;
+}
+
+static void __crc_feed_cpu(const uint32_t *words, uint32_t nb_words)
+{
+	CRC->CR = CRC_CR_WORDS;
+	while(nb_words--) CRC->DR = *words++;
+}
+
+/* Memory to memory: from the buffer to the data register. Writes
+   are held while the unit computes. */
+
+static void __crc_feed_dma(const uint32_t *words, uint32_t nb_words)
+{
+	CRC->CR = CRC_CR_WORDS;
+
+	CRC_DMA_CHANNEL->CCR   = 0;
+	DMA1->IFCR             = CRC_DMA_CLEAR;
+	CRC_DMA_CHANNEL->CPAR  = (uint32_t)&CRC->DR;
+	CRC_DMA_CHANNEL->CMAR  = (uint32_t)words;
+	CRC_DMA_CHANNEL->CNDTR = nb_words;
+	CRC_DMA_CHANNEL->CCR   = DMA_CCR_MEM2MEM | DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1
+	                       | DMA_CCR_EN;
+
+	while(!(DMA1->ISR & (CRC_DMA_FLAG_TC | CRC_DMA_FLAG_TE)));
+
+	CRC_DMA_CHANNEL->CCR = 0;
+	DMA1->IFCR           = CRC_DMA_CLEAR;
+}
+
+static uint32_t __crc_hardware(uint32_t crc, const uint8_t *data, uint32_t length, enum Crc_Feed feed)
+{
+	uint32_t head     = (4 - ((uint32_t)data & 3)) & 3;
+	uint32_t nb_words;
+
+	if(head > length) head = length;
+
+	/* The unit keeps the state unreflected */
+	CRC->INIT = crc32_reflect(~crc);
+	CRC->CR   = CRC_CR_BYTES | CRC_CR_RESET;
+
+	__crc_feed_bytes(data, head);
+	data     += head;
+	length   -= head;
+	nb_words  = length / 4;
+
+	if(feed == CRC_FEED_AUTO) feed = (length >= CRC_DMA_MIN_LENGTH) ? CRC_FEED_DMA : CRC_FEED_CPU;
+
+	if(nb_words) {
+		if(feed == CRC_FEED_DMA) __crc_feed_dma((const uint32_t*)data, nb_words);
+		else                     __crc_feed_cpu((const uint32_t*)data, nb_words);
+	}
+
+	__crc_feed_bytes(data + nb_words * 4, length & 3);
+
+	return ~CRC->DR;
+}
+
+#endif
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void crc_init(void)
+{
+#if !defined(CONFIG_CRC_SOFT)
+	RCC->AHBENR |= RCC_AHBENR_CRCEN | RCC_AHBENR_DMA1EN;
+
+	CRC->POL = CRC32_POLYNOMIAL;
+#endif
+
+	__crc.busy = 0;
+}
+
+uint32_t crc_update(uint32_t crc, const void *data, uint32_t length)
+{
+	return crc_update_feed(crc, data, length, CRC_FEED_AUTO);
+}
+
+uint32_t crc_update_feed(uint32_t crc, const void *data, uint32_t length, enum Crc_Feed feed)
+{
+#if defined(CONFIG_CRC_SOFT)
+	(void)feed;
+	return crc32_kernel(crc, data, length);
+#else
+	if(feed == CRC_FEED_SOFTWARE) return crc32_kernel(crc, data, length);
+
+	/* Interrupted a computation: it goes on once this returns */
+	if(__crc.busy) {
+		crc_stats.fallbacks++;
+		return crc32_kernel(crc, data, length);
+	}
+
+	__crc.busy = 1;
+	crc        = __crc_hardware(crc, data, length, feed);
+	__crc.busy = 0;
+
+	return crc;
+#endif
+}
@@ -0,0 +1,68 @@
+/* ┌──────────────────────────────────────┐
+   │ CRC-32 on the hardware CRC unit      │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ CRC config                             │
+   └────────────────────────────────────────┘ */
+
+/* CRC-32 as zlib (see io/crc_kernels.h), for stream frames, stored
+   looks and firmware images. The CRC unit is written by the CPU for
+   short buffers, by a memory to memory DMA transfer above
+   CRC_DMA_MIN_LENGTH, the CPU waiting meanwhile. Unaligned ends go
+   byte by byte. Registers only: the loader uses it too.
+
+   Usable from interrupts: a call that interrupts a computation on the
+   unit computes in software instead, with the same result. The host
+   build (CONFIG_CRC_SOFT) always does. */
+
+#define CRC_DMA_CHANNEL            DMA1_Channel2                    /* DMA1_Channel1: host link    */
+#define CRC_DMA_FLAG_TC            DMA_ISR_TCIF2
+#define CRC_DMA_FLAG_TE            DMA_ISR_TEIF2
+#define CRC_DMA_CLEAR              DMA_IFCR_CGIF2
+
+#define CRC_DMA_MIN_LENGTH         256                              /* See the crc benchmark line  */
+
+enum Crc_Feed {
+	CRC_FEED_AUTO,                                              /* DMA from CRC_DMA_MIN_LENGTH */
+	CRC_FEED_CPU,
+	CRC_FEED_DMA,
+	CRC_FEED_SOFTWARE                                           /* crc_kernels.h, no hardware  */
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ CRC data                               │
+   └────────────────────────────────────────┘ */
+
+struct Crc_Stats {
+	uint32_t fallbacks;                                         /* Software, the unit was busy */
+};
+
+extern struct Crc_Stats crc_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Clocks of the CRC unit and of the DMA */
+void     crc_init       (void);
+
+/* Continues crc, the result of a previous call or 0 to start */
+uint32_t crc_update     (uint32_t crc, const void *data, uint32_t length);
+uint32_t crc_update_feed(uint32_t crc, const void *data, uint32_t length, enum Crc_Feed feed);
+
+static inline uint32_t crc_compute(const void *data, uint32_t length)
+{
+	return crc_update(0, data, length);
+}
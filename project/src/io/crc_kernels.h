@@ -0,0 +1,68 @@
+/* ┌──────────────────────────────────┐
+   │ CRC-32 software kernel           │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/* CRC-32 as zlib, Ethernet and the hardware unit set up by io/crc.c:
+ * polynomial 0x04C11DB7 reflected, initial value and final xor
+ * 0xFFFFFFFF. Results are bit-exact with the hardware unit, which makes
+ * this the fallback when it is busy, and the host build version. A 16
+ * entries table, one lookup per nibble: 64 bytes of flash instead of
+ * 1K for a byte table. No dependency on the HAL. */
+
+
+/* ┌────────────────────────────────────────┐
+   │ CRC kernel data                        │
+   └────────────────────────────────────────┘ */
+
+#define CRC32_POLYNOMIAL           0x04C11DB7UL
+#define CRC32_REFLECTED            0xEDB88320UL
+#define CRC32_CHECK                0xCBF43926UL                     /* CRC of "123456789"          */
+
+/* Reflected polynomial times each nibble value */
+
+static const uint32_t crc32_nibbles[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ CRC kernels                            │
+   └────────────────────────────────────────┘ */
+
+/* Continues crc, the result of a previous call or 0 to start, as
+   zlib's crc32() */
+
+static inline uint32_t crc32_kernel(uint32_t crc, const uint8_t *data, uint32_t length)
+{
+	crc = ~crc;
+
+	while(length--) {
+		crc ^= *data++;
+		crc  = (crc >> 4) ^ crc32_nibbles[crc & 0xF];
+		crc  = (crc >> 4) ^ crc32_nibbles[crc & 0xF];
+	}
+
+	return ~crc;
+}
+
+/* Bit reversal, as the hardware unit keeps its state unreflected.
+   The M0+ has no RBIT instruction. */
+
+static inline uint32_t crc32_reflect(uint32_t value)
+{
+	value = ((value >> 1) & 0x55555555UL) | ((value & 0x55555555UL) << 1);
+	value = ((value >> 2) & 0x33333333UL) | ((value & 0x33333333UL) << 2);
+	value = ((value >> 4) & 0x0F0F0F0FUL) | ((value & 0x0F0F0F0FUL) << 4);
+	value = ((value >> 8) & 0x00FF00FFUL) | ((value & 0x00FF00FFUL) << 8);
+
+	return (value >> 16) | (value << 16);
+}
@@ -0,0 +1,28 @@
+/* ┌──────────────────────────────────────┐
+   │ Free-running CPU cycle counter       │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "cycles.h"
+
+volatile uint32_t cycles_isr_cycles;
+volatile uint32_t cycles_isr_count;
+volatile uint32_t cycles_isr_nested;
+volatile uint32_t cycles_isr_max;
+
+
+void cycles_init(void)
+{
+	CYCLES_TIMER_CLK_ENABLE();
+
+	/* Count every HCLK cycle, wrap on the full 32 bits range */
+	CYCLES_TIMER_INSTANCE->CR1 = 0;
+	CYCLES_TIMER_INSTANCE->PSC = 0;
+	CYCLES_TIMER_INSTANCE->ARR = 0xFFFFFFFF;
+	CYCLES_TIMER_INSTANCE->CNT = 0;
+	CYCLES_TIMER_INSTANCE->EGR = TIM_EGR_UG; /* Load prescaler */
+	CYCLES_TIMER_INSTANCE->CR1 = TIM_CR1_CEN;
+}
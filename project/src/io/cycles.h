@@ -0,0 +1,94 @@
+/* ┌──────────────────────────────────────┐
+   │ Free-running CPU cycle counter       │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Cycle counter config                   │
+   └────────────────────────────────────────┘ */
+
+/* The Cortex-M0+ has no DWT cycle counter, so the 32 bits TIM2
+   is left free-running at HCLK without any prescaler. Differences
+   between two readings are valid as long as they are less than
+   2^32 cycles apart (~134s at 32MHz). */
+
+#define CYCLES_TIMER_INSTANCE      TIM2
+#define CYCLES_TIMER_CLK_ENABLE  __HAL_RCC_TIM2_CLK_ENABLE
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void cycles_init(void);
+
+static inline uint32_t __attribute__ ((always_inline)) cycles_now(void)
+{
+	return CYCLES_TIMER_INSTANCE->CNT;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ ISR accounting                         │
+   └────────────────────────────────────────┘ */
+
+/* Interrupt handlers are wrapped in CYCLES_ISR_ENTER and CYCLES_ISR_EXIT:
+   the self time of each ISR is accumulated, cycles spent in nested
+   (higher priority) ISRs being only accounted once. Read by the telemetry
+   (app/telemetry.h) and, in benchmark builds, by bench/bench.h. */
+
+struct Cycles_ISR_Ctx {
+	uint32_t start;
+	uint32_t nested;
+};
+
+extern volatile uint32_t cycles_isr_cycles;
+extern volatile uint32_t cycles_isr_count;
+extern volatile uint32_t cycles_isr_nested;
+extern volatile uint32_t cycles_isr_max;
+
+static inline struct Cycles_ISR_Ctx __attribute__ ((always_inline)) cycles_isr_enter(void)
+{
+	struct Cycles_ISR_Ctx ctx;
+
+	/* A higher priority interrupt between the read and the clear
+	   would lose its time */
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	ctx.start         = cycles_now();
+	ctx.nested        = cycles_isr_nested;
+	cycles_isr_nested = 0;
+
+	__set_PRIMASK(primask);
+	return ctx;
+}
+
+static inline void __attribute__ ((always_inline)) cycles_isr_exit(struct Cycles_ISR_Ctx ctx)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t duration = cycles_now() - ctx.start;
+	uint32_t self     = duration - cycles_isr_nested;
+
+	cycles_isr_cycles += self;
+	cycles_isr_count++;
+	if(self > cycles_isr_max) cycles_isr_max = self;
+	cycles_isr_nested  = ctx.nested + duration;
+
+	__set_PRIMASK(primask);
+}
+
+#define CYCLES_ISR_ENTER() struct Cycles_ISR_Ctx __cycles_isr_ctx = cycles_isr_enter()
+#define CYCLES_ISR_EXIT()  cycles_isr_exit(__cycles_isr_ctx)
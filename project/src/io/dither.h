@@ -0,0 +1,28 @@
+/* ┌──────────────────────────────────┐
+   │ Temporal dithering of q8 values  │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/* First order error diffusion in time: the fractional part of a q8
+ * value is accumulated in a per-slot error byte, and carried into the
+ * integer part once it overflows. Averaged over frames, the output is
+ * the q8 value. A value without fractional part is output as is.
+ *
+ * Values are at most 0xFF00 (targets are 8 bits), so the output
+ * never overflows. No dependency on the HAL: also used by the host
+ * build. */
+
+static inline uint8_t __attribute__ ((always_inline)) dither_q8(uint16_t value, uint8_t *err)
+{
+	uint32_t sum = (uint32_t)(value & 0xFF) + *err;
+
+	*err = (uint8_t)sum;
+	return (uint8_t)((value >> 8) + (sum >> 8));
+}
@@ -9,8 +9,11 @@
 
 #include <memory.h>
 
+#include <io/cycles.h>
+#include <io/dither.h>
 #include <io/gpio.h>
 #include <io/oneshot_timer.h>
+#include <io/timebase.h>
 
 /* ┌────────────────────────────────────────┐
    │ Private datatypes                      │
@@ -25,54 +28,129 @@ enum DMX_Controller_Event {
 };
 
 
+/* ┌────────────────────────────────────────┐
+   │ Timing presets                         │
+   └────────────────────────────────────────┘ */
+
+/* Transmitter minimums: break 92us, MAB 12us. Conservative values
+   suit old dimmers that miss short breaks or fast slots. */
+
+const struct DMX_Timing dmx_timing_presets[DMX_TIMING_NB_PRESETS] = {
+	[DMX_TIMING_PRESET_BOOT] = {
+		.mbb_us   = DMX_MBB_DELAY_US,
+		.break_us = DMX_BREAK_DELAY_US,
+		.mab_us   = DMX_MAB_DELAY_US,
+		.mark_us  = DMX_MARK_DELAY,
+		.nb_slots = DMX_NB_DATA_SLOTS
+	},
+
+	[DMX_TIMING_PRESET_MAX_REFRESH] = {
+		.mbb_us   = 0,
+		.break_us = 92,
+		.mab_us   = 12,
+		.mark_us  = 0,
+		.nb_slots = DMX_NB_DATA_SLOTS
+	},
+
+	[DMX_TIMING_PRESET_CONSERVATIVE] = {
+		.mbb_us   = 100,
+		.break_us = 200,
+		.mab_us   = 20,
+		.mark_us  = 8,
+		.nb_slots = DMX_NB_DATA_SLOTS
+	},
+};
+
+
 /* ┌────────────────────────────────────────┐
    │ Platform-specific private interface    │
    └────────────────────────────────────────┘ */
 
 uint32_t __dmx_controller_curtime(void)
 {
-	return HAL_GetTick();
+	return timebase_us();
 }
 
 
 /* ───────────────── GPIO ───────────────── */
 
-inline void __attribute__ ((always_inline)) __dmx_controller_gpio_init(struct DMX_Controller *dmx) 
-{
-	/* Init as AF pin */
-	gpio_pin_init(*dmx->pin_output,
-		GPIO_MODE_AF_PP,
-		GPIO_PULLDOWN,
-		GPIO_SPEED_FREQ_HIGH,
-		dmx->pin_uart_af
-	);
-}
-
-inline void __attribute__ ((always_inline)) __dmx_controller_do_mark(struct DMX_Controller *dmx)
+static inline void __attribute__ ((always_inline)) __dmx_controller_do_mark(struct DMX_Controller *dmx)
 {
 	/* The trick is to enable the transmitter but transmit no data, to
 	   toggle the output to the idle level (high) */
-	// Nothing to do!
+
+	/* Give the pin back to the UART after a break */
+	if(dmx->pin_output) {
+		gpio_fast_mode(dmx->pin_output->port, dmx->output_moder_lsb * 3U, dmx->output_moder_lsb * BSP_MODE_AF);
+	}
 }
 
-inline void __attribute__ ((always_inline)) __dmx_controller_do_space(struct DMX_Controller *dmx)
+static inline void __attribute__ ((always_inline)) __dmx_controller_do_space(struct DMX_Controller *dmx)
 {
-	/* Here we generate a break call! */
-	__HAL_UART_SEND_REQ(&dmx->huart, UART_SENDBREAK_REQUEST);
+	/* A send break request only lasts one character: drive the pin
+	   low instead, for the whole break delay. */
+	if(dmx->pin_output) {
+		gpio_fast_clear(dmx->pin_output->port, dmx->pin_output->pin);
+		gpio_fast_mode (dmx->pin_output->port, dmx->output_moder_lsb * 3U, dmx->output_moder_lsb * BSP_MODE_OUTPUT);
+	}
+
+	/* Unrouted universe: nothing to drive */
+	else {
+		dmx->uart->RQR = USART_RQR_SBKRQ;
+	}
 }
 
 /* ───────────────── UART ───────────────── */
 
-void __dmx_controller_uart_init(struct DMX_Controller *dmx)
+/* Baud rate from the current PCLK, the UART must be disabled */
+
+static void __dmx_controller_uart_brr(struct DMX_Controller *dmx)
+{
+	const uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+
+	if(IS_LPUART_INSTANCE(dmx->uart)) dmx->uart->BRR = UART_DIV_LPUART    (pclk, DMX_BAUDRATE, UART_PRESCALER_DIV1);
+	else                              dmx->uart->BRR = UART_DIV_SAMPLING16(pclk, DMX_BAUDRATE, UART_PRESCALER_DIV1);
+}
+
+#if !defined(CONFIG_IO_LL)
+
+/* Select the kernel clock, switch clock ON and find the IRQ line for the used UART */
+
+void __dmx_controller_uart_resources_init(struct DMX_Controller *dmx)
 {
-	/* Init clock */
 	RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
-	
-	PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_USART1;
-	PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK1;
-	if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK) Error_Handler();
 
-	__HAL_RCC_USART1_CLK_ENABLE();
+	if(dmx->uart == USART1) {
+		PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_USART1;
+		PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK1;
+		if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK) Error_Handler();
+
+		__HAL_RCC_USART1_CLK_ENABLE();
+		dmx->uart_irqn = USART1_IRQn;
+	}
+
+	else if(dmx->uart == USART2) {
+		/* USART2 is always clocked from PCLK on the G031 */
+		__HAL_RCC_USART2_CLK_ENABLE();
+		dmx->uart_irqn = USART2_IRQn;
+	}
+
+	else if(dmx->uart == LPUART1) {
+		PeriphClkInit.PeriphClockSelection  = RCC_PERIPHCLK_LPUART1;
+		PeriphClkInit.Lpuart1ClockSelection = RCC_LPUART1CLKSOURCE_PCLK1;
+		if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK) Error_Handler();
+
+		__HAL_RCC_LPUART1_CLK_ENABLE();
+		dmx->uart_irqn = LPUART1_IRQn;
+	}
+
+	else Error_Handler(); /* Unsupported UART */
+}
+
+void __dmx_controller_uart_init(struct DMX_Controller *dmx)
+{
+	/* Init clock */
+	__dmx_controller_uart_resources_init(dmx);
 	
 	/* HAL Init */
 	dmx->huart.Instance = dmx->uart;
@@ -96,46 +174,269 @@ void __dmx_controller_uart_init(struct DMX_Controller *dmx)
 	ATOMIC_SET_BIT(dmx->uart->CR1, USART_CR1_TCIE);
 
 	/* IRQ configure */
-	HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
+	HAL_NVIC_SetPriority(dmx->uart_irqn, 0, 0);
 	
 	/* Enable Transmit complete interruption */
-	HAL_NVIC_EnableIRQ  (USART1_IRQn);
+	HAL_NVIC_EnableIRQ  (dmx->uart_irqn);
 }
 
-static void __dmx_controller_uart_tx(struct DMX_Controller *dmx, uint32_t data)
+void __dmx_controller_uart_deinit(struct DMX_Controller *dmx)
+{
+	HAL_NVIC_DisableIRQ(dmx->uart_irqn);
+	ATOMIC_CLEAR_BIT(dmx->uart->CR1, USART_CR1_TCIE);
+
+	if(HAL_UART_DeInit(&dmx->huart) != HAL_OK) Error_Handler();
+}
+
+#else
+
+/* Select the kernel clock, switch clock ON and find the IRQ line for the used UART */
+
+void __dmx_controller_uart_resources_init(struct DMX_Controller *dmx)
+{
+	if(dmx->uart == USART1) {
+		MODIFY_REG(RCC->CCIPR, RCC_CCIPR_USART1SEL, 0); /* PCLK */
+
+		__HAL_RCC_USART1_CLK_ENABLE();
+		dmx->uart_irqn = USART1_IRQn;
+	}
+
+	else if(dmx->uart == USART2) {
+		/* USART2 is always clocked from PCLK on the G031 */
+		__HAL_RCC_USART2_CLK_ENABLE();
+		dmx->uart_irqn = USART2_IRQn;
+	}
+
+	else if(dmx->uart == LPUART1) {
+		MODIFY_REG(RCC->CCIPR, RCC_CCIPR_LPUART1SEL, 0); /* PCLK */
+
+		__HAL_RCC_LPUART1_CLK_ENABLE();
+		dmx->uart_irqn = LPUART1_IRQn;
+	}
+
+	else Error_Handler(); /* Unsupported UART */
+}
+
+void __dmx_controller_uart_init(struct DMX_Controller *dmx)
+{
+	USART_TypeDef *uart = dmx->uart;
+
+	/* Init clock */
+	__dmx_controller_uart_resources_init(dmx);
+
+	/* 8N2, transmitter only, FIFO disabled: same settings as the HAL backend */
+	uart->CR1   = 0;
+	uart->CR2   = USART_CR2_STOP_1;
+	uart->CR3   = 0;
+	uart->PRESC = 0;
+	__dmx_controller_uart_brr(dmx);
+
+	uart->CR1   = USART_CR1_TE | USART_CR1_TCIE | USART_CR1_UE;
+
+	/* IRQ configure */
+	HAL_NVIC_SetPriority(dmx->uart_irqn, 0, 0);
+	HAL_NVIC_EnableIRQ  (dmx->uart_irqn);
+}
+
+void __dmx_controller_uart_deinit(struct DMX_Controller *dmx)
+{
+	HAL_NVIC_DisableIRQ(dmx->uart_irqn);
+
+	dmx->uart->CR1 = 0;
+	dmx->uart->CR2 = 0;
+	dmx->uart->CR3 = 0;
+}
+
+#endif
+
+/* Recomputes the baud rate from the current PCLK */
+
+void __dmx_controller_uart_clock_update(struct DMX_Controller *dmx)
+{
+	/* BRR can only be written while the UART is disabled */
+	CLEAR_BIT(dmx->uart->CR1, USART_CR1_UE);
+	__dmx_controller_uart_brr(dmx);
+	SET_BIT  (dmx->uart->CR1, USART_CR1_UE);
+}
+
+RAMFUNC static void __dmx_controller_uart_tx(struct DMX_Controller *dmx, uint32_t data)
 {
 	dmx->uart->TDR = data;
 }
 
+/* Output value of a slot: streamed value, integer part of the q8 value, or dithered */
+
+static inline uint8_t __attribute__ ((always_inline)) __dmx_controller_slot_output(struct DMX_Controller *dmx, uint32_t i_slot)
+{
+	if(dmx->stream) return dmx->stream[i_slot];
+
+#if defined(CONFIG_DMX_DITHER)
+	if(dmx->dither_mask[i_slot >> 5] & (1UL << (i_slot & 31))) {
+		return dither_q8(dmx->slots[i_slot], &dmx->dither_err[i_slot]);
+	}
+#endif
+
+	return dmx->slots[i_slot] >> 8;
+}
+
 
 /* ┌────────────────────────────────────────┐
    │ Private interface                      │
    └────────────────────────────────────────┘ */
 
 /* Updates the current values */
-/* delta_ms is the time difference since last update. */
+/* delta_us is the time difference since last update. Fade times are
+   kept as ms: fade_us is the part of the current ms already elapsed,
+   common to all slots. */
 
-void __dmx_controller_update(struct DMX_Controller *dmx, uint32_t delta_ms)
+RAMFUNC void __dmx_controller_update(struct DMX_Controller *dmx, uint32_t delta_us)
 {
-	uint64_t tmp;
-	uint64_t  v1;
-	uint64_t  v2;
+	uint32_t target;
+	uint32_t value;
+	uint32_t step;
+	uint32_t remaining;
+	uint32_t elapsed;
+	uint32_t delta_ms;
+	uint32_t shift;
 
 	int   i_slot;
 
-	/* Slot data is stored as q8 values. */
+	if(!delta_us) return;
+
+	elapsed       = dmx->fade_us + delta_us;
+	delta_ms      = elapsed / 1000;
+
+	/* Slot data is stored as q8 values. The remaining distance is
+	   covered linearly over the remaining fade time. Distances are
+	   below 2^16 and times are scaled down to it, so their product
+	   fits in 32 bits. */
+	for(shift = 0; (delta_us >> shift) > 0xFFFF; shift++);
+
 	i_slot = DMX_NB_DATA_SLOTS;
 	while(i_slot--) {
-		v2   = (uint64_t)(dmx->targets[i_slot])<<8;
-		v1   = (uint64_t)(dmx->slots[i_slot]);
+		if(!dmx->fadetime[i_slot]) continue;
+
+		target    = (uint32_t)(dmx->targets[i_slot]) << 8;
+		value     = dmx->slots[i_slot];
+		remaining = (uint32_t)(dmx->fadetime[i_slot]) * 1000 - dmx->fade_us;
+
+		/* Fade is over */
+		if(delta_us >= remaining) {
+			dmx->slots   [i_slot] = (uint16_t)target;
+			dmx->fadetime[i_slot] = 0;
+			continue;
+		}
+
+		if(target >= value) {
+			step  = ((target - value) * (delta_us >> shift)) / (remaining >> shift);
+			value = value + step;
+		}
+
+		else {
+			step  = ((value - target) * (delta_us >> shift)) / (remaining >> shift);
+			value = value - step;
+		}
+
+		dmx->slots   [i_slot]  = (uint16_t)value;
+		dmx->fadetime[i_slot] -= delta_ms;
+	}
 
-		tmp  = (v2-v1);
-		tmp *= delta_ms;
-		tmp /= dmx->fadetime[i_slot];
+	dmx->fade_us = elapsed - delta_ms * 1000;
+}
 
-		dmx->slots[i_slot]     = (uint16_t)(tmp & 0xFFFF);
-		dmx->fadetime[i_slot] -= delta_ms;
+
+/* ┌────────────────────────────────────────┐
+   │ Frame scheduling                       │
+   └────────────────────────────────────────┘ */
+
+/* Called at each break start: interval statistics and grid advance */
+
+RAMFUNC static void __dmx_controller_frame_start(struct DMX_Controller *dmx)
+{
+	struct DMX_Controller_Stats *stats = &dmx->stats;
+	const uint32_t               now   = cycles_now();
+	uint32_t                     interval;
+	uint32_t                     reference;
+	uint32_t                     jitter;
+
+	if(!stats->frames) stats->first_break_cycles = now;
+	stats->frames++;
+
+	/* Free mode: this frame carries what the sync was for */
+	if(dmx->schedule.mode == DMX_SCHEDULE_FREE) dmx->sync_pending = 0;
+
+	/* Grid restarts from this break */
+	if(dmx->resync) {
+		dmx->resync            = 0;
+		dmx->next_break_cycles = now;
 	}
+
+	/* No interval across a restart */
+	if(dmx->stats_restart) {
+		dmx->stats_restart = 0;
+	}
+
+	else {
+		interval  = now - stats->last_break_cycles;
+		reference = (dmx->schedule.mode == DMX_SCHEDULE_FREE) ? stats->interval_last : dmx->period_cycles;
+
+		/* Free mode needs a previous interval as reference */
+		if(stats->intervals || (dmx->schedule.mode != DMX_SCHEDULE_FREE)) {
+			jitter = (interval > reference) ? (interval - reference) : (reference - interval);
+
+			if(jitter > stats->jitter_max) stats->jitter_max = jitter;
+			stats->jitter_sum += jitter;
+		}
+
+		if(interval < stats->interval_min) stats->interval_min = interval;
+		if(interval > stats->interval_max) stats->interval_max = interval;
+
+		stats->interval_last = interval;
+		stats->intervals++;
+	}
+
+	stats->last_break_cycles = now;
+
+	/* Next grid point. A late frame restarts the grid from now. */
+	if(dmx->schedule.mode != DMX_SCHEDULE_FREE) {
+		dmx->next_break_cycles += dmx->period_cycles;
+
+		if((int32_t)(dmx->next_break_cycles - now) <= 0) {
+			stats->late++;
+			dmx->next_break_cycles = now + dmx->period_cycles;
+		}
+	}
+}
+
+static void __dmx_controller_stats_reset(struct DMX_Controller *dmx)
+{
+	dmx->stats.intervals     = 0;
+	dmx->stats.interval_last = 0;
+	dmx->stats.interval_min  = UINT32_MAX;
+	dmx->stats.interval_max  = 0;
+	dmx->stats.jitter_max    = 0;
+	dmx->stats.jitter_sum    = 0;
+	dmx->stats.late          = 0;
+
+	dmx->stats_restart = 1;
+}
+
+static void __dmx_controller_schedule_update(struct DMX_Controller *dmx)
+{
+	dmx->period_cycles = dmx->schedule.period_us * dmx->cycles_per_us;
+	dmx->resync        = 1;
+	dmx->sync_pending  = 0;
+
+	__dmx_controller_stats_reset(dmx);
+}
+
+
+/* Free mode sync: the frame can end after this slot */
+
+RAMFUNC static uint8_t __dmx_controller_frame_cut(struct DMX_Controller *dmx)
+{
+	return (dmx->schedule.mode == DMX_SCHEDULE_FREE)
+		&& ((cycles_now() - dmx->stats.last_break_cycles) >= (DMX_FRAME_MIN_US * dmx->cycles_per_us));
 }
 
 
@@ -143,16 +444,80 @@ void __dmx_controller_update(struct DMX_Controller *dmx, uint32_t delta_ms)
    │ state machine process functions        │
    └────────────────────────────────────────┘ */
 
+void __dmx_controller_fsm_actions  (struct DMX_Controller *dmx);
+void __dmx_controller_event_process(struct DMX_Controller *dmx, enum DMX_Controller_Event ev);
+
+/* Starts a delay, a null one ends immediately */
+
+RAMFUNC static void __dmx_controller_delay(struct DMX_Controller *dmx, uint32_t delay_us)
+{
+	if(delay_us) oneshot_timer_start(&dmx->stimer, delay_us);
+	else         __dmx_controller_event_process(dmx, DMX_EVENT_TIMER_TIMEOUT);
+}
+
+/* Waits for the grid point of the next break, minus the MBB */
+
+RAMFUNC static void __dmx_controller_wait_frame(struct DMX_Controller *dmx)
+{
+	const uint32_t start     = dmx->next_break_cycles - dmx->timing.mbb_us * dmx->cycles_per_us;
+	int32_t        remaining = (int32_t)(start - cycles_now());
+	uint32_t       delay_us;
+
+	if(dmx->resync || (remaining < (int32_t)dmx->cycles_per_us)) {
+		dmx->state = DMX_MARK_BEFORE_BREAK;
+		__dmx_controller_fsm_actions(dmx);
+		return;
+	}
+
+	/* Longer waits are done in several delays */
+	delay_us = (uint32_t)remaining / dmx->cycles_per_us;
+	if(delay_us > DMX_DELAY_MAX_US) delay_us = DMX_DELAY_MAX_US;
+
+	dmx->state = DMX_WAIT_FRAME;
+	oneshot_timer_start(&dmx->stimer, delay_us);
+}
+
+/* Starts the next frame according to the schedule */
+
+RAMFUNC static void __dmx_controller_schedule(struct DMX_Controller *dmx)
+{
+	/* Apply the new schedule, if any */
+	if(dmx->schedule_pending) {
+		dmx->schedule         = dmx->schedule_next;
+		dmx->schedule_pending = 0;
+		__dmx_controller_schedule_update(dmx);
+	}
+
+	switch(dmx->schedule.mode) {
+		case DMX_SCHEDULE_EXTERNAL:
+			/* Sync during the frame: late, but start right now */
+			if(dmx->sync_pending) {
+				dmx->sync_pending = 0;
+				dmx->resync       = 1;
+			}
+
+			__dmx_controller_wait_frame(dmx);
+			break;
+
+		case DMX_SCHEDULE_FIXED:
+			__dmx_controller_wait_frame(dmx);
+			break;
+
+		default:
+			dmx->state = DMX_MARK_BEFORE_BREAK;
+			__dmx_controller_fsm_actions(dmx);
+			break;
+	}
+}
+
 /* This function manages the actions for the FSM */
 /* Should be called 1 time only per state */
 
-void __dmx_controller_fsm_actions(struct DMX_Controller *dmx)
+RAMFUNC void __dmx_controller_fsm_actions(struct DMX_Controller *dmx)
 {
-	switch(dmx->state) {
-		case DMX_INIT:
-			oneshot_timer_start(1000);
-			break;
+	uint32_t now;
 
+	switch(dmx->state) {
 		case DMX_MARK_BEFORE_BREAK:
 			/* Switch output pin to TRUE */
 			__dmx_controller_do_mark(dmx);
@@ -160,18 +525,39 @@ void __dmx_controller_fsm_actions(struct DMX_Controller *dmx)
 			/* Reset slot index */
 			dmx->i_slot = 0;
 
+			/* Apply the new timing, if any */
+			if(dmx->timing_pending) {
+				dmx->timing         = dmx->timing_next;
+				dmx->timing_pending = 0;
+			}
+
+			/* Switch the streamed buffer, if any */
+			if(dmx->stream_pending) {
+				dmx->stream         = dmx->stream_next;
+				dmx->stream_pending = 0;
+			}
+
+			/* Probe armed for this frame, if any */
+			if(dmx->probe_next != DMX_PROBE_NONE) {
+				dmx->probe_slot = dmx->probe_next;
+				dmx->probe_next = DMX_PROBE_NONE;
+			}
+
 			/* Start oneshot timer */
-			oneshot_timer_start(DMX_MBB_DELAY_US);
+			__dmx_controller_delay(dmx, dmx->timing.mbb_us);
 			
 			break;
 
 		case DMX_START_BREAK:
+			/* Frame accounting */
+			__dmx_controller_frame_start(dmx);
+
 			/* Switch output pin to FALSE */
 			__dmx_controller_do_space(dmx);
 			//__dmx_controller_uart_tx(dmx, 0x00);
 
 			/* Start oneshot timer */
-			oneshot_timer_start(DMX_BREAK_DELAY_US);
+			__dmx_controller_delay(dmx, dmx->timing.break_us);
 
 			break;
 
@@ -180,7 +566,7 @@ void __dmx_controller_fsm_actions(struct DMX_Controller *dmx)
 			__dmx_controller_do_mark(dmx);
 
 			/* Start oneshot timer */
-			oneshot_timer_start(DMX_MAB_DELAY_US);
+			__dmx_controller_delay(dmx, dmx->timing.mab_us);
 			break;
 
 		case DMX_TX_START:
@@ -189,25 +575,42 @@ void __dmx_controller_fsm_actions(struct DMX_Controller *dmx)
 
 		case DMX_TX_START_MARK:
 			/* Line level is already high, so wait for the mark delay*/
-			oneshot_timer_start(DMX_MARK_DELAY);
+			oneshot_timer_start(&dmx->stimer, dmx->timing.mark_us);
 			break;
 
 		case DMX_TX_BYTE:
-			/* TODO Shift the value */
-			__dmx_controller_uart_tx(dmx, dmx->slots[dmx->i_slot]);
+			__dmx_controller_uart_tx(dmx, __dmx_controller_slot_output(dmx, dmx->i_slot));
+
+			/* A compare per slot when no probe is armed */
+			if(dmx->i_slot == dmx->probe_slot) {
+				dmx->probe_cycles = cycles_now();
+				dmx->probe_slot   = DMX_PROBE_DONE;
+			}
 			break;
 
 		case DMX_TX_MARK:
 			/* Line level is already high, so wait for the mark delay*/
-			oneshot_timer_start(DMX_MARK_DELAY);
+			oneshot_timer_start(&dmx->stimer, dmx->timing.mark_us);
 			break;
 
 		case DMX_UPDATE:
-			/* TODO UPDATE */
-			/* For now, just trigger the timer */
-			
-			dmx->state = DMX_MARK_BEFORE_BREAK;
-			__dmx_controller_fsm_actions(dmx);
+			/* Fades, on the time elapsed since the last frame */
+			now = __dmx_controller_curtime();
+			__dmx_controller_update(dmx, now - dmx->update_us);
+			dmx->update_us = now;
+
+			/* Frame boundary: stop here if requested */
+			if(dmx->hold) {
+				dmx->state = DMX_HOLD;
+				break;
+			}
+
+			__dmx_controller_schedule(dmx);
+			break;
+
+		case DMX_WAIT_FRAME:
+			/* Long waits: wait more, or start the frame */
+			__dmx_controller_wait_frame(dmx);
 			break;
 
 		default:break;
@@ -216,15 +619,9 @@ void __dmx_controller_fsm_actions(struct DMX_Controller *dmx)
 
 /* Transitions for FSM, called on event */
 
-void __dmx_controller_event_process(struct DMX_Controller *dmx, enum DMX_Controller_Event ev)
+RAMFUNC void __dmx_controller_event_process(struct DMX_Controller *dmx, enum DMX_Controller_Event ev)
 {
 	switch(dmx->state) {
-		case DMX_INIT:
-			if(ev == DMX_EVENT_TIMER_TIMEOUT) {
-				dmx->state = DMX_MARK_BEFORE_BREAK;
-			}
-			break;
-
 		case DMX_MARK_BEFORE_BREAK:
 			if(ev == DMX_EVENT_TIMER_TIMEOUT) {
 				dmx->state = DMX_START_BREAK;
@@ -245,7 +642,7 @@ void __dmx_controller_event_process(struct DMX_Controller *dmx, enum DMX_Control
 
 		case DMX_TX_START:
 			if(ev == DMX_EVENT_UART_TX_DONE) {
-				if(DMX_MARK_DELAY == 0) {
+				if(dmx->timing.mark_us == 0) {
 					dmx->state = DMX_TX_BYTE;
 				}
 
@@ -265,13 +662,13 @@ void __dmx_controller_event_process(struct DMX_Controller *dmx, enum DMX_Control
 			if(ev == DMX_EVENT_UART_TX_DONE) {
 				/* Increase slot index, check against last slot */
 				dmx->i_slot++;
-				if(dmx->i_slot >= DMX_NB_DATA_SLOTS) {
+				if((dmx->i_slot >= dmx->timing.nb_slots) || (dmx->sync_pending && __dmx_controller_frame_cut(dmx))) {
 					dmx->state = DMX_UPDATE;
 				}
 
 				else {
 					/* If no MARK delay, directly transmit another byte */
-					if(DMX_MARK_DELAY == 0) {
+					if(dmx->timing.mark_us == 0) {
 						dmx->state = DMX_TX_BYTE;
 					}
 
@@ -286,7 +683,7 @@ void __dmx_controller_event_process(struct DMX_Controller *dmx, enum DMX_Control
 		case DMX_TX_MARK:
 			if(ev == DMX_EVENT_TIMER_TIMEOUT) {
 				/* Transmit next slot data */
-				if(dmx->i_slot >= DMX_NB_DATA_SLOTS) {
+				if(dmx->i_slot >= dmx->timing.nb_slots) {
 					dmx->state = DMX_UPDATE;
 				}
 
@@ -307,7 +704,7 @@ void __dmx_controller_event_process(struct DMX_Controller *dmx, enum DMX_Control
    │ Oneshot timer callback                 │
    └────────────────────────────────────────┘ */
 
-void __dmx_controller_oneshot_timer_done(void *usrdata)
+RAMFUNC void __dmx_controller_oneshot_timer_done(void *usrdata)
 {
 	struct DMX_Controller *dmx = (struct DMX_Controller*)usrdata;
 	__dmx_controller_event_process(dmx, DMX_EVENT_TIMER_TIMEOUT);
@@ -323,63 +720,367 @@ void dmx_controller_init(struct DMX_Controller *dmx)
 	/* Init slot data */
 	memset(dmx->slots   , 0, DMX_NB_DATA_SLOTS*sizeof(uint16_t));
 	memset(dmx->targets , 0, DMX_NB_DATA_SLOTS*sizeof(uint8_t ));
-	memset(dmx->fadetime, 0, DMX_NB_DATA_SLOTS*sizeof(uint32_t));
+	memset(dmx->fadetime, 0, DMX_NB_DATA_SLOTS*sizeof(uint16_t));
+
+#if defined(CONFIG_DMX_DITHER)
+	memset(dmx->dither_mask, 0, sizeof(dmx->dither_mask));
+	memset(dmx->dither_err , 0, sizeof(dmx->dither_err ));
+#endif
+
+	/* Output from the slot data */
+	dmx->stream         = NULL;
+	dmx->stream_pending = 0;
+
+	dmx->probe_slot     = DMX_PROBE_NONE;
+	dmx->probe_next     = DMX_PROBE_NONE;
+
+	/* Init timing */
+	dmx->timing         = dmx_timing_presets[DMX_TIMING_PRESET_BOOT];
+	dmx->timing_pending = 0;
+
+	/* Breaks are driven through the output pin MODER field */
+	dmx->output_moder_lsb = 0;
+	if(dmx->pin_output) {
+		uint32_t i_pin = 0;
+		while(!(dmx->pin_output->pin & (1UL << i_pin))) i_pin++;
+
+		dmx->output_moder_lsb = 1UL << (2*i_pin);
+	}
+
+	/* Init schedule: back-to-back frames */
+	dmx->schedule.mode      = DMX_SCHEDULE_FREE;
+	dmx->schedule.period_us = 0;
+	dmx->schedule_pending   = 0;
+	dmx->sync_pending       = 0;
+	dmx->cycles_per_us      = HAL_RCC_GetHCLKFreq() / 1000000;
 
 	/* Init state machine stuff */
 	dmx->state  = DMX_INIT;
 	dmx->i_slot = 0;
 	dmx->i_bit  = 0;
 
+	memset(&dmx->stats, 0, sizeof(dmx->stats));
+	__dmx_controller_schedule_update(dmx);
+
 	/* Init oneshot timer */
-	oneshot_timer_init(__dmx_controller_oneshot_timer_done, (void*)dmx);
+	oneshot_timer_init(&dmx->stimer, dmx->timer, __dmx_controller_oneshot_timer_done, (void*)dmx);
 
-	/* Init UART and GPIO */
+	/* Init UART */
 	__dmx_controller_uart_init(dmx);
-	__dmx_controller_gpio_init(dmx);
-
-	/* Dumb slots init */
-	/* TODO: Remove */
-	//int i_slot = DMX_NB_DATA_SLOTS;
-	//while(i_slot--) {
-	//	//dmx->slots[i_slot] = (0x80+i_slot)&0xFF;
-	//	dmx->slots[i_slot] = i_slot;
-	//}
-	
-	dmx->slots[0] = 125; // Level operation
-	dmx->slots[1] = 0;   // Level fine tuning
-	dmx->slots[2] = 28;  // Vertical operation
-	dmx->slots[3] = 0;   // Vertical trimming
-	dmx->slots[4] = 160; // Color: Automatic color change
-	dmx->slots[5] = 1;   // Fix spot
-	dmx->slots[6] = 0;   // Strobe
-	dmx->slots[7] = 128; // Dimming
-	dmx->slots[8] = 128; // Move speed
-	dmx->slots[9] = 0;   // No auto mode
-	dmx->slots[10] = 0;  // No reset
 
+	/* Slot values come from the patch defaults, see app/patch.h */
 
 	dmx->lock = 0;
+	dmx->hold = 0;
 }
 
 void dmx_controller_start(struct DMX_Controller *dmx)
 {
+	dmx->update_us     = __dmx_controller_curtime();
+	dmx->fade_us       = 0;
+	dmx->resync        = 1;
+	dmx->stats_restart = 1;
+
+	/* The line is already idle: go straight to the mark before break */
+	dmx->state = DMX_MARK_BEFORE_BREAK;
+
 	/* Start state machine actions */
 	__dmx_controller_fsm_actions(dmx);
 }
 
+void dmx_controller_set(struct DMX_Controller *dmx, uint32_t i_slot, uint8_t value, uint16_t fadetime_ms)
+{
+	if(i_slot >= DMX_NB_DATA_SLOTS) return;
+
+	dmx->targets [i_slot] = value;
+	dmx->fadetime[i_slot] = fadetime_ms;
+
+	/* No fade: value is applied at the next frame */
+	if(!fadetime_ms) dmx->slots[i_slot] = (uint16_t)value << 8;
+}
+
+void dmx_controller_set_q8(struct DMX_Controller *dmx, uint32_t i_slot, uint16_t value)
+{
+	if(i_slot >= DMX_NB_DATA_SLOTS) return;
+
+	dmx->targets [i_slot] = value >> 8;
+	dmx->fadetime[i_slot] = 0;
+	dmx->slots   [i_slot] = value;
+}
+
+void dmx_controller_layer_q8(struct DMX_Controller *dmx, uint32_t i_slot, uint16_t value)
+{
+	uint16_t target;
+
+	/* Fades are only ended by the ISR: no race once fadetime is 0 */
+	if((i_slot >= DMX_NB_DATA_SLOTS) || dmx->fadetime[i_slot]) return;
+
+	target             = (uint16_t)dmx->targets[i_slot] << 8;
+	dmx->slots[i_slot] = (value > target) ? value : target;
+}
+
+void dmx_controller_stop(struct DMX_Controller *dmx)
+{
+	/* Prevent any further FSM action from the ISRs */
+	dmx->lock = 1;
+
+	oneshot_timer_deinit        (&dmx->stimer);
+	__dmx_controller_uart_deinit(dmx);
+
+	dmx->state = DMX_INIT;
+	dmx->lock  = 0;
+}
+
+void dmx_controller_set_dither(struct DMX_Controller *dmx, uint32_t i_slot, uint8_t enable)
+{
+#if defined(CONFIG_DMX_DITHER)
+	uint32_t primask;
+
+	if(i_slot >= DMX_NB_DATA_SLOTS) return;
+
+	/* The mask is read from the UART ISR */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if(enable) dmx->dither_mask[i_slot >> 5] |=  (1UL << (i_slot & 31));
+	else       dmx->dither_mask[i_slot >> 5] &= ~(1UL << (i_slot & 31));
+
+	__set_PRIMASK(primask);
+#else
+	(void)dmx;
+	(void)i_slot;
+	(void)enable;
+#endif
+}
+
+void dmx_controller_stream_set(struct DMX_Controller *dmx, const uint8_t *values)
+{
+	/* Picked up by the ISR at the next frame start */
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	dmx->stream_next    = values;
+	dmx->stream_pending = 1;
+
+	__set_PRIMASK(primask);
+}
+
+const uint8_t* dmx_controller_stream_get(struct DMX_Controller *dmx)
+{
+	return dmx->stream;
+}
+
+void dmx_controller_probe(struct DMX_Controller *dmx, uint32_t i_slot, uint8_t next_frame)
+{
+	uint32_t primask;
+
+	if(i_slot >= DMX_NB_DATA_SLOTS) return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if(next_frame) {
+		dmx->probe_slot = DMX_PROBE_NONE;
+		dmx->probe_next = i_slot;
+	}
+
+	else {
+		dmx->probe_slot = i_slot;
+		dmx->probe_next = DMX_PROBE_NONE;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+uint8_t dmx_controller_probe_get(struct DMX_Controller *dmx, uint32_t *cycles)
+{
+	uint8_t  done;
+	uint32_t primask;
+
+	/* Not rearmed meanwhile */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	done = (dmx->probe_slot == DMX_PROBE_DONE);
+	if(done) {
+		*cycles         = dmx->probe_cycles;
+		dmx->probe_slot = DMX_PROBE_NONE;
+	}
+
+	__set_PRIMASK(primask);
+
+	return done;
+}
+
+uint8_t dmx_controller_set_timing(struct DMX_Controller *dmx, const struct DMX_Timing *timing)
+{
+	uint32_t primask;
+
+	/* Delays are 16 bits, so only the slot count needs a check */
+	if(!timing->break_us                                                  ) return 0;
+	if((timing->nb_slots == 0) || (timing->nb_slots > DMX_NB_DATA_SLOTS)) return 0;
+
+	/* Picked up by the ISR at the next frame start */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	dmx->timing_next    = *timing;
+	dmx->timing_pending = 1;
+
+	__set_PRIMASK(primask);
+
+	return 1;
+}
+
+void dmx_controller_get_timing(struct DMX_Controller *dmx, struct DMX_Timing *timing)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* Pending timing is the one that matters to the caller */
+	*timing = dmx->timing_pending ? dmx->timing_next : dmx->timing;
+
+	__set_PRIMASK(primask);
+}
+
+uint8_t dmx_controller_set_schedule(struct DMX_Controller *dmx, const struct DMX_Schedule *schedule)
+{
+	uint32_t primask;
+
+	if(schedule->mode > DMX_SCHEDULE_EXTERNAL) return 0;
+	if((schedule->mode != DMX_SCHEDULE_FREE)
+		&& ((schedule->period_us == 0) || (schedule->period_us > DMX_SCHEDULE_PERIOD_MAX_US))) return 0;
+
+	/* Picked up by the ISR at the next frame end */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	dmx->schedule_next    = *schedule;
+	dmx->schedule_pending = 1;
+
+	__set_PRIMASK(primask);
+
+	return 1;
+}
+
+void dmx_controller_sync(struct DMX_Controller *dmx)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* Free mode: the frame in progress is cut, see __dmx_controller_event_process */
+	if(dmx->schedule.mode == DMX_SCHEDULE_FREE) {
+		dmx->sync_pending = 1;
+	}
+
+	else if(dmx->schedule.mode == DMX_SCHEDULE_EXTERNAL) {
+		/* Idle: start the frame now */
+		if(dmx->state == DMX_WAIT_FRAME) {
+			oneshot_timer_stop(&dmx->stimer);
+
+			dmx->resync = 1;
+			dmx->state  = DMX_MARK_BEFORE_BREAK;
+			__dmx_controller_fsm_actions(dmx);
+		}
+
+		/* Frame in progress: next one starts as soon as it is done */
+		else {
+			dmx->sync_pending = 1;
+		}
+	}
+
+	__set_PRIMASK(primask);
+}
+
+void dmx_controller_get_stats(struct DMX_Controller *dmx, struct DMX_Controller_Stats *stats, uint8_t reset)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	*stats = dmx->stats;
+	if(reset) __dmx_controller_stats_reset(dmx);
+
+	__set_PRIMASK(primask);
+}
+
+uint32_t dmx_timing_frame_period_us(const struct DMX_Timing *timing)
+{
+	/* Start code and data slots, each data slot preceded by a mark */
+	return timing->mbb_us + timing->break_us + timing->mab_us
+		+ DMX_SLOT_TIME_US * (timing->nb_slots + 1)
+		+ timing->mark_us  *  timing->nb_slots;
+}
+
+void dmx_controller_hold(struct DMX_Controller *dmx)
+{
+	dmx->hold = 1;
+}
+
+uint8_t dmx_controller_is_held(struct DMX_Controller *dmx)
+{
+	return (dmx->state == DMX_HOLD) || (dmx->state == DMX_INIT);
+}
+
+void dmx_controller_clock_update(struct DMX_Controller *dmx)
+{
+	/* Only when held or stopped: no timer nor transfer is running */
+	if(!dmx_controller_is_held(dmx)) Error_Handler();
+
+	oneshot_timer_clock_update(&dmx->stimer);
+
+	/* Grid and statistics are in cycles */
+	dmx->cycles_per_us = HAL_RCC_GetHCLKFreq() / 1000000;
+	__dmx_controller_schedule_update(dmx);
+
+	/* UART is re-initialized from scratch after a stop */
+	if(dmx->uart->CR1 & USART_CR1_UE) __dmx_controller_uart_clock_update(dmx);
+}
+
+void dmx_controller_resume(struct DMX_Controller *dmx)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	/* The frame end may be reached meanwhile if the hold timed out */
+	__disable_irq();
+
+	dmx->hold = 0;
+
+	/* Held universes start over with a mark before break */
+	if(dmx->state == DMX_HOLD) {
+		dmx->state = DMX_MARK_BEFORE_BREAK;
+		__dmx_controller_fsm_actions(dmx);
+	}
+
+	__set_PRIMASK(primask);
+}
+
 
 /* ┌────────────────────────────────────────┐
    │ IRQ Handler                            │
    └────────────────────────────────────────┘ */
 
-void dmx_controller_irq_handler(struct DMX_Controller *dmx)
+RAMFUNC void dmx_controller_irq_handler(struct DMX_Controller *dmx)
 {
 	/* Check interrupts for UART */
 	uint32_t isrflags   = READ_REG(dmx->uart->ISR);
 
+	/* Error flags, seen with the next interrupt: no source on a
+	   transmitter, but a wrong UART setup or a stray receiver */
+	if(isrflags & (USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE)) {
+		dmx->stats.uart_errors++;
+		dmx->uart->ICR = USART_ICR_FECF | USART_ICR_NECF | USART_ICR_ORECF;
+	}
+
 	/* Transfer complete interrupt */
 	if(isrflags & USART_ISR_TC) {
+		dmx->stats.uart_irqs++;
 		__dmx_controller_event_process(dmx, DMX_EVENT_UART_TX_DONE);
 		dmx->uart->ICR = USART_ICR_TCCF; // Clear interrupt flag
 	}
 }
+
+RAMFUNC void dmx_controller_timer_irq_handler(struct DMX_Controller *dmx)
+{
+	dmx->stats.timer_irqs++;
+	oneshot_timer_irq_handler(&dmx->stimer);
+}
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include <bsp/pin.h>
+#include <io/oneshot_timer.h>
 
 #include "stm32g0xx_hal.h"
 
@@ -25,12 +26,23 @@
 
 /* ───── Constants for various delays ───── */
 
+/* Boot timing profile, see struct DMX_Timing */
+
 #define DMX_MBB_DELAY_US   100 /* MBB: Mark before break        */
-#define DMX_BREAK_DELAY_US 50
+#define DMX_BREAK_DELAY_US 100 /* At least 92us for transmitters */
 
-#define DMX_MAB_DELAY_US   10  /* MAB: Mark after break         */
+#define DMX_MAB_DELAY_US   12  /* MAB: Mark after break         */
 #define DMX_MARK_DELAY     0   /* No mark delay! Gotta go fast! */
 
+#define DMX_SLOT_TIME_US   44  /* 11 bits at 250kbps            */
+#define DMX_DELAY_MAX_US   0xFFFF /* 16 bits oneshot timers     */
+#define DMX_FRAME_MIN_US   1204   /* Spec: break to break       */
+
+/* Latency probe states, see dmx_controller_probe */
+
+#define DMX_PROBE_NONE     0xFFFF /* No slot probed              */
+#define DMX_PROBE_DONE     0xFFFE /* probe_cycles is valid       */
+
 
 
 /* ┌────────────────────────────────────────┐
@@ -38,7 +50,7 @@
    └────────────────────────────────────────┘ */
 
 enum DMX_Controller_State {
-	DMX_INIT,
+	DMX_INIT,          /* Stopped */
 	DMX_MARK_BEFORE_BREAK,
 	DMX_START_BREAK,
 	DMX_MARK_AFTER_BREAK,
@@ -46,22 +58,99 @@ enum DMX_Controller_State {
 	DMX_TX_START_MARK,
 	DMX_TX_BYTE,
 	DMX_TX_MARK,
-	DMX_UPDATE
+	DMX_UPDATE,
+	DMX_WAIT_FRAME,    /* Waiting for the next frame start, line idle */
+	DMX_HOLD           /* Held between frames, line idle */
+};
+
+
+/* Frame timing, applied at the start of a frame. Delays are in us.
+ * The break is driven on the output pin, so its length is only
+ * exact for routed universes (see dmx_controller_init). */
+
+struct DMX_Timing {
+	uint16_t                   mbb_us;                          /* Mark before break           */
+	uint16_t                   break_us;                        /* Break                       */
+	uint16_t                   mab_us;                          /* Mark after break            */
+	uint16_t                   mark_us;                         /* Mark between slots          */
+	uint16_t                   nb_slots;                        /* Data slots sent per frame   */
+};
+
+enum DMX_Timing_Preset {
+	DMX_TIMING_PRESET_BOOT,                                     /* Compile-time defaults       */
+	DMX_TIMING_PRESET_MAX_REFRESH,                              /* Transmitter spec minimums   */
+	DMX_TIMING_PRESET_CONSERVATIVE,                             /* Long break for old dimmers  */
+
+	DMX_TIMING_NB_PRESETS
+};
+
+extern const struct DMX_Timing dmx_timing_presets[DMX_TIMING_NB_PRESETS];
+
+
+/* Frame scheduling. In fixed and external modes, breaks are started on
+ * a grid of period_us. External sync events restart the grid, which
+ * keeps running at period_us if they stop. In free mode, they cut the
+ * frame being sent after its current slot, at least DMX_FRAME_MIN_US
+ * after its break: the next frame starts right away. */
+
+enum DMX_Schedule_Mode {
+	DMX_SCHEDULE_FREE,                                          /* Back-to-back frames         */
+	DMX_SCHEDULE_FIXED,                                         /* Fixed grid                  */
+	DMX_SCHEDULE_EXTERNAL                                       /* Grid locked to sync events  */
+};
+
+struct DMX_Schedule {
+	enum DMX_Schedule_Mode     mode;
+	uint32_t                   period_us;                       /* Grid period                 */
+};
+
+#define DMX_SCHEDULE_PERIOD_MAX_US 1000000 /* Spec: at most 1s between breaks */
+
+
+/* Break-to-break statistics, in cycles (see io/cycles.h). Jitter is
+ * the deviation from the grid period, or from the previous interval
+ * in free mode. They restart on clock and schedule changes. */
+
+struct DMX_Controller_Stats {
+	uint32_t                   frames;                          /* Number of frames started    */
+	uint32_t                   first_break_cycles;              /* Cycle count at first break  */
+	uint32_t                   last_break_cycles;               /* Cycle count at last break   */
+
+	uint32_t                   intervals;                       /* Measured intervals          */
+	uint32_t                   interval_last;
+	uint32_t                   interval_min;
+	uint32_t                   interval_max;
+	uint32_t                   jitter_max;
+	uint64_t                   jitter_sum;
+	uint32_t                   late;                            /* Frames started past the grid*/
+
+	uint32_t                   uart_irqs;                       /* UART TC interrupts          */
+	uint32_t                   timer_irqs;                      /* Oneshot timer interrupts    */
+	uint32_t                   uart_errors;                     /* Framing, noise, overrun     */
 };
 
 
 /* The first slot data (start code) is not stored
  * in the arrays. thus -1 for some arrays */
 
+/* Each controller drives one universe: it owns an UART (USART1, USART2
+ * or LPUART1) and a oneshot timer (TIM14, TIM16 or TIM17). The IRQ handlers
+ * for both must call the matching dmx_controller_*_irq_handler function. */
+
 struct DMX_Controller {
 
 	/* ──────────── Interface data ──────────── */
 
-	const struct Pin_Def      *pin_output;                     /* Pin for data output         */
-	uint32_t                   pin_uart_af;                     /* Alternate function for UART */
+	const struct Pin_Def      *pin_output;                     /* Pin for data output, NULL if unrouted. Configured by the pin table */
 
 	USART_TypeDef             *uart;                            /* Used uart */
+#if !defined(CONFIG_IO_LL)
 	UART_HandleTypeDef         huart;                           /* UART Handle for HAL */
+#endif
+	IRQn_Type                  uart_irqn;                       /* IRQ line of the UART        */
+
+	TIM_TypeDef               *timer;                           /* Used timer for delays       */
+	struct Oneshot_Timer       stimer;                          /* Oneshot timer for delays    */
 
 
 	/* ────────────── Slots data ────────────── */
@@ -69,7 +158,30 @@ struct DMX_Controller {
 	uint16_t                   slots    [DMX_NB_DATA_SLOTS];    /* Current slot value          */
 	uint8_t                    targets  [DMX_NB_DATA_SLOTS];    /* Target slot value           */
 
-	uint32_t                   fadetime [DMX_NB_DATA_SLOTS];    /* Fade time as ms             */
+	uint16_t                   fadetime [DMX_NB_DATA_SLOTS];    /* Remaining fade time as ms   */
+	uint32_t                   update_us;                       /* Time of the last update     */
+	uint32_t                   fade_us;                         /* Elapsed in the current ms   */
+
+#if defined(CONFIG_DMX_DITHER)
+	uint32_t                   dither_mask[DMX_NB_DATA_SLOTS/32]; /* Dithered slots            */
+	uint8_t                    dither_err [DMX_NB_DATA_SLOTS];    /* Error diffusion state     */
+#endif
+
+	const uint8_t             *stream;                          /* Output buffer, NULL: slots  */
+	const uint8_t             *stream_next;                     /* For the next frame          */
+	__IO uint32_t              stream_pending;
+
+	__IO uint32_t              probe_slot;                      /* Slot to timestamp, or state */
+	__IO uint32_t              probe_next;                      /* Probed from the next frame  */
+	uint32_t                   probe_cycles;                    /* TDR write of the probed slot*/
+
+	/* ────────────── Timing data ───────────── */
+
+	struct DMX_Timing          timing;                          /* Timing of the current frame */
+	struct DMX_Timing          timing_next;                     /* Timing for the next frame   */
+	__IO uint32_t              timing_pending;
+
+	uint32_t                   output_moder_lsb;                /* Output pin MODER field LSB  */
 
 	/* ─────────────── FSM data ─────────────── */
 
@@ -77,6 +189,24 @@ struct DMX_Controller {
 	__IO uint32_t                   i_slot;                    /* Current slot index          */
 	__IO uint32_t                   i_bit;                     /* Current transmitted bit     */
 	__IO uint32_t                   lock;
+	__IO uint32_t                   hold;                      /* Hold requested at frame end */
+
+	/* ───────────── Schedule data ──────────── */
+
+	struct DMX_Schedule             schedule;
+	struct DMX_Schedule             schedule_next;
+	__IO uint32_t                   schedule_pending;
+
+	uint32_t                        cycles_per_us;             /* From HCLK                   */
+	uint32_t                        period_cycles;             /* Grid period                 */
+	uint32_t                        next_break_cycles;         /* Next grid point             */
+	__IO uint32_t                   sync_pending;              /* Sync during a frame         */
+	__IO uint32_t                   resync;                    /* Restart grid at next break  */
+	__IO uint32_t                   stats_restart;             /* No interval at next break   */
+
+	/* ────────────── Statistics ────────────── */
+
+	struct DMX_Controller_Stats     stats;
 };
 
 
@@ -88,6 +218,62 @@ void dmx_controller_init       (struct DMX_Controller *dmx);
 void dmx_controller_start      (struct DMX_Controller *dmx);
 void dmx_controller_stop       (struct DMX_Controller *dmx);
 
-/* TODO slot set function */
+/* Holds the output at the end of the current frame, e.g. to change
+ * the system clock. Clock can be changed once dmx_controller_is_held. */
+void    dmx_controller_hold        (struct DMX_Controller *dmx);
+uint8_t dmx_controller_is_held     (struct DMX_Controller *dmx);
+void    dmx_controller_clock_update(struct DMX_Controller *dmx);
+void    dmx_controller_resume      (struct DMX_Controller *dmx);
+
+/* Sets the target value of a slot, reached after fadetime_ms */
+void dmx_controller_set        (struct DMX_Controller *dmx, uint32_t i_slot, uint8_t value, uint16_t fadetime_ms);
+
+/* Sets a slot to a q8 value at once (cancels a fade), e.g. from a
+ * generator: the fractional part is left to dithering */
+void dmx_controller_set_q8     (struct DMX_Controller *dmx, uint32_t i_slot, uint16_t value);
+
+/* Highest takes precedence of a q8 value and the slot target, e.g. from
+ * an effect: the target is kept, 0 goes back to it. A running fade
+ * wins until it completes. */
+void dmx_controller_layer_q8   (struct DMX_Controller *dmx, uint32_t i_slot, uint16_t value);
+
+/* Enables temporal dithering of the fractional part of slots, for
+ * smooth slow fades. No effect without CONFIG_DMX_DITHER. */
+void dmx_controller_set_dither (struct DMX_Controller *dmx, uint32_t i_slot, uint8_t enable);
+
+/* Outputs the values of an external buffer of DMX_NB_DATA_SLOTS bytes
+ * instead of the slot data (no fades nor dithering), from the next
+ * frame. NULL goes back to the slot data. The buffer must be left
+ * untouched until dmx_controller_stream_get returns another one. */
+void           dmx_controller_stream_set(struct DMX_Controller *dmx, const uint8_t *values);
+
+/* Buffer output by the current frame */
+const uint8_t* dmx_controller_stream_get(struct DMX_Controller *dmx);
+
+/* Timestamps the next TDR write of a slot with cycles_now, from now
+ * or from the next frame (e.g. a fade or stream starts there). Replaces
+ * the probe in flight. Can be called from any context. */
+void    dmx_controller_probe    (struct DMX_Controller *dmx, uint32_t i_slot, uint8_t next_frame);
+
+/* Returns 1 once the probed slot is output, with the cycle count */
+uint8_t dmx_controller_probe_get(struct DMX_Controller *dmx, uint32_t *cycles);
+
+/* Timing changes apply from the next frame. Returns 0 if invalid. */
+uint8_t  dmx_controller_set_timing (struct DMX_Controller *dmx, const struct DMX_Timing *timing);
+void     dmx_controller_get_timing (struct DMX_Controller *dmx, struct DMX_Timing *timing);
+
+/* Schedule changes apply from the next frame. Returns 0 if invalid. */
+uint8_t  dmx_controller_set_schedule(struct DMX_Controller *dmx, const struct DMX_Schedule *schedule);
+
+/* External sync event, can be called from any context. Ignored with
+ * the fixed schedule. */
+void     dmx_controller_sync        (struct DMX_Controller *dmx);
+
+/* Copies then restarts the interval statistics */
+void     dmx_controller_get_stats   (struct DMX_Controller *dmx, struct DMX_Controller_Stats *stats, uint8_t reset);
+
+/* Nominal frame period, without ISR latencies */
+uint32_t dmx_timing_frame_period_us(const struct DMX_Timing *timing);
 
-void dmx_controller_irq_handler(struct DMX_Controller *dmx);
+void dmx_controller_irq_handler      (struct DMX_Controller *dmx);
+void dmx_controller_timer_irq_handler(struct DMX_Controller *dmx);
@@ -0,0 +1,479 @@
+/* ┌──────────────────────────────────────┐
+   │ DMX line receiver for the analyzer   │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "dmx_rx.h"
+
+#include <string.h>
+
+#include <io/cycles.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+#define DMX_RX_UART_FLAGS          (USART_ICR_FECF | USART_ICR_NECF | USART_ICR_ORECF | USART_ICR_IDLECF)
+
+static void __dmx_rx_stats_reset(struct DMX_RX *rx)
+{
+	memset(&rx->stats, 0, sizeof(rx->stats));
+
+	rx->stats.interval_min = 0xFFFFFFFF;
+	rx->stats.break_min    = 0xFFFFFFFF;
+	rx->stats.mab_min      = 0xFFFFFFFF;
+	rx->stats.slots_min    = 0xFFFFFFFF;
+}
+
+static inline void __dmx_rx_range(uint32_t value, uint32_t *min, uint32_t *max)
+{
+	if(value < *min) *min = value;
+	if(value > *max) *max = value;
+}
+
+static inline uint8_t __dmx_rx_pin_high(struct DMX_RX *rx)
+{
+	return (rx->pin_input->port->IDR & rx->pin_input->pin) != 0;
+}
+
+/* Edges seen before are dropped */
+
+RAMFUNC static void __dmx_rx_edge_arm(struct DMX_RX *rx, enum DMX_RX_Edge edge)
+{
+	const uint32_t line = rx->exti_line;
+
+	EXTI->IMR1 &= ~line;
+
+	if(edge == DMX_RX_EDGE_BREAK_END) EXTI->RTSR1 |=  line;
+	else                              EXTI->RTSR1 &= ~line;
+
+	if((edge == DMX_RX_EDGE_BREAK_START) || (edge == DMX_RX_EDGE_MAB_END)) EXTI->FTSR1 |=  line;
+	else                                                                    EXTI->FTSR1 &= ~line;
+
+	EXTI->RPR1 = line;
+	EXTI->FPR1 = line;
+
+	if(edge != DMX_RX_EDGE_NONE) EXTI->IMR1 |= line;
+
+	rx->edge = edge;
+}
+
+RAMFUNC static void __dmx_rx_frame_close(struct DMX_RX *rx)
+{
+	struct DMX_RX_Frame *frame = &rx->frame;
+	struct DMX_RX_Stats *stats = &rx->stats;
+
+	if(rx->i_byte) {
+		frame->nb_slots = ((rx->i_byte - 1) > 0xFFFF) ? 0xFFFF : (rx->i_byte - 1);
+		frame->length   = rx->last_byte_cycles - frame->break_cycles;
+	}
+
+	/* Already pushed at IDLE: completed in place if slots followed */
+	if(rx->recorded_bytes) {
+		if(rx->i_byte != rx->recorded_bytes) {
+			rx->frames[(rx->head - 1) & (DMX_RX_NB_FRAMES - 1)] = *frame;
+			rx->recorded_bytes = rx->i_byte;
+			rx->slots_last     = frame->nb_slots;
+		}
+
+		return;
+	}
+
+	if(rx->i_byte) {
+		if(frame->mab_len < rx->mab_min_cycles) {
+			frame->flags |= DMX_RX_FLAG_SHORT_MAB;
+			stats->short_mabs++;
+		}
+
+		if(frame->nb_slots > DMX_NB_DATA_SLOTS) {
+			frame->flags |= DMX_RX_FLAG_OVERSIZE;
+			stats->oversize++;
+		}
+
+		if(frame->start_code == DMX_START_CODE) stats->null_frames++;
+		else {
+			stats->alternate_frames++;
+			stats->alternate_last = frame->start_code;
+		}
+
+		__dmx_rx_range(frame->mab_len , &stats->mab_min  , &stats->mab_max  );
+		__dmx_rx_range(frame->nb_slots, &stats->slots_min, &stats->slots_max);
+	}
+
+	else frame->flags |= DMX_RX_FLAG_EMPTY;
+
+	if(frame->break_len < rx->break_min_cycles) {
+		frame->flags |= DMX_RX_FLAG_SHORT_BREAK;
+		stats->short_breaks++;
+	}
+
+	if(frame->flags & DMX_RX_FLAG_ESTIMATED) stats->estimated++;
+
+	__dmx_rx_range(frame->break_len, &stats->break_min, &stats->break_max);
+	if(frame->sequence) __dmx_rx_range(frame->interval, &stats->interval_min, &stats->interval_max);
+
+	stats->frames++;
+
+	if(rx->capture == DMX_RX_CAPTURE_FILLING) {
+		rx->capture_frame = *frame;
+		rx->capture       = DMX_RX_CAPTURE_HELD;
+	}
+
+	rx->frames[rx->head & (DMX_RX_NB_FRAMES - 1)] = *frame;
+	rx->head++;
+
+	rx->recorded_bytes = rx->i_byte;
+	rx->slots_last     = frame->nb_slots;
+}
+
+RAMFUNC static void __dmx_rx_break_end(struct DMX_RX *rx, uint32_t cycles)
+{
+	rx->frame.break_len  = cycles - rx->frame.break_cycles;
+	rx->break_end_cycles = cycles;
+
+	/* A missed MAB end is estimated from the start code */
+	__dmx_rx_edge_arm(rx, DMX_RX_EDGE_MAB_END);
+}
+
+/* A byte received as 0 with a framing error: the break started
+   DMX_RX_STOP_SAMPLE_NS before, at the falling edge caught after IDLE */
+
+RAMFUNC static void __dmx_rx_break(struct DMX_RX *rx, uint32_t now)
+{
+	struct DMX_RX_Frame *frame = &rx->frame;
+	uint32_t             start = rx->fall_cycles;
+	uint8_t              flags = 0;
+
+	if(!rx->fall_valid) {
+		start = now - rx->stop_sample_cycles;
+		flags = DMX_RX_FLAG_ESTIMATED;
+	}
+
+	rx->fall_valid = 0;
+
+	if(rx->in_frame) __dmx_rx_frame_close(rx);
+
+	frame->sequence     = rx->head;
+	frame->break_cycles = start;
+	frame->interval     = rx->in_frame ? (start - rx->last_break_cycles) : 0;
+	frame->break_len    = 0;
+	frame->mab_len      = 0;
+	frame->gap_max      = 0;
+	frame->length       = 0;
+	frame->nb_slots     = 0;
+	frame->start_code   = 0;
+	frame->flags        = flags;
+
+	rx->last_break_cycles = start;
+	rx->in_frame          = 1;
+	rx->i_byte            = 0;
+	rx->recorded_bytes    = 0;
+
+	if(rx->capture == DMX_RX_CAPTURE_ARMED) rx->capture = DMX_RX_CAPTURE_FILLING;
+
+	__dmx_rx_edge_arm(rx, DMX_RX_EDGE_BREAK_END);
+
+	/* Rising edge before it was armed: a late interrupt, or a 0 slot
+	   with a low stop bit (short break) */
+	if(__dmx_rx_pin_high(rx)) {
+		frame->flags |= DMX_RX_FLAG_ESTIMATED;
+		__dmx_rx_break_end(rx, now);
+	}
+}
+
+RAMFUNC static void __dmx_rx_byte(struct DMX_RX *rx, uint32_t now, uint32_t data, uint32_t isrflags)
+{
+	struct DMX_RX_Frame *frame = &rx->frame;
+	uint32_t             gap;
+	uint32_t             i_capture;
+
+	/* The falling edge was this byte's start bit */
+	rx->fall_valid = 0;
+
+	if(!rx->in_frame) return;
+
+	rx->stats.bytes++;
+
+	if(isrflags & USART_ISR_FE) {
+		frame->flags |= DMX_RX_FLAG_FRAMING;
+		rx->stats.framing++;
+	}
+
+	if(isrflags & USART_ISR_NE) {
+		frame->flags |= DMX_RX_FLAG_NOISE;
+		rx->stats.noise++;
+	}
+
+	if(rx->i_byte == 0) {
+		/* Edges missed: the start bit began DMX_RX_STOP_SAMPLE_NS before */
+		if(rx->edge != DMX_RX_EDGE_NONE) {
+			const uint32_t mab_end = now - rx->stop_sample_cycles;
+
+			if(rx->edge == DMX_RX_EDGE_BREAK_END) {
+				frame->break_len     = mab_end - frame->break_cycles;
+				rx->break_end_cycles = mab_end;
+			}
+
+			frame->mab_len  = mab_end - rx->break_end_cycles;
+			frame->flags   |= DMX_RX_FLAG_ESTIMATED;
+			__dmx_rx_edge_arm(rx, DMX_RX_EDGE_NONE);
+		}
+
+		frame->start_code = (uint8_t)data;
+	}
+
+	else {
+		gap = now - rx->last_byte_cycles;
+		if((rx->i_byte > 1) && (gap > frame->gap_max)) frame->gap_max = gap;
+
+		/* Wraps below the first captured slot */
+		i_capture = rx->i_byte - 1 - rx->capture_first;
+		if((rx->capture == DMX_RX_CAPTURE_FILLING) && (i_capture < rx->capture_count)) {
+			rx->slots[i_capture] = (uint8_t)data;
+		}
+	}
+
+	rx->last_byte_cycles = now;
+	rx->i_byte++;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void dmx_rx_init(struct DMX_RX *rx)
+{
+	uint32_t i_pin = 0;
+	uint32_t shift;
+
+	while(!(rx->pin_input->pin & (1UL << i_pin))) i_pin++;
+
+	rx->exti_line = rx->pin_input->pin;
+	rx->exti_irqn = (i_pin < 2) ? EXTI0_1_IRQn : ((i_pin < 4) ? EXTI2_3_IRQn : EXTI4_15_IRQn);
+	rx->running   = 0;
+	rx->capture   = DMX_RX_CAPTURE_NONE;
+	rx->head      = 0;
+
+	/* EXTI line of the pin port, no edge until started */
+	shift = 8 * (i_pin & 3);
+	MODIFY_REG(EXTI->EXTICR[i_pin >> 2], 0xFFUL << shift, rx->input_port << shift);
+
+	__dmx_rx_edge_arm(rx, DMX_RX_EDGE_NONE);
+	__dmx_rx_stats_reset(rx);
+
+	HAL_NVIC_SetPriority(rx->exti_irqn, DMX_RX_IRQ_PRIORITY, 0);
+}
+
+uint8_t dmx_rx_start(struct DMX_RX *rx)
+{
+	USART_TypeDef *uart          = rx->uart;
+	const uint32_t cycles_per_us = HAL_RCC_GetHCLKFreq() / 1000000;
+	uint32_t       primask;
+
+	/* Stopped controller: no UART set up */
+	if(!(uart->CR1 & USART_CR1_UE)) return 0;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	rx->stop_sample_cycles = (DMX_RX_STOP_SAMPLE_NS * cycles_per_us) / 1000;
+	rx->break_min_cycles   = DMX_RX_BREAK_MIN_US * cycles_per_us;
+	rx->mab_min_cycles     = DMX_RX_MAB_MIN_US   * cycles_per_us;
+
+	rx->fall_valid     = 0;
+	rx->in_frame       = 0;
+	rx->i_byte         = 0;
+	rx->recorded_bytes = 0;
+	rx->slots_last     = 0;
+	rx->head           = 0;
+	rx->capture    = DMX_RX_CAPTURE_NONE;
+	__dmx_rx_stats_reset(rx);
+
+	/* Same baud rate and format: the transmitter stays as it is */
+	rx->cr1   = uart->CR1;
+	uart->RQR = USART_RQR_RXFRQ;
+	uart->ICR = DMX_RX_UART_FLAGS;
+	uart->CR1 = (rx->cr1 & ~USART_CR1_TCIE) | USART_CR1_RE | USART_CR1_RXNEIE_RXFNEIE | USART_CR1_IDLEIE;
+
+	__dmx_rx_edge_arm(rx, DMX_RX_EDGE_NONE);
+	HAL_NVIC_ClearPendingIRQ(rx->exti_irqn);
+	HAL_NVIC_EnableIRQ      (rx->exti_irqn);
+
+	rx->running = 1;
+
+	__set_PRIMASK(primask);
+
+	return 1;
+}
+
+void dmx_rx_stop(struct DMX_RX *rx)
+{
+	USART_TypeDef *uart    = rx->uart;
+	uint32_t       primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	if(rx->running) {
+		HAL_NVIC_DisableIRQ(rx->exti_irqn);
+		__dmx_rx_edge_arm(rx, DMX_RX_EDGE_NONE);
+
+		/* No TC interrupt left for the controller */
+		uart->CR1 = rx->cr1 & ~USART_CR1_TCIE;
+		uart->RQR = USART_RQR_RXFRQ;
+		uart->ICR = DMX_RX_UART_FLAGS | USART_ICR_TCCF;
+		uart->CR1 = rx->cr1;
+
+		rx->running = 0;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+uint8_t dmx_rx_is_running(struct DMX_RX *rx)
+{
+	return rx->running;
+}
+
+void dmx_rx_get_stats(struct DMX_RX *rx, struct DMX_RX_Stats *stats, uint8_t reset)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	*stats = rx->stats;
+	if(reset) __dmx_rx_stats_reset(rx);
+
+	__set_PRIMASK(primask);
+}
+
+uint32_t dmx_rx_head(struct DMX_RX *rx)
+{
+	return rx->head;
+}
+
+uint8_t dmx_rx_read(struct DMX_RX *rx, uint32_t sequence, struct DMX_RX_Frame *frame)
+{
+	const struct DMX_RX_Frame *record = &rx->frames[sequence & (DMX_RX_NB_FRAMES - 1)];
+	uint8_t                    found;
+	uint32_t                   primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	found = ((rx->head - sequence - 1) < DMX_RX_NB_FRAMES) && (record->sequence == sequence);
+	if(found) *frame = *record;
+
+	__set_PRIMASK(primask);
+
+	return found;
+}
+
+uint8_t dmx_rx_capture(struct DMX_RX *rx, uint32_t first, uint32_t count)
+{
+	uint32_t primask;
+
+	if((count > DMX_RX_CAPTURE_SLOTS) || ((first + count) > DMX_NB_DATA_SLOTS)) return 0;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	rx->capture_first = first;
+	rx->capture_count = count;
+	rx->capture       = DMX_RX_CAPTURE_ARMED;
+
+	__set_PRIMASK(primask);
+
+	return 1;
+}
+
+uint8_t dmx_rx_capture_get(struct DMX_RX *rx, struct DMX_RX_Frame *frame)
+{
+	if(rx->capture != DMX_RX_CAPTURE_HELD) return 0;
+
+	*frame = rx->capture_frame;
+	return 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ IRQ Handlers                           │
+   └────────────────────────────────────────┘ */
+
+RAMFUNC void dmx_rx_irq_handler(struct DMX_RX *rx)
+{
+	const uint32_t now      = cycles_now();
+	USART_TypeDef *uart     = rx->uart;
+	uint32_t       isrflags = READ_REG(uart->ISR);
+	uint32_t       clear    = 0;
+	uint32_t       data;
+
+	rx->stats.uart_irqs++;
+
+	/* The line was idle before the byte that may follow. After slots,
+	   it is the end of the frame, or a long mark between slots: only
+	   taken as the end once the previous frame length is reached. */
+	if(isrflags & USART_ISR_IDLE) {
+		clear |= USART_ICR_IDLECF;
+		if(rx->edge == DMX_RX_EDGE_NONE) __dmx_rx_edge_arm(rx, DMX_RX_EDGE_BREAK_START);
+
+		if(rx->in_frame && rx->slots_last && (rx->i_byte > rx->slots_last)) __dmx_rx_frame_close(rx);
+	}
+
+	if(isrflags & USART_ISR_ORE) {
+		clear |= USART_ICR_ORECF;
+		rx->frame.flags |= DMX_RX_FLAG_OVERRUN;
+		rx->stats.overruns++;
+	}
+
+	if(isrflags & USART_ISR_RXNE_RXFNE) {
+		data   = uart->RDR;
+		clear |= USART_ICR_FECF | USART_ICR_NECF;
+
+		if((isrflags & USART_ISR_FE) && !data) __dmx_rx_break(rx, now);
+		else                                   __dmx_rx_byte (rx, now, data, isrflags);
+	}
+
+	/* The next byte is a character time away */
+	if(clear) uart->ICR = clear;
+}
+
+RAMFUNC void dmx_rx_exti_irq_handler(struct DMX_RX *rx)
+{
+	const uint32_t now     = cycles_now();
+	const uint32_t rising  = EXTI->RPR1 & rx->exti_line;
+	const uint32_t falling = EXTI->FPR1 & rx->exti_line;
+
+	if(!(rising | falling)) return;
+
+	EXTI->RPR1 = rising;
+	EXTI->FPR1 = falling;
+
+	rx->stats.exti_irqs++;
+
+	switch(rx->edge) {
+		case DMX_RX_EDGE_BREAK_START:
+			if(falling) {
+				rx->fall_cycles = now;
+				rx->fall_valid  = 1;
+				__dmx_rx_edge_arm(rx, DMX_RX_EDGE_NONE);
+			}
+			break;
+
+		case DMX_RX_EDGE_BREAK_END:
+			if(rising) __dmx_rx_break_end(rx, now);
+			break;
+
+		case DMX_RX_EDGE_MAB_END:
+			if(falling) {
+				rx->frame.mab_len = now - rx->break_end_cycles;
+				__dmx_rx_edge_arm(rx, DMX_RX_EDGE_NONE);
+			}
+			break;
+
+		default:break;
+	}
+}
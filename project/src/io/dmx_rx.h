@@ -0,0 +1,223 @@
+/* ┌──────────────────────────────────────┐
+   │ DMX line receiver for the analyzer   │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <bsp/pin.h>
+#include <io/dmx.h>
+
+#include "stm32g0xx_hal.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Receiver config                        │
+   └────────────────────────────────────────┘ */
+
+/* Receive only: the UART of a held universe (see dmx_controller_hold)
+ * gets its receiver switched on, at the same 250kbps. Every received
+ * byte is timestamped with cycles_now (see io/cycles.h) from the UART
+ * interrupt, the break and MAB edges from the EXTI interrupt of the
+ * RX pin:
+ *
+ *          break           MAB   start code   slot 1
+ *   ‾‾‾‾‾‾╲_____________╱‾‾‾‾‾‾╲_┊_┊_┊_┊_┊_╱‾╲_┊_┊_┊ ...
+ *         ↑ falling      ↑ rising ↑ falling
+ *         IDLE arms it   FE arms  rising arms
+ *
+ * The break is the byte received as 0 with a framing error. Its start
+ * edge is only armed once the UART saw an idle line (IDLE, a byte time
+ * high): with a shorter mark before break, the start is estimated from
+ * the framing error, DMX_RX_STOP_SAMPLE_NS after it, and the frame gets
+ * DMX_RX_FLAG_ESTIMATED. Both interrupts run at the same priority, so
+ * lengths are exact up to the interrupt entry jitter; absolute times
+ * include the entry latency.
+ *
+ * A frame is closed by the next break, or by the UART IDLE event once
+ * it has as many slots as the previous frame: its record is then
+ * pushed to a ring of the last DMX_RX_NB_FRAMES frames, and the
+ * statistics updated, from the interrupt. The last frame sent before
+ * the line stops is thus recorded too, while marks between slots
+ * longer than a byte (also IDLE) do not end a frame. A longer frame
+ * with such marks is closed early: the slots that follow complete the
+ * record in place, but the statistics and the capture keep the part
+ * before the mark. */
+
+#define DMX_RX_NB_FRAMES           16                               /* Power of two                */
+#define DMX_RX_CAPTURE_SLOTS       56                               /* One command answer          */
+#define DMX_RX_IRQ_PRIORITY        0                                /* As the DMX UARTs            */
+
+#define DMX_RX_BIT_NS              4000
+#define DMX_RX_STOP_SAMPLE_NS      38000                            /* 9.5 bits: FE, RXNE          */
+
+/* Receiver minimums, E1.11 */
+
+#define DMX_RX_BREAK_MIN_US        88
+#define DMX_RX_MAB_MIN_US          8
+
+/* Frame flags */
+
+#define DMX_RX_FLAG_SHORT_BREAK    0x01                             /* Below DMX_RX_BREAK_MIN_US   */
+#define DMX_RX_FLAG_SHORT_MAB      0x02                             /* Below DMX_RX_MAB_MIN_US     */
+#define DMX_RX_FLAG_FRAMING        0x04                             /* Slot with a low stop bit    */
+#define DMX_RX_FLAG_NOISE          0x08                             /* Slot with a noise error     */
+#define DMX_RX_FLAG_OVERRUN        0x10                             /* Slot lost by the UART       */
+#define DMX_RX_FLAG_OVERSIZE       0x20                             /* Above DMX_NB_DATA_SLOTS     */
+#define DMX_RX_FLAG_ESTIMATED      0x40                             /* Edge missed, see above      */
+#define DMX_RX_FLAG_EMPTY          0x80                             /* No start code               */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Receiver data                          │
+   └────────────────────────────────────────┘ */
+
+enum DMX_RX_Edge {
+	DMX_RX_EDGE_NONE,
+	DMX_RX_EDGE_BREAK_START,                                    /* Falling, after IDLE         */
+	DMX_RX_EDGE_BREAK_END,                                      /* Rising, after the break FE  */
+	DMX_RX_EDGE_MAB_END                                         /* Falling, start code start   */
+};
+
+enum DMX_RX_Capture_State {
+	DMX_RX_CAPTURE_NONE,
+	DMX_RX_CAPTURE_ARMED,                                       /* From the next break         */
+	DMX_RX_CAPTURE_FILLING,
+	DMX_RX_CAPTURE_HELD                                         /* Complete, kept              */
+};
+
+/* Times are in cycles. Slots and the gap exclude the start code. */
+
+struct DMX_RX_Frame {
+	uint32_t                   sequence;                        /* Frames since dmx_rx_start   */
+	uint32_t                   break_cycles;                    /* Break start                 */
+	uint32_t                   interval;                        /* From the previous break     */
+	uint32_t                   break_len;
+	uint32_t                   mab_len;
+	uint32_t                   gap_max;                         /* Longest slot to slot        */
+	uint32_t                   length;                          /* Break start to last slot    */
+	uint16_t                   nb_slots;                        /* Received, even above 512    */
+	uint8_t                    start_code;
+	uint8_t                    flags;
+};
+
+/* Since dmx_rx_start or the last reset. Intervals exclude the first
+ * frame, MABs and slots the empty frames. */
+
+struct DMX_RX_Stats {
+	uint32_t                   frames;
+	uint32_t                   bytes;                           /* Start codes and slots       */
+
+	uint32_t                   interval_min;
+	uint32_t                   interval_max;
+	uint32_t                   break_min;
+	uint32_t                   break_max;
+	uint32_t                   mab_min;
+	uint32_t                   mab_max;
+	uint32_t                   slots_min;
+	uint32_t                   slots_max;
+
+	uint32_t                   null_frames;                     /* DMX_START_CODE              */
+	uint32_t                   alternate_frames;                /* Other start codes, e.g. RDM */
+	uint32_t                   alternate_last;
+
+	uint32_t                   short_breaks;
+	uint32_t                   short_mabs;
+	uint32_t                   framing;                         /* Slots, breaks excluded      */
+	uint32_t                   noise;
+	uint32_t                   overruns;
+	uint32_t                   oversize;
+	uint32_t                   estimated;
+
+	uint32_t                   uart_irqs;
+	uint32_t                   exti_irqs;
+};
+
+struct DMX_RX {
+
+	/* ──────────── Interface data ──────────── */
+
+	USART_TypeDef             *uart;                            /* UART of a DMX_Controller    */
+	const struct Pin_Def      *pin_input;                       /* RX pin, AF of the pin table */
+	uint32_t                   input_port;                      /* BSP_PORT_x, for EXTICR      */
+
+	uint32_t                   exti_line;                       /* Bit of the pin              */
+	IRQn_Type                  exti_irqn;
+	uint32_t                   cr1;                             /* Restored by dmx_rx_stop     */
+
+	uint32_t                   stop_sample_cycles;
+	uint32_t                   break_min_cycles;
+	uint32_t                   mab_min_cycles;
+
+	/* ─────────────── Frame data ───────────── */
+
+	__IO uint32_t              running;
+	__IO enum DMX_RX_Edge      edge;                            /* Armed EXTI edge             */
+
+	uint32_t                   fall_cycles;                     /* Break start candidate       */
+	uint8_t                    fall_valid;
+	uint8_t                    in_frame;                        /* A break was received        */
+	uint32_t                   break_end_cycles;
+	uint32_t                   last_break_cycles;
+	uint32_t                   last_byte_cycles;
+	uint32_t                   i_byte;                          /* Since the break             */
+	uint32_t                   recorded_bytes;                  /* i_byte when pushed, or 0    */
+	uint32_t                   slots_last;                      /* Of the previous frame       */
+
+	struct DMX_RX_Frame        frame;                           /* In progress                 */
+
+	/* ────────────── Capture data ──────────── */
+
+	__IO enum DMX_RX_Capture_State capture;
+	uint32_t                       capture_first;               /* First captured slot         */
+	uint32_t                       capture_count;
+	struct DMX_RX_Frame            capture_frame;
+	uint8_t                        slots[DMX_RX_CAPTURE_SLOTS]; /* From capture_first          */
+
+	/* ──────────── Records and stats ───────── */
+
+	struct DMX_RX_Frame        frames[DMX_RX_NB_FRAMES];
+	__IO uint32_t              head;                            /* Frames pushed               */
+
+	struct DMX_RX_Stats        stats;
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* uart, pin_input and input_port must be set */
+void     dmx_rx_init      (struct DMX_RX *rx);
+
+/* The UART must be set up by a held DMX_Controller, its TC interrupt
+ * is disabled until dmx_rx_stop. The UART IRQ handler must call
+ * dmx_rx_irq_handler meanwhile. Statistics and records restart.
+ * Returns 0 if the UART is not set up. */
+uint8_t  dmx_rx_start     (struct DMX_RX *rx);
+void     dmx_rx_stop      (struct DMX_RX *rx);
+uint8_t  dmx_rx_is_running(struct DMX_RX *rx);
+
+/* Copies then restarts the statistics */
+void     dmx_rx_get_stats (struct DMX_RX *rx, struct DMX_RX_Stats *stats, uint8_t reset);
+
+/* Sequence of the next pushed frame: records from head -
+ * DMX_RX_NB_FRAMES to head - 1 can be read */
+uint32_t dmx_rx_head      (struct DMX_RX *rx);
+
+/* Returns 0 if the record was overwritten or not pushed yet */
+uint8_t  dmx_rx_read      (struct DMX_RX *rx, uint32_t sequence, struct DMX_RX_Frame *frame);
+
+/* Keeps count slots from first of the next complete frame in
+ * rx->slots, replacing the capture held. Returns 0 if invalid. */
+uint8_t  dmx_rx_capture   (struct DMX_RX *rx, uint32_t first, uint32_t count);
+
+/* Returns 1 once the capture is held, with its record */
+uint8_t  dmx_rx_capture_get(struct DMX_RX *rx, struct DMX_RX_Frame *frame);
+
+void     dmx_rx_irq_handler     (struct DMX_RX *rx);
+void     dmx_rx_exti_irq_handler(struct DMX_RX *rx);
@@ -10,6 +10,11 @@
 
 void gpio_pin_init(struct Pin_Def pin, uint32_t mode, uint32_t pull, uint32_t speed, uint32_t alternate)
 {
+#if defined(CONFIG_IO_LL)
+	GPIO_TypeDef *port = pin.port;
+	uint32_t      primask;
+	uint32_t      i_pin;
+#else
 	GPIO_InitTypeDef settings = {
 		.Pin       = pin.pin,
 		.Mode      = mode,
@@ -17,6 +22,7 @@ void gpio_pin_init(struct Pin_Def pin, uint32_t mode, uint32_t pull, uint32_t sp
 		.Speed     = speed,
 		.Alternate = alternate
 	};
+#endif
 
 	/* Switch clock ON */
 	if     (pin.port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
@@ -25,16 +31,38 @@ void gpio_pin_init(struct Pin_Def pin, uint32_t mode, uint32_t pull, uint32_t sp
 	else if(pin.port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
 	else if(pin.port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
 
+#if defined(CONFIG_IO_LL)
+	/* HAL GPIO_MODE_* encoding: MODER value in bits 0-1, open drain in
+	   bit 4. EXTI modes are not supported, see the pin table instead. */
+	if(mode >> 16) Error_Handler();
+
+	/* Registers are shared by the pins of the port */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	for(i_pin = 0; i_pin < 16; i_pin++) {
+		if(!(pin.pin & (1UL << i_pin))) continue;
+
+		MODIFY_REG(port->AFR[i_pin >> 3], 0xFUL << (4*(i_pin & 7)), alternate          << (4*(i_pin & 7)));
+		MODIFY_REG(port->OSPEEDR        , 3UL   << (2*i_pin)      , speed              << (2*i_pin)      );
+		MODIFY_REG(port->PUPDR          , 3UL   << (2*i_pin)      , pull               << (2*i_pin)      );
+		MODIFY_REG(port->OTYPER         , 1UL   << i_pin          , ((mode >> 4) & 1U) << i_pin          );
+		MODIFY_REG(port->MODER          , 3UL   << (2*i_pin)      , (mode & 3U)        << (2*i_pin)      );
+	}
+
+	__set_PRIMASK(primask);
+#else
 	/* Init GPIO stuff */
 	HAL_GPIO_Init(pin.port, &settings);
+#endif
 }
 
 void gpio_pin_write(struct Pin_Def pin, uint8_t value)
 {
-	HAL_GPIO_WritePin(pin.port, pin.pin, value);
+	gpio_fast_write(pin.port, pin.pin, value);
 }
 
 uint8_t gpio_pin_read(struct Pin_Def pin)
 {
-	return HAL_GPIO_ReadPin(pin.port, pin.pin);
+	return gpio_fast_read(pin.port, pin.pin);
 }
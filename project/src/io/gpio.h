@@ -29,3 +29,45 @@ void  gpio_pin_init (
 
 void    gpio_pin_write(struct Pin_Def pin, uint8_t value);
 uint8_t gpio_pin_read (struct Pin_Def pin               );
+
+
+/* ┌────────────────────────────────────────┐
+   │ GPIO fast path                         │
+   └────────────────────────────────────────┘ */
+
+/* Inlined accessors on a port/pin couple. For pins from the
+   pin table, prefer the generated pin_<name>_* accessors. */
+
+static inline void __attribute__ ((always_inline)) gpio_fast_set(GPIO_TypeDef *port, uint32_t pin)
+{
+	port->BSRR = pin;
+}
+
+static inline void __attribute__ ((always_inline)) gpio_fast_clear(GPIO_TypeDef *port, uint32_t pin)
+{
+	port->BRR = pin;
+}
+
+static inline void __attribute__ ((always_inline)) gpio_fast_write(GPIO_TypeDef *port, uint32_t pin, uint8_t value)
+{
+	if(value) port->BSRR = pin;
+	else      port->BRR  = pin;
+}
+
+static inline uint8_t __attribute__ ((always_inline)) gpio_fast_read(GPIO_TypeDef *port, uint32_t pin)
+{
+	return (port->IDR & pin) != 0;
+}
+
+/* Changes the mode of a pin, e.g. to drive a peripheral output by hand.
+   moder_mask and moder_value are the pin field in MODER. */
+
+static inline void __attribute__ ((always_inline)) gpio_fast_mode(GPIO_TypeDef *port, uint32_t moder_mask, uint32_t moder_value)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	/* MODER is shared by the pins of the port, possibly used by other ISRs */
+	__disable_irq();
+	port->MODER = (port->MODER & ~moder_mask) | moder_value;
+	__set_PRIMASK(primask);
+}
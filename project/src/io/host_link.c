@@ -0,0 +1,345 @@
+/* ┌──────────────────────────────────┐
+   │ Host serial link                 │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "host_link.h"
+
+#include <string.h>
+
+#include <io/cycles.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+struct Host_Link {
+	UART_HandleTypeDef *huart;
+
+	uint8_t             rx_buffer[HOST_LINK_RX_BUFFER_SIZE];
+	__IO uint32_t       rx_head;                                /* Written by the ISR          */
+	__IO uint32_t       rx_tail;                                /* Written by the main loop    */
+	uint32_t            rx_stamp_index;                         /* Newest byte, as rx_head     */
+	uint32_t            rx_stamp_cycles;                        /* Its arrival                 */
+
+	/* ─────────────── Block mode ───────────── */
+
+	uint32_t                  dma_request;                      /* DMAMUX request of the UART  */
+	uint32_t                  block_length;                     /* 0: byte queue mode          */
+	uint8_t                   sync[HOST_LINK_SYNC_MAX];
+	uint32_t                  sync_length;
+	uint32_t                  i_sync;                           /* Sync bytes matched so far   */
+	uint8_t                  *block;                            /* Block being received        */
+	Host_Link_Block_Callback  block_cbk;
+};
+
+static struct Host_Link __host_link;
+
+struct Host_Link_Stats host_link_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __host_link_baudrate_set(uint32_t baudrate)
+{
+	UART_HandleTypeDef *huart = __host_link.huart;
+
+	/* Oversampling by 8 allows up to PCLK / 8 */
+	huart->Init.BaudRate     = baudrate;
+	huart->Init.OverSampling = (baudrate > HOST_LINK_BAUDRATE) ? UART_OVERSAMPLING_8 : UART_OVERSAMPLING_16;
+
+	if(HAL_UART_Init(huart) != HAL_OK) Error_Handler();
+}
+
+/* Receives length bytes into buffer, the channel must be disabled */
+
+static void __host_link_dma_start(uint8_t *buffer, uint32_t length)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	HOST_LINK_DMA_CHANNEL->CMAR  = (uint32_t)buffer;
+	HOST_LINK_DMA_CHANNEL->CNDTR = length;
+	HOST_LINK_DMA_CHANNEL->CCR  |= DMA_CCR_EN;
+
+	ATOMIC_SET_BIT(uart->CR3, USART_CR3_DMAR);
+}
+
+static void __host_link_dma_stop(void)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	ATOMIC_CLEAR_BIT(uart->CR3, USART_CR3_DMAR);
+
+	HOST_LINK_DMA_CHANNEL->CCR &= ~DMA_CCR_EN;
+	DMA1->IFCR                  = HOST_LINK_DMA_CLEAR;
+}
+
+/* Sync pattern is looked for byte per byte, from the RX interrupt */
+
+static void __host_link_sync_byte(uint8_t data)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	if     (data == __host_link.sync[__host_link.i_sync]) __host_link.i_sync++;
+	else if(data == __host_link.sync[0]                 ) __host_link.i_sync = 1;
+	else                                                  __host_link.i_sync = 0;
+
+	if(__host_link.i_sync < __host_link.sync_length) return;
+
+	/* Found: the rest of the block is received by DMA */
+	ATOMIC_CLEAR_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+
+	memcpy(__host_link.block, __host_link.sync, __host_link.sync_length);
+	__host_link_dma_start(__host_link.block + __host_link.sync_length, __host_link.block_length - __host_link.sync_length);
+
+	__host_link.i_sync = 0;
+	host_link_stats.syncs++;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void host_link_init(UART_HandleTypeDef *huart)
+{
+	IRQn_Type irqn = USART2_IRQn;
+
+	__host_link.huart        = huart;
+	__host_link.rx_head      = 0;
+	__host_link.rx_tail      = 0;
+	__host_link.block_length = 0;
+
+	if     (huart->Instance == USART1 ) { irqn = USART1_IRQn ; __host_link.dma_request = DMA_REQUEST_USART1_RX ; }
+	else if(huart->Instance == USART2 ) { irqn = USART2_IRQn ; __host_link.dma_request = DMA_REQUEST_USART2_RX ; }
+	else if(huart->Instance == LPUART1) { irqn = LPUART1_IRQn; __host_link.dma_request = DMA_REQUEST_LPUART1_RX; }
+	else Error_Handler(); /* Unsupported UART */
+
+	/* Byte per byte reception, without the HAL */
+	ATOMIC_SET_BIT(huart->Instance->CR1, USART_CR1_RXNEIE_RXFNEIE);
+
+	HAL_NVIC_SetPriority(irqn, HOST_LINK_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ  (irqn);
+}
+
+uint8_t host_link_read(uint8_t *data)
+{
+	uint32_t tail = __host_link.rx_tail;
+
+	if(tail == __host_link.rx_head) return 0;
+
+	*data               = __host_link.rx_buffer[tail & (HOST_LINK_RX_BUFFER_SIZE - 1)];
+	__host_link.rx_tail = tail + 1;
+
+	return 1;
+}
+
+uint8_t host_link_rx_cycles(uint32_t *cycles)
+{
+	uint8_t  known;
+	uint32_t primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	known = (__host_link.rx_stamp_index == (__host_link.rx_tail - 1));
+	if(known) *cycles = __host_link.rx_stamp_cycles;
+
+	__set_PRIMASK(primask);
+
+	return known;
+}
+
+void host_link_write(const uint8_t *data, uint32_t length)
+{
+	if(HAL_UART_Transmit(__host_link.huart, data, length, HAL_MAX_DELAY) != HAL_OK) Error_Handler();
+}
+
+void host_link_set_baudrate(uint32_t baudrate)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	ATOMIC_CLEAR_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+
+	__host_link_baudrate_set(baudrate);
+	__host_link.rx_tail = __host_link.rx_head;
+
+	ATOMIC_SET_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+}
+
+void host_link_clock_update(void)
+{
+	UART_HandleTypeDef *huart = __host_link.huart;
+	uint8_t             receiving;
+	uint32_t            primask;
+
+	if(!huart || (huart->gState == HAL_UART_STATE_RESET)) return;
+
+	/* Not while the DMA writes the block. Masked: a block completed
+	   meanwhile may be held by its callback. */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	receiving = (huart->Instance->CR1 & USART_CR1_RXNEIE_RXFNEIE) || (HOST_LINK_DMA_CHANNEL->CCR & DMA_CCR_EN);
+
+	if(__host_link.block_length) host_link_block_hold();
+	else                         ATOMIC_CLEAR_BIT(huart->Instance->CR1, USART_CR1_RXNEIE_RXFNEIE);
+
+	__set_PRIMASK(primask);
+
+	__host_link_baudrate_set(huart->Init.BaudRate);
+
+	if     (!__host_link.block_length) ATOMIC_SET_BIT(huart->Instance->CR1, USART_CR1_RXNEIE_RXFNEIE);
+	else if(receiving                ) host_link_block_sync(__host_link.block);
+}
+
+/* ────────────── Block mode ────────────── */
+
+void host_link_block_start(uint32_t baudrate, const uint8_t *sync, uint32_t sync_length, uint32_t length,
+                           Host_Link_Block_Callback cbk, uint8_t *buffer)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	if((sync_length == 0) || (sync_length > HOST_LINK_SYNC_MAX) || (length <= sync_length)) Error_Handler();
+
+	ATOMIC_CLEAR_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+
+	memcpy(__host_link.sync, sync, sync_length);
+	__host_link.sync_length  = sync_length;
+	__host_link.block_length = length;
+	__host_link.block_cbk    = cbk;
+
+	__host_link_baudrate_set(baudrate);
+
+	/* Byte to memory, without the HAL */
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	HOST_LINK_DMAMUX_CHANNEL->CCR = __host_link.dma_request;
+	HOST_LINK_DMA_CHANNEL->CCR    = DMA_CCR_MINC | DMA_CCR_PL_1 | DMA_CCR_TCIE | DMA_CCR_TEIE;
+	HOST_LINK_DMA_CHANNEL->CPAR   = (uint32_t)&uart->RDR;
+
+	HAL_NVIC_SetPriority(HOST_LINK_DMA_IRQN, HOST_LINK_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ  (HOST_LINK_DMA_IRQN);
+
+	host_link_block_sync(buffer);
+}
+
+void host_link_block_next(uint8_t *buffer)
+{
+	__host_link.block = buffer;
+
+	HOST_LINK_DMA_CHANNEL->CCR &= ~DMA_CCR_EN;
+	__host_link_dma_start(buffer, __host_link.block_length);
+}
+
+void host_link_block_sync(uint8_t *buffer)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	__host_link_dma_stop();
+
+	__host_link.block  = buffer;
+	__host_link.i_sync = 0;
+
+	/* Errors interrupt while DMA is used */
+	uart->ICR = USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF;
+	ATOMIC_SET_BIT(uart->CR3, USART_CR3_EIE);
+	ATOMIC_SET_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+}
+
+void host_link_block_hold(void)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	/* The UART overruns silently */
+	ATOMIC_CLEAR_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+	ATOMIC_CLEAR_BIT(uart->CR3, USART_CR3_EIE);
+	__host_link_dma_stop();
+}
+
+void host_link_block_stop(void)
+{
+	USART_TypeDef *uart = __host_link.huart->Instance;
+
+	HAL_NVIC_DisableIRQ(HOST_LINK_DMA_IRQN);
+
+	ATOMIC_CLEAR_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+	ATOMIC_CLEAR_BIT(uart->CR3, USART_CR3_EIE);
+	__host_link_dma_stop();
+
+	__host_link.block_length = 0;
+	__host_link.rx_tail      = __host_link.rx_head;
+
+	__host_link_baudrate_set(HOST_LINK_BAUDRATE);
+
+	ATOMIC_SET_BIT(uart->CR1, USART_CR1_RXNEIE_RXFNEIE);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ IRQ Handler                            │
+   └────────────────────────────────────────┘ */
+
+void host_link_irq_handler(void)
+{
+	USART_TypeDef *uart     = __host_link.huart->Instance;
+	uint32_t       isrflags = READ_REG(uart->ISR);
+	uint32_t       head;
+	uint8_t        data;
+
+	if(isrflags & USART_ISR_ORE) {
+		host_link_stats.overruns++;
+		uart->ICR = USART_ICR_ORECF;
+	}
+
+	if(isrflags & (USART_ISR_FE | USART_ISR_NE)) {
+		host_link_stats.errors++;
+		uart->ICR = USART_ICR_FECF | USART_ICR_NECF;
+	}
+
+	/* Received bytes belong to the DMA while it runs */
+	if((isrflags & USART_ISR_RXNE_RXFNE) && (uart->CR1 & USART_CR1_RXNEIE_RXFNEIE)) {
+		data = (uint8_t)uart->RDR; /* Clears the flag */
+
+		if(__host_link.block_length) {
+			__host_link_sync_byte(data);
+			return;
+		}
+
+		head = __host_link.rx_head;
+
+		if((head - __host_link.rx_tail) >= HOST_LINK_RX_BUFFER_SIZE) {
+			host_link_stats.dropped++;
+		}
+
+		else {
+			__host_link.rx_buffer[head & (HOST_LINK_RX_BUFFER_SIZE - 1)] = data;
+			__host_link.rx_stamp_cycles = cycles_now();
+			__host_link.rx_stamp_index  = head;
+			__host_link.rx_head         = head + 1;
+		}
+	}
+}
+
+void host_link_dma_irq_handler(void)
+{
+	uint32_t flags = DMA1->ISR;
+
+	DMA1->IFCR = HOST_LINK_DMA_CLEAR;
+
+	/* Bus error: the channel is disabled, start over */
+	if(flags & HOST_LINK_DMA_FLAG_TE) {
+		host_link_block_sync(__host_link.block);
+		return;
+	}
+
+	if(flags & HOST_LINK_DMA_FLAG_TC) {
+		__host_link.block_cbk(__host_link.block);
+	}
+}
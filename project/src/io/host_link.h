@@ -0,0 +1,102 @@
+/* ┌──────────────────────────────────┐
+   │ Host serial link                 │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Host link config                       │
+   └────────────────────────────────────────┘ */
+
+/* Received bytes are queued from the RX interrupt, and consumed
+   from the main loop. Transmission is blocking. */
+
+#define HOST_LINK_BAUDRATE         115200
+#define HOST_LINK_RX_BUFFER_SIZE   128 /* Power of two */
+#define HOST_LINK_IRQ_PRIORITY     2   /* Below DMX UARTs, above oneshot timers */
+
+/* In block mode, bytes are received by DMA into fixed length blocks
+   instead. The byte queue is not fed meanwhile. */
+
+#define HOST_LINK_DMA_CHANNEL      DMA1_Channel1
+#define HOST_LINK_DMAMUX_CHANNEL   DMAMUX1_Channel0   /* DMAMUX channel n drives DMA channel n+1 */
+#define HOST_LINK_DMA_IRQN         DMA1_Channel1_IRQn
+#define HOST_LINK_DMA_FLAG_TC      DMA_ISR_TCIF1
+#define HOST_LINK_DMA_FLAG_TE      DMA_ISR_TEIF1
+#define HOST_LINK_DMA_CLEAR        DMA_IFCR_CGIF1
+
+#define HOST_LINK_SYNC_MAX         4  /* Longest sync pattern */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Host link data                         │
+   └────────────────────────────────────────┘ */
+
+struct Host_Link_Stats {
+	uint32_t overruns;                                          /* Bytes lost by the UART      */
+	uint32_t dropped;                                           /* Bytes lost, buffer full     */
+	uint32_t errors;                                            /* Framing and noise errors    */
+	uint32_t syncs;                                             /* Block mode sync patterns    */
+};
+
+/* Called from the DMA interrupt with each received block. It must give
+   the next buffer with host_link_block_next or host_link_block_sync. */
+
+typedef void (*Host_Link_Block_Callback)(uint8_t *block);
+
+extern struct Host_Link_Stats host_link_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* huart must be initialized. Starts reception. */
+void    host_link_init       (UART_HandleTypeDef *huart);
+
+/* Returns 1 if a byte was read */
+uint8_t host_link_read       (uint8_t *data);
+
+/* Arrival cycle count (see io/cycles.h) of the last byte read. Only
+   the newest received byte is timestamped: returns 0 if others
+   followed it. */
+uint8_t host_link_rx_cycles  (uint32_t *cycles);
+
+void    host_link_write      (const uint8_t *data, uint32_t length);
+
+/* Byte mode at another baud rate, bytes not read yet are dropped */
+void    host_link_set_baudrate(uint32_t baudrate);
+
+/* Same baud rate after a PCLK change, see app/clock_switch.c. In block
+   mode, the block being received is lost and the sync pattern looked
+   for again; a held link stays held. */
+void    host_link_clock_update(void);
+
+/* Block mode: the sync pattern is looked for in the received bytes,
+   then it is stored at the start of a block, followed by the next
+   length - sync_length bytes. The baud rate is changed meanwhile. */
+void    host_link_block_start(uint32_t baudrate, const uint8_t *sync, uint32_t sync_length, uint32_t length,
+                              Host_Link_Block_Callback cbk, uint8_t *buffer);
+
+/* Next block: directly follows the previous one, or starts with the sync pattern */
+void    host_link_block_next (uint8_t *buffer);
+void    host_link_block_sync (uint8_t *buffer);
+
+/* No reception until the next host_link_block_sync, the bytes received
+   meanwhile are lost */
+void    host_link_block_hold (void);
+
+/* Back to the byte queue, at HOST_LINK_BAUDRATE */
+void    host_link_block_stop (void);
+
+void    host_link_irq_handler    (void);
+void    host_link_dma_irq_handler(void);
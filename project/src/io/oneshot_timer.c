@@ -14,44 +14,54 @@
 
 
 /* ┌────────────────────────────────────────┐
-   │ Static private data                    │
+   │ Private interface                      │
    └────────────────────────────────────────┘ */
 
-struct OneShot_Timer_Private {
-	TIM_HandleTypeDef htim;
+/* Switch the timer clock ON and find its IRQ line */
+
+static void __oneshot_timer_resources_init(struct Oneshot_Timer *stim, TIM_TypeDef *instance)
+{
+	if     (instance == TIM1 ) { __HAL_RCC_TIM1_CLK_ENABLE (); stim->irqn = TIM1_BRK_UP_TRG_COM_IRQn; }
+	else if(instance == TIM14) { __HAL_RCC_TIM14_CLK_ENABLE(); stim->irqn = TIM14_IRQn; }
+	else if(instance == TIM16) { __HAL_RCC_TIM16_CLK_ENABLE(); stim->irqn = TIM16_IRQn; }
+	else if(instance == TIM17) { __HAL_RCC_TIM17_CLK_ENABLE(); stim->irqn = TIM17_IRQn; }
+	else Error_Handler(); /* Unsupported timer */
+}
+
+/* Prescaler for 1us ticks from the current timer clock. APB
+   is not divided (see io/clock.h): timer clock is PCLK. */
 
-	Oneshot_Timer_Callback done_cbk;
-	void *usrdata;
+static uint32_t __oneshot_timer_prescaler(void)
+{
+	return (HAL_RCC_GetPCLK1Freq() / 1000000) - 1;
+}
+
+void __oneshot_timer_irq_config(struct Oneshot_Timer *stim)
+{
+	HAL_NVIC_SetPriority(stim->irqn, 3, 0);
+	HAL_NVIC_EnableIRQ  (stim->irqn);
+}
 
-	volatile uint8_t tick;
-};
 
-static struct OneShot_Timer_Private __stimer_private;
+#if !defined(CONFIG_IO_LL)
 
 /* ┌────────────────────────────────────────┐
-   │ Private interface                      │
+   │ HAL backend                            │
    └────────────────────────────────────────┘ */
 
-void __oneshot_timer_hal_init(struct OneShot_Timer_Private *stim)
+void __oneshot_timer_hal_init(struct Oneshot_Timer *stim)
 {
-	ONESHOT_TIMER_CLK_ENABLE();
-
 	TIM_ClockConfigTypeDef  sClockSourceConfig = {0};
 	TIM_MasterConfigTypeDef sMasterConfig      = {0};
-	uint32_t                clkFreq            = HAL_RCC_GetHCLKFreq();
-
-	uint32_t prescaler;
-	uint32_t period;
 
 	/* Init timer settings */
 	
-	stim->htim.Instance               = ONESHOT_TIMER_INSTANCE;
 	stim->htim.Init.CounterMode       = TIM_COUNTERMODE_UP;
 	stim->htim.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
 	stim->htim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
 
 	/* Configure timer for 1us ticks */
-	stim->htim.Init.Prescaler         = 32;
+	stim->htim.Init.Prescaler         = __oneshot_timer_prescaler();
 	stim->htim.Init.Period            = 60000; // 60ms
 
 	if(HAL_TIM_Base_Init(&stim->htim) != HAL_OK) {
@@ -75,18 +85,11 @@ void __oneshot_timer_hal_init(struct OneShot_Timer_Private *stim)
 }
 
 
-void __oneshot_timer_irq_config(struct OneShot_Timer_Private *stim)
-{
-	HAL_NVIC_SetPriority(ONESHOT_TIMER_IRQ, 3, 0);
-	HAL_NVIC_EnableIRQ  (ONESHOT_TIMER_IRQ);
-}
-
-
-void __oneshot_timer_done(struct OneShot_Timer_Private *stimer)
+RAMFUNC void __oneshot_timer_done(struct Oneshot_Timer *stim)
 {
-	HAL_TIM_Base_Stop_IT(&stimer->htim);
+	HAL_TIM_Base_Stop_IT(&stim->htim);
 
-	if(stimer->done_cbk != NULL) stimer->done_cbk(stimer->usrdata);
+	if(stim->done_cbk != NULL) stim->done_cbk(stim->usrdata);
 }
 
 
@@ -94,48 +97,162 @@ void __oneshot_timer_done(struct OneShot_Timer_Private *stimer)
    │ Public interface                       │
    └────────────────────────────────────────┘ */
 
-void oneshot_timer_init(Oneshot_Timer_Callback done_cbk, void *usrdata)
+void oneshot_timer_init(struct Oneshot_Timer *stim, TIM_TypeDef *instance, Oneshot_Timer_Callback done_cbk, void *usrdata)
 {
-	__oneshot_timer_hal_init    (&__stimer_private);
-	__oneshot_timer_irq_config  (&__stimer_private);
+	stim->htim.Instance = instance;
+
+	__oneshot_timer_resources_init(stim, instance);
+	__oneshot_timer_hal_init      (stim);
+	__oneshot_timer_irq_config    (stim);
 
-	__stimer_private.done_cbk = done_cbk;
-	__stimer_private.usrdata  = usrdata;
+	stim->done_cbk = done_cbk;
+	stim->usrdata  = usrdata;
 }
 
 
-void oneshot_timer_start(uint32_t delay_ms)
+void oneshot_timer_deinit(struct Oneshot_Timer *stim)
+{
+	HAL_NVIC_DisableIRQ(stim->irqn);
+
+	HAL_TIM_Base_Stop_IT(&stim->htim);
+	HAL_TIM_Base_DeInit (&stim->htim);
+}
+
+
+void oneshot_timer_clock_update(struct Oneshot_Timer *stim)
+{
+	/* Applied by the next oneshot_timer_start */
+	stim->htim.Init.Prescaler = __oneshot_timer_prescaler();
+}
+
+
+RAMFUNC void oneshot_timer_start(struct Oneshot_Timer *stim, uint32_t delay_us)
 {
 	/* Set timer period */
-	__stimer_private.htim.Init.Period = delay_ms;
-	if(HAL_TIM_Base_Init(&__stimer_private.htim) != HAL_OK) {
+	stim->htim.Init.Period = delay_us;
+	if(HAL_TIM_Base_Init(&stim->htim) != HAL_OK) {
 		Error_Handler();
 	}
 
 	/* Start timer */
-	__stimer_private.tick = 0;
-	if(HAL_TIM_Base_Start_IT(&__stimer_private.htim) != HAL_OK) {
+	if(HAL_TIM_Base_Start_IT(&stim->htim) != HAL_OK) {
 		Error_Handler();
 	}
 
 }
 
 
+void oneshot_timer_stop(struct Oneshot_Timer *stim)
+{
+	HAL_TIM_Base_Stop_IT(&stim->htim);
+
+	/* Drop an expiry that was not handled yet */
+	__HAL_TIM_CLEAR_FLAG(&stim->htim, TIM_FLAG_UPDATE);
+	HAL_NVIC_ClearPendingIRQ(stim->irqn);
+}
+
+
 /* ┌────────────────────────────────────────┐
    │ IRQs                                   │
    └────────────────────────────────────────┘ */
 
-void ONESHOT_TIMER_ISR(void)
+RAMFUNC void oneshot_timer_irq_handler(struct Oneshot_Timer *stim)
 {
-	if(__HAL_TIM_GET_FLAG(&__stimer_private.htim, TIM_FLAG_UPDATE)) {
-		//__stimer_private.tick++;
-		//if(__stimer_private.tick >= 2) {
-			__oneshot_timer_done(&__stimer_private);
-		//}
+	if(__HAL_TIM_GET_FLAG(&stim->htim, TIM_FLAG_UPDATE)) {
+		__oneshot_timer_done(stim);
 	}
 
 
 	/* Clears interrupts and does HAL stuff */
 
-	HAL_TIM_IRQHandler(&__stimer_private.htim);
+	HAL_TIM_IRQHandler(&stim->htim);
 }
+
+
+#else
+
+/* ┌────────────────────────────────────────┐
+   │ Register backend                       │
+   └────────────────────────────────────────┘ */
+
+/* The counter stops by itself at the update event (one-pulse mode), and
+   only counter overflows raise the update flag (URS): loading the
+   prescaler with an update generation does not. */
+
+#define ONESHOT_TIMER_CR1          (TIM_CR1_URS | TIM_CR1_OPM)
+
+void oneshot_timer_init(struct Oneshot_Timer *stim, TIM_TypeDef *instance, Oneshot_Timer_Callback done_cbk, void *usrdata)
+{
+	stim->instance  = instance;
+
+	__oneshot_timer_resources_init(stim, instance);
+	stim->prescaler = __oneshot_timer_prescaler();
+
+	instance->CR1   = ONESHOT_TIMER_CR1;
+	instance->DIER  = TIM_DIER_UIE;
+	instance->SR    = 0;
+
+	__oneshot_timer_irq_config(stim);
+
+	stim->done_cbk = done_cbk;
+	stim->usrdata  = usrdata;
+}
+
+
+void oneshot_timer_deinit(struct Oneshot_Timer *stim)
+{
+	HAL_NVIC_DisableIRQ(stim->irqn);
+
+	stim->instance->CR1  = 0;
+	stim->instance->DIER = 0;
+	stim->instance->SR   = 0;
+}
+
+
+void oneshot_timer_clock_update(struct Oneshot_Timer *stim)
+{
+	/* Applied by the next oneshot_timer_start */
+	stim->prescaler = __oneshot_timer_prescaler();
+}
+
+
+RAMFUNC void oneshot_timer_start(struct Oneshot_Timer *stim, uint32_t delay_us)
+{
+	TIM_TypeDef *instance = stim->instance;
+
+	/* Same delay as the HAL backend: update after delay_us + 1 ticks */
+	instance->CR1 = ONESHOT_TIMER_CR1;
+	instance->PSC = stim->prescaler;
+	instance->ARR = delay_us;
+	instance->EGR = TIM_EGR_UG;                                 /* Loads PSC, clears CNT       */
+	instance->CR1 = ONESHOT_TIMER_CR1 | TIM_CR1_CEN;
+}
+
+
+void oneshot_timer_stop(struct Oneshot_Timer *stim)
+{
+	CLEAR_BIT(stim->instance->CR1, TIM_CR1_CEN);
+
+	/* Drop an expiry that was not handled yet */
+	stim->instance->SR = ~(uint32_t)TIM_SR_UIF;
+	HAL_NVIC_ClearPendingIRQ(stim->irqn);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ IRQs                                   │
+   └────────────────────────────────────────┘ */
+
+RAMFUNC void oneshot_timer_irq_handler(struct Oneshot_Timer *stim)
+{
+	TIM_TypeDef *instance = stim->instance;
+
+	if(instance->SR & TIM_SR_UIF) {
+		/* rc_w0 flag, the counter is already stopped */
+		instance->SR = ~(uint32_t)TIM_SR_UIF;
+
+		if(stim->done_cbk != NULL) stim->done_cbk(stim->usrdata);
+	}
+}
+
+#endif
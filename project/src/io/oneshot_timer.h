@@ -12,22 +12,47 @@
 
 #include <inttypes.h>
 
+#include "main.h"
+
 
 /* ┌────────────────────────────────────────┐
-   │ Oneshot timer config                   │
+   │ Oneshot timer data                     │
    └────────────────────────────────────────┘ */
 
-#define ONESHOT_TIMER_INSTANCE     TIM17
-#define ONESHOT_TIMER_IRQ          TIM17_IRQn
-#define ONESHOT_TIMER_ISR          TIM17_IRQHandler
-#define ONESHOT_TIMER_CLK_ENABLE __HAL_RCC_TIM17_CLK_ENABLE
-
 typedef void (*Oneshot_Timer_Callback)(void*);
 
+/* Each instance owns a basic timer (TIM14, TIM16 or TIM17).
+   The ISR for this timer must call oneshot_timer_irq_handler.
+
+   With CONFIG_IO_LL, the timer registers are accessed directly
+   instead of through the HAL, in one-pulse mode. */
+
+struct Oneshot_Timer {
+#if defined(CONFIG_IO_LL)
+	TIM_TypeDef           *instance;                           /* Used timer                  */
+	uint32_t               prescaler;                          /* For 1us ticks               */
+#else
+	TIM_HandleTypeDef      htim;                               /* TIM Handle for HAL          */
+#endif
+	IRQn_Type              irqn;                               /* IRQ line of the timer       */
+
+	Oneshot_Timer_Callback done_cbk;
+	void                  *usrdata;
+};
+
 
 /* ┌────────────────────────────────────────┐
    │ Public interface                       │
    └────────────────────────────────────────┘ */
 
-void    oneshot_timer_init (Oneshot_Timer_Callback done_cbk, void *usrdata);
-void    oneshot_timer_start(uint32_t delay_us);
+void    oneshot_timer_init       (struct Oneshot_Timer *stim, TIM_TypeDef *instance, Oneshot_Timer_Callback done_cbk, void *usrdata);
+void    oneshot_timer_deinit     (struct Oneshot_Timer *stim);
+void    oneshot_timer_start      (struct Oneshot_Timer *stim, uint32_t delay_us);
+
+/* Cancels a running delay, the callback is not called */
+void    oneshot_timer_stop       (struct Oneshot_Timer *stim);
+
+/* To call after a system clock change, while the timer is not running */
+void    oneshot_timer_clock_update(struct Oneshot_Timer *stim);
+
+void    oneshot_timer_irq_handler(struct Oneshot_Timer *stim);
@@ -0,0 +1,177 @@
+/* ┌──────────────────────────────────────┐
+   │ Microsecond timebase                 │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "timebase.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+/* time_us = high * 65536 + CNT, and HAL ticks are ms + (ms_us + CNT) / 1000 */
+
+struct Timebase_State {
+	uint8_t       started;
+	__IO uint32_t high;                                         /* Overflows, also a sequence  */
+	__IO uint32_t ms;                                           /* HAL tick at the last one    */
+	__IO uint32_t ms_us;                                        /* Past ms, below 1000         */
+};
+
+struct Timebase_Snapshot {
+	uint32_t high;
+	uint32_t ms;
+	uint32_t ms_us;
+	uint32_t cnt;                                               /* Up to 2^17 with an overflow */
+};
+
+static struct Timebase_State __timebase;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+/* x / 1000 as (x / 8) / 125 with a q21 reciprocal, exact below 171992:
+   the M0+ has no divide instruction. */
+
+static inline uint32_t __attribute__ ((always_inline)) __timebase_div1000(uint32_t x)
+{
+	return ((x >> 3) * 16778) >> 21;
+}
+
+/* With interrupts masked */
+
+static void __timebase_overflow(void)
+{
+	uint32_t us = __timebase.ms_us + 65536;
+	uint32_t ms = __timebase_div1000(us);
+
+	TIMEBASE_TIMER_INSTANCE->SR = ~(uint32_t)TIM_SR_UIF;
+
+	__timebase.ms    += ms;
+	__timebase.ms_us  = us - ms * 1000;
+	__timebase.high++;
+}
+
+/* Retried if the overflow interrupt ran in between. An overflow it did
+   not handle yet is pending: CNT is read again after the flag, so that
+   both agree. */
+
+RAMFUNC static void __timebase_read(struct Timebase_Snapshot *snap)
+{
+	TIM_TypeDef *instance = TIMEBASE_TIMER_INSTANCE;
+
+	do {
+		snap->high  = __timebase.high;
+		snap->ms    = __timebase.ms;
+		snap->ms_us = __timebase.ms_us;
+		snap->cnt   = instance->CNT;
+
+		if(instance->SR & TIM_SR_UIF) snap->cnt = instance->CNT + 65536;
+	} while(snap->high != __timebase.high);
+}
+
+static uint32_t __timebase_prescaler(void)
+{
+	return (HAL_RCC_GetPCLK1Freq() / 1000000) - 1;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ HAL tick                               │
+   └────────────────────────────────────────┘ */
+
+/* Called by HAL_Init, then after each clock change */
+
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
+{
+	TIM_TypeDef *instance = TIMEBASE_TIMER_INSTANCE;
+	uint32_t     primask;
+	uint32_t     cnt;
+
+	(void)TickPriority;
+
+	if(!__timebase.started) {
+		TIMEBASE_TIMER_CLK_ENABLE();
+
+		/* Only overflows raise the update flag (URS) */
+		instance->CR1  = TIM_CR1_URS;
+		instance->PSC  = __timebase_prescaler();
+		instance->ARR  = 0xFFFF;
+		instance->EGR  = TIM_EGR_UG;                        /* Loads PSC, clears CNT       */
+		instance->SR   = 0;
+		instance->DIER = TIM_DIER_UIE;
+		instance->CR1  = TIM_CR1_URS | TIM_CR1_CEN;
+
+		HAL_NVIC_SetPriority(TIMEBASE_IRQN, TIMEBASE_IRQ_PRIORITY, 0);
+		HAL_NVIC_EnableIRQ  (TIMEBASE_IRQN);
+
+		__timebase.started = 1;
+		return HAL_OK;
+	}
+
+	/* New prescaler at once, the count is kept (less than a tick is lost) */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if(instance->SR & TIM_SR_UIF) __timebase_overflow();
+
+	cnt           = instance->CNT;
+	instance->PSC = __timebase_prescaler();
+	instance->EGR = TIM_EGR_UG;
+	instance->CNT = cnt;
+
+	__set_PRIMASK(primask);
+
+	return HAL_OK;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	struct Timebase_Snapshot snap;
+
+	__timebase_read(&snap);
+	return snap.ms + __timebase_div1000(snap.ms_us + snap.cnt);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+RAMFUNC uint32_t timebase_us(void)
+{
+	struct Timebase_Snapshot snap;
+
+	__timebase_read(&snap);
+	return (snap.high << 16) + snap.cnt;
+}
+
+uint64_t timebase_us64(void)
+{
+	struct Timebase_Snapshot snap;
+
+	__timebase_read(&snap);
+	return ((uint64_t)snap.high << 16) + snap.cnt;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ IRQs                                   │
+   └────────────────────────────────────────┘ */
+
+void timebase_irq_handler(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* Readers in higher priority ISRs see all or nothing */
+	if(TIMEBASE_TIMER_INSTANCE->SR & TIM_SR_UIF) __timebase_overflow();
+
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,44 @@
+/* ┌──────────────────────────────────────┐
+   │ Microsecond timebase                 │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Timebase config                        │
+   └────────────────────────────────────────┘ */
+
+/* TIM3 runs free at 1MHz, its overflows (every 65.536ms) are counted
+   in an interrupt to extend it to 48 bits. It is also the HAL tick:
+   HAL_InitTick and HAL_GetTick are replaced, SysTick is left off.
+
+   Readings are lock-free and valid from any context, even with
+   interrupts masked: an overflow not counted yet is seen from the
+   timer flag. The overflow interrupt must not stay masked for more
+   than 65ms. Clock changes go through HAL_InitTick, called by the HAL
+   after each HAL_RCC_ClockConfig: the count goes on across them. */
+
+#define TIMEBASE_TIMER_INSTANCE    TIM3
+#define TIMEBASE_TIMER_CLK_ENABLE  __HAL_RCC_TIM3_CLK_ENABLE
+#define TIMEBASE_IRQN              TIM3_IRQn
+#define TIMEBASE_IRQ_PRIORITY      3                                /* Reads do not depend on it   */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Time since boot: 32 bits wrap after 71 minutes, differences stay valid */
+uint32_t timebase_us  (void);
+uint64_t timebase_us64(void);
+
+void     timebase_irq_handler(void);
@@ -0,0 +1,137 @@
+/* ┌──────────────────────────────────────┐
+   │ Trigger input                        │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "trigger.h"
+
+#include <bsp/pin.h>
+#include <io/timebase.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private data                           │
+   └────────────────────────────────────────┘ */
+
+enum Trigger_Input {
+	TRIGGER_IDLE,                                               /* Next edge is accepted       */
+	TRIGGER_SETTLING,                                           /* Input not seen low yet      */
+	TRIGGER_RELEASED                                            /* Seen low once               */
+};
+
+struct Trigger_State {
+	struct Oneshot_Timer stimer;
+	__IO uint32_t        input;                                 /* enum Trigger_Input          */
+
+	/* Written by the EXTI ISR, read by the main loop */
+	uint32_t             edges[TRIGGER_NB_EDGES];
+	__IO uint32_t        head;
+	__IO uint32_t        tail;
+};
+
+struct Trigger_Stats        trigger_stats;
+static struct Trigger_State __trigger;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static void __trigger_timer_done(void *usrdata)
+{
+	(void)usrdata;
+
+	/* Held or bouncing: sample again */
+	if(pin_nrst_read()) {
+		__trigger.input = TRIGGER_SETTLING;
+		oneshot_timer_start(&__trigger.stimer, TRIGGER_DEBOUNCE_US);
+	}
+
+	else if(__trigger.input == TRIGGER_SETTLING) {
+		__trigger.input = TRIGGER_RELEASED;
+		oneshot_timer_start(&__trigger.stimer, TRIGGER_DEBOUNCE_US);
+	}
+
+	else {
+		__trigger.input = TRIGGER_IDLE;
+	}
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void trigger_init(void)
+{
+	__trigger.input = TRIGGER_IDLE;
+	__trigger.head  = 0;
+	__trigger.tail  = 0;
+
+	oneshot_timer_init(&__trigger.stimer, TRIGGER_TIMER_INSTANCE, __trigger_timer_done, NULL);
+
+	/* The line itself is set up by bsp_pins_init: drop an edge seen before */
+	EXTI->RPR1 = TRIGGER_EXTI_LINE;
+	HAL_NVIC_ClearPendingIRQ(TRIGGER_EXTI_IRQN);
+	HAL_NVIC_SetPriority    (TRIGGER_EXTI_IRQN, TRIGGER_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ      (TRIGGER_EXTI_IRQN);
+}
+
+uint8_t trigger_pop(uint32_t *us)
+{
+	uint32_t tail = __trigger.tail;
+
+	if(tail == __trigger.head) return 0;
+
+	*us            = __trigger.edges[tail & (TRIGGER_NB_EDGES - 1)];
+	__trigger.tail = tail + 1;
+
+	return 1;
+}
+
+void trigger_clock_update(void)
+{
+	oneshot_timer_clock_update(&__trigger.stimer);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ IRQs                                   │
+   └────────────────────────────────────────┘ */
+
+RAMFUNC void trigger_exti_irq_handler(void)
+{
+	uint32_t now = timebase_us();
+	uint32_t head;
+
+	if(!(EXTI->RPR1 & TRIGGER_EXTI_LINE)) return;
+	EXTI->RPR1 = TRIGGER_EXTI_LINE;
+
+	if(__trigger.input != TRIGGER_IDLE) {
+		__trigger.input = TRIGGER_SETTLING;
+		trigger_stats.bounces++;
+		return;
+	}
+
+	__trigger.input = TRIGGER_SETTLING;
+	oneshot_timer_start(&__trigger.stimer, TRIGGER_DEBOUNCE_US);
+	trigger_stats.edges++;
+
+	/* The oldest edges are kept */
+	head = __trigger.head;
+	if((head - __trigger.tail) >= TRIGGER_NB_EDGES) {
+		trigger_stats.overruns++;
+		return;
+	}
+
+	__trigger.edges[head & (TRIGGER_NB_EDGES - 1)] = now;
+	__trigger.head                                 = head + 1;
+}
+
+void trigger_timer_irq_handler(void)
+{
+	oneshot_timer_irq_handler(&__trigger.stimer);
+}
@@ -0,0 +1,68 @@
+/* ┌──────────────────────────────────────┐
+   │ Trigger input                        │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+#include <io/oneshot_timer.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Trigger config                         │
+   └────────────────────────────────────────┘ */
+
+/* Rising edges of pin_nrst (PF2, EXTI line 2, see bsp/pin_table.h),
+   e.g. a GO button or a beat clock. Each accepted edge is stamped with
+   the microsecond timebase (see io/timebase.h) in the EXTI interrupt
+   and queued for the main loop.
+
+   Debouncing is done with a oneshot timer: after an edge, the input is
+   sampled every TRIGGER_DEBOUNCE_US, and the next edge is accepted once
+   it was seen low twice in a row. Edges in between are counted as
+   bounces. */
+
+#define TRIGGER_EXTI_LINE          (1UL << 2)
+#define TRIGGER_EXTI_IRQN          EXTI2_3_IRQn
+#define TRIGGER_IRQ_PRIORITY       3
+
+#define TRIGGER_TIMER_INSTANCE     TIM1                             /* Free with any universes     */
+#define TRIGGER_TIMER_IRQN         TIM1_BRK_UP_TRG_COM_IRQn
+
+#define TRIGGER_DEBOUNCE_US        10000
+#define TRIGGER_NB_EDGES           8                                /* Queue size, power of two    */
+
+
+/* ┌────────────────────────────────────────┐
+   │ Trigger data                           │
+   └────────────────────────────────────────┘ */
+
+struct Trigger_Stats {
+	uint32_t edges;                                             /* Accepted edges              */
+	uint32_t bounces;                                           /* Ignored while settling      */
+	uint32_t overruns;                                          /* Accepted, queue was full    */
+};
+
+extern struct Trigger_Stats trigger_stats;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void    trigger_init             (void);
+
+/* Gets the oldest queued edge time, in us. Returns 0 if none. */
+uint8_t trigger_pop              (uint32_t *us);
+
+/* To call after a system clock change */
+void    trigger_clock_update     (void);
+
+void    trigger_exti_irq_handler (void);
+void    trigger_timer_irq_handler(void);
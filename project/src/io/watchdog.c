@@ -0,0 +1,23 @@
+/* ┌──────────────────────────────────────┐
+   │ Independent watchdog                 │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "watchdog.h"
+
+void watchdog_init(void)
+{
+	__HAL_RCC_DBGMCU_CLK_ENABLE();
+	__HAL_DBGMCU_FREEZE_IWDG();
+
+	/* Starting the IWDG starts the LSI. The new prescaler and reload
+	   are applied a few LSI cycles later, no need to wait for them. */
+	IWDG->KR  = WATCHDOG_KEY_ENABLE;
+	IWDG->KR  = WATCHDOG_KEY_WRITE_ACCESS;
+	IWDG->PR  = WATCHDOG_PRESCALER;
+	IWDG->RLR = WATCHDOG_TIMEOUT_MS;
+	IWDG->KR  = WATCHDOG_KEY_RELOAD;
+}
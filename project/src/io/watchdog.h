@@ -0,0 +1,43 @@
+/* ┌──────────────────────────────────────┐
+   │ Independent watchdog                 │
+   └──────────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "main.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Watchdog config                        │
+   └────────────────────────────────────────┘ */
+
+/* The IWDG runs from the LSI (32kHz), divided to 1ms ticks. Once
+   started, it can't be stopped: the main loop must refresh it. The
+   longest blocking main loop operations are a flash page erase (40ms)
+   and a clock switch (see app/clock_switch.h). */
+
+#define WATCHDOG_TIMEOUT_MS        100
+#define WATCHDOG_PRESCALER         (IWDG_PR_PR_1 | IWDG_PR_PR_0) /* LSI / 32 */
+
+#define WATCHDOG_KEY_RELOAD        0xAAAA
+#define WATCHDOG_KEY_ENABLE        0xCCCC
+#define WATCHDOG_KEY_WRITE_ACCESS  0x5555
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Starts the watchdog, frozen while the core is halted by a debugger */
+void watchdog_init(void);
+
+static inline void __attribute__ ((always_inline)) watchdog_refresh(void)
+{
+	IWDG->KR = WATCHDOG_KEY_RELOAD;
+}
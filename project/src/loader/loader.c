@@ -0,0 +1,440 @@
+/* ┌──────────────────────────────────┐
+   │ Serial firmware loader           │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "loader.h"
+#include "loader_port.h"
+
+#include <io/crc.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private datatypes                      │
+   └────────────────────────────────────────┘ */
+
+enum Loader_Parser_State {
+	LOADER_WAIT_SYNC,
+	LOADER_WAIT_ID,
+	LOADER_WAIT_LENGTH,
+	LOADER_WAIT_PAYLOAD,
+	LOADER_WAIT_CHECKSUM
+};
+
+struct Loader_Frame {
+	uint8_t  id;
+	uint8_t  length;
+	uint8_t  payload[LOADER_MAX_PAYLOAD];
+};
+
+struct Loader_Update {
+	uint32_t length;
+	uint32_t crc;
+	uint32_t version;
+	uint32_t baudrate;
+
+	uint32_t nb_pages;
+	uint32_t nb_received;
+	uint32_t nb_programmed;
+};
+
+struct Loader_State {
+	enum Loader_Parser_State state;
+	struct Loader_Frame      frame;
+	uint32_t                 i_payload;
+	uint8_t                  sum;
+
+	uint32_t                 last_ms;                           /* Last frame or page block    */
+	uint8_t                  boot;                              /* BOOT received               */
+	uint8_t                  updating;                          /* Receiving page blocks       */
+	struct Loader_Update     update;
+
+	/* One is programmed while the other is received */
+	uint8_t                  blocks[2][LOADER_BLOCK_SIZE] __attribute__ ((aligned(4)));
+};
+
+static struct Loader_State __loader;
+
+
+/* ┌────────────────────────────────────────┐
+   │ Payload helpers                        │
+   └────────────────────────────────────────┘ */
+
+static uint16_t __loader_get_u16(const uint8_t *ptr)
+{
+	return (uint16_t)ptr[0] | ((uint16_t)ptr[1] << 8);
+}
+
+static uint32_t __loader_get_u32(const uint8_t *ptr)
+{
+	return (uint32_t)__loader_get_u16(ptr) | ((uint32_t)__loader_get_u16(ptr + 2) << 16);
+}
+
+static void __loader_put_u8(struct Loader_Frame *resp, uint8_t value)
+{
+	resp->payload[resp->length++] = value;
+}
+
+static void __loader_put_u16(struct Loader_Frame *resp, uint16_t value)
+{
+	__loader_put_u8(resp, value & 0xFF);
+	__loader_put_u8(resp, value >> 8  );
+}
+
+static void __loader_put_u32(struct Loader_Frame *resp, uint32_t value)
+{
+	__loader_put_u16(resp, value & 0xFFFF);
+	__loader_put_u16(resp, value >> 16   );
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Slots                                  │
+   └────────────────────────────────────────┘ */
+
+static const struct Loader_Image* __loader_image(uint32_t slot)
+{
+	return (const struct Loader_Image*)loader_port_flash(slot + LOADER_SLOT_SIZE - sizeof(struct Loader_Image));
+}
+
+/* Images are linked for slot A, wherever they are stored */
+
+static uint8_t __loader_valid(uint32_t slot)
+{
+	const struct Loader_Image *image   = __loader_image(slot);
+	const uint32_t            *vectors = (const uint32_t*)loader_port_flash(slot);
+
+	if(image->magic != LOADER_IMAGE_MAGIC                             ) return 0;
+	if((image->length < 8) || (image->length > LOADER_IMAGE_MAX)      ) return 0;
+
+	/* Initial stack pointer and reset handler */
+	if((vectors[0] - LOADER_RAM_BASE) > LOADER_RAM_SIZE               ) return 0;
+	if((vectors[1] - LOADER_SLOT_A  ) >= image->length                ) return 0;
+
+	return crc_compute(loader_port_flash(slot), image->length) == image->crc;
+}
+
+/* Descriptor page first: the slot is invalid from the start */
+
+static uint8_t __loader_erase(uint32_t slot)
+{
+	uint32_t i_page = LOADER_SLOT_NB_PAGES;
+
+	while(i_page--) {
+		if(!loader_port_erase(slot + i_page * LOADER_PAGE_SIZE)) return 0;
+	}
+
+	return 1;
+}
+
+/* The image must be programmed: checked, then the descriptor is written */
+
+static uint8_t __loader_seal(uint32_t slot, uint32_t length, uint32_t crc, uint32_t version)
+{
+	struct Loader_Image image = {
+		.length  = length,
+		.crc     = crc,
+		.version = version,
+		.magic   = LOADER_IMAGE_MAGIC
+	};
+
+	if(crc_compute(loader_port_flash(slot), length) != crc) return 0;
+
+	return loader_port_program(slot + LOADER_SLOT_SIZE - sizeof(image), (const uint8_t*)&image, sizeof(image));
+}
+
+static uint8_t __loader_copy(void)
+{
+	const struct Loader_Image *src = __loader_image(LOADER_SLOT_B);
+	uint32_t                   offset;
+	uint32_t                   length;
+
+	if(!__loader_erase(LOADER_SLOT_A)) return 0;
+
+	for(offset = 0; offset < src->length; offset += LOADER_PAGE_SIZE) {
+		length = src->length - offset;
+		if(length > LOADER_PAGE_SIZE) length = LOADER_PAGE_SIZE;
+
+		if(!loader_port_program(LOADER_SLOT_A + offset, loader_port_flash(LOADER_SLOT_B + offset), (length + 7) & ~7UL)) {
+			return 0;
+		}
+	}
+
+	return __loader_seal(LOADER_SLOT_A, src->length, src->crc, src->version);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Frames                                 │
+   └────────────────────────────────────────┘ */
+
+static void __loader_send(const struct Loader_Frame *resp)
+{
+	uint8_t  header[3] = { LOADER_SYNC, resp->id, resp->length };
+	uint8_t  sum       = resp->id + resp->length;
+	uint32_t i;
+
+	for(i = 0; i < resp->length; i++) sum += resp->payload[i];
+	sum = -sum;
+
+	loader_port_write(header       , sizeof(header));
+	loader_port_write(resp->payload, resp->length  );
+	loader_port_write(&sum         , 1             );
+}
+
+static void __loader_answer(uint8_t id, enum Loader_Status status, struct Loader_Frame *resp)
+{
+	resp->id         = id | LOADER_RESPONSE;
+	resp->payload[0] = status;
+
+	/* No partial data with an error */
+	if(status != LOADER_STATUS_OK) resp->length = 1;
+
+	__loader_send(resp);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Update                                 │
+   └────────────────────────────────────────┘ */
+
+static void __loader_update_end(enum Loader_Status status)
+{
+	static struct Loader_Frame resp;
+
+	loader_port_rx_stop();
+
+	resp.length = 1;
+	__loader_put_u32(&resp, __loader.update.length);
+	__loader_put_u32(&resp, __loader.update.crc   );
+	__loader_answer (LOADER_END, status, &resp);
+
+	loader_port_baudrate(LOADER_BAUDRATE);
+
+	__loader.updating = 0;
+	__loader.state    = LOADER_WAIT_SYNC;
+}
+
+static void __loader_update_poll(void)
+{
+	static struct Loader_Frame  resp;
+	struct Loader_Update       *update = &__loader.update;
+	const uint8_t              *block;
+	const uint8_t              *data;
+	uint32_t                    i_page;
+	uint32_t                    crc;
+	uint32_t                    address;
+	uint32_t                    length;
+
+	if(loader_port_rx_left()) {
+		if((loader_port_ms() - __loader.last_ms) >= LOADER_BLOCK_TIMEOUT_MS) __loader_update_end(LOADER_STATUS_TIMEOUT);
+		return;
+	}
+
+	block  = __loader.blocks[update->nb_received & 1];
+	data   = block + 4;
+	i_page = __loader_get_u16(block);
+	crc    = __loader_get_u32(data + LOADER_PAGE_SIZE);
+
+	if((i_page != update->nb_received) || (crc_compute(data, LOADER_PAGE_SIZE) != crc)) {
+		__loader_update_end(LOADER_STATUS_INVALID);
+		return;
+	}
+
+	/* The next block arrives while this one is programmed */
+	update->nb_received++;
+	__loader.last_ms = loader_port_ms();
+
+	if(update->nb_received < update->nb_pages) {
+		loader_port_rx_block(__loader.blocks[update->nb_received & 1], LOADER_BLOCK_SIZE);
+	}
+
+	resp.length = 1;
+	__loader_put_u16(&resp, (uint16_t)i_page               );
+	__loader_put_u16(&resp, (uint16_t)update->nb_programmed);
+	__loader_answer (LOADER_PAGE, LOADER_STATUS_OK, &resp);
+
+	/* Past the image, the slot stays erased: the descriptor goes there */
+	address = LOADER_SLOT_B + i_page * LOADER_PAGE_SIZE;
+	length  = update->length - i_page * LOADER_PAGE_SIZE;
+	if(length > LOADER_PAGE_SIZE) length = LOADER_PAGE_SIZE;
+
+	if(!loader_port_program(address, data, (length + 7) & ~7UL)
+		|| (crc_compute(loader_port_flash(address), LOADER_PAGE_SIZE) != crc)) {
+		__loader_update_end(LOADER_STATUS_FLASH);
+		return;
+	}
+
+	if(++update->nb_programmed < update->nb_pages) return;
+
+	if(!__loader_seal(LOADER_SLOT_B, update->length, update->crc, update->version)) {
+		__loader_update_end(LOADER_STATUS_FLASH);
+		return;
+	}
+
+	__loader_update_end(LOADER_STATUS_OK);
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Command handlers                       │
+   └────────────────────────────────────────┘ */
+
+static void __loader_info_slot(uint32_t slot, struct Loader_Frame *resp)
+{
+	const struct Loader_Image *image = __loader_image(slot);
+	uint8_t                    valid = __loader_valid(slot);
+
+	__loader_put_u8 (resp, valid                     );
+	__loader_put_u32(resp, valid ? image->length  : 0);
+	__loader_put_u32(resp, valid ? image->crc     : 0);
+	__loader_put_u32(resp, valid ? image->version : 0);
+}
+
+static enum Loader_Status __loader_info(struct Loader_Frame *resp)
+{
+	__loader_put_u32  (resp, LOADER_PAGE_SIZE);
+	__loader_put_u32  (resp, LOADER_SLOT_SIZE);
+	__loader_info_slot(LOADER_SLOT_A, resp);
+	__loader_info_slot(LOADER_SLOT_B, resp);
+
+	return LOADER_STATUS_OK;
+}
+
+static enum Loader_Status __loader_begin(const struct Loader_Frame *req)
+{
+	struct Loader_Update *update = &__loader.update;
+
+	if(req->length < 16) return LOADER_STATUS_INVALID;
+
+	update->length   = __loader_get_u32(&req->payload[0 ]);
+	update->crc      = __loader_get_u32(&req->payload[4 ]);
+	update->version  = __loader_get_u32(&req->payload[8 ]);
+	update->baudrate = __loader_get_u32(&req->payload[12]);
+
+	if((update->length == 0) || (update->length > LOADER_IMAGE_MAX)        ) return LOADER_STATUS_INVALID;
+	if((update->baudrate < 9600) || (update->baudrate > LOADER_BAUDRATE_MAX)) return LOADER_STATUS_INVALID;
+
+	/* Slot A is kept until slot B is complete */
+	if(!__loader_erase(LOADER_SLOT_B)) return LOADER_STATUS_FLASH;
+
+	update->nb_pages      = (update->length + LOADER_PAGE_SIZE - 1) / LOADER_PAGE_SIZE;
+	update->nb_received   = 0;
+	update->nb_programmed = 0;
+	__loader.updating     = 1;
+
+	return LOADER_STATUS_OK;
+}
+
+static void __loader_execute(const struct Loader_Frame *req)
+{
+	static struct Loader_Frame resp;
+	enum Loader_Status         status;
+
+	resp.length = 1;
+
+	switch(req->id) {
+		case LOADER_INFO : status = __loader_info (&resp);      break;
+		case LOADER_BEGIN: status = __loader_begin(req);        break;
+		case LOADER_BOOT : status = LOADER_STATUS_OK; __loader.boot = 1; break;
+		default          : status = LOADER_STATUS_UNKNOWN; break;
+	}
+
+	__loader_answer(req->id, status, &resp);
+
+	/* Page blocks follow the answer, at the new baud rate */
+	if(__loader.updating) {
+		loader_port_baudrate(__loader.update.baudrate);
+		loader_port_rx_block(__loader.blocks[0], LOADER_BLOCK_SIZE);
+	}
+}
+
+static void __loader_parse(uint8_t data)
+{
+	switch(__loader.state) {
+		case LOADER_WAIT_SYNC:
+			if(data == LOADER_SYNC) __loader.state = LOADER_WAIT_ID;
+			break;
+
+		case LOADER_WAIT_ID:
+			__loader.frame.id = data;
+			__loader.sum      = data;
+			__loader.state    = LOADER_WAIT_LENGTH;
+			break;
+
+		case LOADER_WAIT_LENGTH:
+			__loader.frame.length = data;
+			__loader.sum         += data;
+			__loader.i_payload    = 0;
+
+			if     (data > LOADER_MAX_PAYLOAD) __loader.state = LOADER_WAIT_SYNC;
+			else if(data == 0                ) __loader.state = LOADER_WAIT_CHECKSUM;
+			else                               __loader.state = LOADER_WAIT_PAYLOAD;
+			break;
+
+		case LOADER_WAIT_PAYLOAD:
+			__loader.frame.payload[__loader.i_payload++] = data;
+			__loader.sum += data;
+
+			if(__loader.i_payload >= __loader.frame.length) __loader.state = LOADER_WAIT_CHECKSUM;
+			break;
+
+		case LOADER_WAIT_CHECKSUM:
+			__loader.state = LOADER_WAIT_SYNC;
+
+			if((uint8_t)(__loader.sum + data) != 0) break;
+
+			__loader.last_ms = loader_port_ms();
+			__loader_execute(&__loader.frame);
+			break;
+
+		default:break;
+	}
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+uint8_t loader_check(void)
+{
+	const struct Loader_Image *a     = __loader_image(LOADER_SLOT_A);
+	const struct Loader_Image *b     = __loader_image(LOADER_SLOT_B);
+	uint8_t                    valid = __loader_valid(LOADER_SLOT_A);
+
+	/* A new image, or an interrupted copy */
+	if(__loader_valid(LOADER_SLOT_B)
+		&& !(valid && (a->length == b->length) && (a->crc == b->crc) && (a->version == b->version))) {
+		valid = __loader_copy();
+	}
+
+	return valid;
+}
+
+void loader_serve(uint32_t timeout_ms)
+{
+	uint8_t data;
+
+	__loader.state    = LOADER_WAIT_SYNC;
+	__loader.boot     = 0;
+	__loader.updating = 0;
+	__loader.last_ms  = loader_port_ms();
+
+	while(!__loader.boot) {
+		if(__loader.updating) {
+			__loader_update_poll();
+		}
+
+		else if(loader_port_read(&data)) {
+			__loader_parse(data);
+		}
+
+		else if(timeout_ms && ((loader_port_ms() - __loader.last_ms) >= timeout_ms)) {
+			return;
+		}
+	}
+}
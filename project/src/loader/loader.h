@@ -0,0 +1,118 @@
+/* ┌──────────────────────────────────┐
+   │ Serial firmware loader           │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Flash layout                           │
+   └────────────────────────────────────────┘ */
+
+/* The loader stays resident in the first pages. The firmware runs
+   from slot A, updates are received into slot B: slot A is only
+   replaced once slot B holds a complete and verified image, and the
+   copy is resumed at the next boot if it is interrupted. The last two
+   pages are the look store (see app/look_store.h), the page before
+   them is free.
+
+   Must match sys/STM32G031K8Tx_LOADER.ld and sys/STM32G031K8Tx_APP.ld. */
+
+#define LOADER_FLASH_BASE          0x08000000UL
+#define LOADER_PAGE_SIZE           2048
+#define LOADER_SIZE                (3  * LOADER_PAGE_SIZE)
+#define LOADER_SLOT_SIZE           (13 * LOADER_PAGE_SIZE)
+#define LOADER_SLOT_NB_PAGES       (LOADER_SLOT_SIZE / LOADER_PAGE_SIZE)
+
+#define LOADER_SLOT_A              (LOADER_FLASH_BASE + LOADER_SIZE)
+#define LOADER_SLOT_B              (LOADER_SLOT_A + LOADER_SLOT_SIZE)
+
+#define LOADER_RAM_BASE            0x20000000UL
+#define LOADER_RAM_SIZE            (8 * 1024)
+
+/* Image descriptor, in the last 16 bytes of a slot. Written once the
+   image is programmed and checked, magic last. */
+
+struct Loader_Image {
+	uint32_t length;                                            /* Image bytes                 */
+	uint32_t crc;                                               /* CRC-32 of the image         */
+	uint32_t version;                                           /* Given by the host           */
+	uint32_t magic;
+};
+
+#define LOADER_IMAGE_MAGIC         0x474D4946UL /* "FIMG" */
+#define LOADER_IMAGE_MAX           (LOADER_SLOT_SIZE - sizeof(struct Loader_Image))
+
+
+/* ┌────────────────────────────────────────┐
+   │ Protocol                               │
+   └────────────────────────────────────────┘ */
+
+/* Commands use the frames of app/command.h, at LOADER_BAUDRATE until
+ * BEGIN gives the update baud rate. The firmware answers INFO with
+ * UNKNOWN: COMMAND_LOADER_ENTER makes it restart into the loader.
+ *
+ * After BEGIN, slot B is erased and the image is sent as raw page
+ * blocks, in order:
+ *
+ *   ┌──────────┬───────┬──────────────────┬─────────┐
+ *   │ u16 page │ u16 0 │ u8 data[2048]    │ u32 crc │
+ *   └──────────┴───────┴──────────────────┴─────────┘
+ *
+ * The last page is padded with 0xFF. crc is the CRC-32 of data. Each
+ * block is answered with a PAGE frame as soon as it is received: the
+ * next one then arrives while the previous one is programmed. Once the
+ * last page is programmed, the image is checked and END is answered.
+ *
+ * Errors end the update early, with END as well. Either way the loader
+ * is then back to LOADER_BAUDRATE, waiting for commands, and slot A is
+ * left as it was. */
+
+#define LOADER_SYNC                0xA5
+#define LOADER_RESPONSE            0x80
+#define LOADER_MAX_PAYLOAD         48
+
+#define LOADER_BAUDRATE            115200
+#define LOADER_BAUDRATE_MAX        2000000
+#define LOADER_BLOCK_SIZE          (4 + LOADER_PAGE_SIZE + 4)
+#define LOADER_BLOCK_TIMEOUT_MS    1000                             /* Between two blocks          */
+#define LOADER_IDLE_TIMEOUT_MS     30000                            /* Then slot A is started      */
+
+enum Loader_Id {
+	LOADER_INFO            = 0x40, /* -                                          */
+	LOADER_BEGIN           = 0x41, /* u32 length, crc, version, baudrate         */
+	LOADER_PAGE            = 0x42, /* Answer only: u16 page received,
+	                                  u16 pages programmed                       */
+	LOADER_END             = 0x43, /* Answer only: u32 length, crc               */
+	LOADER_BOOT            = 0x44, /* -                                          */
+};
+
+/* Info answer: u32 page size, slot size, then for slot A and B:
+ * u8 valid, u32 length, crc, version */
+
+enum Loader_Status {
+	LOADER_STATUS_OK,
+	LOADER_STATUS_UNKNOWN,                                      /* Unknown command             */
+	LOADER_STATUS_INVALID,                                      /* Bad length, page or CRC     */
+	LOADER_STATUS_FLASH    = 4,                                 /* Erase, program or check     */
+	LOADER_STATUS_TIMEOUT                                       /* Page block not complete     */
+};
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Copies slot B to slot A if it holds another valid image.
+   Returns 1 if slot A can be started. */
+uint8_t loader_check(void);
+
+/* Serves the host until BOOT, or until no frame was received for
+   timeout_ms (0: never) */
+void    loader_serve(uint32_t timeout_ms);
@@ -0,0 +1,59 @@
+/* ┌──────────────────────────────────┐
+   │ Firmware to loader handover      │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "stm32g0xx.h"
+
+
+/* ┌────────────────────────────────────────┐
+   │ Handover config                        │
+   └────────────────────────────────────────┘ */
+
+/* The firmware restarts into the loader with a request left in a TAMP
+   backup register: it survives the system reset, and does not depend
+   on the RAM layout of either program. */
+
+#define LOADER_HANDOVER_MAGIC      0x52444C42UL /* "BLDR" */
+#define LOADER_HANDOVER_REGISTER   (TAMP->BKP0R)
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+/* Clocks of the register, and write access */
+static inline void loader_handover_access(void)
+{
+	RCC->APBENR1 |= RCC_APBENR1_PWREN | RCC_APBENR1_RTCAPBEN;
+	PWR->CR1     |= PWR_CR1_DBP;
+}
+
+/* From the firmware: does not return */
+static inline void loader_handover_request(void)
+{
+	loader_handover_access();
+	LOADER_HANDOVER_REGISTER = LOADER_HANDOVER_MAGIC;
+
+	NVIC_SystemReset();
+}
+
+/* From the loader: returns 1 once after a request */
+static inline uint8_t loader_handover_take(void)
+{
+	uint8_t requested;
+
+	loader_handover_access();
+
+	requested                = (LOADER_HANDOVER_REGISTER == LOADER_HANDOVER_MAGIC);
+	LOADER_HANDOVER_REGISTER = 0;
+
+	return requested;
+}
@@ -0,0 +1,39 @@
+/* ┌──────────────────────────────────┐
+   │ Serial firmware loader           │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include <loader/loader.h>
+#include <loader/loader_port.h>
+#include <loader/loader_handover.h>
+#include <io/crc.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Entry point                            │
+   └────────────────────────────────────────┘ */
+
+/* Started by the startup code like the firmware, see sys/. The
+   firmware runs at once unless it asked for the loader, or is not
+   valid. Once requested, the loader starts it again after a while
+   without frames. */
+
+int main(void)
+{
+	uint8_t requested = loader_handover_take();
+	uint8_t valid;
+
+	loader_port_init();
+	crc_init();
+
+	while(1) {
+		valid = loader_check();
+		if(valid && !requested) loader_port_boot(LOADER_SLOT_A);
+
+		requested = 0;
+		loader_serve(valid ? LOADER_IDLE_TIMEOUT_MS : 0);
+	}
+}
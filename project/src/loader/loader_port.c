@@ -0,0 +1,248 @@
+/* ┌──────────────────────────────────┐
+   │ Loader hardware interface        │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#include "loader_port.h"
+
+#include <string.h>
+
+#include "stm32g0xx.h"
+#include <loader/loader.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Port config                            │
+   └────────────────────────────────────────┘ */
+
+/* Registers only, the HAL does not fit in the loader pages. The core
+   stays on HSI16 as after reset, TIM2 counts milliseconds. USART2 is
+   the ST-LINK virtual COM port (PA2, PA3), received blocks go through
+   DMA channel 1. Flash operations stall the CPU, not the DMA: the next
+   block keeps coming while a page is programmed. */
+
+#define LOADER_PORT_HCLK_HZ        16000000UL
+#define LOADER_PORT_MS_TIMER       TIM2
+#define LOADER_PORT_UART           USART2
+#define LOADER_PORT_UART_AF        1
+#define LOADER_PORT_DMA_CHANNEL    DMA1_Channel1
+#define LOADER_PORT_DMAMUX_CHANNEL DMAMUX1_Channel0
+#define LOADER_PORT_DMA_REQUEST    52                               /* USART2_RX                   */
+
+#define LOADER_PORT_FLASH_KEY1     0x45670123UL
+#define LOADER_PORT_FLASH_KEY2     0xCDEF89ABUL
+#define LOADER_PORT_FLASH_ERRORS   (FLASH_SR_OPERR | FLASH_SR_PROGERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR \
+                                  | FLASH_SR_SIZERR | FLASH_SR_PGSERR | FLASH_SR_MISERR | FLASH_SR_FASTERR)
+
+
+/* ┌────────────────────────────────────────┐
+   │ Private interface                      │
+   └────────────────────────────────────────┘ */
+
+static uint8_t __loader_port_flash_wait(void)
+{
+	uint32_t sr;
+
+	while(FLASH->SR & FLASH_SR_BSY1);
+
+	sr        = FLASH->SR;
+	FLASH->SR = sr & (LOADER_PORT_FLASH_ERRORS | FLASH_SR_EOP);
+	FLASH->CR = 0;
+
+	return !(sr & LOADER_PORT_FLASH_ERRORS);
+}
+
+static void __loader_port_flash_unlock(void)
+{
+	if(!(FLASH->CR & FLASH_CR_LOCK)) return;
+
+	FLASH->KEYR = LOADER_PORT_FLASH_KEY1;
+	FLASH->KEYR = LOADER_PORT_FLASH_KEY2;
+}
+
+
+/* ┌────────────────────────────────────────┐
+   │ Public interface                       │
+   └────────────────────────────────────────┘ */
+
+void loader_port_init(void)
+{
+	GPIO_TypeDef *gpio = GPIOA;
+
+	RCC->IOPENR  |= RCC_IOPENR_GPIOAEN;
+	RCC->APBENR1 |= RCC_APBENR1_USART2EN | RCC_APBENR1_TIM2EN;
+	RCC->AHBENR  |= RCC_AHBENR_DMA1EN;
+
+	/* PA2 TX, PA3 RX with pull-up */
+	gpio->AFR[0] = (gpio->AFR[0] & ~(0xFFUL << 8)) | (LOADER_PORT_UART_AF << 8) | (LOADER_PORT_UART_AF << 12);
+	gpio->PUPDR  = (gpio->PUPDR  & ~(0xFUL  << 4)) | (0x1UL << 6);
+	gpio->MODER  = (gpio->MODER  & ~(0xFUL  << 4)) | (0xAUL << 4);
+
+	LOADER_PORT_DMAMUX_CHANNEL->CCR = LOADER_PORT_DMA_REQUEST;
+	LOADER_PORT_DMA_CHANNEL->CPAR   = (uint32_t)&LOADER_PORT_UART->RDR;
+
+	LOADER_PORT_MS_TIMER->PSC = LOADER_PORT_HCLK_HZ / 1000 - 1;
+	LOADER_PORT_MS_TIMER->ARR = 0xFFFFFFFF;
+	LOADER_PORT_MS_TIMER->EGR = TIM_EGR_UG; /* Load prescaler */
+	LOADER_PORT_MS_TIMER->CR1 = TIM_CR1_CEN;
+
+	loader_port_baudrate(LOADER_BAUDRATE);
+}
+
+uint32_t loader_port_ms(void)
+{
+	return LOADER_PORT_MS_TIMER->CNT;
+}
+
+void loader_port_baudrate(uint32_t baudrate)
+{
+	USART_TypeDef *uart = LOADER_PORT_UART;
+	uint32_t       div;
+
+	if(uart->CR1 & USART_CR1_UE) {
+		while(!(uart->ISR & USART_ISR_TC));
+	}
+
+	uart->CR1 = 0;
+
+	/* Oversampling by 8 above HCLK / 16 */
+	if(baudrate > (LOADER_PORT_HCLK_HZ / 16)) {
+		div       = (2 * LOADER_PORT_HCLK_HZ + baudrate / 2) / baudrate;
+		uart->BRR = (div & ~0xFUL) | ((div & 0xFUL) >> 1);
+		uart->CR1 = USART_CR1_OVER8;
+	}
+
+	else {
+		uart->BRR = (LOADER_PORT_HCLK_HZ + baudrate / 2) / baudrate;
+	}
+
+	uart->CR1 |= USART_CR1_TE | USART_CR1_RE | USART_CR1_UE;
+}
+
+uint8_t loader_port_read(uint8_t *data)
+{
+	USART_TypeDef *uart = LOADER_PORT_UART;
+
+	if(uart->ISR & (USART_ISR_ORE | USART_ISR_FE | USART_ISR_NE)) {
+		uart->ICR = USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF;
+	}
+
+	if(!(uart->ISR & USART_ISR_RXNE_RXFNE)) return 0;
+
+	*data = (uint8_t)uart->RDR;
+	return 1;
+}
+
+void loader_port_write(const uint8_t *data, uint32_t length)
+{
+	USART_TypeDef *uart = LOADER_PORT_UART;
+
+	while(length--) {
+		while(!(uart->ISR & USART_ISR_TXE_TXFNF));
+		uart->TDR = *data++;
+	}
+
+	while(!(uart->ISR & USART_ISR_TC));
+}
+
+void loader_port_rx_block(uint8_t *buffer, uint32_t length)
+{
+	USART_TypeDef *uart = LOADER_PORT_UART;
+
+	LOADER_PORT_DMA_CHANNEL->CCR   = 0;
+	DMA1->IFCR                     = DMA_IFCR_CGIF1;
+	LOADER_PORT_DMA_CHANNEL->CMAR  = (uint32_t)buffer;
+	LOADER_PORT_DMA_CHANNEL->CNDTR = length;
+	LOADER_PORT_DMA_CHANNEL->CCR   = DMA_CCR_MINC | DMA_CCR_PL_1 | DMA_CCR_EN;
+
+	uart->ICR  = USART_ICR_ORECF;
+	uart->CR3 |= USART_CR3_DMAR;
+}
+
+uint32_t loader_port_rx_left(void)
+{
+	return LOADER_PORT_DMA_CHANNEL->CNDTR;
+}
+
+void loader_port_rx_stop(void)
+{
+	LOADER_PORT_UART->CR3        &= ~USART_CR3_DMAR;
+	LOADER_PORT_DMA_CHANNEL->CCR  = 0;
+	DMA1->IFCR                    = DMA_IFCR_CGIF1;
+}
+
+
+/* ───────────────── Flash ──────────────── */
+
+const uint8_t* loader_port_flash(uint32_t address)
+{
+	return (const uint8_t*)address;
+}
+
+uint8_t loader_port_erase(uint32_t address)
+{
+	__loader_port_flash_unlock();
+	if(!__loader_port_flash_wait()) return 0;
+
+	FLASH->CR  = FLASH_CR_PER | (((address - FLASH_BASE) / FLASH_PAGE_SIZE) << FLASH_CR_PNB_Pos);
+	FLASH->CR |= FLASH_CR_STRT;
+
+	return __loader_port_flash_wait();
+}
+
+uint8_t loader_port_program(uint32_t address, const uint8_t *data, uint32_t length)
+{
+	uint32_t words[2];
+	uint32_t offset;
+
+	__loader_port_flash_unlock();
+	if(!__loader_port_flash_wait()) return 0;
+
+	/* Both words back to back, the second one starts programming */
+	for(offset = 0; offset < length; offset += 8) {
+		memcpy(words, data + offset, sizeof(words));
+
+		FLASH->CR = FLASH_CR_PG;
+		*(__IO uint32_t*)(address + offset    ) = words[0];
+		*(__IO uint32_t*)(address + offset + 4) = words[1];
+
+		if(!__loader_port_flash_wait()) return 0;
+	}
+
+	return 1;
+}
+
+
+/* ───────────────── Boot ───────────────── */
+
+void loader_port_boot(uint32_t address)
+{
+	const uint32_t *vectors = (const uint32_t*)address;
+
+	/* Back to the reset state for the firmware */
+	loader_port_rx_stop();
+	while(!(LOADER_PORT_UART->ISR & USART_ISR_TC));
+
+	RCC->APBRSTR1 =  RCC_APBRSTR1_USART2RST | RCC_APBRSTR1_TIM2RST;
+	RCC->APBRSTR1 =  0;
+	RCC->AHBRSTR  =  RCC_AHBRSTR_DMA1RST | RCC_AHBRSTR_CRCRST;
+	RCC->AHBRSTR  =  0;
+	RCC->IOPRSTR  =  RCC_IOPRSTR_GPIOARST;
+	RCC->IOPRSTR  =  0;
+	RCC->APBENR1 &= ~(RCC_APBENR1_USART2EN | RCC_APBENR1_TIM2EN);
+	RCC->AHBENR  &= ~(RCC_AHBENR_DMA1EN | RCC_AHBENR_CRCEN);
+
+	FLASH->CR     =  FLASH_CR_LOCK;
+	SCB->VTOR     =  address;
+
+	__asm volatile(
+		"msr msp, %0\n"
+		"bx  %1\n"
+		:: "r" (vectors[0]), "r" (vectors[1])
+	);
+
+	while(1);
+}
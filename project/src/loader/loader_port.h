@@ -0,0 +1,45 @@
+/* ┌──────────────────────────────────┐
+   │ Loader hardware interface        │
+   └──────────────────────────────────┘
+   
+    Florian Dupeyron
+    May 2022
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Port interface                         │
+   └────────────────────────────────────────┘ */
+
+/* Implemented with registers for the target (loader/loader_port.c), and
+   over a pseudo-terminal with flash in a file for the host build
+   (host/loader/loader_pty.c). Addresses are target flash addresses. */
+
+/* Host link at LOADER_BAUDRATE, see loader/loader.h */
+void           loader_port_init     (void);
+uint32_t       loader_port_ms       (void);
+
+/* Takes effect after the bytes being sent */
+void           loader_port_baudrate (uint32_t baudrate);
+
+/* Byte mode: returns 1 if a byte was read */
+uint8_t        loader_port_read     (uint8_t *data);
+void           loader_port_write    (const uint8_t *data, uint32_t length);
+
+/* Block mode: length bytes are received into buffer in the background.
+   Bytes left to receive, 0 once complete. */
+void           loader_port_rx_block (uint8_t *buffer, uint32_t length);
+uint32_t       loader_port_rx_left  (void);
+void           loader_port_rx_stop  (void);
+
+/* Flash, by page and double-word. Return 0 on error. */
+const uint8_t* loader_port_flash    (uint32_t address);
+uint8_t        loader_port_erase    (uint32_t address);
+uint8_t        loader_port_program  (uint32_t address, const uint8_t *data, uint32_t length);
+
+/* Starts the image at address: does not return */
+void           loader_port_boot     (uint32_t address);
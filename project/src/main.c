@@ -9,65 +9,210 @@
 #include "main.h"
 
 #include <io/clock.h>
+#include <io/cycles.h>
 #include <io/oneshot_timer.h>
 
 #include <io/gpio.h>
 #include <io/dmx.h>
+#include <io/host_link.h>
+#include <io/watchdog.h>
+#include <io/trigger.h>
+#include <io/timebase.h>
+#include <io/crc.h>
+#include <io/dmx_rx.h>
 
+#include <bench/bench.h>
+
+#include <app/boot.h>
+#include <app/look_store.h>
+#include <app/command.h>
+#include <app/patch.h>
+#include <app/color.h>
+#include <app/effect.h>
+#include <app/beat.h>
+#include <app/recovery.h>
+#include <app/stream.h>
+#include <app/latency.h>
+#include <app/ram_watch.h>
+#include <app/telemetry.h>
+#include <app/analyzer.h>
+
+
+/* ┌────────────────────────────────────────┐
+   │ Universes                              │
+   └────────────────────────────────────────┘ */
+
+/* See bsp/pin_table.h for the universes and host link configuration */
 
 UART_HandleTypeDef huart2;
-struct DMX_Controller dmx_controller = {
+struct DMX_Controller dmx_universes[DMX_NB_UNIVERSES] = {
+	{
+		.uart        = USART1,
+		.timer       = TIM17,
+		.pin_output  = &pin_dmx_out
+	},
+
+#if DMX_NB_UNIVERSES > 1
+	{
+		.uart        = USART2,
+		.timer       = TIM16,
+#if BSP_USE_DMX2_OUT
+		.pin_output  = &pin_dmx2_out
+#endif
+	},
+#endif
+
+#if DMX_NB_UNIVERSES > 2
+	{
+		.uart        = LPUART1,
+		.timer       = TIM14,
+#if BSP_USE_DMX3_OUT
+		.pin_output  = &pin_dmx3_out
+#endif
+	},
+#endif
+};
+
+#if BSP_USE_DMX_IN
+/* Receives on the UART of universe 0 in analyzer mode */
+struct DMX_RX dmx_receiver = {
 	.uart        = USART1,
-	.pin_output  = &pin_dmx_out,
-	.pin_uart_af = GPIO_AF1_USART1
+	.pin_input   = &pin_dmx_in,
+	.input_port  = BSP_PORT_A
 };
+#endif
 
+static void ramfunc_init(void);
 static void MX_USART2_UART_Init(void);
 
 int main(void)
 {
+	/* Before any interrupt: RAMFUNC handlers, RAM watch pattern */
+	ramfunc_init();
+	ram_watch_fill();
+
 	HAL_Init();
+	cycles_init();                                     /* Boot timestamps, see app/boot.h */
 	clock_init();
-	
-	MX_USART2_UART_Init();
+	boot_clock_ready();
 
-	/* GPIO Init */
+	/* GPIO Init, from the pin table */
+	bsp_pins_init();
 
-	gpio_pin_init(pin_led,
-		GPIO_MODE_OUTPUT_PP,
-		GPIO_NOPULL,
-		GPIO_SPEED_FREQ_LOW,
-		0
-	);
+	/* Before the first CRC: look restore, benchmark */
+	crc_init();
 
-	gpio_pin_init(pin_nrst,
-		GPIO_MODE_IT_RISING,
-		GPIO_NOPULL,
-		0,
-		0
-	);
+#if defined(CONFIG_BENCH)
+	/* USART2 is used as an universe during the benchmark,
+	   the host link is brought up once it is done. */
+	bench_run(dmx_universes, DMX_NB_UNIVERSES);
 
-	/* DMX init */
+	/* Repeated, so that a capture can be started at any time */
+	MX_USART2_UART_Init();
+	while(1) {
+		bench_report(&huart2);
+		HAL_Delay(5000);
+	}
+#endif
+
+	/* DMX init, the last look is restored before the first frame */
 	
-	dmx_controller_init (&dmx_controller);
+	for(int i = 0; i < DMX_NB_UNIVERSES; i++) {
+		dmx_controller_init(&dmx_universes[i]);
+	}
+
+	/* After a fault, the output restarts as it was instead */
+	boot_stats.warm_restart = recovery_restore(dmx_universes, DMX_NB_UNIVERSES);
+	if(!boot_stats.warm_restart) {
+		patch_apply_defaults(dmx_universes);
+		boot_stats.look_restored = look_store_restore(dmx_universes, DMX_NB_UNIVERSES);
+	}
 
 	/* Let's go! */
 	
-	//dmx_controller_start(&dmx_controller);
+	for(int i = 0; i < DMX_NB_UNIVERSES; i++) {
+		dmx_controller_start(&dmx_universes[i]);
+	}
+
+	boot_dmx_started();
+
+	/* Everything not needed for the first frame is brought up after */
+
+	watchdog_init();
+	ram_watch_init();
+	telemetry_init(dmx_universes, DMX_NB_UNIVERSES);
+
+#if DMX_HAS_HOST_LINK
+	MX_USART2_UART_Init();
+	host_link_init(&huart2);
+	color_init    (dmx_universes);
+	effect_init   (dmx_universes, DMX_NB_UNIVERSES);
+	beat_init     (dmx_universes, DMX_NB_UNIVERSES);
+	command_init  (dmx_universes, DMX_NB_UNIVERSES);
+	latency_init  (dmx_universes, DMX_NB_UNIVERSES);
+#endif
+
+#if BSP_USE_DMX_IN
+	analyzer_init (&dmx_universes[0], &dmx_receiver);
+#endif
+
+	uint32_t led_tick   = HAL_GetTick();
+	uint32_t led_period = 250;
+	uint8_t  led_state  = 0;
 
 	while(1) {
-		gpio_pin_write(pin_led, 1);
-		HAL_Delay(250);
-		gpio_pin_write(pin_led, 0);
-		HAL_Delay(250);
+		/* Faster blinking once the stack came close to the heap */
+		led_period = ram_watch_stats.alarm ? 62 : 250;
+
+		if((HAL_GetTick() - led_tick) >= led_period) {
+			led_tick  += led_period;
+			led_state  = !led_state;
+			pin_led_write(led_state);
+		}
+
+		recovery_poll  ();
+		ram_watch_poll ();
+		telemetry_poll ();
+		boot_poll      (&dmx_universes[0]);
+		look_store_poll(dmx_universes, DMX_NB_UNIVERSES);
+
+#if DMX_HAS_HOST_LINK
+		command_poll   ();
+		beat_poll      ();
+		color_poll     ();
+		effect_poll    ();
+#if defined(CONFIG_STREAM)
+		stream_poll    ();
+#endif
+		latency_poll   ();
+#endif
+
+#if BSP_USE_DMX_IN
+		analyzer_poll  ();
+#endif
 	};
 }
 
+/* The linked startup code only copies .data: the RAM resident code
+   (RAMFUNC in main.h) is copied here, from flash. */
+
+static void ramfunc_init(void)
+{
+	extern uint32_t _siramfunc[], _sramfunc[], _eramfunc[]; /* From linker script */
+
+	const uint32_t *src = _siramfunc;
+	uint32_t       *dst = _sramfunc;
+
+	while(dst < _eramfunc) {
+		*dst++ = *src++;
+	}
+}
+
 static void MX_USART2_UART_Init(void)
 {
 	huart2.Instance = USART2;
-	huart2.Init.BaudRate = 115200;
-	huart2.Init.WordLength = UART_WORDLENGTH_7B;
+	huart2.Init.BaudRate = HOST_LINK_BAUDRATE;
+	huart2.Init.WordLength = UART_WORDLENGTH_8B;
 	huart2.Init.StopBits = UART_STOPBITS_1;
 	huart2.Init.Parity = UART_PARITY_NONE;
 	huart2.Init.Mode = UART_MODE_TX_RX;
@@ -84,14 +229,8 @@ static void MX_USART2_UART_Init(void)
 
 void Error_Handler(void)
 {
-	__disable_irq();
-	while (1)
-	{
-		HAL_Delay(1000);
-		gpio_pin_write(pin_led, 1);
-		HAL_Delay(1000);
-		gpio_pin_write(pin_led, 0);
-	}
+	/* Warm restart, see app/recovery.h */
+	recovery_fault(RECOVERY_CAUSE_ERROR, (uint32_t)__builtin_return_address(0), 0);
 }
 
 #ifdef  USE_FULL_ASSERT
@@ -103,10 +242,98 @@ void assert_failed(uint8_t *file, uint32_t line)
 
 /* Various interrupts */
 
-void USART1_IRQHandler(void)
+RAMFUNC void USART1_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+#if BSP_USE_DMX_IN
+	if(dmx_rx_is_running(&dmx_receiver)) dmx_rx_irq_handler(&dmx_receiver);
+	else
+#endif
+	dmx_controller_irq_handler(&dmx_universes[0]);
+	CYCLES_ISR_EXIT();
+}
+
+RAMFUNC void TIM17_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	dmx_controller_timer_irq_handler(&dmx_universes[0]);
+	CYCLES_ISR_EXIT();
+}
+
+void TIM3_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	timebase_irq_handler();
+	CYCLES_ISR_EXIT();
+}
+
+#if DMX_HAS_HOST_LINK
+void USART2_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	host_link_irq_handler();
+	CYCLES_ISR_EXIT();
+}
+
+void DMA1_Channel1_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	host_link_dma_irq_handler();
+	CYCLES_ISR_EXIT();
+}
+
+RAMFUNC void EXTI2_3_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	trigger_exti_irq_handler();
+	CYCLES_ISR_EXIT();
+}
+
+void TIM1_BRK_UP_TRG_COM_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	trigger_timer_irq_handler();
+	CYCLES_ISR_EXIT();
+}
+#endif
+
+#if BSP_USE_DMX_IN
+RAMFUNC void EXTI4_15_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	dmx_rx_exti_irq_handler(&dmx_receiver);
+	CYCLES_ISR_EXIT();
+}
+#endif
+
+#if DMX_NB_UNIVERSES > 1
+RAMFUNC void USART2_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	dmx_controller_irq_handler(&dmx_universes[1]);
+	CYCLES_ISR_EXIT();
+}
+
+RAMFUNC void TIM16_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	dmx_controller_timer_irq_handler(&dmx_universes[1]);
+	CYCLES_ISR_EXIT();
+}
+#endif
+
+#if DMX_NB_UNIVERSES > 2
+RAMFUNC void LPUART1_IRQHandler(void)
+{
+	CYCLES_ISR_ENTER();
+	dmx_controller_irq_handler(&dmx_universes[2]);
+	CYCLES_ISR_EXIT();
+}
+
+RAMFUNC void TIM14_IRQHandler(void)
 {
-	//static uint8_t state;
-	////gpio_pin_write(pin_led, state);
-	//state = 1 - state;
-	dmx_controller_irq_handler(&dmx_controller);
+	CYCLES_ISR_ENTER();
+	dmx_controller_timer_irq_handler(&dmx_universes[2]);
+	CYCLES_ISR_EXIT();
 }
+#endif
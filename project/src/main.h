@@ -45,12 +45,22 @@ extern "C" {
 
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
-
+/* Hot paths copied to SRAM at the start of main (.ramfunc in the linker
+   script): no flash wait states. Calls to flash go through linker veneers. */
+#if defined(CONFIG_RAMFUNC)
+#define RAMFUNC __attribute__ ((section(".ramfunc")))
+#else
+#define RAMFUNC
+#endif
 /* USER CODE END EM */
 
 /* Exported functions prototypes ---------------------------------------------*/
 void Error_Handler(void);
 
+/* USER CODE BEGIN EV */
+extern UART_HandleTypeDef huart2; /* Host link */
+/* USER CODE END EV */
+
 /* USER CODE BEGIN EFP */
 
 /* USER CODE END EFP */
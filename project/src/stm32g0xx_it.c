@@ -81,17 +81,24 @@ void NMI_Handler(void)
 /**
   * @brief This function handles Hard fault interrupt.
   */
-void HardFault_Handler(void)
+__attribute__ ((naked)) void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
- Error_Handler();
-
+  /* Exception frame from the stack in use, see app/recovery.h */
+  __asm volatile(
+    "movs r0, #4                  \n"
+    "mov  r1, lr                  \n"
+    "tst  r0, r1                  \n"
+    "beq  1f                      \n"
+    "mrs  r0, psp                 \n"
+    "b    2f                      \n"
+    "1:                           \n"
+    "mrs  r0, msp                 \n"
+    "2:                           \n"
+    "ldr  r2, =recovery_hardfault \n"
+    "bx   r2                      \n"
+  );
   /* USER CODE END HardFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_HardFault_IRQn 0 */
-    /* USER CODE END W1_HardFault_IRQn 0 */
-  }
 }
 
 /**
@@ -126,7 +133,7 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
-
+  /* Not enabled: the HAL tick comes from TIM3, see io/timebase.h */
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+# ┌────────────────────────────────────────────────┐
+# │ Record the DMX line of a third-party console   │
+# └────────────────────────────────────────────────┘
+#
+#  Florian Dupeyron
+#  May 2022
+#
+# Starts the analyzer mode of a CONFIG_ANALYZER firmware (see
+# project/src/app/analyzer.h): universe 0 stops sending and its UART
+# receives the console on the dmx_in pin. Each received frame comes as a
+# record over the host link, at --baudrate once started; the line
+# statistics are polled every period, which keeps the mode running.
+# Records are printed when flagged (all of them with --all), and can be
+# saved as CSV.
+#
+#   ./scripts/analyzer.py /dev/ttyUSB0
+#   ./scripts/analyzer.py /dev/ttyUSB0 --csv frames.csv --slots 1:24
+#
+# Exits with 1 if the analyzer does not start or stops answering, or if
+# records were lost.
+
+import argparse
+import csv
+import struct
+import sys
+import time
+
+
+COMMAND_SYNC           = 0xA5
+COMMAND_RESPONSE       = 0x80
+COMMAND_ANALYZER_STATS = 0x1A
+COMMAND_ANALYZER_SLOTS = 0x1B
+COMMAND_ANALYZER_FRAME = 0x1C
+COMMAND_ANALYZER_START = 0x2D
+COMMAND_ANALYZER_STOP  = 0x2E
+
+STATUS_OK              = 0
+STATUS_BUSY            = 3
+
+HOST_LINK_BAUDRATE     = 115200
+
+# Answers and records after the status byte, times in ns
+STATS_FIELDS           = ("frames", "refresh_mhz", "interval_min", "interval_max", "break_min", "break_max",
+                          "mab_min", "mab_max", "slots_min", "slots_max", "null_frames", "alternate_frames",
+                          "alternate_last", "short_breaks", "short_mabs", "framing", "noise", "overruns",
+                          "oversize", "estimated", "lost")
+STATS_LAYOUT           = struct.Struct("<8I2H2IB8H")
+
+RECORD_FIELDS          = ("sequence", "interval", "break", "mab", "gap_max", "length", "slots",
+                          "start_code", "flags")
+RECORD_LAYOUT          = struct.Struct("<6IHBB")
+
+SLOTS_LAYOUT           = struct.Struct("<IBH")
+
+# DMX_RX_FLAG_x of io/dmx_rx.h
+FLAGS                  = ((0x01, "short_break"), (0x02, "short_mab"), (0x04, "framing"), (0x08, "noise"),
+                          (0x10, "overrun"), (0x20, "oversize"), (0x40, "estimated"), (0x80, "empty"))
+FLAG_ESTIMATED         = 0x40
+
+START_TIMEOUT          = 0.5     # Universe 0 ends its frame first
+ANSWER_TIMEOUT         = 0.5
+
+
+# ┌────────────────────────────────────────┐
+# │ Protocol                               │
+# └────────────────────────────────────────┘
+
+def frame(cmd, payload=b""):
+    body = bytes([cmd, len(payload)]) + bytes(payload)
+    return bytes([COMMAND_SYNC]) + body + bytes([-sum(body) & 0xFF])
+
+
+class Link:
+    """Answers and records come interleaved: frames are parsed as a stream"""
+
+    def __init__(self, ser):
+        self.ser    = ser
+        self.buffer = bytearray()
+
+    def frames(self):
+        """Yields the complete frames received so far as (id, status, payload)"""
+
+        self.buffer += self.ser.read(max(1, self.ser.in_waiting))
+
+        while True:
+            start = self.buffer.find(COMMAND_SYNC)
+            if start < 0:
+                self.buffer.clear()
+                return
+
+            del self.buffer[:start]
+            if len(self.buffer) < 3 or len(self.buffer) < self.buffer[2] + 4:
+                return
+
+            length = self.buffer[2]
+            data   = bytes(self.buffer[1:length + 4])
+
+            # Resynchronizes on the next sync byte
+            if sum(data) & 0xFF or length == 0:
+                del self.buffer[:1]
+                continue
+
+            del self.buffer[:length + 4]
+            yield data[0], data[2], data[3:-1]
+
+    def request(self, cmd, payload=b"", records=None, timeout=ANSWER_TIMEOUT):
+        """Returns (status, payload) of the answer, or None. Records received
+           meanwhile are passed to records."""
+
+        self.ser.write(frame(cmd, payload))
+        deadline = time.monotonic() + timeout
+
+        while time.monotonic() < deadline:
+            for ident, status, data in self.frames():
+                if ident == (cmd | COMMAND_RESPONSE):
+                    return status, data
+                if ident == (COMMAND_ANALYZER_FRAME | COMMAND_RESPONSE) and records:
+                    records(data)
+
+        return None
+
+
+def stats(link, records):
+    answer = link.request(COMMAND_ANALYZER_STATS, [0], records)
+    if answer is None or answer[0] != STATUS_OK or len(answer[1]) < STATS_LAYOUT.size:
+        return None
+
+    return dict(zip(STATS_FIELDS, STATS_LAYOUT.unpack_from(answer[1])))
+
+
+def capture(link, first, count, records, timeout=1.0):
+    """Slots first to first + count - 1 (0 based) of one frame, as (sequence, start code, values)"""
+
+    payload = struct.pack("<BHB", 1, first, count)
+    answer  = link.request(COMMAND_ANALYZER_SLOTS, payload, records)
+    if answer is None or answer[0] != STATUS_BUSY:
+        return None
+
+    deadline = time.monotonic() + timeout
+    payload  = struct.pack("<BHB", 0, first, count)
+
+    while time.monotonic() < deadline:
+        answer = link.request(COMMAND_ANALYZER_SLOTS, payload, records)
+        if answer is None or answer[0] not in (STATUS_OK, STATUS_BUSY):
+            return None
+
+        if answer[0] == STATUS_OK:
+            sequence, start_code, _ = SLOTS_LAYOUT.unpack_from(answer[1])
+            return sequence, start_code, answer[1][SLOTS_LAYOUT.size:]
+
+    return None
+
+
+# ┌────────────────────────────────────────┐
+# │ Output                                 │
+# └────────────────────────────────────────┘
+
+def flag_names(flags):
+    return ",".join(name for bit, name in FLAGS if flags & bit) or "-"
+
+
+def show_record(record):
+    print("#{:<8} interval {:>9.2f}us break {:>7.2f}us mab {:>6.2f}us slots {:>3} sc 0x{:02X} "
+          "gap {:>6.2f}us {}".format(
+              record["sequence"], record["interval"] / 1e3, record["break"] / 1e3, record["mab"] / 1e3,
+              record["slots"], record["start_code"], record["gap_max"] / 1e3, flag_names(record["flags"])))
+
+
+def show_stats(sample):
+    print("{:>8} frames {:>7.2f}Hz interval {:.1f}-{:.1f}us break {:.1f}-{:.1f}us mab {:.1f}-{:.1f}us "
+          "slots {}-{} alt {} errors sb {} sm {} fe {} ne {} ore {} big {} est {} lost {}".format(
+              sample["frames"], sample["refresh_mhz"] / 1000.0,
+              sample["interval_min"] / 1e3, sample["interval_max"] / 1e3,
+              sample["break_min"] / 1e3, sample["break_max"] / 1e3,
+              sample["mab_min"] / 1e3, sample["mab_max"] / 1e3,
+              sample["slots_min"], sample["slots_max"], sample["alternate_frames"],
+              sample["short_breaks"], sample["short_mabs"], sample["framing"], sample["noise"],
+              sample["overruns"], sample["oversize"], sample["estimated"], sample["lost"]))
+
+
+# ┌────────────────────────────────────────┐
+# │ Main                                   │
+# └────────────────────────────────────────┘
+
+def main():
+    parser = argparse.ArgumentParser(description="Record the DMX line of a third-party console")
+    parser.add_argument("serial",                                 help="Host link port")
+    parser.add_argument("--baudrate", type=int, default=1000000,  help="Host link baud rate while recording")
+    parser.add_argument("--period"  , type=float, default=1.0,    help="Statistics period in seconds")
+    parser.add_argument("--duration", type=float, default=0.0,    help="Seconds before stopping, 0 for no limit")
+    parser.add_argument("--all"     , action="store_true",        help="Print every record, not only flagged ones")
+    parser.add_argument("--slots",                                help="Print slots FIRST:COUNT (1 based) of one frame")
+    parser.add_argument("--csv",                                  help="Save the records to this file")
+    args = parser.parse_args()
+
+    import serial  # pyserial
+
+    status = 0
+    writer = None
+    last   = [None]
+
+    def records(data):
+        if len(data) < RECORD_LAYOUT.size:
+            return
+
+        record = dict(zip(RECORD_FIELDS, RECORD_LAYOUT.unpack_from(data)))
+
+        # Sequence gaps: records lost by the firmware, or frames by the link
+        if last[0] is not None and record["sequence"] != last[0] + 1:
+            print("{} records missing".format(record["sequence"] - last[0] - 1), file=sys.stderr)
+        last[0] = record["sequence"]
+
+        if args.all or (record["flags"] & ~FLAG_ESTIMATED):
+            show_record(record)
+        if writer:
+            writer.writerow(record)
+
+    with serial.Serial(args.serial, HOST_LINK_BAUDRATE, timeout=0.05) as ser:
+        link = Link(ser)
+
+        answer = link.request(COMMAND_ANALYZER_START, struct.pack("<I", args.baudrate), timeout=START_TIMEOUT)
+        if answer is None or answer[0] != STATUS_OK:
+            print("analyzer not started: {}".format("no answer" if answer is None else "status {}".format(answer[0])),
+                  file=sys.stderr)
+            return 1
+
+        # The firmware switches once the answer is sent
+        ser.flush()
+        ser.baudrate = args.baudrate
+        time.sleep(0.005)
+        ser.reset_input_buffer()
+
+        if args.csv:
+            fhandle = open(args.csv, "w", newline="")
+            writer  = csv.DictWriter(fhandle, fieldnames=RECORD_FIELDS)
+            writer.writeheader()
+
+        start = time.monotonic()
+
+        try:
+            if args.slots:
+                first, count = (int(value) for value in args.slots.split(":"))
+                slots = capture(link, first - 1, count, records)
+                if slots is None:
+                    print("no slots captured", file=sys.stderr)
+                    status = 1
+                else:
+                    print("frame {} start code 0x{:02X}: {}".format(slots[0], slots[1], " ".join(str(v) for v in slots[2])))
+
+            while not args.duration or time.monotonic() - start < args.duration:
+                poll = time.monotonic()
+
+                while time.monotonic() - poll < args.period:
+                    for ident, _, data in link.frames():
+                        if ident == (COMMAND_ANALYZER_FRAME | COMMAND_RESPONSE):
+                            records(data)
+
+                sample = stats(link, records)
+                if sample is None:
+                    print("No answer", file=sys.stderr)
+                    status = 1
+                    break
+
+                show_stats(sample)
+                if sample["lost"]:
+                    status = 1
+
+        except KeyboardInterrupt:
+            pass
+
+        finally:
+            link.request(COMMAND_ANALYZER_STOP, records=records)
+            ser.flush()
+            ser.baudrate = HOST_LINK_BAUDRATE
+
+            if writer:
+                fhandle.close()
+
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+# ┌────────────────────────────────────────────────┐
+# │ Compare on-target benchmark runs               │
+# └────────────────────────────────────────────────┘
+#
+#  Florian Dupeyron
+#  May 2022
+#
+# Parses the "bench <workload> key=value..." lines printed by the
+# CONFIG_BENCH firmware (see project/src/bench/bench.c), from a serial
+# capture or a previously saved JSON run, and compares them with a
+# baseline run. All results are in cycles, lower is better.
+#
+#   ./scripts/bench_compare.py --serial /dev/ttyUSB0 --save runs/new.json
+#   ./scripts/bench_compare.py runs/new.json runs/baseline.json
+#
+# Exits with 1 if a result is worse than the baseline by more than the
+# threshold, 2 if no complete report is found.
+
+import argparse
+import json
+import re
+import sys
+import time
+
+
+# Fields identifying a result, the others are measurements
+ID_FIELDS   = ("clock_mhz", "universes", "active_slots", "channels", "bytes", "delay_us", "iterations")
+
+# Measurements not compared: they depend on the workload, not on the code speed
+INFO_FIELDS = ("isr_count",)
+
+LINE_RE     = re.compile(r"^bench (\w+)((?: \w+=\d+)*)\s*$")
+
+
+# ┌────────────────────────────────────────┐
+# │ Parsing                                │
+# └────────────────────────────────────────┘
+
+def parse_lines(lines):
+    """Returns the results of the last complete report, as a dict of
+    "workload key=value..." to {field: value}, or None."""
+
+    report = None
+    last   = None
+
+    for line in lines:
+        match = LINE_RE.match(line.strip())
+        if not match:
+            continue
+
+        name   = match.group(1)
+        fields = dict(
+            (key, int(value)) for key, value in
+            (field.split("=") for field in match.group(2).split())
+        )
+
+        if name == "begin":
+            report = {}
+
+        elif name == "end":
+            if report is not None:
+                last = report
+            report = None
+
+        elif report is not None:
+            ident = " ".join([name] + ["{}={}".format(key, fields[key]) for key in ID_FIELDS if key in fields])
+            report[ident] = dict((key, value) for key, value in fields.items() if key not in ID_FIELDS)
+
+    return last
+
+
+def load(path):
+    with open(path, "r", errors="replace") as fhandle:
+        text = fhandle.read()
+
+    # Saved run
+    if text.lstrip().startswith("{"):
+        return json.loads(text)["results"]
+
+    return parse_lines(text.splitlines())
+
+
+def capture(port, baudrate, timeout):
+    import serial  # pyserial, only needed for captures
+
+    lines    = []
+    deadline = time.monotonic() + timeout
+
+    with serial.Serial(port, baudrate, timeout=1) as ser:
+        while time.monotonic() < deadline:
+            line = ser.readline().decode("ascii", errors="replace")
+            lines.append(line)
+
+            # Wait for a report started after the capture
+            if line.startswith("bench end") and any(l.startswith("bench begin") for l in lines):
+                break
+
+    return parse_lines(lines)
+
+
+# ┌────────────────────────────────────────┐
+# │ Comparison                             │
+# └────────────────────────────────────────┘
+
+def compare(current, baseline, threshold_pct):
+    regressions = 0
+
+    print("{:<50} {:<16} {:>10} {:>10} {:>8}".format("result", "field", "baseline", "current", "delta"))
+
+    for ident in sorted(set(current) | set(baseline)):
+        cur = current .get(ident)
+        ref = baseline.get(ident)
+
+        if cur is None or ref is None:
+            print("{:<50} {}".format(ident, "missing in current" if cur is None else "new"))
+            continue
+
+        for key in sorted(set(cur) & set(ref)):
+            old   = ref[key]
+            new   = cur[key]
+            delta = ((new - old) * 100.0 / old) if old else (0.0 if new == old else float("inf"))
+
+            flag = ""
+            if key not in INFO_FIELDS:
+                if delta > threshold_pct:
+                    flag = "  REGRESSION"
+                    regressions += 1
+                elif delta < -threshold_pct:
+                    flag = "  improved"
+
+            print("{:<50} {:<16} {:>10} {:>10} {:>+7.1f}%{}".format(ident, key, old, new, delta, flag))
+
+    return regressions
+
+
+def show(results):
+    for ident in sorted(results):
+        fields = " ".join("{}={}".format(key, value) for key, value in sorted(results[ident].items()))
+        print("{:<50} {}".format(ident, fields))
+
+
+# ┌────────────────────────────────────────┐
+# │ Main                                   │
+# └────────────────────────────────────────┘
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare on-target benchmark runs")
+    parser.add_argument("current" , nargs="?",             help="Capture log or saved JSON run")
+    parser.add_argument("baseline", nargs="?",             help="Run to compare with")
+    parser.add_argument("--serial",                        help="Capture the current run from this port")
+    parser.add_argument("--baudrate", type=int, default=115200)
+    parser.add_argument("--timeout" , type=float, default=60.0, help="Capture timeout in seconds")
+    parser.add_argument("--save",                          help="Save the current run as JSON")
+    parser.add_argument("--label", default="",             help="Free text saved with the run")
+    parser.add_argument("--threshold", type=float, default=5.0, help="Regression threshold in percent")
+    args = parser.parse_args()
+
+    if args.serial:
+        # With a capture, the only positional argument is the baseline
+        if args.baseline is None:
+            args.baseline, args.current = args.current, None
+        current = capture(args.serial, args.baudrate, args.timeout)
+
+    elif args.current:
+        current = load(args.current)
+
+    else:
+        parser.error("a capture file or --serial is needed")
+
+    if not current:
+        print("No complete benchmark report found", file=sys.stderr)
+        return 2
+
+    if args.save:
+        with open(args.save, "w") as fhandle:
+            json.dump({"date": time.strftime("%Y-%m-%d %H:%M:%S"), "label": args.label, "results": current},
+                      fhandle, indent=1, sort_keys=True)
+
+    if not args.baseline:
+        show(current)
+        return 0
+
+    baseline = load(args.baseline)
+    if not baseline:
+        print("No complete benchmark report in baseline", file=sys.stderr)
+        return 2
+
+    regressions = compare(current, baseline, args.threshold)
+    if regressions:
+        print("{} result(s) worse by more than {}%".format(regressions, args.threshold))
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+# ┌────────────────────────────────────────────────┐
+# │ Update the firmware through the serial loader  │
+# └────────────────────────────────────────────────┘
+#
+#  Florian Dupeyron
+#  May 2022
+#
+# Sends a firmware binary, linked for slot A (CONFIG_LOADER), to the
+# loader of project/src/loader over the host link. A running firmware is
+# first asked to restart into the loader. The image is checked by the
+# loader before it replaces the current one (see loader/loader.h).
+#
+#   ./scripts/loader.py /dev/ttyUSB0 stm32-template.bin
+#   ./scripts/loader.py /dev/ttyUSB0 --info
+#
+# Exits with 1 if the update failed: the previous firmware is kept.
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+
+COMMAND_SYNC         = 0xA5
+COMMAND_RESPONSE     = 0x80
+COMMAND_LOADER_ENTER = 0x03
+
+LOADER_INFO          = 0x40
+LOADER_BEGIN         = 0x41
+LOADER_PAGE          = 0x42
+LOADER_END           = 0x43
+LOADER_BOOT          = 0x44
+
+LOADER_BAUDRATE      = 115200
+DESCRIPTOR_SIZE      = 16
+
+STATUSES             = {0: "ok", 1: "unknown", 2: "invalid", 4: "flash", 5: "timeout"}
+
+# Info answer after the status byte
+INFO_LAYOUT          = struct.Struct("<II" + "BIII" * 2)
+
+BEGIN_TIMEOUT        = 3.0      # Slot B erase
+PAGE_TIMEOUT         = 1.0
+END_TIMEOUT          = 2.0      # Loader block timeout, then the check
+
+
+class LoaderError(Exception):
+    pass
+
+
+# ┌────────────────────────────────────────┐
+# │ Protocol                               │
+# └────────────────────────────────────────┘
+
+def frame(cmd, payload):
+    body = bytes([cmd, len(payload)]) + bytes(payload)
+    return bytes([COMMAND_SYNC]) + body + bytes([-sum(body) & 0xFF])
+
+
+def receive(ser, timeout):
+    """Returns the next valid frame as (id, status, payload), or None"""
+
+    deadline = time.monotonic() + timeout
+
+    while time.monotonic() < deadline:
+        sync = ser.read(1)
+        if not sync or sync[0] != COMMAND_SYNC:
+            continue
+
+        head = ser.read(2)
+        if len(head) < 2:
+            continue
+
+        rest = ser.read(head[1] + 1)
+        if len(rest) < head[1] + 1 or (sum(head) + sum(rest)) & 0xFF or head[1] == 0:
+            continue
+
+        return head[0], rest[0], rest[1:-1]
+
+    return None
+
+
+def request(ser, cmd, payload=b"", timeout=0.5):
+    """Returns (status, payload) of the answer, or None"""
+
+    ser.reset_input_buffer()
+    ser.write(frame(cmd, payload))
+
+    answer = receive(ser, timeout)
+    if answer is None or answer[0] != (cmd | COMMAND_RESPONSE):
+        return None
+
+    return answer[1:]
+
+
+def info(ser):
+    answer = request(ser, LOADER_INFO)
+    if answer is None or answer[0] != 0 or len(answer[1]) < INFO_LAYOUT.size:
+        return None
+
+    fields = INFO_LAYOUT.unpack_from(answer[1])
+    return {
+        "page_size": fields[0],
+        "slot_size": fields[1],
+        "slots"    : [dict(zip(("valid", "length", "crc", "version"), fields[i:i + 4])) for i in (2, 6)],
+    }
+
+
+def enter(ser, retries=10):
+    """Info of the loader, after restarting the firmware into it if needed"""
+
+    loader = info(ser)
+    if loader:
+        return loader
+
+    request(ser, COMMAND_LOADER_ENTER)
+
+    for _ in range(retries):
+        time.sleep(0.1)
+        loader = info(ser)
+        if loader:
+            return loader
+
+    raise LoaderError("no answer from the loader")
+
+
+# ┌────────────────────────────────────────┐
+# │ Update                                 │
+# └────────────────────────────────────────┘
+
+def check(answer, what):
+    if answer is None:
+        raise LoaderError("no answer to {}".format(what))
+
+    status = answer[0]
+    if status != 0:
+        raise LoaderError("{} failed: {}".format(what, STATUSES.get(status, status)))
+
+
+def update(ser, loader, image, version, baudrate, stop_after):
+    page_size = loader["page_size"]
+    nb_pages  = (len(image) + page_size - 1) // page_size
+    crc       = zlib.crc32(image)
+
+    if len(image) > loader["slot_size"] - DESCRIPTOR_SIZE:
+        raise LoaderError("image of {} bytes, slot holds {}".format(len(image), loader["slot_size"] - DESCRIPTOR_SIZE))
+
+    start = time.monotonic()
+    check(request(ser, LOADER_BEGIN, struct.pack("<IIII", len(image), crc, version, baudrate), BEGIN_TIMEOUT), "begin")
+    erased = time.monotonic()
+
+    # The loader switches once the answer is sent
+    ser.flush()
+    ser.baudrate = baudrate
+    time.sleep(0.005)
+
+    padded = image + b"\xFF" * (nb_pages * page_size - len(image))
+
+    try:
+        for i_page in range(nb_pages):
+            if stop_after is not None and i_page >= stop_after:
+                break
+
+            data = padded[i_page * page_size:(i_page + 1) * page_size]
+            ser.write(struct.pack("<HH", i_page, 0) + data + struct.pack("<I", zlib.crc32(data)))
+
+            # The next block can go as soon as this one is received
+            answer = receive(ser, PAGE_TIMEOUT)
+            if answer is None:
+                raise LoaderError("no answer to page {}".format(i_page))
+            if answer[0] == (LOADER_END | COMMAND_RESPONSE):
+                check(answer[1:], "page {}".format(i_page))
+            if answer[0] != (LOADER_PAGE | COMMAND_RESPONSE):
+                raise LoaderError("unexpected answer to page {}".format(i_page))
+
+        answer = receive(ser, END_TIMEOUT)
+        if answer is None or answer[0] != (LOADER_END | COMMAND_RESPONSE):
+            raise LoaderError("no end of update")
+        check(answer[1:], "update")
+
+    finally:
+        ser.flush()
+        ser.baudrate = LOADER_BAUDRATE
+
+    end = time.monotonic()
+    print("{} bytes in {} pages, crc 0x{:08X}, version {}".format(len(image), nb_pages, crc, version))
+    print("erase {:.3f}s, transfer {:.3f}s ({:.1f} kB/s)".format(
+        erased - start, end - erased, len(padded) / 1024.0 / max(end - erased, 1e-6)))
+
+
+# ┌────────────────────────────────────────┐
+# │ Main                                   │
+# └────────────────────────────────────────┘
+
+def show(loader):
+    print("page {} bytes, slot {} bytes".format(loader["page_size"], loader["slot_size"]))
+    for name, slot in zip("AB", loader["slots"]):
+        if slot["valid"]:
+            print("slot {}: {} bytes, crc 0x{:08X}, version {}".format(name, slot["length"], slot["crc"], slot["version"]))
+        else:
+            print("slot {}: empty".format(name))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Update the firmware through the serial loader")
+    parser.add_argument("serial",                              help="Host link port")
+    parser.add_argument("image"     , nargs="?",               help="Firmware binary linked for slot A")
+    parser.add_argument("--baudrate", type=int, default=1000000, help="Baud rate of the page blocks")
+    parser.add_argument("--version" , type=int,                help="Image version, the file time by default")
+    parser.add_argument("--info"    , action="store_true",     help="Show the slots and stay in the loader")
+    parser.add_argument("--no-boot" , action="store_true",     help="Stay in the loader after the update")
+    parser.add_argument("--stop-after", type=int,              help="Stop after this many pages, to try a failed update")
+    args = parser.parse_args()
+
+    if not args.info and not args.image:
+        parser.error("an image is needed")
+
+    import serial  # pyserial
+
+    status = 0
+
+    with serial.Serial(args.serial, LOADER_BAUDRATE, timeout=0.1) as ser:
+        try:
+            loader = enter(ser)
+
+        except LoaderError as error:
+            print(error, file=sys.stderr)
+            return 1
+
+        if args.info:
+            show(loader)
+            return 0
+
+        with open(args.image, "rb") as fhandle:
+            image = fhandle.read()
+
+        version = args.version if args.version is not None else int(os.path.getmtime(args.image))
+
+        try:
+            update(ser, loader, image, version, args.baudrate, args.stop_after)
+
+        except LoaderError as error:
+            print(error, file=sys.stderr)
+            status = 1
+
+        # After a failure, the loader starts the previous firmware
+        if not args.no_boot:
+            request(ser, LOADER_BOOT)
+
+    return status
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+# ┌────────────────────────────────────────────────┐
+# │ Poll and graph the controller telemetry        │
+# └────────────────────────────────────────────────┘
+#
+#  Florian Dupeyron
+#  May 2022
+#
+# Sends the TELEMETRY command (see project/src/app/command.h) over the
+# host link every period, prints one line per answer, and optionally
+# saves them as CSV or graphs them live (needs matplotlib).
+#
+#   ./scripts/telemetry.py /dev/ttyUSB0
+#   ./scripts/telemetry.py /dev/ttyUSB0 --csv health.csv --plot
+#
+# Exits with 1 if the controller stops answering, or raises the RAM alarm.
+
+import argparse
+import collections
+import csv
+import struct
+import sys
+import time
+
+
+COMMAND_SYNC      = 0xA5
+COMMAND_RESPONSE  = 0x80
+COMMAND_TELEMETRY = 0x18
+
+# Answer after the status byte
+FIELDS            = ("universes", "uptime_ms", "frames", "frame_rate_mhz", "uart_irqs", "timer_irqs",
+                     "uart_errors", "host_overruns", "host_errors", "host_dropped", "isr_max_ns",
+                     "loop_max_us", "load_permille", "ram_free_min", "ram_alarm")
+LAYOUT            = struct.Struct("<B" + "I" * 13 + "B")
+
+# Graphed fields, with their scale to the displayed unit
+GRAPHS            = (("frame_rate_mhz", 1e-3, "frames/s"),
+                     ("load_permille" , 1e-1, "CPU load %"),
+                     ("isr_max_ns"    , 1e-3, "longest ISR us"),
+                     ("loop_max_us"   , 1.0 , "longest loop us"))
+
+HISTORY           = 300
+
+
+# ┌────────────────────────────────────────┐
+# │ Protocol                               │
+# └────────────────────────────────────────┘
+
+def frame(cmd, payload):
+    body = bytes([cmd, len(payload)]) + bytes(payload)
+    return bytes([COMMAND_SYNC]) + body + bytes([-sum(body) & 0xFF])
+
+
+def request(ser, cmd, payload):
+    """Returns the answer payload after the status byte, or None"""
+
+    ser.reset_input_buffer()
+    ser.write(frame(cmd, payload))
+
+    # Skips anything before the sync byte
+    while True:
+        sync = ser.read(1)
+        if not sync:
+            return None
+        if sync[0] == COMMAND_SYNC:
+            break
+
+    head = ser.read(2)
+    if len(head) < 2 or head[0] != (cmd | COMMAND_RESPONSE):
+        return None
+
+    rest = ser.read(head[1] + 1)
+    if len(rest) < head[1] + 1 or (sum(head) + sum(rest)) & 0xFF:
+        return None
+
+    if rest[0] != 0:
+        raise RuntimeError("command failed with status {}".format(rest[0]))
+
+    return rest[1:-1]
+
+
+def poll(ser, reset):
+    answer = request(ser, COMMAND_TELEMETRY, [1 if reset else 0])
+    if answer is None or len(answer) < LAYOUT.size:
+        return None
+
+    return dict(zip(FIELDS, LAYOUT.unpack_from(answer)))
+
+
+# ┌────────────────────────────────────────┐
+# │ Output                                 │
+# └────────────────────────────────────────┘
+
+def show(sample):
+    print("{:>9.1f}s {:>7.2f}fps load {:>5.1f}% isr {:>7.2f}us loop {:>6}us "
+          "irq {}/{} dmx err {} host err {}/{}/{} ram {}B{}".format(
+              sample["uptime_ms"] / 1000.0, sample["frame_rate_mhz"] / 1000.0,
+              sample["load_permille"] / 10.0, sample["isr_max_ns"] / 1000.0, sample["loop_max_us"],
+              sample["uart_irqs"], sample["timer_irqs"], sample["uart_errors"],
+              sample["host_overruns"], sample["host_errors"], sample["host_dropped"],
+              sample["ram_free_min"], " ALARM" if sample["ram_alarm"] else ""))
+
+
+class Plot:
+    def __init__(self):
+        import matplotlib.pyplot as plt  # only needed for graphs
+
+        self.plt     = plt
+        self.history = collections.deque(maxlen=HISTORY)
+        self.figure, self.axes = plt.subplots(len(GRAPHS), 1, sharex=True)
+        self.lines   = []
+
+        for axis, (_, _, label) in zip(self.axes, GRAPHS):
+            axis.set_ylabel(label)
+            axis.grid(True)
+            self.lines.append(axis.plot([], [])[0])
+
+        self.axes[-1].set_xlabel("uptime (s)")
+        plt.ion()
+        plt.show()
+
+    def add(self, sample):
+        self.history.append(sample)
+        times = [s["uptime_ms"] / 1000.0 for s in self.history]
+
+        for axis, line, (field, scale, _) in zip(self.axes, self.lines, GRAPHS):
+            line.set_data(times, [s[field] * scale for s in self.history])
+            axis.relim()
+            axis.autoscale_view()
+
+        self.plt.pause(0.01)
+
+
+# ┌────────────────────────────────────────┐
+# │ Main                                   │
+# └────────────────────────────────────────┘
+
+def main():
+    parser = argparse.ArgumentParser(description="Poll and graph the controller telemetry")
+    parser.add_argument("serial",                          help="Host link port")
+    parser.add_argument("--baudrate", type=int, default=115200)
+    parser.add_argument("--period"  , type=float, default=1.0, help="Poll period in seconds")
+    parser.add_argument("--count"   , type=int, default=0,     help="Polls before exiting, 0 for no limit")
+    parser.add_argument("--reset"   , action="store_true",     help="Clear the maxima after each poll")
+    parser.add_argument("--csv",                               help="Append the samples to this file")
+    parser.add_argument("--plot"    , action="store_true",     help="Graph the samples live")
+    args = parser.parse_args()
+
+    import serial  # pyserial
+
+    plot   = Plot() if args.plot else None
+    writer = None
+    status = 0
+    n_poll = 0
+
+    with serial.Serial(args.serial, args.baudrate, timeout=0.5) as ser:
+        if args.csv:
+            fhandle = open(args.csv, "a", newline="")
+            writer  = csv.DictWriter(fhandle, fieldnames=("time",) + FIELDS)
+            if fhandle.tell() == 0:
+                writer.writeheader()
+
+        try:
+            while not args.count or n_poll < args.count:
+                n_poll += 1
+                start   = time.monotonic()
+                sample  = poll(ser, args.reset)
+
+                if sample is None:
+                    print("No answer", file=sys.stderr)
+                    status = 1
+
+                else:
+                    show(sample)
+                    if sample["ram_alarm"]:
+                        status = 1
+                    if writer:
+                        writer.writerow(dict(sample, time=time.strftime("%Y-%m-%d %H:%M:%S")))
+                    if plot:
+                        plot.add(sample)
+
+                time.sleep(max(0.0, args.period - (time.monotonic() - start)))
+
+        except KeyboardInterrupt:
+            pass
+
+        if writer:
+            fhandle.close()
+
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())